@@ -24,6 +24,7 @@
 #include <apt-pkg/repository.h>
 #include <config.h>
 #include <apt-pkg/rhash.h>
+#include <apt-pkg/gzindex.h>
 #include <apt-pkg/luaiface.h>
 #include <iostream>
 #include <assert.h>
@@ -52,10 +53,16 @@ bool VerifyChecksums(string File,unsigned long Size,string ExpectHash, string me
    if (stat(File.c_str(),&Buf) != 0)
       return true;
 
+   // Lists kept compressed are checked by their content
+   GzIndexReader Indexed;
+   unsigned long long FileSize = Buf.st_size;
+   if (Indexed.Open(File) == true)
+      FileSize = Indexed.Size();
+
    // LORG:2006-03-09
    // XXX hack alert: repomd doesn't have index sizes so ignore it and
    // rely on checksum
-   if (Size > 0 && (unsigned long)Buf.st_size != Size)
+   if (Size > 0 && FileSize != Size)
    {
       if (_config->FindB("Acquire::Verbose", false) == true)
 	 cout << "Size of "<<File<<" did not match what's in the checksum list and was redownloaded."<<endl;
@@ -65,9 +72,18 @@ bool VerifyChecksums(string File,unsigned long Size,string ExpectHash, string me
    if (ExpectHash.empty() == false)
    {
       raptHash hash = raptHash(method);
-      FileFd F(File, FileFd::ReadOnly);
-
-      hash.AddFD(F.Fd(), F.Size());
+      if (Indexed.IsOpen() == true)
+      {
+	 unsigned char Data[64*1024];
+	 unsigned long Actual = 0;
+	 while (Indexed.Read(Data,sizeof(Data),&Actual) == true && Actual != 0)
+	    hash.Add(Data,Actual);
+      }
+      else
+      {
+	 FileFd F(File, FileFd::ReadOnly);
+	 hash.AddFD(F.Fd(), F.Size());
+      }
       if (hash.Result() != ExpectHash) {
 	 if (_config->FindB("Acquire::Verbose", false) == true)
 	    cout << method << " of "<<File<<" did not match what's in the checksum list and was redownloaded."<<endl;
@@ -180,8 +196,10 @@ void pkgAcquire::Item::Rename(string From,string To)
    instantiated to fetch the revision file */
 // CNC:2002-07-03
 pkgAcqIndex::pkgAcqIndex(pkgAcquire *Owner,pkgRepository *Repository,
-			 string URI,string URIDesc,string ShortDesc) :
-                      Item(Owner), RealURI(URI), Repository(Repository)
+			 string URI,string URIDesc,string ShortDesc,
+			 bool KeepCompressed) :
+                      Item(Owner), KeepCompressed(KeepCompressed),
+                      RealURI(URI), Repository(Repository)
 {
    Decompression = false;
    Erase = false;
@@ -239,17 +257,23 @@ pkgAcqIndex::pkgAcqIndex(pkgAcquire *Owner,pkgRepository *Repository,
 									/*}}}*/
 // AcqIndex::Custom600Headers - Insert custom request headers		/*{{{*/
 // ---------------------------------------------------------------------
-/* The only header we use is the last-modified header. */
+/* Besides the last-modified header, the decompressing method is told
+   whether the list may be kept compressed. */
 string pkgAcqIndex::Custom600Headers()
 {
    string Final = _config->FindDir("Dir::State::lists");
    Final += URItoFileName(RealURI);
 
+   string Res = "\nIndex-File: true";
+   if (KeepCompressed == true &&
+       _config->FindB("Acquire::Compressed-Lists",false) == true)
+      Res += "\nCompressed-List: true";
+
    struct stat Buf;
    if (stat(Final.c_str(),&Buf) != 0)
-      return "\nIndex-File: true";
+      return Res;
 
-   return "\nIndex-File: true\nLast-Modified: " + TimeRFC1123(Buf.st_mtime);
+   return Res + "\nLast-Modified: " + TimeRFC1123(Buf.st_mtime);
 }
 									/*}}}*/
 // AcqIndex::Done - Finished a fetch					/*{{{*/
@@ -88,6 +88,8 @@ class pkgAcqIndex : public pkgAcquire::Item
 
    bool Decompression;
    bool Erase;
+   // The readers of the list understand the seekable gzip form
+   bool KeepCompressed;
    pkgAcquire::ItemDesc Desc;
    string RealURI;
 
@@ -104,7 +106,7 @@ class pkgAcqIndex : public pkgAcquire::Item
 
    // CNC:2002-07-03
    pkgAcqIndex(pkgAcquire *Owner,pkgRepository *Repository,string URI,
-	       string URIDesc,string ShortDesct);
+	       string URIDesc,string ShortDesct,bool KeepCompressed = false);
 };
 
 // Item class for index files
@@ -0,0 +1,349 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Acquire Local - The methods for local files
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <apt-pkg/acquire-local.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/gzindex.h>
+
+#include <apti18n.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <string.h>
+
+#include <zlib.h>
+#include <bzlib.h>
+									/*}}}*/
+
+// pkgNewLocalMethod - Create a method by access name			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+pkgAcqMethod *pkgNewLocalMethod(string Access,int InFd,int OutFd)
+{
+   if (Access == "file")
+      return new pkgAcqFileMethod(InFd,OutFd);
+   if (Access == "copy")
+      return new pkgAcqCopyMethod(InFd,OutFd);
+   if (Access == "gzip" || Access == "bzip2")
+      return new pkgAcqGzipMethod(Access,InFd,OutFd);
+   return 0;
+}
+									/*}}}*/
+
+// FileMethod::Fetch - Fetch a file					/*{{{*/
+// ---------------------------------------------------------------------
+/* This simply checks that the file specified exists, if so the relevent
+   information is returned. If a .bz2 filename is specified then the file
+   name with .bz2 removed will also be checked and information about it
+   will be returned in Alt-* */
+bool pkgAcqFileMethod::Fetch(FetchItem *Itm)
+{
+   URI Get = Itm->Uri;
+   string File = Get.Path;
+   FetchResult Res;
+   if (Get.Host.empty() == false)
+      return _error->Error(_("Invalid URI, local URIS must not start with //"));
+
+   // See if the file exists
+   struct stat Buf;
+   if (stat(File.c_str(),&Buf) == 0)
+   {
+      Res.Size = Buf.st_size;
+      Res.Filename = File;
+      Res.LastModified = Buf.st_mtime;
+      Res.IMSHit = false;
+      if (Itm->LastModified == Buf.st_mtime && Itm->LastModified != 0)
+	 Res.IMSHit = true;
+   }
+
+   // CNC:2003-11-04
+   // See if we can compute a file without a .gz/.bz2/etc extension
+   string ComprExtension = _config->Find("Acquire::ComprExtension", ".bz2");
+   string::size_type Pos = File.rfind(ComprExtension);
+   if (Pos + ComprExtension.length() == File.length())
+   {
+      File = string(File,0,Pos);
+      if (stat(File.c_str(),&Buf) == 0)
+      {
+	 FetchResult AltRes;
+	 AltRes.Size = Buf.st_size;
+	 AltRes.Filename = File;
+	 AltRes.LastModified = Buf.st_mtime;
+	 AltRes.IMSHit = false;
+	 if (Itm->LastModified == Buf.st_mtime && Itm->LastModified != 0)
+	    AltRes.IMSHit = true;
+
+	 URIDone(Res,&AltRes);
+	 return true;
+      }
+   }
+
+   if (Res.Filename.empty() == true)
+      return _error->Error(_("File not found"));
+
+   URIDone(Res);
+   return true;
+}
+									/*}}}*/
+
+// CopyMethod::Fetch - Fetch a file					/*{{{*/
+// ---------------------------------------------------------------------
+/* This takes a uri like a file: uri and copies it to the destination
+   file. */
+bool pkgAcqCopyMethod::Fetch(FetchItem *Itm)
+{
+   URI Get = Itm->Uri;
+   string File = Get.Path;
+
+   // Stat the file and send a start message
+   struct stat Buf;
+   if (stat(File.c_str(),&Buf) != 0)
+      return _error->Errno("stat",_("Failed to stat"));
+
+   // Forumulate a result and send a start message
+   FetchResult Res;
+   Res.Size = Buf.st_size;
+   Res.Filename = Itm->DestFile;
+   Res.LastModified = Buf.st_mtime;
+   Res.IMSHit = false;
+   URIStart(Res);
+
+   // See if the file exists
+   FileFd From(File,FileFd::ReadOnly);
+   FileFd To(Itm->DestFile,FileFd::WriteEmpty);
+   To.EraseOnFailure();
+   if (_error->PendingError() == true)
+   {
+      To.OpFail();
+      return false;
+   }
+
+   // Copy the file
+   if (CopyFile(From,To) == false)
+   {
+      To.OpFail();
+      return false;
+   }
+
+   From.Close();
+   To.Close();
+
+   // Transfer the modification times
+   struct utimbuf TimeBuf;
+   TimeBuf.actime = Buf.st_atime;
+   TimeBuf.modtime = Buf.st_mtime;
+   if (utime(Itm->DestFile.c_str(),&TimeBuf) != 0)
+   {
+      To.OpFail();
+      return _error->Errno("utime",_("Failed to set modification time"));
+   }
+
+   URIDone(Res);
+   return true;
+}
+									/*}}}*/
+
+// GzipMethod::Decompress - Inflate From into To			/*{{{*/
+// ---------------------------------------------------------------------
+/* Several compressed streams one after the other are taken as one, like
+   gzip -d and bzip2 -d do. Lists whose readers understand it are kept
+   compressed, in a form that can be seeked, when the item asks for it. */
+bool pkgAcqGzipMethod::Decompress(FileFd &From,FileFd &To,bool Seekable,
+				  unsigned long long &Total,Hashes &Hash)
+{
+   bool Bzip2 = (Prog == "bzip2");
+   z_stream Z;
+   bz_stream B;
+   memset(&Z,0,sizeof(Z));
+   memset(&B,0,sizeof(B));
+
+   GzIndexWriter *Indexed = 0;
+   if (Seekable == true)
+      Indexed = new GzIndexWriter(To);
+
+   unsigned char In[32*1024];
+   unsigned char Out[32*1024];
+   unsigned char *Next = In;
+   unsigned long Avail = 0;
+   bool Started = false;
+   bool Full = false;
+   unsigned long Streams = 0;
+   bool Failed = false;
+   while (Failed == false)
+   {
+      // More input is only needed once the last output was not cut short
+      if (Avail == 0 && Full == false)
+      {
+	 unsigned long Actual;
+	 if (From.Read(In,sizeof(In),&Actual) == false)
+	 {
+	    Failed = true;
+	    break;
+	 }
+	 if (Actual == 0)
+	    break;
+	 Next = In;
+	 Avail = Actual;
+      }
+
+      if (Started == false)
+      {
+	 if ((Bzip2 == true && BZ2_bzDecompressInit(&B,0,0) != BZ_OK) ||
+	     (Bzip2 == false && inflateInit2(&Z,15 + 16) != Z_OK))
+	 {
+	    _error->Error(_("Unable to initialize decompression"));
+	    Failed = true;
+	    break;
+	 }
+	 Started = true;
+	 Streams++;
+      }
+
+      bool End;
+      bool Corrupt;
+      unsigned long Len;
+      if (Bzip2 == true)
+      {
+	 B.next_in = (char *)Next;
+	 B.avail_in = Avail;
+	 B.next_out = (char *)Out;
+	 B.avail_out = sizeof(Out);
+	 int Res = BZ2_bzDecompress(&B);
+	 End = (Res == BZ_STREAM_END);
+	 Corrupt = (Res != BZ_OK && End == false);
+	 Next = (unsigned char *)B.next_in;
+	 Avail = B.avail_in;
+	 Len = sizeof(Out) - B.avail_out;
+      }
+      else
+      {
+	 Z.next_in = Next;
+	 Z.avail_in = Avail;
+	 Z.next_out = Out;
+	 Z.avail_out = sizeof(Out);
+	 int Res = inflate(&Z,Z_NO_FLUSH);
+	 End = (Res == Z_STREAM_END);
+	 Corrupt = (Res != Z_OK && Res != Z_BUF_ERROR && End == false);
+	 Next = Z.next_in;
+	 Avail = Z.avail_in;
+	 Len = sizeof(Out) - Z.avail_out;
+      }
+
+      if (Corrupt == true)
+      {
+	 _error->Error(_("The %s data of %s is corrupt"),Prog.c_str(),
+		     From.Name().c_str());
+	 Failed = true;
+	 break;
+      }
+      Full = (Len == sizeof(Out));
+
+      Hash.Add(Out,Len);
+      Total += Len;
+      if ((Indexed != 0 && Indexed->Write(Out,Len) == false) ||
+	  (Indexed == 0 && To.Write(Out,Len) == false))
+      {
+	 Failed = true;
+	 break;
+      }
+
+      if (End == true)
+      {
+	 if (Bzip2 == true)
+	    BZ2_bzDecompressEnd(&B);
+	 else
+	    inflateEnd(&Z);
+	 Started = false;
+	 Full = false;
+      }
+   }
+
+   if (Started == true)
+   {
+      if (Bzip2 == true)
+	 BZ2_bzDecompressEnd(&B);
+      else
+	 inflateEnd(&Z);
+      if (Failed == false)
+	 _error->Error(_("The %s data of %s is truncated"),
+		       Prog.c_str(),From.Name().c_str());
+      Failed = true;
+   }
+   if (Failed == false && Streams == 0)
+   {
+      _error->Error(_("The %s data of %s is truncated"),
+		    Prog.c_str(),From.Name().c_str());
+      Failed = true;
+   }
+
+   if (Indexed != 0 && Failed == false && Indexed->Finish() == false)
+      Failed = true;
+   delete Indexed;
+   return !Failed;
+}
+									/*}}}*/
+// GzipMethod::Fetch - Decompress the passed URI			/*{{{*/
+// ---------------------------------------------------------------------
+/* Take a file URI in and decompress it into the target file. */
+bool pkgAcqGzipMethod::Fetch(FetchItem *Itm)
+{
+   URI Get = Itm->Uri;
+   string Path = Get.Host + Get.Path; // To account for relative paths
+
+   FetchResult Res;
+   Res.Filename = Itm->DestFile;
+   URIStart(Res);
+
+   // Open the source and destination files
+   FileFd From(Path,FileFd::ReadOnly);
+   FileFd To(Itm->DestFile,FileFd::WriteEmpty);
+   To.EraseOnFailure();
+   if (_error->PendingError() == true)
+      return false;
+
+   // Generate checksums of the data and write it
+   Hashes Hash;
+   unsigned long long Total = 0;
+   if (Decompress(From,To,Itm->CompressedList,Total,Hash) == false)
+   {
+      To.OpFail();
+      return false;
+   }
+
+   From.Close();
+   To.Close();
+
+   // Transfer the modification times
+   struct stat Buf;
+   if (stat(Path.c_str(),&Buf) != 0)
+      return _error->Errno("stat",_("Failed to stat"));
+
+   struct utimbuf TimeBuf;
+   TimeBuf.actime = Buf.st_atime;
+   TimeBuf.modtime = Buf.st_mtime;
+   if (utime(Itm->DestFile.c_str(),&TimeBuf) != 0)
+      return _error->Errno("utime",_("Failed to set modification time"));
+
+   if (stat(Itm->DestFile.c_str(),&Buf) != 0)
+      return _error->Errno("stat",_("Failed to stat"));
+
+   // Return a Done response, the size is that of the uncompressed data
+   // for the size check against the release file
+   Res.LastModified = Buf.st_mtime;
+   Res.Size = Total;
+   Res.TakeHashes(Hash);
+
+   URIDone(Res);
+
+   return true;
+}
+									/*}}}*/
@@ -0,0 +1,63 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Acquire Local - The methods for local files
+
+   The file, copy, gzip and bzip2 methods. They are built into the
+   library so pkgAcquire can run them on a thread of its own process
+   instead of forking a method binary for each; the binaries in methods/
+   are thin wrappers around the same classes. Decompression is done with
+   zlib and libbz2, there is no helper process either way.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_ACQUIRE_LOCAL_H
+#define PKGLIB_ACQUIRE_LOCAL_H
+
+#include <apt-pkg/acquire-method.h>
+
+class FileFd;
+
+class pkgAcqFileMethod : public pkgAcqMethod
+{
+   virtual bool Fetch(FetchItem *Itm);
+
+   public:
+
+   pkgAcqFileMethod(int InFd = STDIN_FILENO,int OutFd = STDOUT_FILENO) :
+      pkgAcqMethod("1.0",SingleInstance | LocalOnly | Embeddable,InFd,OutFd) {}
+};
+
+class pkgAcqCopyMethod : public pkgAcqMethod
+{
+   virtual bool Fetch(FetchItem *Itm);
+
+   public:
+
+   pkgAcqCopyMethod(int InFd = STDIN_FILENO,int OutFd = STDOUT_FILENO) :
+      pkgAcqMethod("1.0",SingleInstance | Embeddable,InFd,OutFd) {}
+};
+
+class pkgAcqGzipMethod : public pkgAcqMethod
+{
+   // gzip or bzip2
+   string Prog;
+
+   bool Decompress(FileFd &From,FileFd &To,bool Seekable,
+		   unsigned long long &Total,Hashes &Hash);
+   virtual bool Fetch(FetchItem *Itm);
+
+   public:
+
+   pkgAcqGzipMethod(string Prog,int InFd = STDIN_FILENO,
+		    int OutFd = STDOUT_FILENO) :
+      pkgAcqMethod("1.1",SingleInstance | SendConfig | Embeddable,InFd,OutFd),
+      Prog(Prog) {}
+};
+
+/* Creates the method for Access talking over InFd and OutFd, 0 if it
+   is not one of the above */
+pkgAcqMethod *pkgNewLocalMethod(string Access,int InFd,int OutFd);
+
+#endif
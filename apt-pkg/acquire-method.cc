@@ -34,8 +34,10 @@ using namespace std;
 // AcqMethod::pkgAcqMethod - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* This constructs the initialization text */
-pkgAcqMethod::pkgAcqMethod(const char *Ver,unsigned long Flags)
-	: Flags(Flags) // CNC:2002-07-11
+pkgAcqMethod::pkgAcqMethod(const char *Ver,unsigned long Flags,int InFd,
+			   int OutFd)
+	: Flags(Flags), // CNC:2002-07-11
+	  InFd(InFd), OutFd(OutFd)
 {
    char S[300] = "";
    char *End = S;
@@ -63,17 +65,32 @@ pkgAcqMethod::pkgAcqMethod(const char *Ver,unsigned long Flags)
    // CNC:2004-04-27
    if ((Flags & HasPreferredURI) == HasPreferredURI)
       strcat(End,"Has-Preferred-URI: true\n");
+
+   if ((Flags & Embeddable) == Embeddable)
+      strcat(End,"Embeddable: true\n");
    strcat(End,"\n");
 
-   if (write(STDOUT_FILENO,S,strlen(S)) != (signed)strlen(S))
-      exit(100);
+   Send(S);
 
-   SetNonBlock(STDIN_FILENO,true);
+   SetNonBlock(InFd,true);
 
    Queue = 0;
    QueueBack = 0;
 }
 									/*}}}*/
+// AcqMethod::Send - Send a message to APT				/*{{{*/
+// ---------------------------------------------------------------------
+/* A method process has nothing left to do once APT is gone. A method
+   running inside APT must not take it down, its Run() ends when it sees
+   the other end closed. */
+void pkgAcqMethod::Send(string const &Message)
+{
+   if (write(OutFd,Message.c_str(),Message.length()) == (ssize_t)Message.length())
+      return;
+   if (OutFd == STDOUT_FILENO)
+      exit(100);
+}
+									/*}}}*/
 // AcqMethod::Fail - A fetch has failed					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -125,8 +142,7 @@ void pkgAcqMethod::Fail(string Err,bool Transient)
    else
       strcat(S,"\n");
 
-   if (write(STDOUT_FILENO,S,strlen(S)) != (signed)strlen(S))
-      exit(100);
+   Send(S);
 }
 									/*}}}*/
 // AcqMethod::URIStart - Indicate a download is starting		/*{{{*/
@@ -151,8 +167,7 @@ void pkgAcqMethod::URIStart(FetchResult &Res)
 
    s << "\n";
    string S = s.str();
-   if (write(STDOUT_FILENO,S.c_str(),S.size()) != (ssize_t)S.size())
-      exit(100);
+   Send(S);
 }
 									/*}}}*/
 // AcqMethod::URIDone - A URI is finished				/*{{{*/
@@ -211,8 +226,7 @@ void pkgAcqMethod::URIDone(FetchResult &Res, FetchResult *Alt)
 
    s << "\n";
    string S = s.str();
-   if (write(STDOUT_FILENO,S.c_str(),S.size()) != (ssize_t)S.size())
-      exit(100);
+   Send(S);
 
    // Dequeue
    FetchItem *Tmp = Queue;
@@ -232,8 +246,7 @@ bool pkgAcqMethod::MediaFail(string Required,string Drive)
    snprintf(S,sizeof(S),"403 Media Failure\nMedia: %s\nDrive: %s\n\n",
 	    Required.c_str(),Drive.c_str());
 
-   if (write(STDOUT_FILENO,S,strlen(S)) != (signed)strlen(S))
-      exit(100);
+   Send(S);
 
    vector<string> MyMessages;
 
@@ -241,10 +254,10 @@ bool pkgAcqMethod::MediaFail(string Required,string Drive)
       appended to the main message list for later processing */
    while (1)
    {
-      if (WaitFd(STDIN_FILENO) == false)
+      if (WaitFd(InFd) == false)
 	 return false;
 
-      if (ReadMessages(STDIN_FILENO,MyMessages) == false)
+      if (ReadMessages(InFd,MyMessages) == false)
 	 return false;
 
       string Message = MyMessages.front();
@@ -285,8 +298,7 @@ bool pkgAcqMethod::NeedAuth(string Description,string &User,string &Pass)
    snprintf(S,sizeof(S),"404 Authenticate\nDescription: %s\n\n",
 	    Description.c_str());
 
-   if (write(STDOUT_FILENO,S,strlen(S)) != (signed)strlen(S))
-      exit(100);
+   Send(S);
 
    vector<string> MyMessages;
 
@@ -294,10 +306,10 @@ bool pkgAcqMethod::NeedAuth(string Description,string &User,string &Pass)
       appended to the main message list for later processing */
    while (1)
    {
-      if (WaitFd(STDIN_FILENO) == false)
+      if (WaitFd(InFd) == false)
 	 return false;
 
-      if (ReadMessages(STDIN_FILENO,MyMessages) == false)
+      if (ReadMessages(InFd,MyMessages) == false)
 	 return false;
 
       string Message = MyMessages.front();
@@ -384,9 +396,9 @@ int pkgAcqMethod::Run(bool Single)
       if (Messages.empty() == true)
       {
 	 if (Single == false)
-	    if (WaitFd(STDIN_FILENO) == false)
+	    if (WaitFd(InFd) == false)
 	       break;
-	 if (ReadMessages(STDIN_FILENO,Messages) == false)
+	 if (ReadMessages(InFd,Messages) == false)
 	    break;
       }
 
@@ -422,6 +434,7 @@ int pkgAcqMethod::Run(bool Single)
 	    if (StrToTime(LookupTag(Message,"Last-Modified"),Tmp->LastModified) == false)
 	       Tmp->LastModified = 0;
 	    Tmp->IndexFile = StringToBool(LookupTag(Message,"Index-File"),false);
+	    Tmp->CompressedList = StringToBool(LookupTag(Message,"Compressed-List"),false);
 	    Tmp->Next = 0;
 
 	    // CNC:2002-07-11
@@ -449,8 +462,7 @@ int pkgAcqMethod::Run(bool Single)
 	    char S[1024];
 	    snprintf(S,sizeof(S),"179 Preferred URI\nPreferredURI: %s\n\n",
 		     PreferredURI().c_str());
-	    if (write(STDOUT_FILENO,S,strlen(S)) != (signed)strlen(S))
-	       exit(100);
+	    Send(S);
 	    break;
 
 	 }
@@ -481,8 +493,7 @@ void pkgAcqMethod::Log(const char *Format,...)
    vsnprintf(S+Len,sizeof(S)-4-Len,Format,args);
    strcat(S,"\n\n");
 
-   if (write(STDOUT_FILENO,S,strlen(S)) != (signed)strlen(S))
-      exit(100);
+   Send(S);
 }
 									/*}}}*/
 // AcqMethod::Status - Send a status message				/*{{{*/
@@ -506,8 +517,7 @@ void pkgAcqMethod::Status(const char *Format,...)
    s << Buf << "\n\n";
 
    string S = s.str();
-   if (write(STDOUT_FILENO,S.c_str(),S.size()) != (ssize_t)S.size())
-      exit(100);
+   Send(S);
 }
 									/*}}}*/
 // AcqMethod::Redirect - Send a redirect message			/*{{{*/
@@ -525,8 +535,7 @@ void pkgAcqMethod::Redirect(const string &NewURI)
      << "\n\n";
 
    string S = s.str();
-   if (write(STDOUT_FILENO,S.c_str(),S.size()) != (ssize_t)S.size())
-      exit(100);
+   Send(S);
 
    // Change the URI for the request.
    Queue->Uri = NewURI;
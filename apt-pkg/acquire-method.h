@@ -17,6 +17,8 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/strutl.h>
 
+#include <unistd.h>
+
 typedef std::map<string,string> HashResults;
 
 class Hashes;
@@ -27,6 +29,10 @@ class pkgAcqMethod
    // CNC:2002-07-11
    unsigned long Flags;
 
+   // The channel to APT, stdin and stdout unless running inside it
+   int InFd;
+   int OutFd;
+
    struct FetchItem
    {
       FetchItem *Next;
@@ -35,6 +41,8 @@ class pkgAcqMethod
       string DestFile;
       time_t LastModified;
       bool IndexFile;
+      // The list may be kept in the seekable gzip form of gzindex.h
+      bool CompressedList;
    };
 
    struct FetchResult
@@ -63,6 +71,7 @@ class pkgAcqMethod
    virtual bool Fetch(FetchItem * /*Item*/) {return true;}
 
    // Outgoing messages
+   void Send(string const &Message);
    void Fail(bool Transient = false);
    inline void Fail(const char *Why, bool Transient = false) {Fail(string(Why),Transient);}
    void Fail(string Why, bool Transient = false);
@@ -80,7 +89,8 @@ class pkgAcqMethod
                   Pipeline = (1<<1), SendConfig = (1<<2),
                   LocalOnly = (1<<3), NeedsCleanup = (1<<4),
                   // CNC:2004-04-27
-                  Removable = (1<<5), HasPreferredURI = (1<<6)};
+                  Removable = (1<<5), HasPreferredURI = (1<<6),
+                  Embeddable = (1<<7)};
 
    void Log(const char *Format,...);
    void Status(const char *Format,...);
@@ -89,7 +99,8 @@ class pkgAcqMethod
    int Run(bool Single = false);
    inline void SetFailExtraMsg(string Msg) {FailExtra = Msg;}
 
-   pkgAcqMethod(const char *Ver,unsigned long Flags = 0);
+   pkgAcqMethod(const char *Ver,unsigned long Flags = 0,
+		int InFd = STDIN_FILENO,int OutFd = STDOUT_FILENO);
    virtual ~pkgAcqMethod() {}
 };
 
@@ -14,6 +14,7 @@
 // Include Files							/*{{{*/
 #include <apt-pkg/acquire-worker.h>
 #include <apt-pkg/acquire-item.h>
+#include <apt-pkg/acquire-local.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
@@ -30,6 +31,12 @@
 #include <signal.h>
 #include <stdio.h>
 #include <errno.h>
+
+#include <config.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 									/*}}}*/
 
 using namespace std;
@@ -73,10 +80,16 @@ void pkgAcquire::Worker::Construct()
    NextQueue = 0;
    NextAcquire = 0;
    Process = -1;
+   Thread = 0;
    InFd = -1;
    OutFd = -1;
    OutReady = false;
    InReady = false;
+   PipeDepth = 0;
+   PipeBytes = 0;
+   WatchIn = -1;
+   WatchOut = -1;
+   Touched = false;
    Debug = _config->FindB("Debug::pkgAcquire::Worker",false);
 }
 									/*}}}*/
@@ -85,8 +98,10 @@ void pkgAcquire::Worker::Construct()
 /* */
 pkgAcquire::Worker::~Worker()
 {
+   Unwatch();
    close(InFd);
    close(OutFd);
+   StopThread();
 
    if (Process > 0)
    {
@@ -100,17 +115,70 @@ pkgAcquire::Worker::~Worker()
 									/*}}}*/
 // Worker::Start - Start the worker process				/*{{{*/
 // ---------------------------------------------------------------------
-/* This forks the method and inits the communication channel */
+/* This starts the method and inits the communication channel. Methods
+   that said they can be embedded and are built into the library run on
+   a thread, the configuration probe finds out by trying. */
 bool pkgAcquire::Worker::Start()
 {
    // Get the method path
    string Method = _config->FindDir("Dir::Bin::Methods") + Access;
-   if (FileExists(Method) == false)
-      return _error->Error(_("The method driver %s could not be found."),Method.c_str());
+   bool Local = false;
+   if (_config->FindB("Acquire::In-Process-Methods",true) == true &&
+       (OwnerQ == 0 || Config->Embeddable == true))
+      Local = StartThread();
 
-   if (Debug == true)
-      clog << "Starting method '" << Method << '\'' << endl;
+   if (Local == true)
+   {
+      if (Debug == true)
+	 clog << "Started method '" << Access << "' in process" << endl;
+   }
+   else
+   {
+      if (FileExists(Method) == false)
+	 return _error->Error(_("The method driver %s could not be found."),Method.c_str());
+
+      if (Debug == true)
+	 clog << "Starting method '" << Method << '\'' << endl;
+
+      if (StartProcess(Method) == false)
+	 return false;
+   }
+
+   OutReady = false;
+   InReady = true;
+   Touch();
 
+   // Read the configuration data
+   if (WaitFd(InFd) == false ||
+       ReadMessages() == false)
+      return _error->Error(_("Method %s did not start correctly"),Method.c_str());
+
+   RunMessages();
+   if (OwnerQ != 0)
+      SendConfiguration();
+
+   // CNC:2004-04-27
+   if (Config->HasPreferredURI == true &&
+       Config->DonePreferredURI == false &&
+       Config->PreferredURI.empty() == true) {
+      SetNonBlock(InFd,false);
+      SetNonBlock(OutFd,false);
+      OutQueue += "679 Preferred URI\n\n";
+      Config->PreferredURI = "<none>";
+      if (OutFdReady() == true)
+	 while (InFdReady() == true && Config->PreferredURI == "<none>");
+      SetNonBlock(InFd,true);
+      SetNonBlock(OutFd,true);
+   }
+
+   return true;
+}
+									/*}}}*/
+// Worker::StartProcess - Fork and exec the method			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool pkgAcquire::Worker::StartProcess(string const &Method)
+{
    // Create the pipes
    int Pipes[4] = {-1,-1,-1,-1};
    if (pipe(Pipes) != 0 || pipe(Pipes+2) != 0)
@@ -149,33 +217,94 @@ bool pkgAcquire::Worker::Start()
    SetNonBlock(Pipes[3],true);
    close(Pipes[1]);
    close(Pipes[2]);
-   OutReady = false;
-   InReady = true;
+   return true;
+}
+									/*}}}*/
+#ifdef HAVE_PTHREAD
+// The method end of the pipes belongs to the thread
+struct LocalMethod
+{
+   pkgAcqMethod *Method;
+   int InFd;
+   int OutFd;
+};
 
-   // Read the configuration data
-   if (WaitFd(InFd) == false ||
-       ReadMessages() == false)
-      return _error->Error(_("Method %s did not start correctly"),Method.c_str());
+// RunLocalMethod - Thread body of a method running in process		/*{{{*/
+// ---------------------------------------------------------------------
+/* Run() returns once the worker closes its end of the pipes. */
+static void *RunLocalMethod(void *Arg)
+{
+   // A closed pipe has to show up as an error from write, not as a signal
+   sigset_t Pipe;
+   sigemptyset(&Pipe);
+   sigaddset(&Pipe,SIGPIPE);
+   pthread_sigmask(SIG_BLOCK,&Pipe,0);
+
+   LocalMethod *Local = (LocalMethod *)Arg;
+   Local->Method->Run();
+   delete Local->Method;
+   close(Local->InFd);
+   close(Local->OutFd);
+   delete Local;
+   return 0;
+}
+									/*}}}*/
+#endif
+// Worker::StartThread - Run a method built into the library		/*{{{*/
+// ---------------------------------------------------------------------
+/* False, without an error, if the method is not one of them. */
+bool pkgAcquire::Worker::StartThread()
+{
+#ifdef HAVE_PTHREAD
+   int Pipes[4] = {-1,-1,-1,-1};
+   if (pipe(Pipes) != 0 || pipe(Pipes+2) != 0)
+   {
+      for (int I = 0; I != 4; I++)
+	 close(Pipes[I]);
+      return false;
+   }
+   for (int I = 0; I != 4; I++)
+      SetCloseExec(Pipes[I],true);
 
-   RunMessages();
-   if (OwnerQ != 0)
-      SendConfiguration();
+   LocalMethod *Local = new LocalMethod;
+   Local->InFd = Pipes[2];
+   Local->OutFd = Pipes[1];
+   Local->Method = pkgNewLocalMethod(Access,Local->InFd,Local->OutFd);
 
-   // CNC:2004-04-27
-   if (Config->HasPreferredURI == true &&
-       Config->DonePreferredURI == false &&
-       Config->PreferredURI.empty() == true) {
-      SetNonBlock(InFd,false);
-      SetNonBlock(OutFd,false);
-      OutQueue += "679 Preferred URI\n\n";
-      Config->PreferredURI = "<none>";
-      if (OutFdReady() == true)
-	 while (InFdReady() == true && Config->PreferredURI == "<none>");
-      SetNonBlock(InFd,true);
-      SetNonBlock(OutFd,true);
+   pthread_t *Id = new pthread_t;
+   if (Local->Method == 0 || pthread_create(Id,0,RunLocalMethod,Local) != 0)
+   {
+      delete Local->Method;
+      delete Local;
+      delete Id;
+      for (int I = 0; I != 4; I++)
+	 close(Pipes[I]);
+      return false;
    }
 
+   Thread = Id;
+   InFd = Pipes[0];
+   OutFd = Pipes[3];
+   SetNonBlock(InFd,true);
+   SetNonBlock(OutFd,true);
    return true;
+#else
+   return false;
+#endif
+}
+									/*}}}*/
+// Worker::StopThread - Wait for an in process method to end		/*{{{*/
+// ---------------------------------------------------------------------
+/* Our end of the pipes must be closed already, that is what stops it. */
+void pkgAcquire::Worker::StopThread()
+{
+#ifdef HAVE_PTHREAD
+   if (Thread == 0)
+      return;
+   pthread_join(*(pthread_t *)Thread,0);
+   delete (pthread_t *)Thread;
+   Thread = 0;
+#endif
 }
 									/*}}}*/
 // Worker::ReadMessages - Read all pending messages into the list	/*{{{*/
@@ -384,6 +513,7 @@ bool pkgAcquire::Worker::Capabilities(string Message)
    Config->LocalOnly = StringToBool(LookupTag(Message,"Local-Only"),false);
    Config->NeedsCleanup = StringToBool(LookupTag(Message,"Needs-Cleanup"),false);
    Config->Removable = StringToBool(LookupTag(Message,"Removable"),false);
+   Config->Embeddable = StringToBool(LookupTag(Message,"Embeddable"),false);
    // CNC:2004-04-27
    Config->HasPreferredURI = StringToBool(LookupTag(Message,"Has-Preferred-URI"),false);
 
@@ -399,6 +529,7 @@ bool pkgAcquire::Worker::Capabilities(string Message)
 	      " NeedsCleanup: " << Config->NeedsCleanup <<
 	      // CNC:2004-04-27
 	      " Removable: " << Config->Removable <<
+	      " Embeddable: " << Config->Embeddable <<
 	      " HasPreferredURI: " << Config->HasPreferredURI << endl;
    }
 
@@ -417,8 +548,7 @@ bool pkgAcquire::Worker::MediaChange(string Message)
       snprintf(S,sizeof(S),"603 Media Changed\nFailed: true\n\n");
       if (Debug == true)
 	 clog << " -> " << Access << ':' << QuoteString(S,"\n") << endl;
-      OutQueue += S;
-      OutReady = true;
+      Send(S);
       return true;
    }
 
@@ -426,8 +556,7 @@ bool pkgAcquire::Worker::MediaChange(string Message)
    snprintf(S,sizeof(S),"603 Media Changed\n\n");
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(S,"\n") << endl;
-   OutQueue += S;
-   OutReady = true;
+   Send(S);
    return true;
 }
 									/*}}}*/
@@ -444,8 +573,7 @@ bool pkgAcquire::Worker::Authenticate(string Message)
       snprintf(S,sizeof(S),"604 Authenticated\nFailed: true\n\n");
       if (Debug == true)
 	 clog << " -> " << Access << ':' << QuoteString(S,"\n") << endl;
-      OutQueue += S;
-      OutReady = true;
+      Send(S);
       return true;
    }
 
@@ -454,8 +582,7 @@ bool pkgAcquire::Worker::Authenticate(string Message)
 	    User.c_str(), Pass.c_str());
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(S,"\n") << endl;
-   OutQueue += S;
-   OutReady = true;
+   Send(S);
    return true;
 }
 									/*}}}*/
@@ -464,7 +591,8 @@ bool pkgAcquire::Worker::Authenticate(string Message)
 /* */
 bool pkgAcquire::Worker::SendConfiguration()
 {
-   if (Config->SendConfig == false)
+   // A method in our own process already sees our configuration
+   if (Config->SendConfig == false || Thread != 0)
       return true;
 
    if (OutFd == -1)
@@ -500,8 +628,7 @@ bool pkgAcquire::Worker::SendConfiguration()
 
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(Message,"\n") << endl;
-   OutQueue += Message;
-   OutReady = true;
+   Send(Message);
 
    return true;
 }
@@ -523,12 +650,21 @@ bool pkgAcquire::Worker::QueueItem(pkgAcquire::Queue::QItem *Item)
 
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(Message,"\n") << endl;
-   OutQueue += Message;
-   OutReady = true;
+   Send(Message);
 
    return true;
 }
 									/*}}}*/
+// Worker::Send - Queue a message for the method			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgAcquire::Worker::Send(string const &Message)
+{
+   OutQueue += Message;
+   OutReady = true;
+   Touch();
+}
+									/*}}}*/
 // Worker::OutFdRead - Out bound FD is ready				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -550,7 +686,10 @@ bool pkgAcquire::Worker::OutFdReady()
 
    OutQueue.erase(0,Res);
    if (OutQueue.empty() == true)
+   {
       OutReady = false;
+      Touch();
+   }
 
    return true;
 }
@@ -576,8 +715,10 @@ bool pkgAcquire::Worker::MethodFailure()
 
    ExecWait(Process,Access.c_str(),true);
    Process = -1;
+   Unwatch();
    close(InFd);
    close(OutFd);
+   StopThread();
    InFd = -1;
    OutFd = -1;
    OutReady = false;
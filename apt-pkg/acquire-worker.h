@@ -5,7 +5,9 @@
 
    Acquire Worker - Worker process manager
 
-   Each worker class is associated with exaclty one subprocess.
+   Each worker class is associated with exaclty one subprocess, or with
+   a thread for the methods built into the library. Both talk the same
+   protocol over a pair of pipes.
 
    ##################################################################### */
 									/*}}}*/
@@ -35,11 +37,23 @@ class pkgAcquire::Worker
 
    // This is the subprocess IPC setup
    pid_t Process;
+   void *Thread;
    int InFd;
    int OutFd;
    bool InReady;
    bool OutReady;
 
+   // Items handed to the method and not done yet
+   signed long PipeDepth;
+   unsigned long PipeBytes;
+
+   // What the epoll loop of the owner has registered
+   int WatchIn;
+   int WatchOut;
+   bool Touched;
+   inline void Touch() {if (OwnerQ != 0) OwnerQ->Owner->Touch(this);}
+   inline void Unwatch() {if (OwnerQ != 0) OwnerQ->Owner->Unwatch(this);}
+
    // Various internal things
    bool Debug;
    vector<string> MessageQueue;
@@ -47,8 +61,12 @@ class pkgAcquire::Worker
 
    // Private constructor helper
    void Construct();
+   bool StartProcess(string const &Method);
+   bool StartThread();
+   void StopThread();
 
    // Message handling things
+   void Send(string const &Message);
    bool ReadMessages();
    bool RunMessages();
    bool InFdReady();
@@ -19,7 +19,9 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/strutl.h>
+#include <apt-pkg/fileutl.h>
 
+#include <config.h>
 #include <apti18n.h>
 
 #include <iostream>
@@ -28,6 +30,12 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <sys/stat.h>
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define APT_ACQUIRE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <stdint.h>
+#endif
 									/*}}}*/
 
 using namespace std;
@@ -42,6 +50,8 @@ pkgAcquire::pkgAcquire(pkgAcquireStatus *Log) : Log(Log)
    Workers = 0;
    ToFetch = 0;
    Running = false;
+   EpollFd = -1;
+   TimerFd = -1;
 
    string Mode = _config->Find("Acquire::Queue-Mode","host");
    if (strcasecmp(Mode.c_str(),"host") == 0)
@@ -309,6 +319,11 @@ pkgAcquire::RunResult pkgAcquire::Run()
 {
    Running = true;
 
+   // The workers register themselves while they start up
+   bool Epoll = false;
+   if (_config->Find("Acquire::Event-Loop","epoll") != "select")
+      Epoll = EpollStart();
+
    for (Queue *I = Queues; I != 0; I = I->Next)
       I->Startup();
 
@@ -318,6 +333,36 @@ pkgAcquire::RunResult pkgAcquire::Run()
    bool WasCancelled = false;
 
    // Run till all things have been acquired
+   if (Epoll == true)
+      RunEpoll(WasCancelled);
+   else
+      RunSelect(WasCancelled);
+
+   if (Log != 0)
+      Log->Stop();
+
+   // Shut down the acquire bits
+   Running = false;
+   EpollStop();
+   for (Queue *I = Queues; I != 0; I = I->Next)
+      I->Shutdown(false);
+
+   // Shut down the items
+   for (ItemIterator I = Items.begin(); I != Items.end(); I++)
+      (*I)->Finished();
+
+   if (_error->PendingError())
+      return Failed;
+   if (WasCancelled)
+      return Cancelled;
+   return Continue;
+}
+									/*}}}*/
+// Acquire::RunSelect - The select loop of Run()			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool pkgAcquire::RunSelect(bool &WasCancelled)
+{
    struct timeval tv;
    tv.tv_sec = 0;
    tv.tv_usec = 500000;
@@ -338,14 +383,11 @@ pkgAcquire::RunResult pkgAcquire::Run()
       while (Res < 0 && errno == EINTR);
 
       if (Res < 0)
-      {
-	 _error->Errno("select","Select has failed");
-	 break;
-      }
+	 return _error->Errno("select","Select has failed");
 
       RunFds(&RFds,&WFds);
       if (_error->PendingError() == true)
-	 break;
+	 return false;
 
       // Timeout, notify the log class
       if (Res == 0 || (Log != 0 && Log->Update == true))
@@ -356,30 +398,234 @@ pkgAcquire::RunResult pkgAcquire::Run()
 	 if (Log != 0 && Log->Pulse(this) == false)
 	 {
 	    WasCancelled = true;
-	    break;
+	    return true;
 	 }
       }
    }
+   return true;
+}
+									/*}}}*/
+// Acquire::Touch - A worker changed its FDs or what it waits for	/*{{{*/
+// ---------------------------------------------------------------------
+/* The registration is brought up to date by Watch() right before the
+   next wait, so a worker queueing many messages costs one update. */
+void pkgAcquire::Touch(Worker *Work)
+{
+   if (EpollFd < 0 || Work->Touched == true)
+      return;
+   Work->Touched = true;
+   Touched.push_back(Work);
+}
+									/*}}}*/
+#ifdef APT_ACQUIRE_EPOLL
+// Acquire::Unwatch - A worker is about to close its FDs		/*{{{*/
+// ---------------------------------------------------------------------
+/* This has to happen right away, once closed the numbers may be reused
+   by a worker started before the next wait. */
+void pkgAcquire::Unwatch(Worker *Work)
+{
+   if (EpollFd < 0)
+      return;
+   if (Work->WatchIn >= 0)
+      EpollCtl(EPOLL_CTL_DEL,Work->WatchIn,0,0);
+   if (Work->WatchOut >= 0)
+      EpollCtl(EPOLL_CTL_DEL,Work->WatchOut,0,0);
+   Work->WatchIn = -1;
+   Work->WatchOut = -1;
+}
+									/*}}}*/
+// Acquire::EpollStart - Set up the epoll loop				/*{{{*/
+// ---------------------------------------------------------------------
+/* Workers left running from an earlier Run() are registered here, the
+   others register themselves as they start. False, and the select loop
+   is used, if the kernel can't do it. */
+bool pkgAcquire::EpollStart()
+{
+   EpollFd = epoll_create(64);
+   if (EpollFd < 0)
+      return false;
+   SetCloseExec(EpollFd,true);
 
-   if (Log != 0)
-      Log->Stop();
+   TimerFd = timerfd_create(CLOCK_MONOTONIC,0);
+   if (TimerFd < 0)
+   {
+      close(EpollFd);
+      EpollFd = -1;
+      return false;
+   }
+   SetCloseExec(TimerFd,true);
+   SetNonBlock(TimerFd,true);
+
+   struct itimerspec Pulse;
+   Pulse.it_interval.tv_sec = 0;
+   Pulse.it_interval.tv_nsec = 500000000;
+   Pulse.it_value = Pulse.it_interval;
+   struct epoll_event Ev;
+   Ev.events = EPOLLIN;
+   Ev.data.fd = TimerFd;
+   if (timerfd_settime(TimerFd,0,&Pulse,0) != 0 ||
+       epoll_ctl(EpollFd,EPOLL_CTL_ADD,TimerFd,&Ev) != 0)
+   {
+      EpollStop();
+      return false;
+   }
 
-   // Shut down the acquire bits
-   Running = false;
-   for (Queue *I = Queues; I != 0; I = I->Next)
-      I->Shutdown(false);
+   for (Worker *I = Workers; I != 0; I = I->NextAcquire)
+   {
+      I->WatchIn = -1;
+      I->WatchOut = -1;
+      I->Touched = false;
+      Touch(I);
+   }
+   return true;
+}
+									/*}}}*/
+// Acquire::EpollStop - Tear down the epoll loop			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgAcquire::EpollStop()
+{
+   if (EpollFd < 0)
+      return;
+   close(TimerFd);
+   close(EpollFd);
+   TimerFd = -1;
+   EpollFd = -1;
+   for (vector<Worker *>::iterator I = Touched.begin(); I != Touched.end(); I++)
+      (*I)->Touched = false;
+   Touched.clear();
+   FdWorker.clear();
+}
+									/*}}}*/
+// Acquire::EpollCtl - Change the registration of one FD		/*{{{*/
+// ---------------------------------------------------------------------
+/* The FD itself is the event data, FdWorker finds its worker. Failures
+   to remove are ignored, the FD may have been closed by the method
+   dying already. */
+void pkgAcquire::EpollCtl(int Op,int Fd,Worker *Work,unsigned int Events)
+{
+   struct epoll_event Ev;
+   Ev.events = Events;
+   Ev.data.fd = Fd;
+   if (epoll_ctl(EpollFd,Op,Fd,&Ev) != 0 && Op != EPOLL_CTL_DEL)
+      _error->Errno("epoll_ctl","Unable to watch the method FD %i",Fd);
+
+   if ((unsigned)Fd >= FdWorker.size())
+      FdWorker.resize(Fd + 1,0);
+   FdWorker[Fd] = (Op == EPOLL_CTL_DEL) ? 0 : Work;
+}
+									/*}}}*/
+// Acquire::Watch - Bring the registration of a worker up to date	/*{{{*/
+// ---------------------------------------------------------------------
+/* This is what SetFds() decides on each pass: the input is watched while
+   the worker is reading and the output only while it has something to
+   write. An FD is not left registered without events in between, epoll
+   would still report EPOLLERR and EPOLLHUP for it, and again on every
+   wait once the method is gone. */
+void pkgAcquire::Watch(Worker *Work)
+{
+   Work->Touched = false;
 
-   // Shut down the items
-   for (ItemIterator I = Items.begin(); I != Items.end(); I++)
-      (*I)->Finished();
+   int In = (Work->InReady == true) ? Work->InFd : -1;
+   if (In != Work->WatchIn)
+   {
+      if (Work->WatchIn >= 0)
+	 EpollCtl(EPOLL_CTL_DEL,Work->WatchIn,0,0);
+      if (In >= 0)
+	 EpollCtl(EPOLL_CTL_ADD,In,Work,EPOLLIN);
+      Work->WatchIn = In;
+   }
 
-   if (_error->PendingError())
-      return Failed;
-   if (WasCancelled)
-      return Cancelled;
-   return Continue;
+   int Out = (Work->OutReady == true) ? Work->OutFd : -1;
+   if (Out != Work->WatchOut)
+   {
+      if (Work->WatchOut >= 0)
+	 EpollCtl(EPOLL_CTL_DEL,Work->WatchOut,0,0);
+      if (Out >= 0)
+	 EpollCtl(EPOLL_CTL_ADD,Out,Work,EPOLLOUT);
+      Work->WatchOut = Out;
+   }
+}
+									/*}}}*/
+// Acquire::RunEpoll - The epoll loop of Run()				/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the workers that changed are looked at before waiting and only
+   the ones with ready FDs are run afterwards. As with RunFds() a worker
+   is never erased while this runs, but it may close its FDs and start
+   again; events for FDs unregistered in the meantime are dropped. */
+bool pkgAcquire::RunEpoll(bool &WasCancelled)
+{
+   vector<struct epoll_event> Events(64);
+   vector<Worker *> Changed;
+   while (ToFetch > 0)
+   {
+      // Watch() may not be reentered through the list it walks
+      Changed.swap(Touched);
+      for (vector<Worker *>::iterator I = Changed.begin(); I != Changed.end(); I++)
+	 Watch(*I);
+      Changed.clear();
+      if (_error->PendingError() == true)
+	 return false;
+
+      int Res;
+      do
+      {
+	 Res = epoll_wait(EpollFd,&Events[0],Events.size(),-1);
+      }
+      while (Res < 0 && errno == EINTR);
+
+      if (Res < 0)
+	 return _error->Errno("epoll_wait","Waiting for the methods has failed");
+
+      bool Pulse = false;
+      for (int I = 0; I != Res; I++)
+      {
+	 int Fd = Events[I].data.fd;
+	 if (Fd == TimerFd)
+	 {
+	    uint64_t Expired;
+	    if (read(TimerFd,&Expired,sizeof(Expired)) > 0)
+	       Pulse = true;
+	    continue;
+	 }
+	 if ((unsigned)Fd >= FdWorker.size() || FdWorker[Fd] == 0)
+	    continue;
+
+	 Worker *Work = FdWorker[Fd];
+	 if (Fd == Work->InFd && Work->InReady == true)
+	    Work->InFdReady();
+	 else if (Fd == Work->OutFd && Work->OutReady == true)
+	    Work->OutFdReady();
+      }
+      if (_error->PendingError() == true)
+	 return false;
+
+      // Lots of workers are busy at once, take more events next time
+      if ((unsigned)Res == Events.size())
+	 Events.resize(Events.size()*2);
+
+      if (Pulse == true || (Log != 0 && Log->Update == true))
+      {
+	 for (Worker *I = Workers; I != 0; I = I->NextAcquire)
+	    I->Pulse();
+	 if (Log != 0 && Log->Pulse(this) == false)
+	 {
+	    WasCancelled = true;
+	    return true;
+	 }
+      }
+   }
+   return true;
 }
 									/*}}}*/
+#else
+void pkgAcquire::Unwatch(Worker *Work) {}
+bool pkgAcquire::EpollStart() {return false;}
+void pkgAcquire::EpollStop() {}
+void pkgAcquire::EpollCtl(int Op,int Fd,Worker *Work,unsigned int Events) {}
+void pkgAcquire::Watch(Worker *Work) {}
+bool pkgAcquire::RunEpoll(bool &WasCancelled) {return RunSelect(WasCancelled);}
+#endif
 // Acquire::Bump - Called when an item is dequeued			/*{{{*/
 // ---------------------------------------------------------------------
 /* This routine bumps idle queues in hopes that they will be able to fetch
@@ -502,6 +748,7 @@ pkgAcquire::MethodConfig::MethodConfig()
    Pipeline = false;
    SendConfig = false;
    LocalOnly = false;
+   Embeddable = false;
    Removable = false;
    Next = 0;
    // CNC:2004-04-27
@@ -521,6 +768,7 @@ pkgAcquire::Queue::Queue(string Name,pkgAcquire *Owner) : Name(Name),
    Next = 0;
    Workers = 0;
    MaxPipeDepth = 1;
+   MaxPipeBytes = 0;
    PipeDepth = 0;
 }
 									/*}}}*/
@@ -589,7 +837,8 @@ bool pkgAcquire::Queue::Dequeue(Item *Owner)
 // Queue::Startup - Start the worker processes				/*{{{*/
 // ---------------------------------------------------------------------
 /* It is possible for this to be called with a pre-existing set of
-   workers. */
+   workers. Queues of a single host may get several workers, single
+   instance methods and access queues always have one. */
 bool pkgAcquire::Queue::Startup()
 {
    if (Workers == 0)
@@ -599,10 +848,22 @@ bool pkgAcquire::Queue::Startup()
       if (Cnf == 0)
 	 return false;
 
-      Workers = new Worker(this,Cnf,Owner->Log);
-      Owner->Add(Workers);
-      if (Workers->Start() == false)
-	 return false;
+      string Conf = "Acquire::" + U.Access + "::";
+      int Connections = 1;
+      if (Cnf->SingleInstance == false && Owner->QueueMode == QueueHost)
+	 Connections = _config->FindI((Conf + "Max-Connections-Per-Host").c_str(),1);
+      if (Connections < 1)
+	 Connections = 1;
+
+      for (int I = 0; I != Connections; I++)
+      {
+	 Worker *Work = new Worker(this,Cnf,Owner->Log);
+	 Work->NextQueue = Workers;
+	 Workers = Work;
+	 Owner->Add(Work);
+	 if (Work->Start() == false)
+	    return false;
+      }
 
       /* When pipelining we commit 10 items. This needs to change when we
          added other source retry to have cycle maintain a pipeline depth
@@ -611,6 +872,12 @@ bool pkgAcquire::Queue::Startup()
 	 MaxPipeDepth = 10;
       else
 	 MaxPipeDepth = 1;
+
+      // With a single connection there is nothing to balance
+      MaxPipeBytes = 0;
+      if (Connections > 1)
+	 MaxPipeBytes = _config->FindI((Conf + "Max-Pipeline-Bytes").c_str(),
+				       2*1024*1024);
    }
 
    return Cycle();
@@ -659,6 +926,8 @@ pkgAcquire::Queue::QItem *pkgAcquire::Queue::FindItem(string URI,pkgAcquire::Wor
 bool pkgAcquire::Queue::ItemDone(QItem *Itm)
 {
    PipeDepth--;
+   Itm->Worker->PipeDepth--;
+   Itm->Worker->PipeBytes -= Itm->Size;
    if (Itm->Owner->Status == pkgAcquire::Item::StatFetching)
       Itm->Owner->Status = pkgAcquire::Item::StatDone;
 
@@ -673,10 +942,10 @@ bool pkgAcquire::Queue::ItemDone(QItem *Itm)
    return Cycle();
 }
 									/*}}}*/
-// Queue::Cycle - Queue new items into the method			/*{{{*/
+// Queue::Cycle - Queue new items into the methods			/*{{{*/
 // ---------------------------------------------------------------------
-/* This locates a new idle item and sends it to the worker. If pipelining
-   is enabled then it keeps the pipe full. */
+/* This locates new idle items and sends them to the workers. If pipelining
+   is enabled then it keeps their pipes full. */
 bool pkgAcquire::Queue::Cycle()
 {
    if (Items == 0 || Workers == 0)
@@ -685,46 +954,69 @@ bool pkgAcquire::Queue::Cycle()
    if (PipeDepth < 0)
       return _error->Error("Pipedepth failure");
 
+   for (Worker *I = Workers; I != 0; I = I->NextQueue)
+      if (Fill(I) == false)
+	 return false;
+   return true;
+}
+									/*}}}*/
+// Queue::Fill - Queue new items into one method			/*{{{*/
+// ---------------------------------------------------------------------
+/* With several workers the largest idle item goes first, and a worker
+   that has MaxPipeBytes in its pipe only gets more once it is done with
+   some of it. */
+bool pkgAcquire::Queue::Fill(Worker *Work)
+{
    // Look for a queable item
    // CNC:2004-04-27
-   bool Preferred = (Workers->Config->HasPreferredURI == true &&
-		     Workers->Config->DonePreferredURI == false &&
-		     Workers->Config->PreferredURI.empty() == false);
-   QItem *I = Items;
-   while (PipeDepth < (signed)MaxPipeDepth)
+   bool Preferred = (Work->Config->HasPreferredURI == true &&
+		     Work->Config->DonePreferredURI == false &&
+		     Work->Config->PreferredURI.empty() == false);
+   bool Largest = (Workers->NextQueue != 0);
+   while (Work->PipeDepth < (signed)MaxPipeDepth)
    {
-      // CNC:2004-04-27
-      if (Preferred) {
-	 for (; I != 0; I = I->Next)
-	    if (I->Owner->Status == pkgAcquire::Item::StatIdle &&
-	        strncmp(I->URI.c_str(), Workers->Config->PreferredURI.c_str(),
-		        Workers->Config->PreferredURI.length()) == 0)
-	       break;
-      } else {
-	 for (; I != 0; I = I->Next)
-	    if (I->Owner->Status == pkgAcquire::Item::StatIdle)
-	       break;
+      if (MaxPipeBytes != 0 && Work->PipeDepth != 0 &&
+	  Work->PipeBytes >= MaxPipeBytes)
+	 return true;
+
+      QItem *I = 0;
+      for (QItem *J = Items; J != 0; J = J->Next)
+      {
+	 if (J->Owner->Status != pkgAcquire::Item::StatIdle)
+	    continue;
+	 // CNC:2004-04-27
+	 if (Preferred == true &&
+	     strncmp(J->URI.c_str(),Work->Config->PreferredURI.c_str(),
+		     Work->Config->PreferredURI.length()) != 0)
+	    continue;
+	 if (I == 0 || (Largest == true && J->Owner->FileSize > I->Owner->FileSize))
+	    I = J;
+	 if (Largest == false)
+	    break;
       }
 
       // Nothing to do, queue is idle.
-      if (I == 0) {
-         // CNC:2004-04-27
-	 if (Preferred == true) {
+      if (I == 0)
+      {
+	 // CNC:2004-04-27
+	 if (Preferred == true)
+	 {
 	    Preferred = false;
-	    Workers->Config->DonePreferredURI = true;
-	    I = Items;
+	    Work->Config->DonePreferredURI = true;
 	    continue;
 	 }
 	 return true;
       }
 
-      I->Worker = Workers;
+      I->Worker = Work;
+      I->Size = I->Owner->FileSize;
       I->Owner->Status = pkgAcquire::Item::StatFetching;
       PipeDepth++;
-      if (Workers->QueueItem(I) == false)
+      Work->PipeDepth++;
+      Work->PipeBytes += I->Size;
+      if (Work->QueueItem(I) == false)
 	 return false;
    }
-
    return true;
 }
 									/*}}}*/
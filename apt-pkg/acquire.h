@@ -23,10 +23,25 @@
    preserves the order of the download as much as possible. And means the
    fastest source will tend to process the largest number of files.
 
+   A host queue can be served by several workers, each with its own
+   connection, Acquire::<access>::Max-Connections-Per-Host sets how many.
+   The items stay in the shared queue until a worker has room for them,
+   so a worker that runs dry takes what its siblings have not started
+   yet. They then go largest first, and a worker only pipelines behind
+   what it has while that is below Acquire::<access>::Max-Pipeline-Bytes,
+   so a huge file neither holds small ones behind it nor starts last.
+
    Internal methods and queues for performing gzip decompression,
    md5sum hashing and file copying are provided to allow items to apply
    a number of transformations to the data files they are working with.
 
+   Run() waits on the worker FDs with epoll where it is available. The
+   workers tell it when their FDs or what they wait for change, so only
+   those are looked at again and only ready workers are run; a timerfd
+   gives the progress pulses. Acquire::Event-Loop "select" selects the
+   old loop over SetFds() and RunFds(), which derived classes overriding
+   those need.
+
    ##################################################################### */
 									/*}}}*/
 #ifndef PKGLIB_ACQUIRE_H
@@ -53,6 +68,7 @@ class pkgAcquire
    struct ItemDesc;
    friend class Item;
    friend class Queue;
+   friend class Worker;
 
    typedef vector<Item *>::iterator ItemIterator;
    typedef vector<Item *>::const_iterator ItemCIterator;
@@ -87,6 +103,22 @@ class pkgAcquire
    virtual void SetFds(int &Fd,fd_set *RSet,fd_set *WSet);
    virtual void RunFds(fd_set *RSet,fd_set *WSet);
 
+   // The epoll loop, -1 when it is not running
+   int EpollFd;
+   int TimerFd;
+   vector<Worker *> Touched;         // Workers to look at again
+   vector<Worker *> FdWorker;        // Owner of each registered FD
+   bool EpollStart();
+   void EpollStop();
+   void EpollCtl(int Op,int Fd,Worker *Work,unsigned int Events);
+   void Watch(Worker *Work);
+   bool RunEpoll(bool &WasCancelled);
+   bool RunSelect(bool &WasCancelled);
+
+   // Workers call these when their FDs change and before closing them
+   void Touch(Worker *Work);
+   void Unwatch(Worker *Work);
+
    // A queue calls this when it dequeues an item
    void Bump();
 
@@ -147,6 +179,7 @@ class pkgAcquire::Queue
    {
       QItem *Next;
       pkgAcquire::Worker *Worker;
+      unsigned long Size;             // Counted in the pipeline of Worker
 
       void operator =(pkgAcquire::ItemDesc const &I)
       {
@@ -167,6 +200,9 @@ class pkgAcquire::Queue
    pkgAcquire *Owner;
    signed long PipeDepth;
    unsigned long MaxPipeDepth;
+   unsigned long MaxPipeBytes;        // 0 for no limit
+
+   bool Fill(pkgAcquire::Worker *Work);
 
    public:
 
@@ -236,6 +272,7 @@ struct pkgAcquire::MethodConfig
    bool LocalOnly;
    bool NeedsCleanup;
    bool Removable;
+   bool Embeddable;
    // CNC:2004-04-27
    bool HasPreferredURI;
    bool DonePreferredURI;
@@ -15,6 +15,8 @@
 									/*}}}*/
 // Include Files							/*{{{*/
 #include <apt-pkg/algorithms.h>
+#include <apt-pkg/satresolver.h>
+#include <apt-pkg/resolvetrace.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/sptr.h>
@@ -27,6 +29,9 @@
 
 #include <iostream>
 #include <cstring>
+#include <queue>
+#include <algorithm>
+#include <functional>
 									/*}}}*/
 using namespace std;
 
@@ -135,8 +140,6 @@ bool pkgSimulate::Configure(PkgIterator iPkg)
    {
       cout << "Conf " << Pkg.Name() << " broken" << endl;
 
-      Sim.Update();
-
       // Print out each package and the failed dependencies
       for (pkgCache::DepIterator D = Sim[Pkg].InstVerIter(Sim).DependsList(); D.end() == false; D++)
       {
@@ -332,6 +335,11 @@ bool pkgFixBroken(pkgDepCache &Cache)
    The problem resolver is used to resolve the problems.
  */
 bool pkgDistUpgrade(pkgDepCache &Cache)
+{
+   pkgProblemResolver Fix(&Cache);
+   return pkgDistUpgrade(Cache,Fix);
+}
+bool pkgDistUpgrade(pkgDepCache &Cache,pkgProblemResolver &Fix)
 {
    /* Auto upgrade all installed packages, this provides the basis
       for the installation */
@@ -347,7 +355,7 @@ bool pkgDistUpgrade(pkgDepCache &Cache)
 	    if (D->Type == pkgCache::Dep::Obsoletes &&
 	        Cache[D.ParentPkg()].CandidateVer != 0 &&
 		Cache[D.ParentPkg()].CandidateVerIter(Cache).Downloadable() == true &&
-	        (pkgCache::Version*)D.ParentVer() == Cache[D.ParentPkg()].CandidateVer &&
+	        D->ParentVer == Cache[D.ParentPkg()].CandidateVer &&
 	        Cache.VS().CheckDep(I.CurrentVer().VerStr(), D) == true &&
 		Cache.GetPkgPriority(D.ParentPkg()) >= Cache.GetPkgPriority(I))
 	    {
@@ -381,7 +389,7 @@ bool pkgDistUpgrade(pkgDepCache &Cache)
 	    if (D->Type == pkgCache::Dep::Obsoletes &&
 	        Cache[D.ParentPkg()].CandidateVer != 0 &&
 		Cache[D.ParentPkg()].CandidateVerIter(Cache).Downloadable() == true &&
-	        (pkgCache::Version*)D.ParentVer() == Cache[D.ParentPkg()].CandidateVer &&
+	        D->ParentVer == Cache[D.ParentPkg()].CandidateVer &&
 	        Cache.VS().CheckDep(I.CurrentVer().VerStr(), D) == true &&
 		Cache.GetPkgPriority(D.ParentPkg()) >= Cache.GetPkgPriority(I))
 	    {
@@ -395,8 +403,6 @@ bool pkgDistUpgrade(pkgDepCache &Cache)
       }
    }
 
-   pkgProblemResolver Fix(&Cache);
-
    // CNC:2002-07-04
    _system->ProcessCache(Cache,Fix);
 
@@ -510,6 +516,13 @@ pkgProblemResolver::pkgProblemResolver(pkgDepCache *pCache) : Cache(*pCache)
 
    // Set debug to true to see its decision logic
    Debug = _config->FindB("Debug::pkgProblemResolver",false);
+   Trace = Cache.GetTrace();
+   Passes = 0;
+   Considered = 0;
+   SatConflicts = 0;
+   Explore = _config->FindI("APT::Solver::Explore",0);
+   PassBegin = PassEnd = 0;
+   PassFix = false;
 }
 									/*}}}*/
 // ProblemResolver::~pkgProblemResolver - Destructor			/*{{{*/
@@ -598,7 +611,7 @@ void pkgProblemResolver::MakeScores()
       for (pkgCache::DepIterator D = I.RevDependsList(); D.end() == false; D++)
       {
 	 // Only do it for the install version
-	 if ((pkgCache::Version *)D.ParentVer() != Cache[D.ParentPkg()].InstallVer ||
+	 if (D->ParentVer != Cache[D.ParentPkg()].InstallVer ||
 	     (D->Type != pkgCache::Dep::Depends && D->Type != pkgCache::Dep::PreDepends))
 	    continue;
 
@@ -613,7 +626,7 @@ void pkgProblemResolver::MakeScores()
       for (pkgCache::PrvIterator P = I.ProvidesList(); P.end() == false; P++)
       {
 	 // Only do it once per package
-	 if ((pkgCache::Version *)P.OwnerVer() != Cache[P.OwnerPkg()].InstallVer)
+	 if (P->Version != Cache[P.OwnerPkg()].InstallVer)
 	    continue;
 	 Scores[P.OwnerPkg()->ID] += abs(Scores[I->ID] - OldScores[I->ID]);
       }
@@ -732,16 +745,45 @@ bool pkgProblemResolver::DoUpgrade(pkgCache::PkgIterator Pkg)
 	 Cache.MarkKeep(Pkg);
       else
 	 Cache.MarkDelete(Pkg);
+      if (Trace != 0)
+	 Trace->Action("upgrade-undone",Pkg,Scores[Pkg->ID],"broken-dep");
       return false;
    }
 
    if (Debug == true)
       clog << "  Re-Instated " << Pkg.Name() << endl;
+   if (Trace != 0)
+      Trace->Action("upgrade",Pkg,Scores[Pkg->ID],"reinstate");
    return true;
 }
 									/*}}}*/
 // ProblemResolver::Resolve - Run the resolution pass			/*{{{*/
 // ---------------------------------------------------------------------
+/* With a trace the start and the end, with the counters, are written
+   around the real work. */
+bool pkgProblemResolver::Resolve(bool BrokenFix)
+{
+   Passes = 0;
+   Considered = 0;
+   SatConflicts = 0;
+   if (Trace == 0)
+      return ResolveInternal(BrokenFix);
+
+   Trace->Reset();
+   Trace->Event("resolve-start","broken=%lu fix=%i",Cache.BrokenCount(),
+		BrokenFix == true);
+   double Start = Trace->Now();
+   bool Res = ResolveInternal(BrokenFix);
+   Trace->Event("resolve-end","ok=%i broken=%lu passes=%i considered=%lu "
+		"mark-install=%lu max-depth=%lu depth-limited=%lu secs=%.6f",
+		Res == true,Cache.BrokenCount(),Passes,Considered,
+		Trace->MarkInstalls,Trace->MaxDepth,Trace->DepthLimited,
+		Trace->Now() - Start);
+   return Res;
+}
+									/*}}}*/
+// ProblemResolver::ResolveInternal - Run the resolution pass		/*{{{*/
+// ---------------------------------------------------------------------
 /* This routines works by calculating a score for each package. The score
    is derived by considering the package's priority and all reverse
    dependents giving an integer that reflects the amount of breakage that
@@ -754,7 +796,7 @@ bool pkgProblemResolver::DoUpgrade(pkgCache::PkgIterator Pkg)
 
    The BrokenFix flag enables a mode where the algorithm tries to
    upgrade packages to advoid problems. */
-bool pkgProblemResolver::Resolve(bool BrokenFix)
+bool pkgProblemResolver::ResolveInternal(bool BrokenFix)
 {
    unsigned long Size = Cache.Head().PackageCount;
 
@@ -786,7 +828,18 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
    if (Debug == true)
       clog << "Starting" << endl;
 
-   MakeScores();
+   {
+      pkgResolveTrace::Timer Phase(Trace,"MakeScores");
+      MakeScores();
+   }
+
+   // The SAT engine when asked for, the passes below if it finds nothing
+   if (_config->Find("APT::Solver","internal") == "sat")
+   {
+      pkgResolveTrace::Timer Phase(Trace,"SAT");
+      if (ResolveSat() == true)
+	 return true;
+   }
 
    /* We have to order the packages so that the broken fixing pass
       operates from highest score to lowest. This prevents problems when
@@ -797,7 +850,10 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
    for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
       *PEnd++ = I;
    This = this;
-   qsort(PList,PEnd - PList,sizeof(*PList),&ScoreSort);
+   {
+      pkgResolveTrace::Timer Phase(Trace,"ScoreSort");
+      qsort(PList,PEnd - PList,sizeof(*PList),&ScoreSort);
+   }
 
 /* for (pkgCache::Package **K = PList; K != PEnd; K++)
       if (Scores[(*K)->ID] != 0)
@@ -815,259 +871,353 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
       remove the package or fix it's problem. We do this once, it should
       not be possible for a loop to form (that is a < b < c and fixing b by
       changing a breaks c) */
+   pkgResolveTrace::Timer Phase(Trace,"Passes");
+   PassBegin = PList;
+   PassEnd = PEnd;
+   PassFix = BrokenFix;
+   ResolvePasses(PList,PEnd,BrokenFix);
+   PassBegin = PassEnd = 0;
+
+   if (Debug == true)
+      clog << "Done" << endl;
+
+   if (Cache.BrokenCount() != 0)
+   {
+      // See if this is the result of a hold
+      pkgCache::PkgIterator I = Cache.PkgBegin();
+      for (;I.end() != true; I++)
+      {
+	 if (Cache[I].InstBroken() == false)
+	    continue;
+	 if ((Flags[I->ID] & Protected) != Protected)
+	    return _error->Error(_("Error, pkgProblemResolver::Resolve generated breaks, this may be caused by held packages."));
+      }
+      return _error->Error(_("Unable to correct problems, you have held broken packages."));
+   }
+
+   return true;
+}
+									/*}}}*/
+// ProblemResolver::ResolveSat - Resolve with pkgSatResolver		/*{{{*/
+// ---------------------------------------------------------------------
+/* It gets the scores and the flags set here, so the same packages are
+   protected and the same ones are tried first. */
+bool pkgProblemResolver::ResolveSat()
+{
+   pkgSatResolver Sat(Cache);
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+   {
+      Sat.Score(I,Scores[I->ID]);
+      if ((Flags[I->ID] & Protected) != 0)
+	 Sat.Protect(I);
+      if ((Flags[I->ID] & ToRemove) != 0)
+	 Sat.Remove(I);
+   }
+   bool Res = Sat.Resolve();
+   SatConflicts += Sat.Conflicts();
+   if (Res == true)
+      return true;
+
+   if (Debug == true)
+      clog << "SAT resolver failed, using the passes" << endl;
+   return false;
+}
+									/*}}}*/
+// ProblemResolver::Interesting - Check if ResolvePkg() would act	/*{{{*/
+// ---------------------------------------------------------------------
+/* These are the conditions ResolvePkg() starts with, for everything else
+   it does nothing at all. */
+bool pkgProblemResolver::Interesting(pkgCache::PkgIterator I)
+{
+   pkgDepCache::StateCache &State = Cache[I];
+   if (State.CandidateVer != State.InstallVer &&
+       I->CurrentVer != 0 && State.InstallVer != 0 &&
+       (Flags[I->ID] & (PreInstalled | Protected | ReInstateTried)) == PreInstalled)
+      return true;
+   return State.InstallVer != 0 && State.InstBroken() == true;
+}
+									/*}}}*/
+// ProblemResolver::ResolvePasses - Run the passes over the sorted list	/*{{{*/
+// ---------------------------------------------------------------------
+/* Over a worklist unless APT::ProblemResolver::Worklist is off, then the
+   whole list is gone over up to 10 times. */
+void pkgProblemResolver::ResolvePasses(pkgCache::Package **PList,
+				       pkgCache::Package **PEnd,
+				       bool BrokenFix)
+{
+   if (_config->FindB("APT::ProblemResolver::Worklist",true) == true)
+   {
+      ResolveQueued(PList,PEnd,BrokenFix);
+      return;
+   }
+
    bool Change = true;
    for (int Counter = 0; Counter != 10 && Change == true; Counter++)
    {
+      Passes++;
       Change = false;
       for (pkgCache::Package **K = PList; K != PEnd; K++)
+	 ResolvePkg(pkgCache::PkgIterator(Cache,*K),BrokenFix,Counter,Change);
+   }
+}
+									/*}}}*/
+// ProblemResolver::ResolveQueued - Resolve passes over a worklist	/*{{{*/
+// ---------------------------------------------------------------------
+/* This gives the same result as going over the whole sorted list up to
+   10 times, but only packages ResolvePkg() would act on are visited.
+   Packages are queued by their place in the sorted list. A State taken
+   around each step tells which packages it changed, those further down
+   the list are queued for this pass and the others for the next one, as
+   is the package itself if it still needs work. */
+void pkgProblemResolver::ResolveQueued(pkgCache::Package **PList,
+				       pkgCache::Package **PEnd,
+				       bool BrokenFix)
+{
+   typedef priority_queue<unsigned long,vector<unsigned long>,
+			  greater<unsigned long> > PosQueue;
+
+   unsigned long Size = Cache.Head().PackageCount;
+   vector<unsigned long> Pos(Size);
+   vector<bool> InQueue(Size,false);
+   vector<bool> InNext(Size,false);
+   PosQueue Queue;
+   PosQueue Next;
+   for (pkgCache::Package **K = PList; K != PEnd; K++)
+   {
+      Pos[(*K)->ID] = K - PList;
+      if (Interesting(pkgCache::PkgIterator(Cache,*K)) == true)
       {
-	 pkgCache::PkgIterator I(Cache,*K);
-
-	 /* We attempt to install this and see if any breaks result,
-	    this takes care of some strange cases */
-	 if (Cache[I].CandidateVer != Cache[I].InstallVer &&
-	     I->CurrentVer != 0 && Cache[I].InstallVer != 0 &&
-	     (Flags[I->ID] & PreInstalled) != 0 &&
-	     (Flags[I->ID] & Protected) == 0 &&
-	     (Flags[I->ID] & ReInstateTried) == 0)
-	 {
-	    if (Debug == true)
-	       clog << " Try to Re-Instate " << I.Name() << endl;
-	    unsigned long OldBreaks = Cache.BrokenCount();
-	    pkgCache::Version *OldVer = Cache[I].InstallVer;
-	    Flags[I->ID] &= ReInstateTried;
+	 Queue.push(K - PList);
+	 InQueue[K - PList] = true;
+      }
+   }
 
-	    Cache.MarkInstall(I,false);
-	    if (Cache[I].InstBroken() == true ||
-		OldBreaks < Cache.BrokenCount())
+   bool Change = true;
+   vector<unsigned long> Touched;
+   for (int Counter = 0; Counter != 10 && Change == true; Counter++)
+   {
+      Passes++;
+      Change = false;
+      while (Queue.empty() == false)
+      {
+	 unsigned long P = Queue.top();
+	 Queue.pop();
+	 InQueue[P] = false;
+
+	 pkgCache::PkgIterator I(Cache,PList[P]);
+	 pkgDepCache::State Watch(&Cache);
+	 ResolvePkg(I,BrokenFix,Counter,Change);
+
+	 Touched.clear();
+	 Watch.Touched(Touched);
+	 Touched.push_back(I->ID);
+	 for (vector<unsigned long>::const_iterator T = Touched.begin();
+	      T != Touched.end(); T++)
+	 {
+	    unsigned long Q = Pos[*T];
+	    if (Interesting(pkgCache::PkgIterator(Cache,PList[Q])) == false)
+	       continue;
+	    if (Q > P && InQueue[Q] == false)
 	    {
-	       if (OldVer == 0)
-		  Cache.MarkDelete(I);
-	       else
-		  Cache.MarkKeep(I);
+	       Queue.push(Q);
+	       InQueue[Q] = true;
+	    }
+	    else if (Q <= P && InNext[Q] == false)
+	    {
+	       Next.push(Q);
+	       InNext[Q] = true;
 	    }
+	 }
+      }
+
+      swap(Queue,Next);
+      swap(InQueue,InNext);
+   }
+}
+									/*}}}*/
+// ProblemResolver::ResolvePkg - Try to fix a single broken package	/*{{{*/
+// ---------------------------------------------------------------------
+/* One step of the Resolve() passes, Change is set if anything was done.
+   Packages that are not broken and have nothing to re-instate are left
+   alone, see Interesting(). */
+void pkgProblemResolver::ResolvePkg(pkgCache::PkgIterator I,bool BrokenFix,
+				    int Counter,bool &Change)
+{
+      /* We attempt to install this and see if any breaks result,
+	 this takes care of some strange cases */
+      if (Cache[I].CandidateVer != Cache[I].InstallVer &&
+	  I->CurrentVer != 0 && Cache[I].InstallVer != 0 &&
+	  (Flags[I->ID] & PreInstalled) != 0 &&
+	  (Flags[I->ID] & Protected) == 0 &&
+	  (Flags[I->ID] & ReInstateTried) == 0)
+      {
+	 if (Debug == true)
+	    clog << " Try to Re-Instate " << I.Name() << endl;
+	 unsigned long OldBreaks = Cache.BrokenCount();
+	 map_ptrloc OldVer = Cache[I].InstallVer;
+	 Flags[I->ID] &= ReInstateTried;
+
+	 Cache.MarkInstall(I,false);
+	 if (Cache[I].InstBroken() == true ||
+	     OldBreaks < Cache.BrokenCount())
+	 {
+	    if (OldVer == 0)
+	       Cache.MarkDelete(I);
 	    else
-	       if (Debug == true)
-		  clog << "Re-Instated " << I.Name() << " (" << OldBreaks << " vs " << Cache.BrokenCount() << ')' << endl;
+	       Cache.MarkKeep(I);
+	 }
+	 else
+	 {
+	    if (Debug == true)
+	       clog << "Re-Instated " << I.Name() << " (" << OldBreaks << " vs " << Cache.BrokenCount() << ')' << endl;
+	    if (Trace != 0)
+	       Trace->Action("upgrade",I,Scores[I->ID],"reinstate");
 	 }
+      }
 
-	 if (Cache[I].InstallVer == 0 || Cache[I].InstBroken() == false)
-	    continue;
+      if (Cache[I].InstallVer == 0 || Cache[I].InstBroken() == false)
+	 return;
 
-	 if (Debug == true)
-	    cout << "Investigating " << I.Name() << endl;
-
-	 // Isolate the problem dependency
-	 PackageKill KillList[100];
-	 PackageKill *LEnd = KillList;
-	 bool InOr = false;
-	 pkgCache::DepIterator Start;
-	 pkgCache::DepIterator End;
-	 PackageKill *OldEnd = LEnd;
-
-	 enum {OrRemove,OrKeep} OrOp = OrRemove;
-	 for (pkgCache::DepIterator D = Cache[I].InstVerIter(Cache).DependsList();
-	      D.end() == false || InOr == true;)
+      if (Debug == true)
+	 cout << "Investigating " << I.Name() << endl;
+      Considered++;
+      if (Trace != 0)
+	 Trace->Event("consider","pkg=%s score=%i pass=%i",I.Name(),
+		      (int)Scores[I->ID],Counter);
+
+      // Settle the or groups by trying their alternatives first
+      if (Explore > 0 && ExploreOrs(I) == true)
+      {
+	 Change = true;
+	 return;
+      }
+
+      // Isolate the problem dependency
+      PackageKill KillList[100];
+      PackageKill *LEnd = KillList;
+      bool InOr = false;
+      pkgCache::DepIterator Start;
+      pkgCache::DepIterator End;
+      PackageKill *OldEnd = LEnd;
+
+      enum {OrRemove,OrKeep} OrOp = OrRemove;
+      for (pkgCache::DepIterator D = Cache[I].InstVerIter(Cache).DependsList();
+	   D.end() == false || InOr == true;)
+      {
+	 // Compute a single dependency element (glob or)
+	 if (Start == End)
 	 {
-	    // Compute a single dependency element (glob or)
-	    if (Start == End)
+	    // Decide what to do
+	    if (InOr == true)
 	    {
-	       // Decide what to do
-	       if (InOr == true)
+	       if (OldEnd == LEnd && OrOp == OrRemove)
 	       {
-		  if (OldEnd == LEnd && OrOp == OrRemove)
-		  {
-		     if ((Flags[I->ID] & Protected) != Protected)
-		     {
-			if (Debug == true)
-			   clog << "  Or group remove for " << I.Name() << endl;
-			Cache.MarkDelete(I);
-			Change = true;
-		     }
-		  }
-		  if (OldEnd == LEnd && OrOp == OrKeep)
+		  if ((Flags[I->ID] & Protected) != Protected)
 		  {
 		     if (Debug == true)
-			clog << "  Or group keep for " << I.Name() << endl;
-		     Cache.MarkKeep(I);
+			clog << "  Or group remove for " << I.Name() << endl;
+		     if (Trace != 0)
+			Trace->Action("remove",I,Scores[I->ID],"or-group");
+		     Cache.MarkDelete(I);
 		     Change = true;
 		  }
 	       }
-
-	       /* We do an extra loop (as above) to finalize the or group
-		  processing */
-	       InOr = false;
-	       OrOp = OrRemove;
-	       D.GlobOr(Start,End);
-	       if (Start.end() == true)
-		  break;
-
-	       // We only worry about critical deps.
-	       if (End.IsCritical() != true)
-		  continue;
-
-	       InOr = Start != End;
-	       OldEnd = LEnd;
-	    }
-	    else
-	       Start++;
-
-	    // Dep is ok
-	    if ((Cache[End] & pkgDepCache::DepGInstall) == pkgDepCache::DepGInstall)
-	    {
-	       InOr = false;
-	       continue;
-	    }
-
-	    if (Debug == true)
-	       clog << "Package " << I.Name() << " has broken dep on " << Start.TargetPkg().Name() << endl;
-
-	    /* Look across the version list. If there are no possible
-	       targets then we keep the package and bail. This is necessary
-	       if a package has a dep on another package that cant be found */
-	    SPtrArray<pkgCache::Version *> VList = Start.AllTargets();
-	    if (*VList == 0 && (Flags[I->ID] & Protected) != Protected &&
-		Start->Type != pkgCache::Dep::Conflicts &&
-		Start->Type != pkgCache::Dep::Obsoletes &&
-		Cache[I].NowBroken() == false)
-	    {
-	       if (InOr == true)
+	       if (OldEnd == LEnd && OrOp == OrKeep)
 	       {
-		  /* No keep choice because the keep being OK could be the
-		     result of another element in the OR group! */
-		  continue;
+		  if (Debug == true)
+		     clog << "  Or group keep for " << I.Name() << endl;
+		  if (Trace != 0)
+		     Trace->Action("keep",I,Scores[I->ID],"or-group");
+		  Cache.MarkKeep(I);
+		  Change = true;
 	       }
+	    }
 
-	       Change = true;
-	       Cache.MarkKeep(I);
+	    /* We do an extra loop (as above) to finalize the or group
+	       processing */
+	    InOr = false;
+	    OrOp = OrRemove;
+	    D.GlobOr(Start,End);
+	    if (Start.end() == true)
 	       break;
-	    }
 
-	    bool Done = false;
-	    for (pkgCache::Version **V = VList; *V != 0; V++)
-	    {
-	       pkgCache::VerIterator Ver(Cache,*V);
-	       pkgCache::PkgIterator Pkg = Ver.ParentPkg();
+	    // We only worry about critical deps.
+	    if (End.IsCritical() != true)
+	       continue;
 
-	       if (Debug == true)
-		  clog << "  Considering " << Pkg.Name() << ' ' << (int)Scores[Pkg->ID] <<
-		  " as a solution to " << I.Name() << ' ' << (int)Scores[I->ID] << endl;
-
-	       /* Try to fix the package under consideration rather than
-	          fiddle with the VList package */
-	       if (Scores[I->ID] <= Scores[Pkg->ID] ||
-		   ((Cache[Start] & pkgDepCache::DepNow) == 0 &&
-		    End->Type != pkgCache::Dep::Conflicts &&
-		    End->Type != pkgCache::Dep::Obsoletes))
-	       {
-		  // Try a little harder for protected packages and obsoletes..
-		  if ((Flags[I->ID] & Protected) == Protected ||
-		      End->Type == pkgCache::Dep::Obsoletes)
-		  {
-		     if (DoUpgrade(Pkg) == true)
-		     {
-			if (Scores[Pkg->ID] > Scores[I->ID])
-			   Scores[Pkg->ID] = Scores[I->ID];
-			break;
-		     }
+	    InOr = Start != End;
+	    OldEnd = LEnd;
+	 }
+	 else
+	    Start++;
 
-		     continue;
-		  }
+	 // Dep is ok
+	 if ((Cache[End] & pkgDepCache::DepGInstall) == pkgDepCache::DepGInstall)
+	 {
+	    InOr = false;
+	    continue;
+	 }
 
-		  /* See if a keep will do, unless the package is protected,
-		     then installing it will be necessary */
-		  bool Installed = Cache[I].Install();
-		  Cache.MarkKeep(I);
-		  if (Cache[I].InstBroken() == false)
-		  {
-		     // Unwind operation will be keep now
-		     if (OrOp == OrRemove)
-			OrOp = OrKeep;
+	 if (Debug == true)
+	    clog << "Package " << I.Name() << " has broken dep on " << Start.TargetPkg().Name() << endl;
+
+	 /* Look across the version list. If there are no possible
+	    targets then we keep the package and bail. This is necessary
+	    if a package has a dep on another package that cant be found */
+	 SPtrArray<pkgCache::Version *> VList = Start.AllTargets();
+	 if (*VList == 0 && (Flags[I->ID] & Protected) != Protected &&
+	     Start->Type != pkgCache::Dep::Conflicts &&
+	     Start->Type != pkgCache::Dep::Obsoletes &&
+	     Cache[I].NowBroken() == false)
+	 {
+	    if (InOr == true)
+	    {
+	       /* No keep choice because the keep being OK could be the
+		  result of another element in the OR group! */
+	       continue;
+	    }
 
-		     // Restore
-		     if (InOr == true && Installed == true)
-			Cache.MarkInstall(I,false);
+	    if (Trace != 0)
+	       Trace->Action("keep",I,Scores[I->ID],"no-target",
+			     Start.TargetPkg().Name());
+	    Change = true;
+	    Cache.MarkKeep(I);
+	    break;
+	 }
 
-		     if (Debug == true)
-			clog << "  Holding Back " << I.Name() << " rather than change " << Start.TargetPkg().Name() << endl;
-		  }
-		  else
-		  {
-		     if (BrokenFix == false || DoUpgrade(I) == false)
-		     {
-			// Consider other options
-			if (InOr == false)
-			{
-			   if (Debug == true)
-			      clog << "  Removing " << I.Name() << " rather than change " << Start.TargetPkg().Name() << endl;
-			   Cache.MarkDelete(I);
-			   if (Counter > 1)
-			   {
-			      if (Scores[Pkg->ID] > Scores[I->ID])
-				 Scores[I->ID] = Scores[Pkg->ID];
-			   }
-			}
-		     }
-		  }
+	 bool Done = false;
+	 for (pkgCache::Version **V = VList; *V != 0; V++)
+	 {
+	    pkgCache::VerIterator Ver(Cache,*V);
+	    pkgCache::PkgIterator Pkg = Ver.ParentPkg();
 
-		  Change = true;
-		  Done = true;
-		  break;
-	       }
-	       else
+	    if (Debug == true)
+	       clog << "  Considering " << Pkg.Name() << ' ' << (int)Scores[Pkg->ID] <<
+	       " as a solution to " << I.Name() << ' ' << (int)Scores[I->ID] << endl;
+
+	    /* Try to fix the package under consideration rather than
+	       fiddle with the VList package */
+	    if (Scores[I->ID] <= Scores[Pkg->ID] ||
+		((Cache[Start] & pkgDepCache::DepNow) == 0 &&
+		 End->Type != pkgCache::Dep::Conflicts &&
+		 End->Type != pkgCache::Dep::Obsoletes))
+	    {
+	       // Try a little harder for protected packages and obsoletes..
+	       if ((Flags[I->ID] & Protected) == Protected ||
+		   End->Type == pkgCache::Dep::Obsoletes)
 	       {
-		  /* This is a conflicts, and the version we are looking
-		     at is not the currently selected version of the
-		     package, which means it is not necessary to
-		     remove/keep */
-		  if (Cache[Pkg].InstallVer != Ver &&
-		      (Start->Type == pkgCache::Dep::Conflicts ||
-		       Start->Type == pkgCache::Dep::Obsoletes))
-		     continue;
-
-		  // Skip adding to the kill list if it is protected
-		  if ((Flags[Pkg->ID] & Protected) != 0)
-		     continue;
-
-		  // CNC:2003-03-22
-		  pkgDepCache::State State(&Cache);
-		  if (BrokenFix == true && DoUpgrade(Pkg) == true)
+		  if (DoUpgrade(Pkg) == true)
 		  {
-		     if (Cache[I].InstBroken() == false &&
-			 State.BrokenCount() >= Cache.BrokenCount())
-		     {
-			if (Debug == true)
-			   clog << "  Installing " << Pkg.Name() << endl;
-			Change = true;
-			break;
-		     }
-		     else
-			State.Restore();
+		     if (Scores[Pkg->ID] > Scores[I->ID])
+			Scores[Pkg->ID] = Scores[I->ID];
+		     break;
 		  }
 
-		  if (Debug == true)
-		     clog << "  Added " << Pkg.Name() << " to the remove list" << endl;
-
-		  // CNC:2002-07-09
-		  if (*(V+1) != 0) //XXX Look for other solutions?
-		      continue;
-
-		  LEnd->Pkg = Pkg;
-		  LEnd->Dep = End;
-		  LEnd++;
-
-		  if (Start->Type != pkgCache::Dep::Conflicts &&
-		      Start->Type != pkgCache::Dep::Obsoletes)
-		     break;
+		  continue;
 	       }
-	    }
 
-	    // Hm, nothing can possibly satisify this dep. Nuke it.
-	    if (VList[0] == 0 &&
-		Start->Type != pkgCache::Dep::Conflicts &&
-		Start->Type != pkgCache::Dep::Obsoletes &&
-		(Flags[I->ID] & Protected) != Protected)
-	    {
+	       /* See if a keep will do, unless the package is protected,
+		  then installing it will be necessary */
 	       bool Installed = Cache[I].Install();
 	       Cache.MarkKeep(I);
 	       if (Cache[I].InstBroken() == false)
@@ -1081,79 +1231,356 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
 		     Cache.MarkInstall(I,false);
 
 		  if (Debug == true)
-		     clog << "  Holding Back " << I.Name() << " because I can't find " << Start.TargetPkg().Name() << endl;
+		     clog << "  Holding Back " << I.Name() << " rather than change " << Start.TargetPkg().Name() << endl;
+		  if (Trace != 0)
+		     Trace->Action("keep",I,Scores[I->ID],"rather-than-change",
+				   Start.TargetPkg().Name());
 	       }
 	       else
 	       {
-		  if (Debug == true)
-		     clog << "  Removing " << I.Name() << " because I can't find " << Start.TargetPkg().Name() << endl;
-		  if (InOr == false)
-		     Cache.MarkDelete(I);
+		  if (BrokenFix == false || DoUpgrade(I) == false)
+		  {
+		     // Consider other options
+		     if (InOr == false)
+		     {
+			if (Debug == true)
+			   clog << "  Removing " << I.Name() << " rather than change " << Start.TargetPkg().Name() << endl;
+			if (Trace != 0)
+			   Trace->Action("remove",I,Scores[I->ID],"rather-than-change",
+					 Start.TargetPkg().Name());
+			Cache.MarkDelete(I);
+			if (Counter > 1)
+			{
+			   if (Scores[Pkg->ID] > Scores[I->ID])
+			      Scores[I->ID] = Scores[Pkg->ID];
+			}
+		     }
+		  }
 	       }
 
 	       Change = true;
 	       Done = true;
+	       break;
 	    }
+	    else
+	    {
+	       /* This is a conflicts, and the version we are looking
+		  at is not the currently selected version of the
+		  package, which means it is not necessary to
+		  remove/keep */
+	       if (Cache[Pkg].InstallVer != Ver.Index() &&
+		   (Start->Type == pkgCache::Dep::Conflicts ||
+		    Start->Type == pkgCache::Dep::Obsoletes))
+		  continue;
 
-	    // Try some more
-	    if (InOr == true)
-	       continue;
-
-	    if (Done == true)
-	       break;
-	 }
+	       // Skip adding to the kill list if it is protected
+	       if ((Flags[Pkg->ID] & Protected) != 0)
+		  continue;
 
-	 // Apply the kill list now
-	 if (Cache[I].InstallVer != 0)
-	 {
-	    for (PackageKill *J = KillList; J != LEnd; J++)
-	    {
-	       Change = true;
-	       if ((Cache[J->Dep] & pkgDepCache::DepGNow) == 0)
+	       // CNC:2003-03-22
+	       pkgDepCache::State State(&Cache);
+	       if (BrokenFix == true && DoUpgrade(Pkg) == true)
 	       {
-		  if (J->Dep->Type == pkgCache::Dep::Conflicts ||
-		      J->Dep->Type == pkgCache::Dep::Obsoletes)
+		  if (Cache[I].InstBroken() == false &&
+		      State.BrokenCount() >= Cache.BrokenCount())
 		  {
 		     if (Debug == true)
-			clog << "  Fixing " << I.Name() << " via remove of " << J->Pkg.Name() << endl;
-		     Cache.MarkDelete(J->Pkg);
+			clog << "  Installing " << Pkg.Name() << endl;
+		     if (Trace != 0)
+			Trace->Action("install",Pkg,Scores[Pkg->ID],"fixes-dep",
+				      I.Name());
+		     Change = true;
+		     break;
 		  }
+		  else
+		     State.Restore();
 	       }
-	       else
+
+	       if (Debug == true)
+		  clog << "  Added " << Pkg.Name() << " to the remove list" << endl;
+
+	       // CNC:2002-07-09
+	       if (*(V+1) != 0) //XXX Look for other solutions?
+		   continue;
+
+	       LEnd->Pkg = Pkg;
+	       LEnd->Dep = End;
+	       LEnd++;
+
+	       if (Start->Type != pkgCache::Dep::Conflicts &&
+		   Start->Type != pkgCache::Dep::Obsoletes)
+		  break;
+	    }
+	 }
+
+	 // Hm, nothing can possibly satisify this dep. Nuke it.
+	 if (VList[0] == 0 &&
+	     Start->Type != pkgCache::Dep::Conflicts &&
+	     Start->Type != pkgCache::Dep::Obsoletes &&
+	     (Flags[I->ID] & Protected) != Protected)
+	 {
+	    bool Installed = Cache[I].Install();
+	    Cache.MarkKeep(I);
+	    if (Cache[I].InstBroken() == false)
+	    {
+	       // Unwind operation will be keep now
+	       if (OrOp == OrRemove)
+		  OrOp = OrKeep;
+
+	       // Restore
+	       if (InOr == true && Installed == true)
+		  Cache.MarkInstall(I,false);
+
+	       if (Debug == true)
+		  clog << "  Holding Back " << I.Name() << " because I can't find " << Start.TargetPkg().Name() << endl;
+	       if (Trace != 0)
+		  Trace->Action("keep",I,Scores[I->ID],"missing-dep",
+				Start.TargetPkg().Name());
+	    }
+	    else
+	    {
+	       if (Debug == true)
+		  clog << "  Removing " << I.Name() << " because I can't find " << Start.TargetPkg().Name() << endl;
+	       if (InOr == false)
 	       {
-		  if (Debug == true)
-		     clog << "  Fixing " << I.Name() << " via keep of " << J->Pkg.Name() << endl;
-		  Cache.MarkKeep(J->Pkg);
+		  if (Trace != 0)
+		     Trace->Action("remove",I,Scores[I->ID],"missing-dep",
+				   Start.TargetPkg().Name());
+		  Cache.MarkDelete(I);
 	       }
+	    }
+
+	    Change = true;
+	    Done = true;
+	 }
+
+	 // Try some more
+	 if (InOr == true)
+	    continue;
+
+	 if (Done == true)
+	    break;
+      }
 
-	       if (Counter > 1)
+      // Apply the kill list now
+      if (Cache[I].InstallVer != 0)
+      {
+	 for (PackageKill *J = KillList; J != LEnd; J++)
+	 {
+	    Change = true;
+	    if ((Cache[J->Dep] & pkgDepCache::DepGNow) == 0)
+	    {
+	       if (J->Dep->Type == pkgCache::Dep::Conflicts ||
+		   J->Dep->Type == pkgCache::Dep::Obsoletes)
 	       {
-		  if (Scores[I->ID] > Scores[J->Pkg->ID])
-		     Scores[J->Pkg->ID] = Scores[I->ID];
+		  if (Debug == true)
+		     clog << "  Fixing " << I.Name() << " via remove of " << J->Pkg.Name() << endl;
+		  if (Trace != 0)
+		     Trace->Action("remove",J->Pkg,Scores[J->Pkg->ID],"conflicts",
+				   I.Name());
+		  Cache.MarkDelete(J->Pkg);
 	       }
 	    }
+	    else
+	    {
+	       if (Debug == true)
+		  clog << "  Fixing " << I.Name() << " via keep of " << J->Pkg.Name() << endl;
+	       if (Trace != 0)
+		  Trace->Action("keep",J->Pkg,Scores[J->Pkg->ID],"breaks",
+				I.Name());
+	       Cache.MarkKeep(J->Pkg);
+	    }
+
+	    if (Counter > 1)
+	    {
+	       if (Scores[I->ID] > Scores[J->Pkg->ID])
+		  Scores[J->Pkg->ID] = Scores[I->ID];
+	    }
 	 }
       }
-   }
+}
+									/*}}}*/
+// Higher scores first
+struct ExploreScoreOrder
+{
+   const signed short *Scores;
+   bool operator ()(pkgCache::Package *A,pkgCache::Package *B) const
+      {return Scores[A->ID] > Scores[B->ID];}
+   ExploreScoreOrder(const signed short *Scores) : Scores(Scores) {}
+};
 
-   if (Debug == true)
-      clog << "Done" << endl;
+// ProblemResolver::ExploreFork - Resolve with a package installed	/*{{{*/
+// ---------------------------------------------------------------------
+/* Pkg is installed, or nothing when Pkg is 0, and the passes are run to
+   the end in a State that is restored afterwards. The scores, flags and
+   counters of the resolver are put back too, and the run is quiet and
+   does not explore itself. Broken is what the passes leave broken and
+   Changes how many packages they end up changing. False if Pkg did not
+   stay installed or a protected package was changed. */
+bool pkgProblemResolver::ExploreFork(Package *Pkg,unsigned long &Broken,
+				     unsigned long &Changes)
+{
+   unsigned long Size = Cache.Head().PackageCount;
+   SPtrArray<signed short> OldScores = new signed short[Size];
+   SPtrArray<unsigned char> OldFlags = new unsigned char[Size];
+   memcpy(OldScores,Scores,sizeof(*Scores)*Size);
+   memcpy(OldFlags,Flags,sizeof(*Flags)*Size);
+   int OldPasses = Passes;
+   unsigned long OldConsidered = Considered;
+   int OldExplore = Explore;
+   bool OldDebug = Debug;
+   pkgResolveTrace *OldTrace = Trace;
+   Explore = 0;
+   Debug = false;
+   Trace = 0;
+
+   pkgDepCache::State Fork(&Cache);
+   if (Pkg != 0)
+      Cache.MarkInstall(PkgIterator(Cache,Pkg),true);
+   ResolvePasses(PassBegin,PassEnd,PassFix);
+
+   bool Good = Pkg == 0 || Cache[PkgIterator(Cache,Pkg)].Install() == true;
+   Broken = Cache.BrokenCount();
+   Changes = 0;
+   vector<unsigned long> Touched;
+   Fork.Touched(Touched);
+   for (vector<unsigned long>::const_iterator T = Touched.begin();
+	T != Touched.end(); T++)
+   {
+      PkgIterator P(Cache,ByID[*T]);
+      if (Fork[P].InstallVer == Cache[P].InstallVer &&
+	  Fork[P].Mode == Cache[P].Mode)
+	 continue;
+      if ((OldFlags[*T] & Protected) != 0 && P != Pkg)
+	 Good = false;
+      Changes++;
+   }
+   Fork.Restore();
+
+   memcpy(Scores,OldScores,sizeof(*Scores)*Size);
+   memcpy(Flags,OldFlags,sizeof(*Flags)*Size);
+   Passes = OldPasses;
+   Considered = OldConsidered;
+   Explore = OldExplore;
+   Debug = OldDebug;
+   Trace = OldTrace;
+   return Good;
+}
+									/*}}}*/
+// ProblemResolver::ExploreOrs - Pick or group alternatives by trial	/*{{{*/
+// ---------------------------------------------------------------------
+/* The passes fix a broken or group with the first alternative the scores
+   allow and only come back to it if that goes badly, which on a large
+   upgrade can cost many removals. With APT::Solver::Explore set to K,
+   the K best scored packages that could satisfy a broken group of I are
+   each installed and the passes run to the end on that, see
+   ExploreFork(). So is the state as it is, which is what the passes do
+   without exploring. If an alternative leaves fewer packages broken, or
+   as many with fewer changes, than that, the best one is installed and
+   the passes are run for real, which gives what its trial found. The
+   trials share the one depcache and run one after the other, each costs
+   about a whole run of the passes, so exploring a group costs K+1 of
+   them. This is why it is off unless asked for. True if an alternative
+   was installed. */
+bool pkgProblemResolver::ExploreOrs(pkgCache::PkgIterator I)
+{
+   if (PassBegin == 0)
+      return false;
+   if (ByID.empty() == true)
+   {
+      ByID.resize(Cache.Head().PackageCount);
+      for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; P++)
+	 ByID[P->ID] = P;
+   }
 
-   if (Cache.BrokenCount() != 0)
+   for (pkgCache::DepIterator D = Cache[I].InstVerIter(Cache).DependsList();
+	D.end() == false;)
    {
-      // See if this is the result of a hold
-      pkgCache::PkgIterator I = Cache.PkgBegin();
-      for (;I.end() != true; I++)
+      DepIterator Start;
+      DepIterator End;
+      D.GlobOr(Start,End);
+
+      if (End.IsCritical() != true ||
+	  End->Type == pkgCache::Dep::Conflicts ||
+	  End->Type == pkgCache::Dep::Obsoletes)
+	 continue;
+      if ((Cache[End] & pkgDepCache::DepGInstall) == pkgDepCache::DepGInstall)
+	 continue;
+
+      // Everything in the group that installing its candidate would do
+      vector<Package *> Alts;
+      for (DepIterator A = Start;; A++)
       {
-	 if (Cache[I].InstBroken() == false)
+	 SPtrArray<Version *> VList = A.AllTargets();
+	 for (Version **V = VList; *V != 0; V++)
+	 {
+	    pkgCache::VerIterator Ver(Cache,*V);
+	    PkgIterator Pkg = Ver.ParentPkg();
+	    if (Cache[Pkg].CandidateVerIter(Cache) != Ver ||
+		Cache[Pkg].InstallVer == Ver.Index() ||
+		(Flags[Pkg->ID] & ToRemove) != 0)
+	       continue;
+	    if (find(Alts.begin(),Alts.end(),(Package *)Pkg) == Alts.end())
+	       Alts.push_back(Pkg);
+	 }
+	 if (A == End)
+	    break;
+      }
+      if (Alts.size() < 2)
+	 continue;
+
+      // Highest scores first, the order of the group breaks ties
+      stable_sort(Alts.begin(),Alts.end(),ExploreScoreOrder(Scores));
+      if (Alts.size() > (unsigned)Explore)
+	 Alts.resize(Explore);
+
+      // What the passes come to on their own is the one to beat
+      unsigned long BestBroken = 0;
+      unsigned long BestChanges = 0;
+      ExploreFork(0,BestBroken,BestChanges);
+      if (Debug == true)
+	 clog << "  Explored nothing for " << I.Name() << ": " << BestBroken
+	      << " broken, " << BestChanges << " changes" << endl;
+
+      Package *Best = 0;
+      for (vector<Package *>::const_iterator A = Alts.begin(); A != Alts.end(); A++)
+      {
+	 unsigned long Broken;
+	 unsigned long Changes;
+	 bool Good = ExploreFork(*A,Broken,Changes);
+
+	 if (Debug == true)
+	    clog << "  Explored " << PkgIterator(Cache,*A).Name() << " for "
+		 << I.Name() << ": " << (Good == true ? "" : "unusable, ")
+		 << Broken << " broken, " << Changes << " changes" << endl;
+	 if (Good == false)
 	    continue;
-	 if ((Flags[I->ID] & Protected) != Protected)
-	    return _error->Error(_("Error, pkgProblemResolver::Resolve generated breaks, this may be caused by held packages."));
+	 if (Broken < BestBroken ||
+	     (Broken == BestBroken && Changes < BestChanges))
+	 {
+	    Best = *A;
+	    BestBroken = Broken;
+	    BestChanges = Changes;
+	 }
       }
-      return _error->Error(_("Unable to correct problems, you have held broken packages."));
-   }
 
-   return true;
+      if (Best == 0)
+	 continue;
+      PkgIterator Pkg(Cache,Best);
+      if (Debug == true)
+	 clog << "  Installing " << Pkg.Name() << " for " << I.Name() << " after exploring" << endl;
+      if (Trace != 0)
+	 Trace->Action("install",Pkg,Scores[Pkg->ID],"explored",I.Name());
+
+      // The same run as the trial, so it ends where the trial did
+      int OldExplore = Explore;
+      Explore = 0;
+      Cache.MarkInstall(Pkg,true);
+      ResolvePasses(PassBegin,PassEnd,PassFix);
+      Explore = OldExplore;
+      return true;
+   }
+   return false;
 }
 									/*}}}*/
 // ProblemResolver::ResolveByKeep - Resolve problems using keep		/*{{{*/
@@ -1167,8 +1594,12 @@ bool pkgProblemResolver::ResolveByKeep()
 
    if (Debug == true)
       clog << "Entering ResolveByKeep" << endl;
+   pkgResolveTrace::Timer Total(Trace,"ResolveByKeep");
 
-   MakeScores();
+   {
+      pkgResolveTrace::Timer Phase(Trace,"MakeScores");
+      MakeScores();
+   }
 
    /* We have to order the packages so that the broken fixing pass
       operates from highest score to lowest. This prevents problems when
@@ -1189,6 +1620,9 @@ bool pkgProblemResolver::ResolveByKeep()
 
       if (Cache[I].InstallVer == 0 || Cache[I].InstBroken() == false)
 	 continue;
+      if (Trace != 0)
+	 Trace->Event("consider","pkg=%s score=%i pass=0",I.Name(),
+		      (int)Scores[I->ID]);
 
       /* Keep the package. If this works then great, otherwise we have
 	 to be significantly more agressive and manipulate its dependencies */
@@ -1196,6 +1630,8 @@ bool pkgProblemResolver::ResolveByKeep()
       {
 	 if (Debug == true)
 	    clog << "Keeping package " << I.Name() << endl;
+	 if (Trace != 0)
+	    Trace->Action("keep",I,Scores[I->ID],"broken");
 	 Cache.MarkKeep(I);
 	 if (Cache[I].InstBroken() == false)
 	 {
@@ -1245,6 +1681,8 @@ bool pkgProblemResolver::ResolveByKeep()
 	       {
 		  if (Debug == true)
 		     clog << "  Keeping Package " << Pkg.Name() << " due to dep" << endl;
+		  if (Trace != 0)
+		     Trace->Action("keep",Pkg,Scores[Pkg->ID],"breaks",I.Name());
 		  Cache.MarkKeep(Pkg);
 	       }
 
@@ -1339,7 +1777,7 @@ bool pkgProblemResolver::RemoveDepends()
 		  continue;
 
 	       if ((Cache[RPkg].Install() &&
-		    (pkgCache::Version*)R.ParentVer() == Cache[RPkg].InstallVer &&
+		    R->ParentVer == Cache[RPkg].InstallVer &&
 		    Cache.VS().CheckDep(DPkg.CurrentVer().VerStr(), R) == true) ||
 		   (RPkg->CurrentVer != 0 &&
 		    Cache[RPkg].Install() == false &&
@@ -1371,7 +1809,7 @@ bool pkgProblemResolver::RemoveDepends()
 		     continue;
 
 		  if ((Cache[RPkg].Install() &&
-		       (pkgCache::Version*)R.ParentVer() == Cache[RPkg].InstallVer &&
+		       R->ParentVer == Cache[RPkg].InstallVer &&
 		       Cache.VS().CheckDep(P.ProvideVersion(), R) == true) ||
 		      (RPkg->CurrentVer != 0 &&
 		       Cache[RPkg].Install() == false &&
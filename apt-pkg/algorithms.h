@@ -90,6 +90,21 @@ class pkgProblemResolver
    unsigned char *Flags;
    bool Debug;
 
+   // Trace counters, see resolvetrace.h
+   pkgResolveTrace *Trace;
+   int Passes;
+   unsigned long Considered;
+   unsigned long SatConflicts;
+
+   // Alternatives of an or group tried out by ExploreOrs(), 0 for none
+   int Explore;
+   vector<Package *> ByID;
+
+   // The sorted list and mode of the running passes, for ExploreOrs()
+   pkgCache::Package **PassBegin;
+   pkgCache::Package **PassEnd;
+   bool PassFix;
+
    // Sort stuff
    static pkgProblemResolver *This;
    static int ScoreSort(const void *a,const void *b);
@@ -103,6 +118,19 @@ class pkgProblemResolver
    void MakeScores();
    bool DoUpgrade(pkgCache::PkgIterator Pkg);
 
+   // The steps of Resolve()
+   bool ResolveInternal(bool BrokenFix);
+   bool Interesting(pkgCache::PkgIterator I);
+   bool ExploreOrs(pkgCache::PkgIterator I);
+   bool ExploreFork(Package *Pkg,unsigned long &Broken,unsigned long &Changes);
+   void ResolvePasses(pkgCache::Package **PList,pkgCache::Package **PEnd,
+		      bool BrokenFix);
+   void ResolvePkg(pkgCache::PkgIterator I,bool BrokenFix,int Counter,
+		   bool &Change);
+   void ResolveQueued(pkgCache::Package **PList,pkgCache::Package **PEnd,
+		      bool BrokenFix);
+   bool ResolveSat();
+
    public:
 
    inline void Protect(pkgCache::PkgIterator Pkg) {Flags[Pkg->ID] |= Protected;}
@@ -119,11 +147,15 @@ class pkgProblemResolver
 
    bool RemoveDepends(); // CNC:2002-08-01
 
+   // Conflicts the SAT engine ran into in the last Resolve(), 0 without it
+   inline unsigned long Conflicts() const {return SatConflicts;}
+
    pkgProblemResolver(pkgDepCache *Cache);
    ~pkgProblemResolver();
 };
 
 bool pkgDistUpgrade(pkgDepCache &Cache);
+bool pkgDistUpgrade(pkgDepCache &Cache,pkgProblemResolver &Fix);
 bool pkgApplyStatus(pkgDepCache &Cache);
 bool pkgFixBroken(pkgDepCache &Cache);
 bool pkgAllUpgrade(pkgDepCache &Cache);
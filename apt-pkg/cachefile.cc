@@ -84,8 +84,9 @@ bool pkgCacheFile::BuildCaches(OpProgress &Progress,bool WithLock)
 									/*}}}*/
 // CacheFile::Open - Open the cache files, creating if necessary	/*{{{*/
 // ---------------------------------------------------------------------
-/* */
-bool pkgCacheFile::Open(OpProgress &Progress,bool WithLock)
+/* With Lazy the dependency cache is only worked out as far as it gets
+   looked at, see pkgDepCache::InitLazy(). */
+bool pkgCacheFile::Open(OpProgress &Progress,bool WithLock,bool Lazy)
 {
    if (BuildCaches(Progress,WithLock) == false)
       return false;
@@ -102,7 +103,10 @@ bool pkgCacheFile::Open(OpProgress &Progress,bool WithLock)
    if (_error->PendingError() == true)
       return false;
 
-   DCache->Init(&Progress);
+   if (Lazy == true)
+      DCache->InitLazy(&Progress);
+   else
+      DCache->Init(&Progress);
    Progress.Done();
    if (_error->PendingError() == true)
       return false;
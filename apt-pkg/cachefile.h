@@ -43,7 +43,7 @@ class pkgCacheFile
    inline unsigned char &operator [](pkgCache::DepIterator const &I) {return (*DCache)[I];}
 
    bool BuildCaches(OpProgress &Progress,bool WithLock = true);
-   bool Open(OpProgress &Progress,bool WithLock = true);
+   bool Open(OpProgress &Progress,bool WithLock = true,bool Lazy = false);
    void Close();
 
    pkgCacheFile();
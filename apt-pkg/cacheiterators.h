@@ -306,6 +306,7 @@ class pkgCache::PkgFileIterator
    inline const char *Site() const {return File->Site == 0?0:Owner->StrP + File->Site;}
    inline const char *Architecture() const {return File->Architecture == 0?0:Owner->StrP + File->Architecture;}
    inline const char *IndexType() const {return File->IndexType == 0?0:Owner->StrP + File->IndexType;}
+   inline const char *Entries() const {return File->Entries == 0?0:Owner->StrP + File->Entries;}
 
    inline unsigned long Index() const {return File - Owner->PkgFileP;}
 
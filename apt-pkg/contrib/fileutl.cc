@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <signal.h>
 #include <errno.h>
 
@@ -283,41 +284,26 @@ void SetNonBlock(int Fd,bool Block)
 									/*}}}*/
 // WaitFd - Wait for a FD to become readable				/*{{{*/
 // ---------------------------------------------------------------------
-/* This waits for a FD to become readable using select. It is useful for
+/* This waits for a FD to become readable using poll. It is useful for
    applications making use of non-blocking sockets. The timeout is
-   in seconds. */
+   in seconds. Unlike select this works for FDs past FD_SETSIZE, which
+   the acquire methods reach with many queues. */
 bool WaitFd(int Fd,bool write,unsigned long timeout)
 {
-   fd_set Set;
-   struct timeval tv;
-   FD_ZERO(&Set);
-   FD_SET(Fd,&Set);
-   tv.tv_sec = timeout;
-   tv.tv_usec = 0;
-   if (write == true)
-   {
-      int Res;
-      do
-      {
-	 Res = select(Fd+1,0,&Set,0,(timeout != 0?&tv:0));
-      }
-      while (Res < 0 && errno == EINTR);
+   struct pollfd P;
+   P.fd = Fd;
+   P.events = (write == true) ? POLLOUT : POLLIN;
+   P.revents = 0;
 
-      if (Res <= 0)
-	 return false;
-   }
-   else
+   int Res;
+   do
    {
-      int Res;
-      do
-      {
-	 Res = select(Fd+1,&Set,0,0,(timeout != 0?&tv:0));
-      }
-      while (Res < 0 && errno == EINTR);
-
-      if (Res <= 0)
-	 return false;
+      Res = poll(&P,1,(timeout != 0) ? (int)(timeout*1000) : -1);
    }
+   while (Res < 0 && errno == EINTR);
+
+   if (Res <= 0)
+      return false;
 
    return true;
 }
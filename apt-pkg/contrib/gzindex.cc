@@ -0,0 +1,348 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Indexed GZip - gzip files that can be read from any offset
+
+   Blocks are independent gzip members so that inflating can start at
+   any of them. The index goes into the extra field of a final empty
+   member, laid out so it can be found from the end of the file:
+
+      uint64 block offsets[count], uint64 size, uint32 block size,
+      uint32 count, "APTGZIX1"
+
+   followed only by the empty deflate stream and the gzip trailer. If
+   there are more blocks than the extra field holds the count is zero;
+   the file is still readable, seeking then inflates from the start.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <apt-pkg/gzindex.h>
+#include <apt-pkg/error.h>
+
+#include <apti18n.h>
+
+#include <cstring>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <zlib.h>
+									/*}}}*/
+
+static const char GzIndexMagic[] = "APTGZIX1";
+static const unsigned long GzIndexBlockSize = 256*1024;
+static const unsigned long GzIndexBufSize = 64*1024;
+
+// Fixed part at the very end: size, block size, count, magic, the empty
+// deflate stream and the gzip crc and size
+static const unsigned long GzIndexTail = 8 + 4 + 4 + 8 + 2 + 8;
+
+// GzIndexWriter::GzIndexWriter - Constructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+GzIndexWriter::GzIndexWriter(FileFd &To) : To(To), BlockSize(GzIndexBlockSize),
+                     InBlock(0), Total(0), Written(0)
+{
+   Z = new z_stream;
+   memset(Z,0,sizeof(*Z));
+   Out = new unsigned char[GzIndexBufSize];
+   if (deflateInit2(Z,Z_DEFAULT_COMPRESSION,Z_DEFLATED,16 + MAX_WBITS,8,
+		    Z_DEFAULT_STRATEGY) != Z_OK)
+      _error->Error(_("Unable to initialize compression"));
+}
+									/*}}}*/
+GzIndexWriter::~GzIndexWriter()
+{
+   deflateEnd(Z);
+   delete Z;
+   delete [] Out;
+}
+// GzIndexWriter::Deflate - Compress the pending input			/*{{{*/
+// ---------------------------------------------------------------------
+/* Runs until the input is consumed, or with Z_FINISH until the member
+   is complete, writing the output as it goes. */
+bool GzIndexWriter::Deflate(int Flush)
+{
+   while (true)
+   {
+      Z->next_out = Out;
+      Z->avail_out = GzIndexBufSize;
+      int Res = deflate(Z,Flush);
+      if (Res != Z_OK && Res != Z_STREAM_END && Res != Z_BUF_ERROR)
+	 return _error->Error(_("Compression failed"));
+      unsigned long Len = GzIndexBufSize - Z->avail_out;
+      if (Len != 0 && To.Write(Out,Len) == false)
+	 return false;
+      Written += Len;
+      if (Flush == Z_FINISH ? Res == Z_STREAM_END :
+	  (Z->avail_in == 0 && Z->avail_out != 0))
+	 return true;
+   }
+}
+									/*}}}*/
+// GzIndexWriter::Write - Add data					/*{{{*/
+// ---------------------------------------------------------------------
+/* Each time a block is full its gzip member is closed. */
+bool GzIndexWriter::Write(const void *From,unsigned long Size)
+{
+   const unsigned char *Data = (const unsigned char *)From;
+   while (Size != 0)
+   {
+      if (InBlock == 0)
+	 Blocks.push_back(Written);
+
+      unsigned long Len = std::min(Size,BlockSize - InBlock);
+      Z->next_in = (Bytef *)Data;
+      Z->avail_in = Len;
+      if (Deflate(Z_NO_FLUSH) == false)
+	 return false;
+      Data += Len;
+      Size -= Len;
+      InBlock += Len;
+      Total += Len;
+
+      if (InBlock == BlockSize)
+      {
+	 if (Deflate(Z_FINISH) == false)
+	    return false;
+	 deflateReset(Z);
+	 InBlock = 0;
+      }
+   }
+   return true;
+}
+									/*}}}*/
+// GzIndexWriter::Finish - Close the last block and write the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* The index member is put together by hand, it has no content. */
+bool GzIndexWriter::Finish()
+{
+   if (InBlock != 0)
+   {
+      if (Deflate(Z_FINISH) == false)
+	 return false;
+      deflateReset(Z);
+      InBlock = 0;
+   }
+
+   // The extra field, a single 'AX' subfield, is limited to 64k
+   uint32_t Count = Blocks.size();
+   unsigned long Payload = (unsigned long)Count*8 + 8 + 4 + 4 + 8;
+   if (4 + Payload > 0xffff)
+   {
+      Count = 0;
+      Payload = 8 + 4 + 4 + 8;
+   }
+
+   string Member;
+   const unsigned char Head[] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff};
+   Member.append((const char *)Head,sizeof(Head));
+   unsigned long XLen = 4 + Payload;
+   Member += (char)(XLen & 0xff);
+   Member += (char)(XLen >> 8);
+   Member += 'A';
+   Member += 'X';
+   Member += (char)(Payload & 0xff);
+   Member += (char)(Payload >> 8);
+   for (uint32_t I = 0; I != Count; I++)
+   {
+      uint64_t Off = Blocks[I];
+      Member.append((const char *)&Off,sizeof(Off));
+   }
+   uint64_t Size = Total;
+   uint32_t Block = BlockSize;
+   Member.append((const char *)&Size,sizeof(Size));
+   Member.append((const char *)&Block,sizeof(Block));
+   Member.append((const char *)&Count,sizeof(Count));
+   Member.append(GzIndexMagic,sizeof(GzIndexMagic) - 1);
+   // Empty fixed huffman block, then crc32 and size of nothing
+   const unsigned char Tail[] = {3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+   Member.append((const char *)Tail,sizeof(Tail));
+
+   if (To.Write(Member.c_str(),Member.size()) == false)
+      return false;
+   Written += Member.size();
+   return true;
+}
+									/*}}}*/
+
+// GzIndexReader::GzIndexReader - Constructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+GzIndexReader::GzIndexReader() : Fd(-1), BlockSize(0), iSize(0), Pos(0),
+                     AtEnd(false)
+{
+   Z = new z_stream;
+   memset(Z,0,sizeof(*Z));
+   In = new unsigned char[GzIndexBufSize];
+   if (inflateInit2(Z,16 + MAX_WBITS) != Z_OK)
+      _error->Error(_("Unable to initialize decompression"));
+}
+									/*}}}*/
+GzIndexReader::~GzIndexReader()
+{
+   Close();
+   inflateEnd(Z);
+   delete Z;
+   delete [] In;
+}
+
+void GzIndexReader::Close()
+{
+   if (Fd >= 0)
+      close(Fd);
+   Fd = -1;
+   Blocks.clear();
+}
+
+// GzIndexReader::Open - Open an indexed gzip file			/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the index is read here. Anything that doesn't end the way the
+   writer ends its files is not ours, and not an error. */
+bool GzIndexReader::Open(const string &File)
+{
+   Close();
+   Fd = open(File.c_str(),O_RDONLY);
+   if (Fd < 0)
+      return false;
+   SetCloseExec(Fd,true);
+
+   struct stat St;
+   unsigned char Tail[GzIndexTail];
+   unsigned char Head[2];
+   if (fstat(Fd,&St) != 0 || (unsigned long)St.st_size < GzIndexTail + 16 ||
+       pread(Fd,Head,sizeof(Head),0) != sizeof(Head) ||
+       Head[0] != 0x1f || Head[1] != 0x8b ||
+       pread(Fd,Tail,sizeof(Tail),St.st_size - sizeof(Tail)) != sizeof(Tail) ||
+       memcmp(Tail + 16,GzIndexMagic,sizeof(GzIndexMagic) - 1) != 0 ||
+       Tail[24] != 3 || Tail[25] != 0)
+   {
+      Close();
+      return false;
+   }
+
+   uint64_t Size;
+   uint32_t Block, Count;
+   memcpy(&Size,Tail,sizeof(Size));
+   memcpy(&Block,Tail + 8,sizeof(Block));
+   memcpy(&Count,Tail + 12,sizeof(Count));
+   off_t Start = St.st_size - sizeof(Tail) - (off_t)Count*8;
+   if (Block == 0 || Start < 0 ||
+       4 + (unsigned long)Count*8 + 8 + 4 + 4 + 8 > 0xffff)
+   {
+      Close();
+      return false;
+   }
+   vector<uint64_t> Raw(Count);
+   if (Count != 0 &&
+       pread(Fd,&Raw[0],Count*8,Start) != (ssize_t)(Count*8))
+   {
+      Close();
+      return false;
+   }
+   Blocks.assign(Raw.begin(),Raw.end());
+   iSize = Size;
+   BlockSize = Block;
+   return Seek(0);
+}
+									/*}}}*/
+// GzIndexReader::Read - Read uncompressed data				/*{{{*/
+// ---------------------------------------------------------------------
+/* Like FileFd::Read(), without Actual reading less than Size is an
+   error. Member boundaries are passed transparently. */
+bool GzIndexReader::Read(void *To,unsigned long Size,unsigned long *Actual)
+{
+   if (Actual != 0)
+      *Actual = 0;
+   Z->next_out = (Bytef *)To;
+   Z->avail_out = Size;
+   while (Z->avail_out != 0 && AtEnd == false)
+   {
+      if (Z->avail_in == 0)
+      {
+	 ssize_t Res = read(Fd,In,GzIndexBufSize);
+	 if (Res < 0)
+	 {
+	    if (errno == EINTR)
+	       continue;
+	    return _error->Errno("read",_("Read error"));
+	 }
+	 if (Res == 0)
+	 {
+	    AtEnd = true;
+	    break;
+	 }
+	 Z->next_in = In;
+	 Z->avail_in = Res;
+      }
+
+      int Res = inflate(Z,Z_NO_FLUSH);
+      if (Res == Z_STREAM_END)
+	 inflateReset(Z);
+      else if (Res != Z_OK && Res != Z_BUF_ERROR)
+	 return _error->Error(_("Compressed data is corrupt"));
+   }
+
+   unsigned long Done = Size - Z->avail_out;
+   Pos += Done;
+   if (Actual != 0)
+      *Actual = Done;
+   else if (Done != Size)
+      return _error->Error(_("read, still have %lu to read but none left"),
+			   Size - Done);
+   return true;
+}
+									/*}}}*/
+// GzIndexReader::Seek - Move to an uncompressed offset			/*{{{*/
+// ---------------------------------------------------------------------
+/* Moving forward inside the current block just inflates up to the
+   offset, anything else restarts at the block holding it. */
+bool GzIndexReader::Seek(unsigned long long To)
+{
+   if (To > iSize)
+      return _error->Error(_("Unable to seek to %llu"),To);
+
+   bool Restart;
+   unsigned long long Block = To/BlockSize;
+   if (Blocks.empty() == true)
+      Restart = (To < Pos || To == 0);
+   else
+      Restart = (To < Pos || Block != Pos/BlockSize || To == 0);
+
+   if (Restart == true)
+   {
+      unsigned long long Start = 0;
+      if (Block < Blocks.size())
+	 Start = Blocks[Block];
+      else
+	 Block = 0;
+      if (lseek(Fd,Start,SEEK_SET) != (off_t)Start)
+	 return _error->Errno("lseek",_("Unable to seek to %llu"),To);
+      inflateReset(Z);
+      Z->avail_in = 0;
+      AtEnd = false;
+      Pos = Block*BlockSize;
+   }
+
+   unsigned char Buf[16*1024];
+   while (Pos < To)
+   {
+      unsigned long Len = std::min((unsigned long long)sizeof(Buf),To - Pos);
+      if (Read(Buf,Len) == false)
+	 return false;
+   }
+   return true;
+}
+									/*}}}*/
+// GzIndexReader::IsIndexed - Check if a file is an indexed gzip	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool GzIndexReader::IsIndexed(const string &File)
+{
+   GzIndexReader R;
+   return R.Open(File);
+}
+									/*}}}*/
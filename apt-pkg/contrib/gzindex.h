@@ -0,0 +1,79 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Indexed GZip - gzip files that can be read from any offset
+
+   The file is a series of gzip members, each holding a fixed size block
+   of the data, followed by an empty member whose extra field lists where
+   each block starts. It is an ordinary gzip file to any other reader,
+   but GzIndexReader can Seek() to any uncompressed offset by inflating
+   a single block from its start. Index lists are kept this way instead
+   of uncompressed.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_GZINDEX_H
+#define PKGLIB_GZINDEX_H
+
+#include <string>
+#include <vector>
+#include <apt-pkg/fileutl.h>
+
+using std::string;
+using std::vector;
+
+struct z_stream_s;
+
+class GzIndexWriter
+{
+   FileFd &To;
+   struct z_stream_s *Z;
+   unsigned long BlockSize;
+   unsigned long InBlock;
+   unsigned long long Total;
+   unsigned long long Written;
+   vector<unsigned long long> Blocks;
+   unsigned char *Out;
+
+   bool Deflate(int Flush);
+
+   public:
+
+   bool Write(const void *From,unsigned long Size);
+   bool Finish();
+   unsigned long long Size() const {return Total;}
+
+   GzIndexWriter(FileFd &To);
+   ~GzIndexWriter();
+};
+
+class GzIndexReader
+{
+   int Fd;
+   struct z_stream_s *Z;
+   unsigned long BlockSize;
+   unsigned long long iSize;
+   vector<unsigned long long> Blocks;
+   unsigned long long Pos;
+   unsigned char *In;
+   bool AtEnd;
+
+   public:
+
+   // False, without an error, if File isn't an indexed gzip file
+   bool Open(const string &File);
+   bool Read(void *To,unsigned long Size,unsigned long *Actual = 0);
+   bool Seek(unsigned long long To);
+   unsigned long long Tell() const {return Pos;}
+   unsigned long long Size() const {return iSize;}
+   bool IsOpen() const {return Fd >= 0;}
+   void Close();
+
+   static bool IsIndexed(const string &File);
+
+   GzIndexReader();
+   ~GzIndexReader();
+};
+
+#endif
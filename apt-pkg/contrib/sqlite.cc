@@ -82,36 +82,66 @@ bool SqliteQuery::Rewind()
    return (sqlite3_reset(stmt) == SQLITE_OK);
 }
 
-bool SqliteQuery::Get(const string & ColName, string & Val)
+int SqliteQuery::ColIndex(const string & ColName) const
+{
+   map<string,int>::const_iterator I = ColNames.find(ColName);
+   if (I == ColNames.end())
+      return -1;
+   return I->second;
+}
+
+bool SqliteQuery::Get(int Col, string & Val)
 {
-   const char *item = (const char *) sqlite3_column_text(stmt, ColNames[ColName]);
+   if (Col < 0)
+      return false;
+   const char *item = (const char *) sqlite3_column_text(stmt, Col);
    if (item != NULL)
       Val = item;
    return item != NULL;
 }
 
+bool SqliteQuery::Get(int Col, unsigned long & Val)
+{
+   if (Col < 0 || sqlite3_column_type(stmt, Col) == SQLITE_NULL)
+      return false;
+   Val = (unsigned long) sqlite3_column_int64(stmt, Col);
+   return true;
+}
+
+bool SqliteQuery::Get(const string & ColName, string & Val)
+{
+   return Get(ColIndex(ColName), Val);
+}
+
 bool SqliteQuery::Get(const string & ColName, unsigned long & Val)
 {
-   const char *item = (const char *) sqlite3_column_text(stmt, + ColNames[ColName]);
-   if (item != NULL)
-      Val = atol((const char *) item);
-   return item != NULL;
+   return Get(ColIndex(ColName), Val);
 }
 
-string SqliteQuery::GetCol(const string & ColName)
+string SqliteQuery::GetCol(int Col)
 {
    string val = "";
-   Get(ColName, val);
+   Get(Col, val);
    return val;
 }
 
-unsigned long SqliteQuery::GetColI(const string & ColName)
+unsigned long SqliteQuery::GetColI(int Col)
 {
    unsigned long val = 0;
-   Get(ColName, val);
+   Get(Col, val);
    return val;
 }
 
+string SqliteQuery::GetCol(const string & ColName)
+{
+   return GetCol(ColIndex(ColName));
+}
+
+unsigned long SqliteQuery::GetColI(const string & ColName)
+{
+   return GetColI(ColIndex(ColName));
+}
+
 #endif /* WITH_SQLITE3 */
 
 
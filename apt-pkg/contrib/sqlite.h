@@ -25,9 +25,18 @@ class SqliteQuery
    bool Rewind();
    bool Step();
 
+   // Column names are resolved once at prepare time, callers on hot
+   // paths should look up the index with ColIndex() and use the
+   // index based accessors.
+   int ColIndex(const string & ColName) const;
+
+   bool Get(int Col, string & Val);
+   bool Get(int Col, unsigned long & Val);
    bool Get(const string & ColName, string & Val);
    bool Get(const string & ColName, unsigned long & Val);
 
+   string GetCol(int Col);
+   unsigned long GetColI(int Col);
    string GetCol(const string & ColName);
    unsigned long GetColI(const string & ColName);
 
@@ -600,7 +600,8 @@ int StringToBool(string Text,int Default)
    year 2000 complient and timezone neutral */
 string TimeRFC1123(time_t Date)
 {
-   struct tm Conv = *gmtime(&Date);
+   struct tm Conv;
+   gmtime_r(&Date,&Conv);
    char Buf[300];
 
    const char *Day[] = {"Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
@@ -11,8 +11,12 @@
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/version.h>
 #include <apt-pkg/error.h>
+#include <apt-pkg/configuration.h>
 #include <apt-pkg/sptr.h>
 #include <apt-pkg/algorithms.h>
+#include <apt-pkg/resolvetrace.h>
+
+#include <algorithm>
 
 // CNC:2002-07-05
 #include <apt-pkg/pkgsystem.h>
@@ -22,16 +26,23 @@
 #include <apt-pkg/luaiface.h>
 
 #include <apti18n.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
 									/*}}}*/
 
 // DepCache::pkgDepCache - Constructors					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
-                Cache(pCache), PkgState(0), DepState(0)
+                Cache(pCache), PkgState(0), DepState(0), PkgDirty(0),
+		Deferring(false), Lazy(false), PkgLast(0)
 {
    delLocalPolicy = 0;
    LocalPolicy = Plcy;
+   Trace = pkgResolveTrace::Get();
    if (LocalPolicy == 0)
       delLocalPolicy = LocalPolicy = new Policy;
 }
@@ -41,8 +52,15 @@ pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
 /* */
 pkgDepCache::~pkgDepCache()
 {
+   // States still around must not touch us anymore
+   for (vector<State *>::iterator I = Checkpoints.begin();
+	I != Checkpoints.end(); I++)
+      (*I)->Dep = 0;
+
    delete [] PkgState;
    delete [] DepState;
+   delete [] PkgDirty;
+   delete [] PkgLast;
    delete delLocalPolicy;
 }
 									/*}}}*/
@@ -50,13 +68,69 @@ pkgDepCache::~pkgDepCache()
 // ---------------------------------------------------------------------
 /* This allocats the extension buffers and initializes them. */
 bool pkgDepCache::Init(OpProgress *Prog)
+{
+   Allocate();
+   return Build(Prog);
+}
+									/*}}}*/
+// DepCache::InitLazy - Generate the extra structures on demand		/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the buffers are allocated here, see LazyPkg() and Build(). The
+   Scripts::Cache::Init scripts are meant to run when the cache is opened
+   and may look at or mark any package, so with any of them set this is
+   the same as Init(). */
+bool pkgDepCache::InitLazy(OpProgress *Prog)
+{
+// CNC:2003-03-17
+#ifdef APT_WITH_LUA
+   if (_lua->HasScripts("Scripts::Cache::Init") == true)
+      return Init(Prog);
+#endif
+
+   Allocate();
+   Lazy = true;
+   LazyDone.assign(Head().PackageCount,0);
+
+#ifdef APT_WITH_LUA
+   _lua->SetDepCache(this);
+#endif
+
+   return true;
+}
+									/*}}}*/
+// DepCache::Allocate - Allocate the extension buffers			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::Allocate()
 {
    delete [] PkgState;
    delete [] DepState;
+   delete [] PkgDirty;
+   delete [] PkgLast;
    PkgState = new StateCache[Head().PackageCount];
    DepState = new unsigned char[Head().DependsCount];
+   PkgDirty = new unsigned char[Head().PackageCount];
+   PkgLast = new long[Head().PackageCount];
    memset(PkgState,0,sizeof(*PkgState)*Head().PackageCount);
    memset(DepState,0,sizeof(*DepState)*Head().DependsCount);
+   memset(PkgDirty,0,sizeof(*PkgDirty)*Head().PackageCount);
+   for (unsigned long I = 0; I != Head().PackageCount; I++)
+      PkgLast[I] = -1;
+   DirtyPkgs.clear();
+   Lazy = false;
+   LazyDone.clear();
+}
+									/*}}}*/
+// DepCache::Build - Compute the state of everything			/*{{{*/
+// ---------------------------------------------------------------------
+/* After InitLazy() the packages that were already asked for are left as
+   they are, the references handed out for them stay valid. */
+bool pkgDepCache::Build(OpProgress *Prog)
+{
+   vector<unsigned char> Done;
+   Done.swap(LazyDone);
+   Lazy = false;
+   LocalPolicy->Prepare();
 
    if (Prog != 0)
    {
@@ -67,19 +141,21 @@ bool pkgDepCache::Init(OpProgress *Prog)
 
    /* Set the current state of everything. In this state all of the
       packages are kept exactly as is. See AllUpgrade */
-   int Done = 0;
-   for (PkgIterator I = PkgBegin(); I.end() != true; I++,Done++)
+   int Count = 0;
+   for (PkgIterator I = PkgBegin(); I.end() != true; I++,Count++)
    {
       if (Prog != 0)
-	 Prog->Progress(Done);
+	 Prog->Progress(Count);
+      if (Done.empty() == false && (Done[I->ID] & LazyBase) != 0)
+	 continue;
 
       // Find the proper cache slot
       StateCache &State = PkgState[I->ID];
       State.iFlags = 0;
 
       // Figure out the install version
-      State.CandidateVer = GetCandidateVer(I);
-      State.InstallVer = I.CurrentVer();
+      State.CandidateVer = GetCandidateVer(I).Index();
+      State.InstallVer = I->CurrentVer;
       State.Mode = ModeKeep;
 
       State.Update(I,*this);
@@ -170,14 +246,14 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
       if (Type == InstallVersion)
       {
 	 StateCache &State = PkgState[P.OwnerPkg()->ID];
-	 if (State.InstallVer != (Version *)P.OwnerVer())
+	 if (State.InstallVer != P->Version)
 	    continue;
       }
 
       if (Type == CandidateVersion)
       {
 	 StateCache &State = PkgState[P.OwnerPkg()->ID];
-	 if (State.CandidateVer != (Version *)P.OwnerVer())
+	 if (State.CandidateVer != P->Version)
 	    continue;
       }
 
@@ -274,14 +350,14 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
 	 case InstallVersion:
 	    {
 	       StateCache &State = PkgState[P_OwnerPkg->ID];
-	       if (State.InstallVer != (Version *)P.OwnerVer())
+	       if (State.InstallVer != P->Version)
 		  continue;
 	       break;
 	    }
 	 case CandidateVersion:
 	    {
 	       StateCache &State = PkgState[P_OwnerPkg->ID];
-	       if (State.CandidateVer != (Version *)P.OwnerVer())
+	       if (State.CandidateVer != P->Version)
 		  continue;
 	       break;
 	    }
@@ -330,7 +406,7 @@ void pkgDepCache::AddSizes(const PkgIterator &Pkg,signed long Mult)
 
    // Upgrading
    if (Pkg->CurrentVer != 0 &&
-       (P.InstallVer != (Version *)Pkg.CurrentVer() ||
+       (P.InstallVer != Pkg->CurrentVer ||
 	(P.iFlags & ReInstall) == ReInstall) && P.InstallVer != 0)
    {
       iUsrSize += (signed)(Mult*((signed)P.InstVerIter(*this)->InstalledSize -
@@ -419,7 +495,7 @@ void pkgDepCache::BuildGroupOrs(VerIterator const &V)
    for (DepIterator D = V.DependsList(); D.end() != true; D++)
    {
       // Build the dependency state.
-      unsigned char &State = DepState[D->ID];
+      unsigned char State = DepState[D->ID];
 
       /* Invert for Conflicts. We have to do this twice to get the
          right sense for a conflicts group */
@@ -436,6 +512,8 @@ void pkgDepCache::BuildGroupOrs(VerIterator const &V)
       // Invert for Conflicts
       if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
 	 State = ~State;
+
+      SetDepState(D->ID,State);
    }
 }
 									/*}}}*/
@@ -510,7 +588,8 @@ unsigned char pkgDepCache::DependencyState(DepIterator &D)
 // ---------------------------------------------------------------------
 /* This determines the combined dependency representation of a package
    for its two states now and install. This is done by using the pre-generated
-   dependency information. */
+   dependency information. It is also used from the threads of Update() so
+   the caller has to Journal() the package. */
 void pkgDepCache::UpdateVerState(PkgIterator Pkg)
 {
    // Empty deps are always true
@@ -547,6 +626,12 @@ void pkgDepCache::UpdateVerState(PkgIterator Pkg)
    dependencies based on the current policy. */
 void pkgDepCache::Update(OpProgress *Prog)
 {
+   if (Lazy == true)
+   {
+      Build(Prog);
+      return;
+   }
+
    iUsrSize = 0;
    iDownloadSize = 0;
    iDelCount = 0;
@@ -555,37 +640,29 @@ void pkgDepCache::Update(OpProgress *Prog)
    iBrokenCount = 0;
    iBadCount = 0;
 
-   // Perform the depends pass
+   // Everything may change, the threads below can't journal
+   if (Checkpoints.empty() == false)
+      JournalAll();
+
+   // Perform the depends pass, in threads if possible
+   bool Threaded = false;
+#ifdef HAVE_PTHREAD
+   Threaded = UpdateThreaded(Prog);
+#endif
+
+   /* Compute the pacakge size additions and the counters. These only
+      depend on the package itself, so when the depends pass was threaded
+      they are simply summed up here in the usual order. */
    int Done = 0;
    for (PkgIterator I = PkgBegin(); I.end() != true; I++,Done++)
    {
-      if (Prog != 0 && Done%20 == 0)
-	 Prog->Progress(Done);
-      for (VerIterator V = I.VersionList(); V.end() != true; V++)
+      if (Threaded == false)
       {
-	 unsigned char Group = 0;
-
-	 for (DepIterator D = V.DependsList(); D.end() != true; D++)
-	 {
-	    // Build the dependency state.
-	    unsigned char &State = DepState[D->ID];
-	    State = DependencyState(D);
-
-	    // Add to the group if we are within an or..
-	    Group |= State;
-	    State |= Group << 3;
-	    if ((D->CompareOp & Dep::Or) != Dep::Or)
-	       Group = 0;
-
-	    // Invert for Conflicts
-	    if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
-	       State = ~State;
-	 }
+	 if (Prog != 0 && Done%20 == 0)
+	    Prog->Progress(Done);
+	 UpdateDepends(I);
       }
-
-      // Compute the pacakge dependency state and size additions
       AddSizes(I);
-      UpdateVerState(I);
       AddStates(I);
    }
 
@@ -593,27 +670,169 @@ void pkgDepCache::Update(OpProgress *Prog)
       Prog->Progress(Done);
 }
 									/*}}}*/
-// DepCache::Update - Update the deps list of a package	   		/*{{{*/
+// DepCache::UpdateDepends - Compute the dependencies of a package	/*{{{*/
 // ---------------------------------------------------------------------
-/* This is a helper for update that only does the dep portion of the scan.
-   It is mainly ment to scan reverse dependencies. */
-void pkgDepCache::Update(DepIterator D)
+/* Only the dependency states of the package and its own StateCache::DepState
+   are written, everything else is only read. So any number of packages can
+   be done at once. */
+void pkgDepCache::UpdateDepends(PkgIterator const &Pkg)
 {
-   // Update the reverse deps
-   for (;D.end() != true; D++)
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; V++)
    {
-      unsigned char &State = DepState[D->ID];
-      State = DependencyState(D);
+      unsigned char Group = 0;
 
-      // Invert for Conflicts
-      if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
-	 State = ~State;
+      for (DepIterator D = V.DependsList(); D.end() != true; D++)
+      {
+	 // Build the dependency state.
+	 unsigned char &State = DepState[D->ID];
+	 State = DependencyState(D);
+
+	 // Add to the group if we are within an or..
+	 Group |= State;
+	 State |= Group << 3;
+	 if ((D->CompareOp & Dep::Or) != Dep::Or)
+	    Group = 0;
+
+	 // Invert for Conflicts
+	 if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
+	    State = ~State;
+      }
+   }
+
+   UpdateVerState(Pkg);
+}
+									/*}}}*/
+// DepCache::LazyBasePkg - The starting state of a single package	/*{{{*/
+// ---------------------------------------------------------------------
+/* This is what Build() does for each package. */
+void pkgDepCache::LazyBasePkg(PkgIterator const &Pkg)
+{
+   if ((LazyDone[Pkg->ID] & LazyBase) != 0)
+      return;
+   LazyDone[Pkg->ID] |= LazyBase;
 
-      RemoveStates(D.ParentPkg());
-      BuildGroupOrs(D.ParentVer());
-      UpdateVerState(D.ParentPkg());
-      AddStates(D.ParentPkg());
+   StateCache &State = PkgState[Pkg->ID];
+   State.iFlags = 0;
+   State.CandidateVer = GetCandidateVer(Pkg).Index();
+   State.InstallVer = Pkg->CurrentVer;
+   State.Mode = ModeKeep;
+   State.Update(Pkg,*this);
+}
+									/*}}}*/
+// DepCache::LazyPkg - Compute a single package on first access		/*{{{*/
+// ---------------------------------------------------------------------
+/* The dependencies of its versions look at the targets and at the owners
+   of their provides, so those get their starting state first. Nothing is
+   marked before Build() runs, so this is the same as the full pass. */
+void pkgDepCache::LazyPkg(PkgIterator const &Pkg)
+{
+   if ((LazyDone[Pkg->ID] & LazyDeps) != 0)
+      return;
+   LazyDone[Pkg->ID] |= LazyDeps;
+
+   LazyBasePkg(Pkg);
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; V++)
+   {
+      for (DepIterator D = V.DependsList(); D.end() != true; D++)
+      {
+	 PkgIterator Target = D.TargetPkg();
+	 LazyBasePkg(Target);
+	 for (PrvIterator P = Target.ProvidesList(); P.end() != true; P++)
+	    LazyBasePkg(P.OwnerPkg());
+      }
    }
+   UpdateDepends(Pkg);
+}
+									/*}}}*/
+#ifdef HAVE_PTHREAD
+// DepCache::UpdateThreaded - Run the depends pass in threads		/*{{{*/
+// ---------------------------------------------------------------------
+/* The packages are handed out in chunks of consecutive ones, the calling
+   thread takes its share and also reports the progress. This is only
+   done when the versioning system allows for it and there is enough to
+   do, APT::Cache::Update-Threads sets the number of threads, by default
+   one for each processor. */
+struct pkgDepCache::UpdateJob
+{
+   pkgDepCache *Cache;
+   pthread_mutex_t Lock;
+   vector<pkgCache::Package *> Pkgs;
+   vector<pkgCache::Package *>::size_type Next;
+   pthread_t Main;
+   OpProgress *Prog;
+};
+
+static const unsigned long UpdateChunk = 256;
+
+void *pkgDepCache::UpdateThread(void *Arg)
+{
+   UpdateJob *Job = (UpdateJob *)Arg;
+   bool Main = pthread_equal(pthread_self(),Job->Main);
+   while (true)
+   {
+      pthread_mutex_lock(&Job->Lock);
+      vector<pkgCache::Package *>::size_type Start = Job->Next;
+      if (Job->Next < Job->Pkgs.size())
+	 Job->Next = std::min(Job->Next + UpdateChunk,Job->Pkgs.size());
+      vector<pkgCache::Package *>::size_type Stop = Job->Next;
+      pthread_mutex_unlock(&Job->Lock);
+      if (Start == Stop)
+	 break;
+
+      if (Main == true && Job->Prog != 0)
+	 Job->Prog->Progress(Start);
+      for (; Start != Stop; Start++)
+	 Job->Cache->UpdateDepends(PkgIterator(*Job->Cache->Cache,
+					       Job->Pkgs[Start]));
+   }
+   return 0;
+}
+
+bool pkgDepCache::UpdateThreaded(OpProgress *Prog)
+{
+   long Threads = _config->FindI("APT::Cache::Update-Threads",0);
+   if (Threads <= 0)
+      Threads = sysconf(_SC_NPROCESSORS_ONLN);
+   if ((unsigned long)Threads > Head().PackageCount/UpdateChunk)
+      Threads = Head().PackageCount/UpdateChunk;
+   if (Threads < 2 || VS().ThreadSafeCheckDep() == false)
+      return false;
+
+   UpdateJob Job;
+   Job.Cache = this;
+   Job.Pkgs.reserve(Head().PackageCount);
+   for (PkgIterator I = PkgBegin(); I.end() != true; I++)
+      Job.Pkgs.push_back(I);
+   Job.Next = 0;
+   Job.Main = pthread_self();
+   Job.Prog = Prog;
+   pthread_mutex_init(&Job.Lock,0);
+
+   // Whatever threads can't be started the ones that could make up for
+   vector<pthread_t> Tids;
+   for (long I = 1; I < Threads; I++)
+   {
+      pthread_t Tid;
+      if (pthread_create(&Tid,0,UpdateThread,&Job) != 0)
+	 break;
+      Tids.push_back(Tid);
+   }
+   UpdateThread(&Job);
+   for (vector<pthread_t>::iterator I = Tids.begin(); I != Tids.end(); I++)
+      pthread_join(*I,0);
+   pthread_mutex_destroy(&Job.Lock);
+   return true;
+}
+									/*}}}*/
+#endif
+// DepCache::Update - Update the deps list of a package	   		/*{{{*/
+// ---------------------------------------------------------------------
+/* This is a helper for update that only does the dep portion of the scan.
+   It is mainly ment to scan reverse dependencies. */
+void pkgDepCache::Update(DepIterator D)
+{
+   DirtyDepends(D);
+   UpdateDirty();
 }
 									/*}}}*/
 // DepCache::Update - Update the related deps of a package		/*{{{*/
@@ -621,28 +840,103 @@ void pkgDepCache::Update(DepIterator D)
 /* This is called whenever the state of a package changes. It updates
    all cached dependencies related to this package. */
 void pkgDepCache::Update(PkgIterator const &Pkg)
+{
+   // MarkList() does them all at once when it is done marking
+   if (Deferring == true)
+   {
+      DeferredPkgs.push_back(Pkg.Index());
+      return;
+   }
+
+   DirtyPackage(Pkg);
+   UpdateDirty();
+}
+									/*}}}*/
+// DepCache::DirtyPackage - Recompute a package and queue its related deps/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::DirtyPackage(PkgIterator const &Pkg)
 {
    // Recompute the dep of the package
+   Journal(Pkg);
    RemoveStates(Pkg);
    UpdateVerState(Pkg);
    AddStates(Pkg);
 
    // Update the reverse deps
-   Update(Pkg.RevDependsList());
+   DirtyDepends(Pkg.RevDependsList());
 
    // Update the provides map for the current ver
    if (Pkg->CurrentVer != 0)
-      for (PrvIterator P = Pkg.CurrentVer().ProvidesList();
-	   P.end() != true; P++)
-	 Update(P.ParentPkg().RevDependsList());
+      DirtyProvides(Pkg.CurrentVer());
 
    // Update the provides map for the candidate ver
    if (PkgState[Pkg->ID].CandidateVer != 0)
-      for (PrvIterator P = PkgState[Pkg->ID].CandidateVerIter(*this).ProvidesList();
-	   P.end() != true; P++)
-	 Update(P.ParentPkg().RevDependsList());
+      DirtyProvides(PkgState[Pkg->ID].CandidateVerIter(*this));
 }
+									/*}}}*/
+// DepCache::DirtyDepends - Recompute a list of deps			/*{{{*/
+// ---------------------------------------------------------------------
+/* The result of a dependency only depends on the versions the packages
+   are at or going to, so it is recomputed right away. The package owning
+   it is only queued for UpdateDirty() if the result really changed,
+   which for most reverse dependencies of a popular package it does not. */
+void pkgDepCache::DirtyDepends(DepIterator D)
+{
+   for (;D.end() != true; D++)
+   {
+      unsigned char State = DepState[D->ID];
+      unsigned char New = DependencyState(D);
+
+      // Invert for Conflicts
+      if (D->Type == Dep::Conflicts || D->Type == Dep::Obsoletes)
+	 New = ~New;
+
+      // The or group bits are rebuilt from these by UpdateDirty()
+      if (((State ^ New) & 0x7) == 0)
+	 continue;
+      SetDepState(D->ID,New);
 
+      PkgIterator Pkg = D.ParentPkg();
+      if (PkgDirty[Pkg->ID] == 0)
+      {
+	 PkgDirty[Pkg->ID] = 1;
+	 DirtyPkgs.push_back(Pkg.Index());
+      }
+   }
+}
+									/*}}}*/
+// DepCache::DirtyProvides - Recompute the deps on what a version provides/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::DirtyProvides(VerIterator const &Ver)
+{
+   for (PrvIterator P = Ver.ProvidesList(); P.end() != true; P++)
+      DirtyDepends(P.ParentPkg().RevDependsList());
+}
+									/*}}}*/
+// DepCache::UpdateDirty - Recompute the state of the queued packages	/*{{{*/
+// ---------------------------------------------------------------------
+/* Each package is done once no matter how many of its dependencies
+   changed. The or groups of all its versions are rebuilt, which leaves
+   the ones with nothing changed as they were. */
+void pkgDepCache::UpdateDirty()
+{
+   for (vector<unsigned long>::const_iterator I = DirtyPkgs.begin();
+	I != DirtyPkgs.end(); I++)
+   {
+      PkgIterator Pkg(*Cache,Cache->PkgP + *I);
+      PkgDirty[Pkg->ID] = 0;
+
+      Journal(Pkg);
+      RemoveStates(Pkg);
+      for (VerIterator V = Pkg.VersionList(); V.end() != true; V++)
+	 BuildGroupOrs(V);
+      UpdateVerState(Pkg);
+      AddStates(Pkg);
+   }
+   DirtyPkgs.clear();
+}
 									/*}}}*/
 
 // DepCache::MarkKeep - Put the package in the keep state		/*{{{*/
@@ -650,6 +944,8 @@ void pkgDepCache::Update(PkgIterator const &Pkg)
 /* */
 void pkgDepCache::MarkKeep(PkgIterator const &Pkg,bool Soft)
 {
+   NeedAll();
+
    // Simplifies other routines.
    if (Pkg.end() == true)
       return;
@@ -663,6 +959,7 @@ void pkgDepCache::MarkKeep(PkgIterator const &Pkg,bool Soft)
    /* We changed the soft state all the time so the UI is a bit nicer
       to use */
    StateCache &P = PkgState[Pkg->ID];
+   Journal(Pkg);
    if (Soft == true)
       P.iFlags |= AutoKept;
    else
@@ -684,7 +981,7 @@ void pkgDepCache::MarkKeep(PkgIterator const &Pkg,bool Soft)
    if (Pkg->CurrentVer == 0)
       P.InstallVer = 0;
    else
-      P.InstallVer = Pkg.CurrentVer();
+      P.InstallVer = Pkg->CurrentVer;
 
    AddStates(Pkg);
 
@@ -698,12 +995,15 @@ void pkgDepCache::MarkKeep(PkgIterator const &Pkg,bool Soft)
 /* */
 void pkgDepCache::MarkDelete(PkgIterator const &Pkg, bool rPurge)
 {
+   NeedAll();
+
    // Simplifies other routines.
    if (Pkg.end() == true)
       return;
 
    // Check that it is not already marked for delete
    StateCache &P = PkgState[Pkg->ID];
+   Journal(Pkg);
    P.iFlags &= ~(AutoKept | Purge);
    if (rPurge == true)
       P.iFlags |= Purge;
@@ -737,6 +1037,11 @@ void pkgDepCache::MarkDelete(PkgIterator const &Pkg, bool rPurge)
 void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
 			      unsigned long Depth)
 {
+   NeedAll();
+
+   if (Trace != 0 && Pkg.end() == false)
+      Trace->MarkInstall(Pkg,AutoInst,Depth);
+
    if (Depth > 100)
       return;
 
@@ -747,11 +1052,12 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
    /* Check that it is not already marked for install and that it can be
       installed */
    StateCache &P = PkgState[Pkg->ID];
+   Journal(Pkg);
    P.iFlags &= ~AutoKept;
    if (P.InstBroken() == false && (P.Mode == ModeInstall ||
-	P.CandidateVer == (Version *)Pkg.CurrentVer()))
+	P.CandidateVer == Pkg->CurrentVer))
    {
-      if (P.CandidateVer == (Version *)Pkg.CurrentVer() && P.InstallVer == 0)
+      if (P.CandidateVer == Pkg->CurrentVer && P.InstallVer == 0)
 	 MarkKeep(Pkg);
       return;
    }
@@ -773,7 +1079,7 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
    P.Mode = ModeInstall;
    P.InstallVer = P.CandidateVer;
    P.Flags &= ~Flag::Auto;
-   if (P.CandidateVer == (Version *)Pkg.CurrentVer())
+   if (P.CandidateVer == Pkg->CurrentVer)
       P.Mode = ModeKeep;
 
    AddStates(Pkg);
@@ -837,7 +1143,7 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
 	 for (; *Cur != 0 && (*Cur)->ParentPkg == P.Index(); Cur++)
 	 {
 	    PkgIterator Pkg(*Cache,Cache->PkgP + (*Cur)->ParentPkg);
-	    if (PkgState[Pkg->ID].CandidateVer != *Cur)
+	    if (Cache->VerP + PkgState[Pkg->ID].CandidateVer != *Cur)
 	       continue;
 	    InstPkg = Pkg;
 	    break;
@@ -850,7 +1156,7 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
 	    for (; *Cur != 0; Cur++)
 	    {
 	       PkgIterator Pkg(*Cache,Cache->PkgP + (*Cur)->ParentPkg);
-	       if (PkgState[Pkg->ID].CandidateVer != *Cur)
+	       if (Cache->VerP + PkgState[Pkg->ID].CandidateVer != *Cur)
 		  continue;
 	       InstPkg = Pkg;
 	       break;
@@ -863,7 +1169,10 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
 
 	    // Set the autoflag, after MarkInstall because MarkInstall unsets it
 	    if (P->CurrentVer == 0)
+	    {
+	       Journal(InstPkg);
 	       PkgState[InstPkg->ID].Flags |= Flag::Auto;
+	    }
 	 }
 
 	 continue;
@@ -879,6 +1188,7 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
 	    PkgIterator Pkg = Ver.ParentPkg();
 
 	    MarkDelete(Pkg);
+	    Journal(Pkg);
 	    PkgState[Pkg->ID].Flags |= Flag::Auto;
 	 }
 	 continue;
@@ -886,15 +1196,60 @@ void pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
    }
 }
 									/*}}}*/
+// DepCache::MarkList - Mark a whole selection at once			/*{{{*/
+// ---------------------------------------------------------------------
+/* Marking a large selection one package at a time redoes the reverse
+   dependencies shared by the selection for every package of it, and
+   auto installs dependencies that other selected packages would have
+   satisfied. Here the selection is first marked with the dependency
+   updates held back, then everything touched is updated once, and only
+   the selected packages still broken after that have their dependencies
+   auto installed, in the order given. Removals are marked before the
+   installs, so a package in both lists gets installed. */
+void pkgDepCache::MarkList(vector<PkgIterator> const &Install,
+			   vector<PkgIterator> const &Remove,bool AutoInst)
+{
+   NeedAll();
+
+   Deferring = true;
+   for (vector<PkgIterator>::const_iterator I = Remove.begin();
+	I != Remove.end(); I++)
+      MarkDelete(*I);
+   for (vector<PkgIterator>::const_iterator I = Install.begin();
+	I != Install.end(); I++)
+      MarkInstall(*I,false);
+   Deferring = false;
+
+   // The one consolidated update
+   std::sort(DeferredPkgs.begin(),DeferredPkgs.end());
+   DeferredPkgs.erase(std::unique(DeferredPkgs.begin(),DeferredPkgs.end()),
+		      DeferredPkgs.end());
+   for (vector<unsigned long>::const_iterator I = DeferredPkgs.begin();
+	I != DeferredPkgs.end(); I++)
+      DirtyPackage(PkgIterator(*Cache,Cache->PkgP + *I));
+   DeferredPkgs.clear();
+   UpdateDirty();
+
+   if (AutoInst == false)
+      return;
+   for (vector<PkgIterator>::const_iterator I = Install.begin();
+	I != Install.end(); I++)
+      if (PkgState[(*I)->ID].InstBroken() == true)
+	 MarkInstall(*I,true);
+}
+									/*}}}*/
 // DepCache::SetReInstall - Set the reinstallation flag			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
 {
+   NeedAll();
+
    RemoveSizes(Pkg);
    RemoveStates(Pkg);
 
    StateCache &P = PkgState[Pkg->ID];
+   Journal(Pkg);
    if (To == true)
       P.iFlags |= ReInstall;
    else
@@ -909,18 +1264,26 @@ void pkgDepCache::SetReInstall(PkgIterator const &Pkg,bool To)
 /* */
 void pkgDepCache::SetCandidateVersion(VerIterator TargetVer)
 {
+   NeedAll();
+
    pkgCache::PkgIterator Pkg = TargetVer.ParentPkg();
    StateCache &P = PkgState[Pkg->ID];
+   VerIterator OldCand = P.CandidateVerIter(*this);
 
    RemoveSizes(Pkg);
    RemoveStates(Pkg);
+   Journal(Pkg);
 
    if (P.CandidateVer == P.InstallVer)
-      P.InstallVer = (Version *)TargetVer;
-   P.CandidateVer = (Version *)TargetVer;
+      P.InstallVer = TargetVer.Index();
+   P.CandidateVer = TargetVer.Index();
    P.Update(Pkg,*this);
 
    AddStates(Pkg);
+
+   // What relied on the provides of the old candidate needs a look too
+   if (OldCand.end() == false)
+      DirtyProvides(OldCand);
    Update(Pkg);
    AddSizes(Pkg);
 }
@@ -930,30 +1293,33 @@ void pkgDepCache::SetCandidateVersion(VerIterator TargetVer)
 /* This is called whenever the Candidate version changes. */
 void pkgDepCache::StateCache::Update(PkgIterator Pkg,pkgCache &Cache)
 {
-   // Some info
-   VerIterator Ver = CandidateVerIter(Cache);
-
-   // Use a null string or the version string
-   if (Ver.end() == true)
-      CandVersion = "";
-   else
-      CandVersion = Ver.VerStr();
-
-   // Find the current version
-   CurVersion = "";
-   if (Pkg->CurrentVer != 0)
-      CurVersion = Pkg.CurrentVer().VerStr();
-
-   // Strip off the epochs for display
-   CurVersion = StripEpoch(CurVersion);
-   CandVersion = StripEpoch(CandVersion);
-
    // Figure out if its up or down or equal
-   Status = Ver.CompareVer(Pkg.CurrentVer());
+   Status = CandidateVerIter(Cache).CompareVer(Pkg.CurrentVer());
    if (Pkg->CurrentVer == 0 || Pkg->VersionList == 0 || CandidateVer == 0)
      Status = 2;
 }
 									/*}}}*/
+// StateCache::CandVersion - Candidate version string for display	/*{{{*/
+// ---------------------------------------------------------------------
+/* The version strings are not kept around, they are simply looked up
+   again when something shows them. */
+const char *pkgDepCache::StateCache::CandVersion(pkgCache &Cache) const
+{
+   if (CandidateVer == 0)
+      return "";
+   return StripEpoch(CandidateVerIter(Cache).VerStr());
+}
+									/*}}}*/
+// StateCache::CurVersion - Current version string for display		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+const char *pkgDepCache::StateCache::CurVersion(PkgIterator const &Pkg) const
+{
+   if (Pkg->CurrentVer == 0)
+      return "";
+   return StripEpoch(Pkg.CurrentVer().VerStr());
+}
+									/*}}}*/
 // StateCache::StripEpoch - Remove the epoch specifier from the version	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -1019,37 +1385,93 @@ bool pkgDepCache::Policy::IsImportantDep(DepIterator Dep)
 }
 									/*}}}*/
 
+// DepCache::JournalPkg - Record the state of a package			/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the first change after the newest State was taken is recorded,
+   that is the state it has to go back to. */
+void pkgDepCache::JournalPkg(unsigned long ID)
+{
+   long Last = PkgLast[ID];
+   if (Last >= 0 && (unsigned long)Last >= Checkpoints.back()->PkgMark)
+      return;
+
+   PkgUndo Undo;
+   Undo.State = PkgState[ID];
+   Undo.ID = ID;
+   Undo.Prev = Last;
+   PkgJournal.push_back(Undo);
+   PkgLast[ID] = PkgJournal.size() - 1;
+}
+									/*}}}*/
+// DepCache::JournalAll - Record the state of everything		/*{{{*/
+// ---------------------------------------------------------------------
+/* For the full Update(), which doesn't go through the small steps. */
+void pkgDepCache::JournalAll()
+{
+   for (unsigned long I = 0; I != Head().PackageCount; I++)
+      JournalPkg(I);
+   DepJournal.reserve(DepJournal.size() + Head().DependsCount);
+   for (unsigned long I = 0; I != Head().DependsCount; I++)
+      DepJournal.push_back(pair<unsigned long,unsigned char>(I,DepState[I]));
+}
+									/*}}}*/
+// DepCache::Undo - Roll the journal back to the given marks		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::Undo(unsigned long PkgMark,unsigned long DepMark)
+{
+   while (PkgJournal.size() > PkgMark)
+   {
+      PkgUndo &Undo = PkgJournal.back();
+      PkgState[Undo.ID] = Undo.State;
+      PkgLast[Undo.ID] = Undo.Prev;
+      PkgJournal.pop_back();
+   }
+   while (DepJournal.size() > DepMark)
+   {
+      DepState[DepJournal.back().first] = DepJournal.back().second;
+      DepJournal.pop_back();
+   }
+}
+									/*}}}*/
+
 // CNC:2003-02-24
 // pkgDepCache::State::* - Routines to work on the state of a DepCache.	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 void pkgDepCache::State::Copy(pkgDepCache::State const &Other)
 {
-   memcpy(this, &Other, sizeof(*this));
-   int Size = Dep->Head().PackageCount;
-   int DepSize = Dep->Head().DependsCount;
-   PkgState = new StateCache[Size];
-   PkgIgnore = new bool[Size];
-   DepState = new unsigned char[DepSize];
-   memcpy(PkgState, Other.PkgState, Size*sizeof(*PkgState));
-   memcpy(PkgIgnore, Other.PkgIgnore, Size*sizeof(*PkgIgnore));
-   memcpy(DepState, Other.DepState, DepSize*sizeof(*DepState));
+   // The copy stands for the same point, right after the original
+   Dep = Other.Dep;
+   PkgMark = Other.PkgMark;
+   DepMark = Other.DepMark;
+   iUsrSize = Other.iUsrSize;
+   iDownloadSize = Other.iDownloadSize;
+   iInstCount = Other.iInstCount;
+   iDelCount = Other.iDelCount;
+   iKeepCount = Other.iKeepCount;
+   iBrokenCount = Other.iBrokenCount;
+   iBadCount = Other.iBadCount;
+   PkgIgnore = Other.PkgIgnore;
+   if (Dep == 0)
+      return;
+
+   vector<State *> &Checks = Dep->Checkpoints;
+   vector<State *>::iterator I = Checks.begin();
+   for (; I != Checks.end() && *I != &Other; I++);
+   if (I != Checks.end())
+      I++;
+   Checks.insert(I,this);
 }
 
 void pkgDepCache::State::Save(pkgDepCache *dep)
 {
+   Release();
    Dep = dep;
-   delete[] PkgState;
-   delete[] DepState;
-   delete[] PkgIgnore;
-   int Size = Dep->Head().PackageCount;
-   int DepSize = Dep->Head().DependsCount;
-   PkgState = new StateCache[Size];
-   PkgIgnore = new bool[Size];
-   DepState = new unsigned char[DepSize];
-   memcpy(PkgState, Dep->PkgState, Size*sizeof(*PkgState));
-   memset(PkgIgnore, 0, Size*sizeof(*PkgIgnore));
-   memcpy(DepState, Dep->DepState, DepSize*sizeof(*DepState));
+   Dep->NeedAll();
+   PkgMark = Dep->PkgJournal.size();
+   DepMark = Dep->DepJournal.size();
+   PkgIgnore.clear();
    iUsrSize = Dep->iUsrSize;
    iDownloadSize= Dep->iDownloadSize;
    iInstCount = Dep->iInstCount;
@@ -1057,12 +1479,15 @@ void pkgDepCache::State::Save(pkgDepCache *dep)
    iKeepCount = Dep->iKeepCount;
    iBrokenCount = Dep->iBrokenCount;
    iBadCount = Dep->iBadCount;
+   Dep->Checkpoints.push_back(this);
 }
 
 void pkgDepCache::State::Restore()
 {
-   memcpy(Dep->PkgState, PkgState, Dep->Head().PackageCount*sizeof(*PkgState));
-   memcpy(Dep->DepState, DepState, Dep->Head().DependsCount*sizeof(*DepState));
+   if (Dep == 0)
+      return;
+
+   Dep->Undo(PkgMark,DepMark);
    Dep->iUsrSize = iUsrSize;
    Dep->iDownloadSize= iDownloadSize;
    Dep->iInstCount = iInstCount;
@@ -1070,26 +1495,97 @@ void pkgDepCache::State::Restore()
    Dep->iKeepCount = iKeepCount;
    Dep->iBrokenCount = iBrokenCount;
    Dep->iBadCount = iBadCount;
+
+   // States taken after this one now stand for the same point
+   vector<State *> &Checks = Dep->Checkpoints;
+   for (vector<State *>::iterator I = Checks.begin(); I != Checks.end(); I++)
+   {
+      if ((*I)->PkgMark < PkgMark || *I == this)
+	 continue;
+      (*I)->PkgMark = PkgMark;
+      (*I)->DepMark = DepMark;
+      (*I)->iUsrSize = iUsrSize;
+      (*I)->iDownloadSize = iDownloadSize;
+      (*I)->iInstCount = iInstCount;
+      (*I)->iDelCount = iDelCount;
+      (*I)->iKeepCount = iKeepCount;
+      (*I)->iBrokenCount = iBrokenCount;
+      (*I)->iBadCount = iBadCount;
+   }
+}
+
+/* The oldest record of a package after the mark holds its state at the
+   time the State was taken, if there is none it didn't change since.
+   It is returned by value, a reference into the journal would dangle as
+   soon as the next change grows it. */
+pkgDepCache::StateCache pkgDepCache::State::operator [](PkgIterator const &I) const
+{
+   long Found = -1;
+   for (long E = Dep->PkgLast[I->ID]; E >= 0 && (unsigned long)E >= PkgMark;
+	E = Dep->PkgJournal[E].Prev)
+      Found = E;
+   if (Found < 0)
+      return Dep->PkgState[I->ID];
+   return Dep->PkgJournal[Found].State;
 }
 
 bool pkgDepCache::State::Changed()
 {
-   int Size = Dep->Head().PackageCount;
+   if (Dep == 0)
+      return false;
+
    StateCache *NewPkgState = Dep->PkgState;
-   for (int i = 0; i != Size; i++) {
-      if (PkgIgnore[i] == false &&
-          ((PkgState[i].Status != NewPkgState[i].Status) ||
-          (PkgState[i].Mode != NewPkgState[i].Mode)))
+   vector<PkgUndo> &Journal = Dep->PkgJournal;
+   for (unsigned long I = PkgMark; I < Journal.size(); I++)
+   {
+      PkgUndo &Old = Journal[I];
+      if (Old.Prev >= 0 && (unsigned long)Old.Prev >= PkgMark)
+	 continue;
+      if (PkgIgnore.find(Old.ID) == PkgIgnore.end() &&
+          ((Old.State.Status != NewPkgState[Old.ID].Status) ||
+          (Old.State.Mode != NewPkgState[Old.ID].Mode)))
          return true;
    }
    return false;
 }
 
-void pkgDepCache::State::UnIgnoreAll()
+void pkgDepCache::State::Touched(vector<unsigned long> &IDs)
 {
-   memset(PkgIgnore, 0, Dep->Head().PackageCount*sizeof(*PkgIgnore));
+   if (Dep == 0)
+      return;
+
+   vector<PkgUndo> &Journal = Dep->PkgJournal;
+   for (unsigned long I = PkgMark; I < Journal.size(); I++)
+      if (Journal[I].Prev < 0 || (unsigned long)Journal[I].Prev < PkgMark)
+	 IDs.push_back(Journal[I].ID);
 }
 
+/* Once no State is left the journal is dropped. */
+void pkgDepCache::State::Release()
+{
+   if (Dep == 0)
+      return;
+
+   vector<State *> &Checks = Dep->Checkpoints;
+   for (vector<State *>::iterator I = Checks.begin(); I != Checks.end(); I++)
+   {
+      if (*I == this)
+      {
+	 Checks.erase(I);
+	 break;
+      }
+   }
+
+   if (Checks.empty() == true)
+   {
+      for (vector<PkgUndo>::iterator I = Dep->PkgJournal.begin();
+	   I != Dep->PkgJournal.end(); I++)
+	 Dep->PkgLast[I->ID] = -1;
+      Dep->PkgJournal.clear();
+      Dep->DepJournal.clear();
+   }
+   Dep = 0;
+}
 									/*}}}*/
 
 // vim:sts=3:sw=3
@@ -33,6 +33,13 @@
 
    The Candidate version is what is shown the 'Install Version' field.
 
+   InitLazy() is for users that mostly look at the cache. Nothing is
+   computed up front then; the state of a package, and of the dependencies
+   of its versions, is worked out when it is first asked for. The first
+   Mark*() call, count query or State brings everything up to date just
+   like Init() would have. When Scripts::Cache::Init scripts are set they
+   are run on opening as before, on a cache built like Init() does.
+
    ##################################################################### */
 									/*}}}*/
 #ifndef PKGLIB_DEPCACHE_H
@@ -41,10 +48,24 @@
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/progress.h>
 
+#include <vector>
+#include <set>
+#include <utility>
+
+class pkgResolveTrace;
+
+using std::vector;
+using std::set;
+using std::pair;
+
 class pkgDepCache : protected pkgCache::Namespace
 {
    public:
 
+   // CNC:2003-02-23 - See below.
+   class State;
+   friend class State;
+
    // These flags are used in DepState
    enum DepFlags {DepNow = (1 << 0),DepInstall = (1 << 1),DepCVer = (1 << 2),
                   DepGNow = (1 << 3),DepGInstall = (1 << 4),DepGCVer = (1 << 5)};
@@ -61,15 +82,10 @@ class pkgDepCache : protected pkgCache::Namespace
    enum ModeList {ModeDelete = 0, ModeKeep = 1, ModeInstall = 2};
    struct StateCache
    {
-      // Epoch stripped text versions of the two version fields
-      const char *CandVersion;
-      const char *CurVersion;
-
-      // Pointer to the candidate install version.
-      Version *CandidateVer;
-
-      // Pointer to the install version.
-      Version *InstallVer;
+      /* Candidate and install versions as offsets into the version
+         table, like the ones in the cache itself, 0 if there is none */
+      map_ptrloc CandidateVer;
+      map_ptrloc InstallVer;
 
       // Copy of Package::Flags
       unsigned short Flags;
@@ -81,9 +97,13 @@ class pkgDepCache : protected pkgCache::Namespace
       unsigned char DepState;          // DepState Flags
 
       // Update of candidate version
-      const char *StripEpoch(const char *Ver);
+      static const char *StripEpoch(const char *Ver);
       void Update(PkgIterator Pkg,pkgCache &Cache);
 
+      // Epoch stripped text versions of the two version fields
+      const char *CandVersion(pkgCache &Cache) const;
+      const char *CurVersion(PkgIterator const &Pkg) const;
+
       // Various test members for the current status of the package
       inline bool NewInstall() const {return Status == 2 && Mode == ModeInstall;}
       inline bool Delete() const {return Mode == ModeDelete;}
@@ -95,10 +115,10 @@ class pkgDepCache : protected pkgCache::Namespace
       inline bool NowBroken() const {return (DepState & DepNowMin) != DepNowMin;}
       inline bool InstBroken() const {return (DepState & DepInstMin) != DepInstMin;}
       inline bool Install() const {return Mode == ModeInstall;}
-      inline VerIterator InstVerIter(pkgCache &Cache)
-                {return VerIterator(Cache,InstallVer);}
-      inline VerIterator CandidateVerIter(pkgCache &Cache)
-                {return VerIterator(Cache,CandidateVer);}
+      inline VerIterator InstVerIter(pkgCache &Cache) const
+                {return VerIterator(Cache,Cache.VerP + InstallVer);}
+      inline VerIterator CandidateVerIter(pkgCache &Cache) const
+                {return VerIterator(Cache,Cache.VerP + CandidateVer);}
    };
 
    // Helper functions
@@ -112,6 +132,8 @@ class pkgDepCache : protected pkgCache::Namespace
 
       virtual VerIterator GetCandidateVer(PkgIterator Pkg);
       virtual bool IsImportantDep(DepIterator Dep);
+      // Every package is about to be asked for
+      virtual void Prepare() {}
       // CNC:2003-03-05 - We need access to the priority in pkgDistUpgrade
       //		  while checking for obsoleting packages.
       virtual signed short GetPkgPriority(pkgCache::PkgIterator const &Pkg)
@@ -127,6 +149,51 @@ class pkgDepCache : protected pkgCache::Namespace
    StateCache *PkgState;
    unsigned char *DepState;
 
+   // Packages waiting for UpdateDirty()
+   unsigned char *PkgDirty;
+   vector<unsigned long> DirtyPkgs;
+
+   // Packages changed while MarkList() holds back Update()
+   bool Deferring;
+   vector<unsigned long> DeferredPkgs;
+
+   // Only what was asked for is computed, see InitLazy()
+   enum LazyFlags {LazyBase = (1 << 0), LazyDeps = (1 << 1)};
+   bool Lazy;
+   vector<unsigned char> LazyDone;
+   void LazyBasePkg(PkgIterator const &Pkg);
+   void LazyPkg(PkgIterator const &Pkg);
+   inline void NeedAll() {if (Lazy == true) Build(0);}
+
+   /* Undo journal for the State objects watching the cache. Old package
+      states are recorded once per State, Prev chains the older records of
+      the same package. */
+   struct PkgUndo
+   {
+      StateCache State;
+      unsigned long ID;
+      long Prev;
+   };
+   vector<PkgUndo> PkgJournal;
+   vector<pair<unsigned long,unsigned char> > DepJournal;
+   long *PkgLast;                    // Newest record of each package, or -1
+   vector<State *> Checkpoints;      // In the order they were taken
+
+   // Call before changing the state of a package
+   inline void Journal(PkgIterator const &Pkg)
+      {if (Checkpoints.empty() == false) JournalPkg(Pkg->ID);}
+   void JournalPkg(unsigned long ID);
+   void JournalAll();
+   inline void SetDepState(unsigned long ID,unsigned char Value)
+   {
+      if (DepState[ID] == Value)
+	 return;
+      if (Checkpoints.empty() == false)
+	 DepJournal.push_back(pair<unsigned long,unsigned char>(ID,DepState[ID]));
+      DepState[ID] = Value;
+   }
+   void Undo(unsigned long PkgMark,unsigned long DepMark);
+
    double iUsrSize;
    double iDownloadSize;
    unsigned long iInstCount;
@@ -137,6 +204,7 @@ class pkgDepCache : protected pkgCache::Namespace
 
    Policy *delLocalPolicy;           // For memory clean up..
    Policy *LocalPolicy;
+   pkgResolveTrace *Trace;           // 0 unless tracing
 
    // Check for a matching provides
    bool CheckDep(DepIterator Dep,int Type,PkgIterator &Res);
@@ -156,17 +224,30 @@ class pkgDepCache : protected pkgCache::Namespace
    void Update(DepIterator Dep);           // Mostly internal
    void Update(PkgIterator const &P);
 
+   // Dependency states of the versions of a package, and the package
+   void UpdateDepends(PkgIterator const &Pkg);
+
+   // The depends pass of the full Update() shared among threads
+   struct UpdateJob;
+   static void *UpdateThread(void *Arg);
+   bool UpdateThreaded(OpProgress *Prog);
+
+   // Incremental propagation, only what really changed gets recomputed
+   void DirtyDepends(DepIterator D);
+   void DirtyProvides(VerIterator const &Ver);
+   void DirtyPackage(PkgIterator const &Pkg);
+   void UpdateDirty();
+
    // Count manipulators
    void AddSizes(const PkgIterator &Pkg,signed long Mult = 1);
    inline void RemoveSizes(const PkgIterator &Pkg) {AddSizes(Pkg,-1);}
    void AddStates(const PkgIterator &Pkg,int Add = 1);
    inline void RemoveStates(const PkgIterator &Pkg) {AddStates(Pkg,-1);}
 
-   public:
+   void Allocate();
+   bool Build(OpProgress *Prog);
 
-   // CNC:2003-02-23 - See below.
-   class State;
-   friend class State;
+   public:
 
    // Legacy.. We look like a pkgCache
    inline operator pkgCache &() {return *Cache;}
@@ -184,9 +265,13 @@ class pkgDepCache : protected pkgCache::Namespace
    // CNC:2003-03-05 - See above.
    inline signed short GetPkgPriority(pkgCache::PkgIterator const &Pkg) {return LocalPolicy->GetPkgPriority(Pkg);}
 
+   inline pkgResolveTrace *GetTrace() {return Trace;}
+
    // Accessors
-   inline StateCache &operator [](PkgIterator const &I) {return PkgState[I->ID];}
-   inline unsigned char &operator [](DepIterator const &I) {return DepState[I->ID];}
+   inline StateCache &operator [](PkgIterator const &I)
+      {if (Lazy == true) LazyPkg(I); return PkgState[I->ID];}
+   inline unsigned char &operator [](DepIterator const &I)
+      {if (Lazy == true) LazyPkg(DepIterator(I).ParentPkg()); return DepState[I->ID];}
 
    // Manipulators
    void MarkKeep(PkgIterator const &Pkg,bool Soft = false);
@@ -196,33 +281,47 @@ class pkgDepCache : protected pkgCache::Namespace
    void SetReInstall(PkgIterator const &Pkg,bool To);
    void SetCandidateVersion(VerIterator TargetVer);
 
-   // This is for debuging
+   // Many MarkDelete() and MarkInstall() calls with a single update
+   void MarkList(vector<PkgIterator> const &Install,
+		 vector<PkgIterator> const &Remove,bool AutoInst = true);
+
+   // Full rebuild of every dependency state, the Mark*() calls keep
+   // things up to date on their own
    void Update(OpProgress *Prog = 0);
 
    // Size queries
-   inline double UsrSize() {return iUsrSize;}
-   inline double DebSize() {return iDownloadSize;}
-   inline unsigned long DelCount() {return iDelCount;}
-   inline unsigned long KeepCount() {return iKeepCount;}
-   inline unsigned long InstCount() {return iInstCount;}
-   inline unsigned long BrokenCount() {return iBrokenCount;}
-   inline unsigned long BadCount() {return iBadCount;}
+   inline double UsrSize() {NeedAll(); return iUsrSize;}
+   inline double DebSize() {NeedAll(); return iDownloadSize;}
+   inline unsigned long DelCount() {NeedAll(); return iDelCount;}
+   inline unsigned long KeepCount() {NeedAll(); return iKeepCount;}
+   inline unsigned long InstCount() {NeedAll(); return iInstCount;}
+   inline unsigned long BrokenCount() {NeedAll(); return iBrokenCount;}
+   inline unsigned long BadCount() {NeedAll(); return iBadCount;}
 
    bool Init(OpProgress *Prog);
+   bool InitLazy(OpProgress *Prog = 0);
 
    pkgDepCache(pkgCache *Cache,Policy *Plcy = 0);
    virtual ~pkgDepCache();
 };
 
 // CNC:2003-02-24 - Class to work on the state of a depcache.
+/* A State is a checkpoint in the undo journal of the depcache, nothing
+   is copied when it is taken. Changes made to the cache afterwards are
+   recorded once per package, so Restore(), Changed() and looking at the
+   old state of a package cost what was changed, not the cache size.
+   States may be nested and copied; a State must not be used after the
+   depcache it watches is gone. */
 class pkgDepCache::State
 {
+   friend class pkgDepCache;
+
    protected:
 
    pkgDepCache *Dep;
 
-   StateCache *PkgState;
-   unsigned char *DepState;
+   unsigned long PkgMark;
+   unsigned long DepMark;
    double iUsrSize;
    double iDownloadSize;
    unsigned long iInstCount;
@@ -231,7 +330,9 @@ class pkgDepCache::State
    unsigned long iBrokenCount;
    unsigned long iBadCount;
 
-   bool *PkgIgnore;
+   set<unsigned long> PkgIgnore;
+
+   void Release();
 
    public:
 
@@ -239,12 +340,16 @@ class pkgDepCache::State
    void Restore();
    bool Changed();
 
-   void Ignore(PkgIterator const &I) {PkgIgnore[I->ID] = true;}
-   void UnIgnore(PkgIterator const &I) {PkgIgnore[I->ID] = false;}
-   bool Ignored(PkgIterator const &I) {return PkgIgnore[I->ID];}
-   void UnIgnoreAll();
+   // IDs of the packages whose state may have changed since
+   void Touched(vector<unsigned long> &IDs);
 
-   StateCache &operator [](pkgCache::PkgIterator const &I) {return PkgState[I->ID];}
+   void Ignore(PkgIterator const &I) {PkgIgnore.insert(I->ID);}
+   void UnIgnore(PkgIterator const &I) {PkgIgnore.erase(I->ID);}
+   bool Ignored(PkgIterator const &I) {return PkgIgnore.find(I->ID) != PkgIgnore.end();}
+   void UnIgnoreAll() {PkgIgnore.clear();}
+
+   // A copy, the journal it comes from moves as the cache is changed
+   StateCache operator [](pkgCache::PkgIterator const &I) const;
 
    // Size queries
    inline double UsrSize() {return iUsrSize;}
@@ -258,22 +363,18 @@ class pkgDepCache::State
    void Copy(State const &Other);
    void operator =(State const &Other)
       {
-	 delete[] PkgState;
-	 delete[] DepState;
-	 delete[] PkgIgnore;
-	 Copy(Other);
+	 if (&Other != this)
+	 {
+	    Release();
+	    Copy(Other);
+	 }
       }
-   State(const State &Other)
+   State(const State &Other) : Dep(0)
       { Copy(Other); }
-   State(pkgDepCache *Dep=NULL)
-	 : Dep(0), PkgState(0), DepState(0), PkgIgnore(0)
+   State(pkgDepCache *Dep=NULL) : Dep(0)
       { if (Dep != NULL) Save(Dep); }
    ~State()
-      {
-	 delete[] PkgState;
-	 delete[] DepState;
-	 delete[] PkgIgnore;
-      }
+      { Release(); }
 };
 
 
@@ -283,15 +384,10 @@ class pkgDepCache::State
 #ifdef SWIG
    struct pkgDepCache::StateCache
    {
-      // Epoch stripped text versions of the two version fields
-      const char *CandVersion;
-      const char *CurVersion;
-
-      // Pointer to the candidate install version.
-      Version *CandidateVer;
-
-      // Pointer to the install version.
-      Version *InstallVer;
+      /* Candidate and install versions as offsets into the version
+         table, like the ones in the cache itself, 0 if there is none */
+      map_ptrloc CandidateVer;
+      map_ptrloc InstallVer;
 
       // Copy of Package::Flags
       unsigned short Flags;
@@ -303,9 +399,13 @@ class pkgDepCache::State
       unsigned char DepState;          // DepState Flags
 
       // Update of candidate version
-      const char *StripEpoch(const char *Ver);
+      static const char *StripEpoch(const char *Ver);
       void Update(PkgIterator Pkg,pkgCache &Cache);
 
+      // Epoch stripped text versions of the two version fields
+      const char *CandVersion(pkgCache &Cache) const;
+      const char *CurVersion(PkgIterator const &Pkg) const;
+
       // Various test members for the current status of the package
       inline bool NewInstall() const {return Status == 2 && Mode == ModeInstall;}
       inline bool Delete() const {return Mode == ModeDelete;}
@@ -317,10 +417,10 @@ class pkgDepCache::State
       inline bool NowBroken() const {return (DepState & DepNowMin) != DepNowMin;}
       inline bool InstBroken() const {return (DepState & DepInstMin) != DepInstMin;}
       inline bool Install() const {return Mode == ModeInstall;}
-      inline VerIterator InstVerIter(pkgCache &Cache)
-                {return VerIterator(Cache,InstallVer);}
-      inline VerIterator CandidateVerIter(pkgCache &Cache)
-                {return VerIterator(Cache,CandidateVer);}
+      inline VerIterator InstVerIter(pkgCache &Cache) const
+                {return VerIterator(Cache,Cache.VerP + InstallVer);}
+      inline VerIterator CandidateVerIter(pkgCache &Cache) const
+                {return VerIterator(Cache,Cache.VerP + CandidateVer);}
    };
 #endif
 
@@ -78,6 +78,9 @@ class pkgIndexFile
    virtual bool Merge(pkgCacheGenerator &/*Gen*/,OpProgress &/*Prog*/) const {return false;}
    virtual bool MergeFileProvides(pkgCacheGenerator &/*Gen*/,OpProgress &/*Prog*/) const {return true;}
    virtual pkgCache::PkgFileIterator FindInCache(pkgCache &Cache) const;
+   // Brings the versions of an index that changed since the cache was
+   // built up to date in place. False means it has to be rebuilt.
+   virtual bool MergeChanges(pkgCacheGenerator &/*Gen*/,OpProgress &/*Prog*/) const {return false;}
 
    virtual ~pkgIndexFile() {}
 };
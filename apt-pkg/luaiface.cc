@@ -733,8 +733,46 @@ inline int AptAux_PushBool(lua_State *L, bool Value)
 #define MARK_REINSTALL 2
 #define MARK_REMOVE    3
 
+// A table of packages or names is marked with a single MarkList()
+static int AptAux_marklist(lua_State *L, int Kind)
+{
+   pkgDepCache *DepCache = _lua->GetDepCache(L);
+   if (DepCache == NULL)
+      return 0;
+   vector<pkgCache::PkgIterator> List;
+   lua_pushnil(L);
+   while (lua_next(L, 1) != 0) {
+      pkgCache::Package *Pkg = AptAux_ToPackage(L, -1);
+      if (Pkg != NULL)
+	 List.push_back(pkgCache::PkgIterator(DepCache->GetCache(), Pkg));
+      lua_pop(L, 1);
+   }
+   pkgProblemResolver *MyFix = NULL;
+   pkgProblemResolver *Fix = _lua->GetProblemResolver();
+   if (Fix == NULL)
+      Fix = MyFix = new pkgProblemResolver(DepCache);
+   for (vector<pkgCache::PkgIterator>::iterator I = List.begin();
+	I != List.end(); I++) {
+      Fix->Clear(*I);
+      Fix->Protect(*I);
+      if (Kind == MARK_REMOVE)
+	 Fix->Remove(*I);
+   }
+   vector<pkgCache::PkgIterator> None;
+   if (Kind == MARK_INSTALL)
+      DepCache->MarkList(List, None);
+   else
+      DepCache->MarkList(None, List);
+   if (_lua->GetDontFix() == false && DepCache->BrokenCount() > 0)
+      Fix->Resolve(false);
+   delete MyFix;
+   return 0;
+}
+
 static int AptAux_mark(lua_State *L, int Kind)
 {
+   if ((Kind == MARK_INSTALL || Kind == MARK_REMOVE) && lua_istable(L, 1))
+      return AptAux_marklist(L, Kind);
    pkgCache::Package *Pkg = AptAux_ToPackage(L, 1);
    if (Pkg != NULL) {
       pkgDepCache *DepCache = _lua->GetDepCache(L);
@@ -977,7 +1015,7 @@ static int AptLua_pkgverinst(lua_State *L)
    SPtr<pkgCache::PkgIterator> PkgI = AptAux_ToPkgIterator(L, 1);
    if (PkgI == NULL)
       return 0;
-   pkgCache::Version *InstVer = (*DepCache)[(*PkgI)].InstallVer;
+   pkgCache::Version *InstVer = (*DepCache)[(*PkgI)].InstVerIter(*DepCache);
    pkgCache::Version *CurVer = (*PkgI).CurrentVer();
    if (InstVer == CurVer)
       InstVer = NULL;
@@ -992,7 +1030,7 @@ static int AptLua_pkgvercand(lua_State *L)
    SPtr<pkgCache::PkgIterator> PkgI = AptAux_ToPkgIterator(L, 1);
    if (PkgI == NULL)
       return 0;
-   pkgCache::Version *CandVer = (*DepCache)[(*PkgI)].CandidateVer;
+   pkgCache::Version *CandVer = (*DepCache)[(*PkgI)].CandidateVerIter(*DepCache);
    pkgCache::Version *CurVer = (*PkgI).CurrentVer();
    if (CandVer == CurVer)
       CandVer = NULL;
@@ -60,6 +60,13 @@
    possible to impove this further to make some better choices when
    presented with cycles.
 
+   Very large lists, like the bootstrap of a whole system, are ordered
+   differently. The recursion of VisitNode() goes as deep as the longest
+   dependency chain, so instead the same rules are turned into a graph,
+   its strongly connected components are found without recursion and
+   put in dependency order, see DoSCC(). The components of more than
+   one package are the loops.
+
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
@@ -71,6 +78,9 @@
 #include <apt-pkg/configuration.h>
 
 #include <iostream>
+#include <algorithm>
+#include <queue>
+#include <functional>
 									/*}}}*/
 
 using namespace std;
@@ -186,7 +196,12 @@ bool pkgOrderList::OrderCritical()
    Me = this;
    qsort(List,End - List,sizeof(*List),&OrderCompareB);
 
-   if (DoRun() == false)
+   if (UseSCC() == true)
+   {
+      if (DoSCC(SCCCritical) == false)
+	 return false;
+   }
+   else if (DoRun() == false)
       return false;
 
    if (LoopCount != 0)
@@ -226,31 +241,42 @@ bool pkgOrderList::OrderUnpack(string *FileList)
    Me = this;
    qsort(List,End - List,sizeof(*List),&OrderCompareA);
 
-   if (Debug == true)
-      clog << "** Pass A" << endl;
-   if (DoRun() == false)
-      return false;
+   if (UseSCC() == true)
+   {
+      if (Debug == true)
+	 clog << "** Components" << endl;
+      LoopCount = 0;
+      if (DoSCC(SCCUnpack) == false)
+	 return false;
+   }
+   else
+   {
+      if (Debug == true)
+	 clog << "** Pass A" << endl;
+      if (DoRun() == false)
+	 return false;
 
-   if (Debug == true)
-      clog << "** Pass B" << endl;
-   Secondary = 0;
-   if (DoRun() == false)
-      return false;
+      if (Debug == true)
+	 clog << "** Pass B" << endl;
+      Secondary = 0;
+      if (DoRun() == false)
+	 return false;
 
-   if (Debug == true)
-      clog << "** Pass C" << endl;
-   LoopCount = 0;
-   RevDepends = 0;
-   Remove = 0;             // Otherwise the libreadline remove problem occures
-   if (DoRun() == false)
-      return false;
+      if (Debug == true)
+	 clog << "** Pass C" << endl;
+      LoopCount = 0;
+      RevDepends = 0;
+      Remove = 0;             // Otherwise the libreadline remove problem occures
+      if (DoRun() == false)
+	 return false;
 
-   if (Debug == true)
-      clog << "** Pass D" << endl;
-   LoopCount = 0;
-   Primary = &pkgOrderList::DepUnPackPre;
-   if (DoRun() == false)
-      return false;
+      if (Debug == true)
+	 clog << "** Pass D" << endl;
+      LoopCount = 0;
+      Primary = &pkgOrderList::DepUnPackPre;
+      if (DoRun() == false)
+	 return false;
+   }
 
    if (Debug == true)
    {
@@ -279,6 +305,8 @@ bool pkgOrderList::OrderConfigure()
    RevDepends = 0;
    Remove = 0;
    LoopCount = -1;
+   if (UseSCC() == true)
+      return DoSCC(SCCConfigure);
    return DoRun();
 }
 									/*}}}*/
@@ -489,7 +517,7 @@ bool pkgOrderList::VisitProvides(DepIterator D,bool Critical)
 
       if (D->Type != pkgCache::Dep::Conflicts &&
 	  D->Type != pkgCache::Dep::Obsoletes &&
-	  Cache[Pkg].InstallVer != *I)
+	  Cache[Pkg].InstallVer != Ver.Index())
 	 continue;
 
       if ((D->Type == pkgCache::Dep::Conflicts ||
@@ -939,7 +967,7 @@ bool pkgOrderList::CheckDep(DepIterator D)
       if (IsFlag(Pkg,Added) == true ||
 	  (IsFlag(Pkg,AddPending) == true && D.Reverse() == true))
       {
-	 if (Cache[Pkg].InstallVer != *I)
+	 if (Cache[Pkg].InstallVer != Ver.Index())
 	    continue;
       }
       else
@@ -986,3 +1014,384 @@ bool pkgOrderList::CheckDep(DepIterator D)
    return false;
 }
 									/*}}}*/
+
+// OrderList::UseSCC - Check if the list is ordered by components	/*{{{*/
+// ---------------------------------------------------------------------
+/* The recursive visit is kept for the lists it has always handled, the
+   component ordering takes over from APT::Order::SCC-Threshold packages
+   on. 0 always uses it, a negative value never. */
+bool pkgOrderList::UseSCC()
+{
+   int Threshold = _config->FindI("APT::Order::SCC-Threshold",1000);
+   return Threshold >= 0 && size() >= (unsigned int)Threshold;
+}
+									/*}}}*/
+// OrderList::SCCTargets - List members a dependency points at		/*{{{*/
+// ---------------------------------------------------------------------
+/* The same packages VisitProvides() would visit: the install version
+   for depends and the current version for conflicts, of packages that
+   change. */
+void pkgOrderList::SCCTargets(DepIterator D,vector<long> const &Node,
+			      vector<unsigned long> &Out)
+{
+   bool Conflicts = (D->Type == pkgCache::Dep::Conflicts ||
+		     D->Type == pkgCache::Dep::Obsoletes);
+   SPtrArray<Version *> Vers = D.AllTargets();
+   for (Version **I = Vers; *I != 0; I++)
+   {
+      VerIterator Ver(Cache,*I);
+      PkgIterator Pkg = Ver.ParentPkg();
+      if (Node[Pkg->ID] < 0)
+	 continue;
+      if (Cache[Pkg].Keep() == true && Pkg.State() == PkgIterator::NeedsNothing)
+	 continue;
+      if (Conflicts == false && Cache[Pkg].InstallVer != Ver.Index())
+	 continue;
+      if (Conflicts == true && (Version *)Pkg.CurrentVer() != *I)
+	 continue;
+      Out.push_back(Node[Pkg->ID]);
+   }
+}
+									/*}}}*/
+// OrderList::SCCEdges - Build the ordering graph			/*{{{*/
+// ---------------------------------------------------------------------
+/* SCCConfigure has the Depends only. SCCCritical has the PreDepends and
+   then all Depends and PreDepends of the packages those reach, and of
+   the ones to configure immediately, as DepUnPackPre() follows them.
+   SCCUnpack adds what DepUnPackCrit() and DepRemove() look at: packages
+   conflicting either way go first, and so do the ones depending on a
+   package that is removed. */
+void pkgOrderList::SCCEdges(SCCMode Mode,vector<long> const &Node,
+			    SCCGraph &Succ)
+{
+   unsigned long Count = Succ.size();
+   vector<char> Closure(Count,0);
+   vector<unsigned long> Work;
+   vector<unsigned long> Targets;
+   for (unsigned long I = 0; I != Count; I++)
+   {
+      PkgIterator Pkg(Cache,List[I]);
+      if (IsNow(Pkg) == false)
+	 continue;
+
+      // Whatever depends on a package to remove goes first
+      if (Cache[Pkg].Delete() == true)
+      {
+	 if (Mode != SCCUnpack || Pkg->CurrentVer == 0)
+	    continue;
+	 vector<DepIterator> Rev(1,Pkg.RevDependsList());
+	 for (PrvIterator P = Pkg.CurrentVer().ProvidesList(); P.end() == false; P++)
+	    Rev.push_back(P.ParentPkg().RevDependsList());
+	 for (vector<DepIterator>::iterator R = Rev.begin(); R != Rev.end(); R++)
+	    for (DepIterator D = *R; D.end() == false; D++)
+	    {
+	       if (D->Type != pkgCache::Dep::Depends &&
+		   D->Type != pkgCache::Dep::PreDepends)
+		  continue;
+	       if (D.ParentPkg().CurrentVer() != D.ParentVer())
+		  continue;
+	       long Q = Node[D.ParentPkg()->ID];
+	       if (Q >= 0 && (unsigned long)Q != I)
+		  Succ[Q].push_back(I);
+	    }
+	 continue;
+      }
+
+      if (Cache[Pkg].InstallVer == 0)
+	 continue;
+      VerIterator Ver = Cache[Pkg].InstVerIter(Cache);
+      if (Mode != SCCConfigure && IsFlag(Pkg,Immediate) == true &&
+	  Closure[I] == 0)
+      {
+	 Closure[I] = 1;
+	 Work.push_back(I);
+      }
+
+      for (DepIterator D = Ver.DependsList(); D.end() == false; D++)
+      {
+	 bool Conflicts = (D->Type == pkgCache::Dep::Conflicts ||
+			   D->Type == pkgCache::Dep::Obsoletes);
+	 if (Mode == SCCConfigure ? D->Type != pkgCache::Dep::Depends :
+	     (D->Type != pkgCache::Dep::PreDepends &&
+	      (Mode != SCCUnpack || Conflicts == false)))
+	    continue;
+
+	 Targets.clear();
+	 SCCTargets(D,Node,Targets);
+	 for (vector<unsigned long>::iterator T = Targets.begin();
+	      T != Targets.end(); T++)
+	 {
+	    if (*T == I)
+	       continue;
+	    Succ[*T].push_back(I);
+	    if (D->Type == pkgCache::Dep::PreDepends && Closure[*T] == 0)
+	    {
+	       Closure[*T] = 1;
+	       Work.push_back(*T);
+	    }
+	 }
+      }
+
+      /* Installed packages whose current version conflicts with the
+	 new one go first as well */
+      if (Mode != SCCUnpack)
+	 continue;
+      vector<DepIterator> Rev(1,Pkg.RevDependsList());
+      vector<const char *> RevVer(1,Ver.VerStr());
+      for (PrvIterator P = Ver.ProvidesList(); P.end() == false; P++)
+      {
+	 Rev.push_back(P.ParentPkg().RevDependsList());
+	 RevVer.push_back(P.ProvideVersion());
+      }
+      for (unsigned long R = 0; R != Rev.size(); R++)
+	 for (DepIterator D = Rev[R]; D.end() == false; D++)
+	 {
+	    if (D->Type != pkgCache::Dep::Conflicts &&
+		(D->Type != pkgCache::Dep::Obsoletes || R != 0))
+	       continue;
+	    if (D.ParentPkg().CurrentVer() != D.ParentVer())
+	       continue;
+	    long Q = Node[D.ParentPkg()->ID];
+	    if (Q < 0 || (unsigned long)Q == I ||
+		Cache.VS().CheckDep(RevVer[R],D) == false)
+	       continue;
+	    Succ[Q].push_back(I);
+	 }
+   }
+
+   // Everything a predepended package needs is in place before it
+   while (Work.empty() == false)
+   {
+      unsigned long N = Work.back();
+      Work.pop_back();
+      PkgIterator Pkg(Cache,List[N]);
+      if (IsNow(Pkg) == false || Cache[Pkg].Delete() == true ||
+	  Cache[Pkg].InstallVer == 0)
+	 continue;
+      for (DepIterator D = Cache[Pkg].InstVerIter(Cache).DependsList();
+	   D.end() == false; D++)
+      {
+	 if (D->Type != pkgCache::Dep::Depends &&
+	     D->Type != pkgCache::Dep::PreDepends)
+	    continue;
+	 Targets.clear();
+	 SCCTargets(D,Node,Targets);
+	 for (vector<unsigned long>::iterator T = Targets.begin();
+	      T != Targets.end(); T++)
+	 {
+	    if (*T == N)
+	       continue;
+	    Succ[*T].push_back(N);
+	    if (Closure[*T] == 0)
+	    {
+	       Closure[*T] = 1;
+	       Work.push_back(*T);
+	    }
+	 }
+      }
+   }
+}
+									/*}}}*/
+// Lower priorities first
+struct SCCPrioCompare
+{
+   vector<unsigned long> const &Prio;
+   bool operator ()(unsigned long A,unsigned long B) const
+      {return Prio[A] < Prio[B];}
+   SCCPrioCompare(vector<unsigned long> const &Prio) : Prio(Prio) {}
+};
+
+// OrderList::SCCSort - Order a graph by its components			/*{{{*/
+// ---------------------------------------------------------------------
+/* Tarjan's algorithm with an explicit stack finds the components, then
+   they are output in dependency order, the one holding the lowest
+   priority first among those that are ready. Members of a component
+   are given by priority. Comp gets the component of each node. */
+void pkgOrderList::SCCSort(SCCGraph const &Succ,vector<unsigned long> const &Prio,
+			   vector<unsigned long> &Comp,vector<unsigned long> &Order)
+{
+   unsigned long Count = Succ.size();
+   vector<long> Index(Count,-1);
+   vector<long> Low(Count,0);
+   vector<char> OnStack(Count,0);
+   vector<unsigned long> Stack;
+   vector<pair<unsigned long,unsigned long> > Call;
+   unsigned long Comps = 0;
+   long Counter = 0;
+   Comp.assign(Count,0);
+
+   for (unsigned long Root = 0; Root != Count; Root++)
+   {
+      if (Index[Root] >= 0)
+	 continue;
+      Index[Root] = Low[Root] = Counter++;
+      Stack.push_back(Root);
+      OnStack[Root] = 1;
+      Call.push_back(pair<unsigned long,unsigned long>(Root,0));
+      while (Call.empty() == false)
+      {
+	 unsigned long V = Call.back().first;
+	 unsigned long E = Call.back().second;
+	 if (E < Succ[V].size())
+	 {
+	    Call.back().second++;
+	    unsigned long W = Succ[V][E];
+	    if (Index[W] < 0)
+	    {
+	       Index[W] = Low[W] = Counter++;
+	       Stack.push_back(W);
+	       OnStack[W] = 1;
+	       Call.push_back(pair<unsigned long,unsigned long>(W,0));
+	    }
+	    else if (OnStack[W] != 0 && Index[W] < Low[V])
+	       Low[V] = Index[W];
+	    continue;
+	 }
+
+	 if (Low[V] == Index[V])
+	 {
+	    unsigned long W;
+	    do
+	    {
+	       W = Stack.back();
+	       Stack.pop_back();
+	       OnStack[W] = 0;
+	       Comp[W] = Comps;
+	    }
+	    while (W != V);
+	    Comps++;
+	 }
+	 Call.pop_back();
+	 if (Call.empty() == false && Low[V] < Low[Call.back().first])
+	    Low[Call.back().first] = Low[V];
+      }
+   }
+
+   // The components form a DAG, take them in order
+   vector<vector<unsigned long> > Members(Comps);
+   vector<unsigned long> InDeg(Comps,0);
+   vector<unsigned long> CompPrio(Comps,~0UL);
+   for (unsigned long V = 0; V != Count; V++)
+   {
+      Members[Comp[V]].push_back(V);
+      if (Prio[V] < CompPrio[Comp[V]])
+	 CompPrio[Comp[V]] = Prio[V];
+      for (vector<unsigned long>::const_iterator W = Succ[V].begin();
+	   W != Succ[V].end(); W++)
+	 if (Comp[*W] != Comp[V])
+	    InDeg[Comp[*W]]++;
+   }
+
+   typedef pair<unsigned long,unsigned long> Entry;
+   priority_queue<Entry,vector<Entry>,greater<Entry> > Ready;
+   for (unsigned long C = 0; C != Comps; C++)
+      if (InDeg[C] == 0)
+	 Ready.push(Entry(CompPrio[C],C));
+
+   Order.clear();
+   while (Ready.empty() == false)
+   {
+      unsigned long C = Ready.top().second;
+      Ready.pop();
+      sort(Members[C].begin(),Members[C].end(),SCCPrioCompare(Prio));
+      for (vector<unsigned long>::const_iterator V = Members[C].begin();
+	   V != Members[C].end(); V++)
+      {
+	 Order.push_back(*V);
+	 for (vector<unsigned long>::const_iterator W = Succ[*V].begin();
+	      W != Succ[*V].end(); W++)
+	    if (Comp[*W] != C && --InDeg[Comp[*W]] == 0)
+	       Ready.push(Entry(CompPrio[Comp[*W]],Comp[*W]));
+      }
+   }
+}
+									/*}}}*/
+// OrderList::DoSCC - Does an order run by components			/*{{{*/
+// ---------------------------------------------------------------------
+/* The counterpart of DoRun(), linear in the size of the graph but for
+   the sorting of ties. Every component of more than one package is a
+   loop. For unpacking the Depends order is worked out first and breaks
+   the ties, as the Secondary and RevDepends passes do for DoRun(), and
+   the After flag is passed on to whatever has to wait for a package
+   that has it. */
+bool pkgOrderList::DoSCC(SCCMode Mode)
+{
+   unsigned long Size = Cache.Head().PackageCount;
+   unsigned long Count = End - List;
+   WipeFlags(Added | AddPending | Loop | InList);
+   vector<long> Node(Size,-1);
+   vector<unsigned long> Prio(Count);
+   for (unsigned long I = 0; I != Count; I++)
+   {
+      Flag(List[I],InList);
+      Node[List[I]->ID] = I;
+      Prio[I] = I;
+   }
+
+   SCCGraph Succ(Count);
+   vector<unsigned long> Comp;
+   vector<unsigned long> Order;
+   if (Mode == SCCUnpack)
+   {
+      SCCEdges(SCCConfigure,Node,Succ);
+      SCCSort(Succ,Prio,Comp,Order);
+      for (unsigned long I = 0; I != Count; I++)
+	 Prio[Order[I]] = I;
+      Succ.assign(Count,vector<unsigned long>());
+   }
+   SCCEdges(Mode,Node,Succ);
+   SCCSort(Succ,Prio,Comp,Order);
+
+   // Loops and the After flag, component by component
+   vector<char> CompAfter(Count,0);
+   for (unsigned long I = 0; I != Count;)
+   {
+      unsigned long C = Comp[Order[I]];
+      unsigned long J = I;
+      for (; J != Count && Comp[Order[J]] == C; J++)
+	 if (IsFlag(List[Order[J]],After) == true)
+	    CompAfter[C] = 1;
+
+      if (J - I > 1)
+      {
+	 if (LoopCount >= 0)
+	    LoopCount++;
+	 if (Debug == true)
+	    clog << "Loop of " << J - I << " packages at "
+		 << PkgIterator(Cache,List[Order[I]]).Name() << endl;
+      }
+      for (unsigned long K = I; K != J; K++)
+      {
+	 if (J - I > 1)
+	    Flag(List[Order[K]],Loop);
+	 if (CompAfter[C] == 0)
+	    continue;
+	 Flag(List[Order[K]],After);
+	 if (Mode != SCCUnpack)
+	    continue;
+	 for (vector<unsigned long>::const_iterator W = Succ[Order[K]].begin();
+	      W != Succ[Order[K]].end(); W++)
+	    CompAfter[Comp[*W]] = 1;
+      }
+      I = J;
+   }
+
+   // The new list, with the After packages moved to the end
+   SPtrArray<Package *> NList = new Package *[Size];
+   Package **NEnd = NList;
+   for (int Pass = 0; Pass != 2; Pass++)
+      for (unsigned long I = 0; I != Count; I++)
+      {
+	 Package *Pkg = List[Order[I]];
+	 if (IsFlag(Pkg,After) != (Pass == 1))
+	    continue;
+	 Flag(Pkg,Added);
+	 *NEnd++ = Pkg;
+      }
+
+   delete [] List;
+   List = NList.UnGuard();
+   End = NEnd;
+   return true;
+}
+									/*}}}*/
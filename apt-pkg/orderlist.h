@@ -18,6 +18,10 @@
 
 #include <apt-pkg/pkgcache.h>
 
+#include <vector>
+
+using std::vector;
+
 class pkgDepCache;
 class pkgOrderList : protected pkgCache::Namespace
 {
@@ -63,6 +67,19 @@ class pkgOrderList : protected pkgCache::Namespace
    bool CheckDep(DepIterator D);
    bool DoRun();
 
+   /* Ordering of large lists by strongly connected components, without
+      recursion. Graphs go from the package that has to come first to
+      the ones that wait for it, by place in the list. */
+   enum SCCMode {SCCConfigure, SCCCritical, SCCUnpack};
+   typedef vector<vector<unsigned long> > SCCGraph;
+   bool UseSCC();
+   void SCCTargets(DepIterator D,vector<long> const &Node,
+		   vector<unsigned long> &Out);
+   void SCCEdges(SCCMode Mode,vector<long> const &Node,SCCGraph &Succ);
+   void SCCSort(SCCGraph const &Succ,vector<unsigned long> const &Prio,
+		vector<unsigned long> &Comp,vector<unsigned long> &Order);
+   bool DoSCC(SCCMode Mode);
+
    // For pre sorting
    static pkgOrderList *Me;
    static int OrderCompareA(const void *a, const void *b);
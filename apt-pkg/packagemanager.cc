@@ -336,7 +336,7 @@ bool pkgPackageManager::DepAdd(pkgOrderList &OList,PkgIterator Pkg,int Depth)
 	    }
 
 	    // Not the install version
-	    if (Cache[Pkg].InstallVer != *I ||
+	    if (Cache[Pkg].InstallVer != Ver.Index() ||
 		(Cache[Pkg].Keep() == true && Pkg.State() == PkgIterator::NeedsNothing))
 	       continue;
 
@@ -424,7 +424,7 @@ bool pkgPackageManager::SmartRemove(PkgIterator Pkg)
    {
       if (D->Type == pkgCache::Dep::Obsoletes &&
           Cache[D.ParentPkg()].Install() &&
-          (pkgCache::Version*)D.ParentVer() == Cache[D.ParentPkg()].InstallVer &&
+          D->ParentVer == Cache[D.ParentPkg()].InstallVer &&
           Cache.VS().CheckDep(Pkg.CurrentVer().VerStr(), D) == true)
       {
          return true;
@@ -488,7 +488,7 @@ bool pkgPackageManager::SmartUnPack(PkgIterator Pkg)
 	    PkgIterator Pkg = Ver.ParentPkg();
 
 	    // Not the install version
-	    if (Cache[Pkg].InstallVer != *I ||
+	    if (Cache[Pkg].InstallVer != Ver.Index() ||
 		(Cache[Pkg].Keep() == true && Pkg.State() == PkgIterator::NeedsNothing))
 	       continue;
 
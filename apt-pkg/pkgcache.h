@@ -240,6 +240,7 @@ struct pkgCache::PackageFile
    map_ptrloc Architecture;    // Stringtable
    map_ptrloc Site;            // Stringtable
    map_ptrloc IndexType;       // Stringtable
+   map_ptrloc Entries;         // Stringtable, entries known to the index
    unsigned long Size;
    unsigned long Flags;
 
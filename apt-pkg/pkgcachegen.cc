@@ -546,6 +546,92 @@ bool pkgCacheGenerator::SelectFile(const string & File, const string & Site,
    return true;
 }
 									/*}}}*/
+// CacheGenerator::SelectFile - Select a file that is already there	/*{{{*/
+// ---------------------------------------------------------------------
+/* Newly added versions go to a file of the cache that is being updated
+   in place. */
+void pkgCacheGenerator::SelectFile(pkgCache::PkgFileIterator File)
+{
+   CurrentFile = File;
+   PkgFileName = File.FileName();
+}
+									/*}}}*/
+// CacheGenerator::RemoveFileVer - Drop a File<->Version association	/*{{{*/
+// ---------------------------------------------------------------------
+/* A version left without any file is taken out of its package, and its
+   dependencies and provides out of the lists of their targets. The
+   structures themselves stay in the map unused and the counters aren't
+   lowered, the IDs handed out must stay unique. */
+bool pkgCacheGenerator::RemoveFileVer(pkgCache::VerIterator Ver,
+				      pkgCache::PkgFileIterator File)
+{
+   map_ptrloc *Last = &Ver->FileList;
+   for (pkgCache::VerFileIterator VF = Ver.FileList(); VF.end() == false; VF++)
+   {
+      if (VF.File() == File)
+      {
+	 *Last = VF->NextFile;
+	 break;
+      }
+      Last = &VF->NextFile;
+   }
+   if (Ver->FileList != 0)
+      return true;
+
+   pkgCache::PkgIterator Pkg = Ver.ParentPkg();
+   for (Last = &Pkg->VersionList; *Last != 0; Last = &Cache.VerP[*Last].NextVer)
+   {
+      if (*Last == Ver.Index())
+      {
+	 *Last = Ver->NextVer;
+	 break;
+      }
+   }
+   if (Pkg->CurrentVer == Ver.Index())
+      Pkg->CurrentVer = 0;
+
+   for (pkgCache::DepIterator D = Ver.DependsList(); D.end() == false; D++)
+   {
+      pkgCache::PkgIterator Target = D.TargetPkg();
+      for (Last = &Target->RevDepends; *Last != 0;
+	   Last = &Cache.DepP[*Last].NextRevDepends)
+      {
+	 if (*Last == D.Index())
+	 {
+	    *Last = D->NextRevDepends;
+	    break;
+	 }
+      }
+   }
+
+   for (pkgCache::PrvIterator P = Ver.ProvidesList(); P.end() == false; P++)
+   {
+      pkgCache::PkgIterator Target = P.ParentPkg();
+      for (Last = &Target->ProvidesList; *Last != 0;
+	   Last = &Cache.ProvideP[*Last].NextProvides)
+      {
+	 if (*Last == P.Index())
+	 {
+	    *Last = P->NextProvides;
+	    break;
+	 }
+      }
+   }
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::NewFilePackages - Look for new file dependencies	/*{{{*/
+// ---------------------------------------------------------------------
+/* True if a file dependency added a package since there were Count of
+   them. Its provides would have to be collected over every index. */
+bool pkgCacheGenerator::NewFilePackages(unsigned long Count)
+{
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; Pkg++)
+      if (Pkg->ID >= Count && Pkg.Name()[0] == '/')
+	 return true;
+   return false;
+}
+									/*}}}*/
 // CacheGenerator::WriteUniqueString - Insert a unique string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to create handles to strings. Given the same text it
@@ -751,6 +837,147 @@ static bool CollectFileProvides(pkgCacheGenerator &Gen,
    return true;
 }
 									/*}}}*/
+// MergeChangedFiles - Merge the changed status files into a cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* This is the part of UpdateStatusCache() that works on the copy of the
+   old cache. */
+static bool MergeChangedFiles(pkgCacheGenerator &Gen,OpProgress &Progress,
+			      FileIterator Start,FileIterator Status,
+			      FileIterator End)
+{
+   pkgCache &Cache = Gen.GetCache();
+   if (_system->OptionsHash() != Cache.HeaderP->OptionsHash)
+      return false;
+
+   // Only status files may have changed
+   vector<pkgIndexFile *> Changed;
+   SPtrArray<bool> Visited = new bool[Cache.HeaderP->PackageFileCount];
+   memset(Visited,0,sizeof(*Visited)*Cache.HeaderP->PackageFileCount);
+   for (FileIterator I = Start; I != End; I++)
+   {
+      if ((*I)->HasPackages() == false || (*I)->Exists() == false)
+	 continue;
+      pkgCache::PkgFileIterator File = (*I)->FindInCache(Cache);
+      if (File.end() == false)
+	 Visited[File->ID] = true;
+      else if (I < Status)
+	 return false;
+      else
+	 Changed.push_back(*I);
+   }
+   if (Changed.empty() == true)
+      return false;
+
+   unsigned long PackageCount = Cache.HeaderP->PackageCount;
+   unsigned long CurrentSize = 0;
+   unsigned long TotalSize = ComputeSize(Changed.begin(),Changed.end());
+   for (FileIterator I = Changed.begin(); I != Changed.end(); I++)
+   {
+      unsigned long Size = (*I)->Size();
+      Progress.OverallProgress(CurrentSize,TotalSize,Size,_("Reading Package Lists"));
+      CurrentSize += Size;
+
+      if ((*I)->MergeChanges(Gen,Progress) == false)
+	 return false;
+      pkgCache::PkgFileIterator File = (*I)->FindInCache(Cache);
+      if (File.end() == true)
+	 return false;
+      Visited[File->ID] = true;
+   }
+
+   for (unsigned I = 0; I != Cache.HeaderP->PackageFileCount; I++)
+      if (Visited[I] == false)
+	 return false;
+
+   // The files of every index would have to be looked at for these
+   if (Gen.HasFileDeps() == true &&
+       (Cache.HeaderP->HasFileDeps == false ||
+	Gen.NewFilePackages(PackageCount) == true))
+      return false;
+
+   return _error->PendingError() == false;
+}
+									/*}}}*/
+// UpdateStatusCache - Update the status files of the cache in place	/*{{{*/
+// ---------------------------------------------------------------------
+/* When all that changed since the status cache was built are some status
+   files, eg. the rpm database after a transaction, their changes are
+   merged into a copy of the old cache instead of building it all over.
+   Anything that can't be handled that way, an index file that is new,
+   gone or changed, or a status file that can't tell what changed in it,
+   makes this return false and the cache is rebuilt. */
+static bool UpdateStatusCache(string CacheFile,FileIterator Start,
+			      FileIterator Status,FileIterator End,
+			      bool Writeable,unsigned long MapSize,
+			      OpProgress &Progress,MMap **OutMap)
+{
+   if (_config->FindB("APT::Cache-Update",true) == false ||
+       _config->FindB("APT::Get::ReInstall",false) == true ||
+       CacheFile.empty() == true || FileExists(CacheFile) == false ||
+       _error->PendingError() == true)
+      return false;
+
+   // Copy the old cache into the new map
+   FileFd OldF(CacheFile,FileFd::ReadOnly);
+   unsigned long OldSize = OldF.Size();
+   if (_error->PendingError() == true || OldSize < sizeof(pkgCache::Header))
+   {
+      _error->Discard();
+      return false;
+   }
+   SPtr<FileFd> CacheF;
+   SPtr<DynamicMMap> Map;
+   if (Writeable == true)
+   {
+      unlink(CacheFile.c_str());
+      CacheF = new FileFd(CacheFile,FileFd::WriteEmpty);
+      if (_error->PendingError() == true)
+      {
+	 _error->Discard();
+	 return false;
+      }
+      fchmod(CacheF->Fd(),0644);
+      Map = new DynamicMMap(*CacheF,MMap::Public,MapSize);
+   }
+   else
+      Map = new DynamicMMap(MMap::Public,MapSize);
+   if (_error->PendingError() == false)
+      OldF.Read((unsigned char *)Map->Data() + Map->RawAllocate(OldSize),
+		OldSize);
+   OldF.Close();
+
+   bool Res = false;
+   if (_error->PendingError() == false)
+   {
+      pkgCacheGenerator Gen(Map.Get(),&Progress);
+      Res = (_error->PendingError() == false &&
+	     MergeChangedFiles(Gen,Progress,Start,Status,End) == true);
+   }
+   if (Res == false)
+   {
+      _error->Discard();
+      if (CacheF != 0)
+	 unlink(CacheFile.c_str());
+      return false;
+   }
+
+   if (OutMap != 0)
+   {
+      if (CacheF != 0)
+      {
+	 delete Map.UnGuard();
+	 *OutMap = new MMap(*CacheF,MMap::Public | MMap::ReadOnly);
+      }
+      else
+      {
+	 *OutMap = Map.UnGuard();
+      }
+   }
+
+   _system->CacheBuilt();
+   return true;
+}
+									/*}}}*/
 // MakeStatusCache - Construct the status cache				/*{{{*/
 // ---------------------------------------------------------------------
 /* This makes sure that the status cache (the cache that has all
@@ -793,6 +1020,14 @@ bool pkgMakeStatusCache(pkgSourceList &List,OpProgress &Progress,
       return true;
    }
 
+   // Only the status files changed, patch them in
+   if (UpdateStatusCache(CacheFile,Files.begin(),Files.begin()+EndOfSource,
+			 Files.end(),Writeable,MapSize,Progress,OutMap) == true)
+   {
+      Progress.OverallProgress(1,1,1,_("Reading Package Lists"));
+      return true;
+   }
+
    // CNC:2002-07-03
 #if DYING
    if (_system->PreProcess(Files.begin(),Files.end(),Progress) == false)
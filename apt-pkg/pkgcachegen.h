@@ -72,6 +72,12 @@ class pkgCacheGenerator
    bool HasFileDeps() {return FoundFileDeps;}
    bool MergeFileProvides(ListParser &List);
 
+   // For pkgIndexFile::MergeChanges()
+   void SelectFile(pkgCache::PkgFileIterator File);
+   bool RemoveFileVer(pkgCache::VerIterator Ver,pkgCache::PkgFileIterator File);
+   bool NewFilePackages(unsigned long Count);
+   inline unsigned long WriteString(const string &S) {return Map.WriteString(S);}
+
    // CNC:2003-03-18
    inline void ResetFileDeps() {FoundFileDeps = false;}
 
@@ -20,6 +20,17 @@
    0 -> 100    = NotAutomatic sources like experimental
    -inf -> 0   = Never selected
 
+   The candidate and priority of a package are looked up over and over by
+   the depcache, the resolver and the front ends, so they are kept in a
+   table. Queries fill in single entries; Prepare() fills it for every
+   package, in threads when there are enough of them. A pin created for a
+   single package only drops that package's entry.
+
+   Pin files written by configuration management can hold thousands of
+   package pins, mostly with the same few patterns. Every distinct
+   pattern is compiled into one pkgVersionMatch that the pins share, and
+   pins of unknown packages are indexed by name.
+
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
@@ -29,10 +40,18 @@
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/sptr.h>
+#include <apt-pkg/version.h>
 
+#include <config.h>
 #include <apti18n.h>
 
 #include <iostream>
+#include <algorithm>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
 									/*}}}*/
 
 using namespace std;
@@ -41,10 +60,14 @@ using namespace std;
 // ---------------------------------------------------------------------
 /* Set the defaults for operation. The default mode with no loaded policy
    file matches the V0 policy engine. */
-pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(0), PFPriority(0), Cache(Owner)
+pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(0), PFPriority(0), Cache(Owner),
+                      TableBuilt(false)
 {
    PFPriority = new signed short[Owner->Head().PackageFileCount];
    Pins = new Pin[Owner->Head().PackageCount];
+   CandTable.resize(Owner->Head().PackageCount);
+   PrioTable.resize(Owner->Head().PackageCount);
+   Known.resize(Owner->Head().PackageCount);
 
    for (unsigned long I = 0; I != Owner->Head().PackageCount; I++)
       Pins[I].Type = pkgVersionMatch::None;
@@ -57,6 +80,18 @@ pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(0), PFPriority(0), Cache(Owner)
    InitDefaults();
 }
 									/*}}}*/
+// Policy::~pkgPolicy - Destructor					/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+pkgPolicy::~pkgPolicy()
+{
+   delete [] PFPriority;
+   delete [] Pins;
+   for (map<string,pkgVersionMatch *>::iterator I = Matchers.begin();
+	I != Matchers.end(); I++)
+      delete I->second;
+}
+									/*}}}*/
 // Policy::InitDefaults - Compute the default selections		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -106,14 +141,145 @@ bool pkgPolicy::InitDefaults()
       for (pkgCache::PkgFileIterator F = Cache->FileBegin(); F != Cache->FileEnd(); F++)
 	 cout << "Prio of " << F.FileName() << ' ' << PFPriority[F->ID] << endl;
 
+   // Everything has to be worked out again
+   CompatArchSuffix = _config->Find("RPM::CompatArchSuffix");
+   std::fill(Known.begin(),Known.end(),0);
+   TableBuilt = false;
    return true;
 }
 									/*}}}*/
+// Policy::Prepare - Every package is about to be asked for		/*{{{*/
+// ---------------------------------------------------------------------
+/* Single queries fill the tables one package at a time, when all of them
+   are coming they are filled at once. */
+void pkgPolicy::Prepare()
+{
+   if (TableBuilt == false)
+      BuildTable();
+}
+									/*}}}*/
+// Policy::BuildTable - Fill the candidate and priority tables		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgPolicy::BuildTable()
+{
+   TableBuilt = true;
+   std::fill(Known.begin(),Known.end(),0);
+
+#ifdef HAVE_PTHREAD
+   if (BuildTableThreaded() == true)
+      return;
+#endif
+
+   vector<pkgCache::Package *> Pkgs;
+   Pkgs.reserve(Known.size());
+   for (pkgCache::PkgIterator I = Cache->PkgBegin(); I.end() == false; I++)
+      Pkgs.push_back(I);
+   FillTable(Pkgs,0,Pkgs.size());
+}
+									/*}}}*/
+// Policy::FillTable - Fill the table entries of some packages		/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the entries of the given packages are written, so any number of
+   these can run at once on different packages. */
+void pkgPolicy::FillTable(vector<pkgCache::Package *> const &Pkgs,
+			  unsigned long Start,unsigned long Stop)
+{
+   for (; Start != Stop; Start++)
+   {
+      pkgCache::PkgIterator Pkg(*Cache,Pkgs[Start]);
+      CandTable[Pkg->ID] = FindCandidateVer(Pkg).Index();
+      PrioTable[Pkg->ID] = FindPkgPriority(Pkg);
+      Known[Pkg->ID] = CandKnown | PrioKnown;
+   }
+}
+									/*}}}*/
+#ifdef HAVE_PTHREAD
+// Policy::BuildTableThreaded - Fill the tables in threads		/*{{{*/
+// ---------------------------------------------------------------------
+/* This works like pkgDepCache::UpdateThreaded() and takes the number of
+   threads from APT::Cache::Update-Threads as well. Version pins compare
+   versions, so the versioning system has to allow that from threads. */
+struct pkgPolicy::TableJob
+{
+   pkgPolicy *Policy;
+   pthread_mutex_t Lock;
+   vector<pkgCache::Package *> Pkgs;
+   vector<pkgCache::Package *>::size_type Next;
+};
+
+static const unsigned long TableChunk = 256;
+
+void *pkgPolicy::TableThread(void *Arg)
+{
+   TableJob *Job = (TableJob *)Arg;
+   while (true)
+   {
+      pthread_mutex_lock(&Job->Lock);
+      vector<pkgCache::Package *>::size_type Start = Job->Next;
+      if (Job->Next < Job->Pkgs.size())
+	 Job->Next = std::min(Job->Next + TableChunk,Job->Pkgs.size());
+      vector<pkgCache::Package *>::size_type Stop = Job->Next;
+      pthread_mutex_unlock(&Job->Lock);
+      if (Start == Stop)
+	 break;
+      Job->Policy->FillTable(Job->Pkgs,Start,Stop);
+   }
+   return 0;
+}
+
+bool pkgPolicy::BuildTableThreaded()
+{
+   long Threads = _config->FindI("APT::Cache::Update-Threads",0);
+   if (Threads <= 0)
+      Threads = sysconf(_SC_NPROCESSORS_ONLN);
+   if ((unsigned long)Threads > Known.size()/TableChunk)
+      Threads = Known.size()/TableChunk;
+   if (Threads < 2 || Cache->VS->ThreadSafeCheckDep() == false)
+      return false;
+
+   TableJob Job;
+   Job.Policy = this;
+   Job.Pkgs.reserve(Known.size());
+   for (pkgCache::PkgIterator I = Cache->PkgBegin(); I.end() == false; I++)
+      Job.Pkgs.push_back(I);
+   Job.Next = 0;
+   pthread_mutex_init(&Job.Lock,0);
+
+   vector<pthread_t> Tids;
+   for (long I = 1; I < Threads; I++)
+   {
+      pthread_t Tid;
+      if (pthread_create(&Tid,0,TableThread,&Job) != 0)
+	 break;
+      Tids.push_back(Tid);
+   }
+   TableThread(&Job);
+   for (vector<pthread_t>::iterator I = Tids.begin(); I != Tids.end(); I++)
+      pthread_join(*I,0);
+   pthread_mutex_destroy(&Job.Lock);
+   return true;
+}
+									/*}}}*/
+#endif
 // Policy::GetCandidateVer - Get the candidate install version		/*{{{*/
 // ---------------------------------------------------------------------
+/* */
+pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator Pkg)
+{
+   if ((Known[Pkg->ID] & CandKnown) == 0)
+   {
+      CandTable[Pkg->ID] = FindCandidateVer(Pkg).Index();
+      Known[Pkg->ID] |= CandKnown;
+   }
+   return pkgCache::VerIterator(*Cache,Cache->VerP + CandTable[Pkg->ID]);
+}
+									/*}}}*/
+// Policy::FindCandidateVer - Work out the candidate install version	/*{{{*/
+// ---------------------------------------------------------------------
 /* Evaluate the package pins and the default list to deteremine what the
    best package is. */
-pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator Pkg)
+pkgCache::VerIterator pkgPolicy::FindCandidateVer(pkgCache::PkgIterator const &Pkg)
 {
    // Look for a package pin and evaluate it.
    // CNC:2004-05-29
@@ -189,17 +355,22 @@ void pkgPolicy::CreatePin(pkgVersionMatch::MatchType Type,string Name,
       if (Pkg.end() == true)
       {
 	 // Check the unmatched table
-	 for (vector<PkgPin>::iterator I = Unmatched.begin();
-	      I != Unmatched.end() && P == 0; I++)
-	    if (I->Pkg == Name)
-	       P = &*I;
-
-	 if (P == 0)
-	    P = &*Unmatched.insert(Unmatched.end(),PkgPin());
+	 map<string,unsigned long>::iterator I = UnmatchedIdx.find(Name);
+	 if (I != UnmatchedIdx.end())
+	    P = &Unmatched[I->second];
+	 else
+	 {
+	    UnmatchedIdx[Name] = Unmatched.size();
+	    PkgPin &New = *Unmatched.insert(Unmatched.end(),PkgPin());
+	    New.Pkg = Name;
+	    P = &New;
+	 }
       }
       else
       {
 	 P = Pins + Pkg->ID;
+	 P->Match = CompileMatch(Type,Data,Priority);
+	 Known[Pkg->ID] = 0;
       }
    }
 
@@ -209,30 +380,42 @@ void pkgPolicy::CreatePin(pkgVersionMatch::MatchType Type,string Name,
    P->Data = Data;
 }
 									/*}}}*/
+// Policy::CompileMatch - Get the matcher of a package pin		/*{{{*/
+// ---------------------------------------------------------------------
+/* Pins with the same type, data and sign of version pin get the same
+   matcher, compiled against the package files once. */
+pkgVersionMatch *pkgPolicy::CompileMatch(pkgVersionMatch::MatchType Type,
+					 string const &Data,
+					 signed short Priority)
+{
+   if (Type == pkgVersionMatch::None)
+      return 0;
+
+   // CNC:2004-05-29 - Make negative pins on individual packages
+   // behave like package<>version, GetPriority() gives them the
+   // default pin priority.
+   bool Negative = (Type == pkgVersionMatch::Version && Priority < 0);
+   string Key = string(1,'0' + Type) + (Negative == true ? '!' : '=') + Data;
+   pkgVersionMatch *&Match = Matchers[Key];
+   if (Match != 0)
+      return Match;
+
+   if (Negative == true)
+      Match = new pkgVersionMatch(Data,Type,pkgCache::Dep::NotEquals);
+   else
+      Match = new pkgVersionMatch(Data,Type);
+   Match->Compile(*Cache);
+   return Match;
+}
+									/*}}}*/
 // Policy::GetMatch - Get the matching version for a package pin	/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 pkgCache::VerIterator pkgPolicy::GetMatch(pkgCache::PkgIterator Pkg)
 {
    const Pin &PPkg = Pins[Pkg->ID];
-   if (PPkg.Type != pkgVersionMatch::None)
-   {
-      // CNC:2004-05-29 - Make negative pins on individual packages
-      // behave like package<>version.
-      pkgCache::VerIterator Ver;
-      pkgVersionMatch *Match;
-      if (PPkg.Type == pkgVersionMatch::Version && PPkg.Priority < 0)
-      {
-         Match = new pkgVersionMatch(PPkg.Data,PPkg.Type, pkgCache::Dep::NotEquals);
-	 Pins[Pkg->ID].Priority = 0;
-      }
-      else
-         Match = new pkgVersionMatch(PPkg.Data,PPkg.Type);
-      Ver = Match->Find(Pkg);
-      delete Match;
-
-      return Ver;
-   }
+   if (PPkg.Type != pkgVersionMatch::None && PPkg.Match != 0)
+      return PPkg.Match->Find(Pkg);
    return pkgCache::VerIterator(*Pkg.Cache());
 }
 									/*}}}*/
@@ -246,18 +429,35 @@ signed short pkgPolicy::GetPriority(pkgCache::PkgIterator const &Pkg)
       // In this case 0 means default priority
       if (Pins[Pkg->ID].Priority == 0)
 	 return 989;
+      // A negative version pin is matched as package<>version
+      if (Pins[Pkg->ID].Type == pkgVersionMatch::Version &&
+	  Pins[Pkg->ID].Priority < 0)
+	 return 989;
       return Pins[Pkg->ID].Priority;
    }
 
    return 0;
 }
 									/*}}}*/
-// CNC:2003-03-06
 // Policy::GetPkgPriority - Return a package priority			/*{{{*/
 // ---------------------------------------------------------------------
-/* Evaluate the package pins and the default list to deteremine what the
-   best package is. This is a hacked version of GetCandidateVer(). */
+/* */
 signed short pkgPolicy::GetPkgPriority(const pkgCache::PkgIterator &Pkg)
+{
+   if ((Known[Pkg->ID] & PrioKnown) == 0)
+   {
+      PrioTable[Pkg->ID] = FindPkgPriority(Pkg);
+      Known[Pkg->ID] |= PrioKnown;
+   }
+   return PrioTable[Pkg->ID];
+}
+									/*}}}*/
+// CNC:2003-03-06
+// Policy::FindPkgPriority - Work out a package priority		/*{{{*/
+// ---------------------------------------------------------------------
+/* Evaluate the package pins and the default list to deteremine what the
+   best package is. This is a hacked version of FindCandidateVer(). */
+signed short pkgPolicy::FindPkgPriority(pkgCache::PkgIterator const &Pkg)
 {
    // Look for a package pin and evaluate it.
    signed Max = GetPriority(Pkg);
@@ -294,7 +494,7 @@ signed short pkgPolicy::GetPkgPriority(const pkgCache::PkgIterator &Pkg)
    }
 
    /* XXX HACK alert: give non-native packages slightly lower priority */
-   string CAS = _config->Find("RPM::CompatArchSuffix");
+   string const &CAS = CompatArchSuffix;
    if (!CAS.empty() &&
 	string(Pkg.Name()).rfind(CAS) != string::npos) {
         Max--;
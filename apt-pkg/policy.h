@@ -36,8 +36,10 @@
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/versionmatch.h>
 #include <vector>
+#include <map>
 
 using std::vector;
+using std::map;
 
 class pkgPolicy : public pkgDepCache::Policy
 {
@@ -46,7 +48,8 @@ class pkgPolicy : public pkgDepCache::Policy
       pkgVersionMatch::MatchType Type;
       string Data;
       signed short Priority;
-      Pin() : Type(pkgVersionMatch::None), Priority(0) {};
+      pkgVersionMatch *Match;
+      Pin() : Type(pkgVersionMatch::None), Priority(0), Match(0) {};
    };
 
    struct PkgPin : Pin
@@ -60,9 +63,36 @@ class pkgPolicy : public pkgDepCache::Policy
    signed short *PFPriority;
    vector<Pin> Defaults;
    vector<PkgPin> Unmatched;
+   map<string,unsigned long> UnmatchedIdx;
    pkgCache *Cache;
+
+   // Compiled matchers of the package pins, shared by equal pins
+   map<string,pkgVersionMatch *> Matchers;
+   pkgVersionMatch *CompileMatch(pkgVersionMatch::MatchType Type,
+				 string const &Data,signed short Priority);
+
    bool StatusOverride;
 
+   /* Candidate version and priority of each package, worked out for all
+      of them by Prepare() or one at a time at their first query, and
+      again for a single package when its pin changes */
+   enum TableFlags {CandKnown = (1 << 0), PrioKnown = (1 << 1)};
+   vector<map_ptrloc> CandTable;
+   vector<signed short> PrioTable;
+   vector<unsigned char> Known;
+   bool TableBuilt;
+   string CompatArchSuffix;
+
+   pkgCache::VerIterator FindCandidateVer(pkgCache::PkgIterator const &Pkg);
+   signed short FindPkgPriority(pkgCache::PkgIterator const &Pkg);
+   void FillTable(vector<pkgCache::Package *> const &Pkgs,
+		  unsigned long Start,unsigned long Stop);
+   void BuildTable();
+
+   struct TableJob;
+   static void *TableThread(void *Arg);
+   bool BuildTableThreaded();
+
    public:
 
    // Things for manipulating pins
@@ -78,6 +108,7 @@ class pkgPolicy : public pkgDepCache::Policy
 
    // Things for the cache interface.
    virtual pkgCache::VerIterator GetCandidateVer(pkgCache::PkgIterator Pkg);
+   virtual void Prepare();
    // CNC:2002-03-17 - Every place that uses this function seems to
    //		       currently check for IsCritical() as well. Since
    //		       this is a virtual (heavy) function, we'll try
@@ -86,7 +117,7 @@ class pkgPolicy : public pkgDepCache::Policy
    bool InitDefaults();
 
    pkgPolicy(pkgCache *Owner);
-   virtual ~pkgPolicy() {delete [] PFPriority; delete [] Pins;}
+   virtual ~pkgPolicy();
 };
 
 bool ReadPinFile(pkgPolicy &Plcy,string File = "");
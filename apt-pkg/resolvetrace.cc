@@ -0,0 +1,103 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Resolve Trace - Machine readable trace of the problem resolver
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <apt-pkg/resolvetrace.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+
+#include <apti18n.h>
+
+#include <stdarg.h>
+#include <sys/time.h>
+									/*}}}*/
+
+// ResolveTrace::pkgResolveTrace - Constructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+pkgResolveTrace::pkgResolveTrace(FILE *Out) : Out(Out), Begin(0)
+{
+   Begin = Now();
+   Reset();
+}
+									/*}}}*/
+// ResolveTrace::Get - The trace of this process			/*{{{*/
+// ---------------------------------------------------------------------
+/* The configuration is looked at once, by the first depcache. The file
+   is appended to and line buffered so lines of other runs and of other
+   processes don't mix. */
+pkgResolveTrace *pkgResolveTrace::Get()
+{
+   static bool Checked = false;
+   static pkgResolveTrace *Trace = 0;
+   if (Checked == true)
+      return Trace;
+   Checked = true;
+
+   string File = _config->Find("Debug::pkgProblemResolver::Trace");
+   if (File.empty() == true)
+      return 0;
+   FILE *Out = fopen(File.c_str(),"a");
+   if (Out == 0)
+   {
+      _error->Warning(_("Unable to open the resolver trace %s"),File.c_str());
+      return 0;
+   }
+   setvbuf(Out,0,_IOLBF,0);
+   Trace = new pkgResolveTrace(Out);
+   return Trace;
+}
+									/*}}}*/
+// ResolveTrace::Now - Seconds since the trace started			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+double pkgResolveTrace::Now() const
+{
+   struct timeval Tv;
+   gettimeofday(&Tv,0);
+   return Tv.tv_sec + Tv.tv_usec/1000000.0 - Begin;
+}
+									/*}}}*/
+// ResolveTrace::Event - Write an event					/*{{{*/
+// ---------------------------------------------------------------------
+/* Fmt gives the key=value part. */
+void pkgResolveTrace::Event(const char *Name,const char *Fmt,...)
+{
+   va_list Args;
+   va_start(Args,Fmt);
+   fprintf(Out,"%.6f %s ",Now(),Name);
+   vfprintf(Out,Fmt,Args);
+   fputc('\n',Out);
+   va_end(Args);
+}
+									/*}}}*/
+// ResolveTrace::Action - Write a change the resolver made		/*{{{*/
+// ---------------------------------------------------------------------
+/* Dep is the package whose dependency was the reason, if any. */
+void pkgResolveTrace::Action(const char *Op,pkgCache::PkgIterator const &Pkg,
+			     int Score,const char *Reason,const char *Dep)
+{
+   Event("action","op=%s pkg=%s score=%i reason=%s dep=%s",Op,Pkg.Name(),
+	 Score,Reason,Dep == 0 ? "-" : Dep);
+}
+									/*}}}*/
+// ResolveTrace::MarkInstall - Count and write a MarkInstall() call	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgResolveTrace::MarkInstall(pkgCache::PkgIterator const &Pkg,
+				  bool AutoInst,unsigned long Depth)
+{
+   MarkInstalls++;
+   if (Depth > MaxDepth)
+      MaxDepth = Depth;
+   if (Depth > 100)
+      DepthLimited++;
+   Event("mark-install","pkg=%s depth=%lu auto=%i",Pkg.Name(),Depth,
+	 AutoInst == true);
+}
+									/*}}}*/
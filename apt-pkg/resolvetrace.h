@@ -0,0 +1,74 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Resolve Trace - Machine readable trace of the problem resolver
+
+   When Debug::pkgProblemResolver::Trace names a file, the problem
+   resolver and pkgDepCache::MarkInstall() append a line to it for each
+   thing they do:
+
+      <seconds> <event> key=value key=value ...
+
+   Seconds count from the first event of the process, values never hold
+   spaces. The events are
+      resolve-start   broken, fix
+      phase           name, secs
+      consider        pkg, score, pass
+      action          op, pkg, score, reason, dep
+      mark-install    pkg, depth, auto
+      resolve-end     ok, broken, passes, considered, mark-install,
+                      max-depth, depth-limited
+   The trace is shared by everything in the process. When it is off
+   Get() returns 0 and every caller only tests that pointer.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_RESOLVETRACE_H
+#define PKGLIB_RESOLVETRACE_H
+
+#include <apt-pkg/pkgcache.h>
+
+#include <stdio.h>
+
+class pkgResolveTrace
+{
+   FILE *Out;
+   double Begin;
+
+   pkgResolveTrace(FILE *Out);
+
+   public:
+
+   // MarkInstall() counters, resolve-end reports them since Reset()
+   unsigned long MarkInstalls;
+   unsigned long MaxDepth;
+   unsigned long DepthLimited;
+
+   double Now() const;
+   void Event(const char *Name,const char *Fmt,...);
+   void Action(const char *Op,pkgCache::PkgIterator const &Pkg,int Score,
+	       const char *Reason,const char *Dep = 0);
+   void MarkInstall(pkgCache::PkgIterator const &Pkg,bool AutoInst,
+		    unsigned long Depth);
+   void Reset() {MarkInstalls = MaxDepth = DepthLimited = 0;}
+
+   // Writes a phase event with the time between its creation and end
+   class Timer
+   {
+      pkgResolveTrace *Trace;
+      const char *Name;
+      double Start;
+
+      public:
+
+      Timer(pkgResolveTrace *Trace,const char *Name) : Trace(Trace), Name(Name)
+	 {if (Trace != 0) Start = Trace->Now();}
+      ~Timer()
+	 {if (Trace != 0) Trace->Event("phase","name=%s secs=%.6f",Name,Trace->Now() - Start);}
+   };
+
+   static pkgResolveTrace *Get();
+};
+
+#endif
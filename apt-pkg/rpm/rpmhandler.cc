@@ -12,21 +12,34 @@
 #ifdef HAVE_RPM
 
 #include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
 #include <utime.h>
 #include <unistd.h>
 #include <signal.h>
 #include <assert.h>
 #include <libgen.h>
 #include <cstring>
+#include <cstdio>
 #include <sstream>
 #include <algorithm>
+#include <map>
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
 
 #include <apt-pkg/error.h>
 #include <apt-pkg/configuration.h>
+#include <apt-pkg/strutl.h>
 #include <apt-pkg/md5.h>
 #include <apt-pkg/crc-16.h>
+#include <apt-pkg/rhash.h>
+#include <apt-pkg/gzindex.h>
 
 #include "rpmhandler.h"
 #include "rpmpackagedata.h"
@@ -264,9 +277,19 @@ bool RPMHdrHandler::ChangeLog(vector<ChangeLogEntry *> &ChangeLogs) const
    return true;
 }
 
-RPMFileHandler::RPMFileHandler(string File)
+RPMFileHandler::RPMFileHandler(string File) : Indexed(NULL)
 {
    ID = File;
+   FD = NULL;
+   GzIndexReader *Reader = new GzIndexReader;
+   if (Reader->Open(File) == true)
+   {
+      Indexed = Reader;
+      iSize = Indexed->Size();
+      return;
+   }
+   delete Reader;
+
    FD = Fopen(File.c_str(), "r");
    if (FD == NULL)
    {
@@ -279,7 +302,7 @@ RPMFileHandler::RPMFileHandler(string File)
    iSize = fdSize(FD);
 }
 
-RPMFileHandler::RPMFileHandler(FileFd *File)
+RPMFileHandler::RPMFileHandler(FileFd *File) : Indexed(NULL)
 {
    FD = fdDup(File->Fd());
    if (FD == NULL)
@@ -299,10 +322,53 @@ RPMFileHandler::~RPMFileHandler()
       headerFree(HeaderP);
    if (FD != NULL)
       Fclose(FD);
+   delete Indexed;
+}
+
+// RPMFileHandler::ReadIndexed - headerRead() from a compressed list	/*{{{*/
+// ---------------------------------------------------------------------
+/* The headers are stored as headerWrite() leaves them, magic first. */
+bool RPMFileHandler::ReadIndexed()
+{
+   static const unsigned char Magic[] = {0x8e, 0xad, 0xe8, 0x01, 0, 0, 0, 0};
+   unsigned char Intro[16];
+   unsigned long Actual = 0;
+   if (Indexed->Read(Intro, sizeof(Intro), &Actual) == false || Actual == 0)
+      return false;
+
+   uint32_t il, dl;
+   memcpy(&il, Intro + 8, sizeof(il));
+   memcpy(&dl, Intro + 12, sizeof(dl));
+   il = ntohl(il);
+   dl = ntohl(dl);
+   if (Actual != sizeof(Intro) || memcmp(Intro, Magic, sizeof(Magic)) != 0 ||
+       il > 0xffff || dl > 0x10000000)
+      return _error->Error(_("Corrupt package list %s"), ID.c_str());
+
+   unsigned long Len = 8 + il*16 + dl;
+   vector<char> Blob(Len);
+   memcpy(&Blob[0], Intro + 8, 8);
+   if (Indexed->Read(&Blob[8], Len - 8) == false)
+      return false;
+#if RPM_VERSION >= 0x040c00
+   HeaderP = headerImport(&Blob[0], Len, HEADERIMPORT_COPY);
+#else
+   HeaderP = headerCopyLoad(&Blob[0]);
+#endif
+   return (HeaderP != NULL);
 }
+									/*}}}*/
 
 bool RPMFileHandler::Skip()
 {
+   if (Indexed != NULL)
+   {
+      iOffset = Indexed->Tell();
+      if (HeaderP != NULL)
+	 headerFree(HeaderP);
+      HeaderP = NULL;
+      return ReadIndexed();
+   }
    if (FD == NULL)
       return false;
    iOffset = lseek(Fileno(FD),0,SEEK_CUR);
@@ -314,6 +380,8 @@ bool RPMFileHandler::Skip()
 
 bool RPMFileHandler::Jump(off_t Offset)
 {
+   if (Indexed != NULL)
+      return (Indexed->Seek(Offset) == true && Skip() == true);
    if (FD == NULL)
       return false;
    if (lseek(Fileno(FD),Offset,SEEK_SET) != Offset)
@@ -323,6 +391,12 @@ bool RPMFileHandler::Jump(off_t Offset)
 
 void RPMFileHandler::Rewind()
 {
+   if (Indexed != NULL)
+   {
+      Indexed->Seek(0);
+      iOffset = 0;
+      return;
+   }
    if (FD == NULL)
       return;
    iOffset = lseek(Fileno(FD),0,SEEK_SET);
@@ -415,24 +489,331 @@ bool RPMSingleFileHandler::ChangeLog(vector<ChangeLogEntry* > &ChangeLogs) const
    return RPMHdrHandler::ChangeLog(ChangeLogs);
 }
 
+#if RPM_VERSION >= 0x040c00
+// Helpers shared by the header caches					/*{{{*/
+// ---------------------------------------------------------------------
+/* Both caches keep their previous contents mapped and refer into the
+   map until they are rewritten. A missing or empty file isn't an error. */
+static void *MapCacheFile(const string &FileName, size_t &Size)
+{
+   int Fd = open(FileName.c_str(), O_RDONLY);
+   if (Fd < 0)
+      return NULL;
+   struct stat St;
+   if (fstat(Fd, &St) != 0 || St.st_size == 0) {
+      close(Fd);
+      return NULL;
+   }
+   void *Map = mmap(NULL, St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+   close(Fd);
+   if (Map == MAP_FAILED)
+      return NULL;
+   Size = St.st_size;
+   return Map;
+}
+
+static bool WriteCacheString(FILE *F, const char *Data, unsigned long Len)
+{
+   uint32_t L = Len;
+   return (fwrite(&L, sizeof(L), 1, F) == 1 &&
+	   (Len == 0 || fwrite(Data, Len, 1, F) == 1));
+}
+
+static bool ReadCacheString(const char *&Pos, const char *End,
+			    const char *&Data, uint32_t &Len)
+{
+   if ((size_t)(End - Pos) < sizeof(Len))
+      return false;
+   memcpy(&Len, Pos, sizeof(Len));
+   Pos += sizeof(Len);
+   if ((size_t)(End - Pos) < Len)
+      return false;
+   Data = Pos;
+   Pos += Len;
+   return true;
+}
+
+// Copy the given tags to a new header, as genpkglist does
+static Header StripCacheHeader(Header Full, const raptTag *Tags, size_t Count)
+{
+   Header H = headerNew();
+   struct rpmtd_s td;
+   for (size_t i = 0; i < Count; i++) {
+      if (headerGet(Full, Tags[i], &td, HEADERGET_RAW)) {
+	 headerPut(H, &td, HEADERPUT_DEFAULT);
+	 rpmtdFreeData(&td);
+      }
+   }
+   return H;
+}
+									/*}}}*/
+// RPMDirHeaderCache - Stripped headers and hashes of rpm-dir packages	/*{{{*/
+// ---------------------------------------------------------------------
+/* An rpm-dir source has no index, so each merge used to open every
+   package in the directory to read its header, and hash it in full on
+   top of that. This remembers both per file name, valid for as long as
+   the inode, size and mtime of the file stay the same, so a rescan of an
+   unchanged directory doesn't open any package at all.
+
+   The cache lives in Dir::Cache::dirheaders, one file per directory.
+   File layout, in host byte order:
+      "APTDRHC1", uint32 count
+      count * (uint32 length + name, uint64 inode, uint64 size,
+	       uint64 mtime, uint32 length + md5, uint32 length + blob)
+*/
+static const char DirHeaderCacheMagic[] = "APTDRHC1";
+
+static raptTag DirHeaderCacheTags[] = {
+   RPMTAG_NAME,
+   RPMTAG_EPOCH,
+   RPMTAG_VERSION,
+   RPMTAG_RELEASE,
+   RPMTAG_GROUP,
+   RPMTAG_ARCH,
+   RPMTAG_PACKAGER,
+   RPMTAG_SOURCERPM,
+   RPMTAG_SIZE,
+   RPMTAG_VENDOR,
+   RPMTAG_OS,
+
+   RPMTAG_DESCRIPTION,
+   RPMTAG_SUMMARY,
+   RPMTAG_HEADERI18NTABLE,
+
+   RPMTAG_REQUIREFLAGS,
+   RPMTAG_REQUIRENAME,
+   RPMTAG_REQUIREVERSION,
+
+   RPMTAG_CONFLICTFLAGS,
+   RPMTAG_CONFLICTNAME,
+   RPMTAG_CONFLICTVERSION,
+
+   RPMTAG_PROVIDENAME,
+   RPMTAG_PROVIDEFLAGS,
+   RPMTAG_PROVIDEVERSION,
+
+   RPMTAG_OBSOLETENAME,
+   RPMTAG_OBSOLETEFLAGS,
+   RPMTAG_OBSOLETEVERSION,
+
+   RPMTAG_SUGGESTNAME,
+   RPMTAG_SUGGESTFLAGS,
+   RPMTAG_SUGGESTVERSION,
+
+   RPMTAG_ENHANCENAME,
+   RPMTAG_ENHANCEFLAGS,
+   RPMTAG_ENHANCEVERSION,
+
+   RPMTAG_DIRNAMES,
+   RPMTAG_BASENAMES,
+   RPMTAG_DIRINDEXES,
+
+   RPMTAG_CHANGELOGTIME,
+   RPMTAG_CHANGELOGNAME,
+   RPMTAG_CHANGELOGTEXT
+};
+
+class RPMDirHeaderCache
+{
+   struct Entry
+   {
+      unsigned long long Inode;
+      unsigned long long Size;
+      unsigned long long Mtime;
+      string MD5;
+      const char *Blob;
+      unsigned long Len;
+   };
+   struct NewEntry
+   {
+      string MD5;
+      string Blob;
+   };
+
+   string FileName;
+
+   void *OldMap;
+   size_t OldSize;
+   map<string,Entry> Entries;
+   map<string,NewEntry> Added;
+
+   bool Load();
+   const Entry *Lookup(const RPMDirHandler::DirFile &F) const;
+
+   public:
+
+   bool Valid(const RPMDirHandler::DirFile &F) const
+      {return Lookup(F) != NULL;}
+   Header Find(RPMDirHandler::DirFile &F);
+   Header Add(const RPMDirHandler::DirFile &F, Header Full);
+   bool Commit(const vector<RPMDirHandler::DirFile> &Files);
+
+   RPMDirHeaderCache(const string &FileName);
+   ~RPMDirHeaderCache();
+};
+
+RPMDirHeaderCache::RPMDirHeaderCache(const string &FileName) :
+   FileName(FileName), OldMap(NULL), OldSize(0)
+{
+   if (Load() == false)
+      Entries.clear();
+}
+
+RPMDirHeaderCache::~RPMDirHeaderCache()
+{
+   if (OldMap != NULL)
+      munmap(OldMap, OldSize);
+}
+
+// Like the database header cache, anything unexpected in the file just
+// makes it get rewritten.
+bool RPMDirHeaderCache::Load()
+{
+   OldMap = MapCacheFile(FileName, OldSize);
+   if (OldMap == NULL)
+      return false;
+
+   const char *Pos = (const char *)OldMap;
+   const char *End = Pos + OldSize;
+   uint32_t Count;
+
+   if ((size_t)(End - Pos) < sizeof(DirHeaderCacheMagic) - 1 + sizeof(Count) ||
+       memcmp(Pos, DirHeaderCacheMagic, sizeof(DirHeaderCacheMagic) - 1) != 0)
+      return false;
+   Pos += sizeof(DirHeaderCacheMagic) - 1;
+   memcpy(&Count, Pos, sizeof(Count));
+   Pos += sizeof(Count);
+
+   for (; Count > 0; Count--) {
+      const char *Name;
+      const char *MD5;
+      uint32_t NameLen, MD5Len, Len;
+      uint64_t Key[3];
+      Entry E;
+      if (ReadCacheString(Pos, End, Name, NameLen) == false ||
+	  (size_t)(End - Pos) < sizeof(Key))
+	 return false;
+      memcpy(Key, Pos, sizeof(Key));
+      Pos += sizeof(Key);
+      if (ReadCacheString(Pos, End, MD5, MD5Len) == false ||
+	  ReadCacheString(Pos, End, E.Blob, Len) == false)
+	 return false;
+      E.Inode = Key[0];
+      E.Size = Key[1];
+      E.Mtime = Key[2];
+      E.MD5 = string(MD5, MD5Len);
+      E.Len = Len;
+      Entries[string(Name, NameLen)] = E;
+   }
+   return true;
+}
+
+const RPMDirHeaderCache::Entry *
+RPMDirHeaderCache::Lookup(const RPMDirHandler::DirFile &F) const
+{
+   map<string,Entry>::const_iterator I = Entries.find(F.Name);
+   if (I == Entries.end() ||
+       I->second.Inode != (unsigned long long)F.Inode ||
+       I->second.Size != (unsigned long long)F.Size ||
+       I->second.Mtime != (unsigned long long)F.Mtime)
+      return NULL;
+   return &I->second;
+}
+
+Header RPMDirHeaderCache::Find(RPMDirHandler::DirFile &F)
+{
+   const Entry *E = Lookup(F);
+   if (E == NULL)
+      return NULL;
+   Header H = headerImport((void *)E->Blob, E->Len, HEADERIMPORT_COPY);
+   if (H != NULL)
+      F.MD5 = E->MD5;
+   return H;
+}
+
+// Strip the package header down and remember it for Commit()
+Header RPMDirHeaderCache::Add(const RPMDirHandler::DirFile &F, Header Full)
+{
+   Header H = StripCacheHeader(Full, DirHeaderCacheTags,
+			       sizeof(DirHeaderCacheTags)/sizeof(raptTag));
+   unsigned int Len = 0;
+   void *Blob = headerExport(H, &Len);
+   if (Blob != NULL) {
+      NewEntry &N = Added[F.Name];
+      N.MD5 = F.MD5;
+      N.Blob = string((const char *)Blob, Len);
+      free(Blob);
+   }
+   return H;
+}
+
+// Rewrite the file when a package was added, changed or removed. Files
+// that haven't been looked at keep their old entry if it's still valid.
+bool RPMDirHeaderCache::Commit(const vector<RPMDirHandler::DirFile> &Files)
+{
+   vector<RPMDirHandler::DirFile>::const_iterator I;
+   uint32_t Count = 0;
+   unsigned long Kept = 0;
+   for (I = Files.begin(); I != Files.end(); I++) {
+      if (Added.find(I->Name) != Added.end())
+	 Count++;
+      else if (Lookup(*I) != NULL)
+	 Count++, Kept++;
+   }
+   if (Added.empty() == true && Kept == Entries.size())
+      return true;
+
+   string NewName = FileName + ".new";
+   FILE *F = fopen(NewName.c_str(), "w");
+   if (F == NULL && errno == ENOENT &&
+       mkdir(flNotFile(FileName).c_str(), 0755) == 0)
+      F = fopen(NewName.c_str(), "w");
+   if (F == NULL)
+      return false;
+
+   bool Res = (fwrite(DirHeaderCacheMagic, sizeof(DirHeaderCacheMagic) - 1,
+		      1, F) == 1 &&
+	       fwrite(&Count, sizeof(Count), 1, F) == 1);
+   for (I = Files.begin(); Res == true && I != Files.end(); I++) {
+      map<string,NewEntry>::const_iterator A = Added.find(I->Name);
+      const Entry *E = Lookup(*I);
+      if (A == Added.end() && E == NULL)
+	 continue;
+      uint64_t Key[3] = {(uint64_t)I->Inode, (uint64_t)I->Size,
+			 (uint64_t)I->Mtime};
+      Res = (WriteCacheString(F, I->Name.c_str(), I->Name.size()) &&
+	     fwrite(Key, sizeof(Key), 1, F) == 1);
+      if (Res == false)
+	 break;
+      if (A != Added.end())
+	 Res = (WriteCacheString(F, A->second.MD5.c_str(), A->second.MD5.size()) &&
+		WriteCacheString(F, A->second.Blob.c_str(), A->second.Blob.size()));
+      else
+	 Res = (WriteCacheString(F, E->MD5.c_str(), E->MD5.size()) &&
+		WriteCacheString(F, E->Blob, E->Len));
+   }
+   if (fclose(F) != 0)
+      Res = false;
+
+   if (Res == false || rename(NewName.c_str(), FileName.c_str()) != 0) {
+      unlink(NewName.c_str());
+      return false;
+   }
+   Added.clear();
+   return true;
+}
+									/*}}}*/
+#endif
+
 RPMDirHandler::RPMDirHandler(string DirName)
-   : sDirName(DirName)
+   : DirOK(false), sDirName(DirName), TS(NULL), HdrCache(NULL),
+     Walking(false)
 {
    ID = DirName;
-   TS = NULL;
-   Dir = opendir(sDirName.c_str());
+   iSize = 0;
+   DIR *Dir = opendir(sDirName.c_str());
    if (Dir == NULL)
       return;
-   iSize = 0;
-   while (nextFileName() != NULL)
-      iSize += 1;
-   rewinddir(Dir);
-   TS = rpmtsCreate();
-   rpmtsSetVSFlags(TS, (rpmVSFlags_e)-1);
-}
-
-const char *RPMDirHandler::nextFileName()
-{
    for (struct dirent *Ent = readdir(Dir); Ent != 0; Ent = readdir(Dir))
    {
       const char *name = Ent->d_name;
@@ -444,16 +825,33 @@ const char *RPMDirHandler::nextFileName()
 	 continue;
 
       // Make sure it is a file and not something else
-      sFilePath = flCombine(sDirName,name);
       struct stat St;
-      if (stat(sFilePath.c_str(),&St) != 0 || S_ISREG(St.st_mode) == 0)
+      if (stat(flCombine(sDirName,name).c_str(),&St) != 0 ||
+	  S_ISREG(St.st_mode) == 0)
 	 continue;
 
-      sFileName = name;
+      DirFile F;
+      F.Name = name;
+      F.Inode = St.st_ino;
+      F.Size = St.st_size;
+      F.Mtime = St.st_mtime;
+      F.Scanned = false;
+      Files.push_back(F);
+   }
+   closedir(Dir);
+   DirOK = true;
+   iSize = Files.size();
+   TS = rpmtsCreate();
+   rpmtsSetVSFlags(TS, (rpmVSFlags_e)-1);
 
-      return name;
+#if RPM_VERSION >= 0x040c00
+   if (_config->FindB("RPM::Dir-Header-Cache", true) == true) {
+      // Quoting '%' as well keeps two directories from sharing a file
+      HdrCache = new RPMDirHeaderCache(
+	 _config->FindDir("Dir::Cache::dirheaders") +
+	 QuoteString(sDirName, "/%") + ".bin");
    }
-   return NULL;
+#endif
 }
 
 RPMDirHandler::~RPMDirHandler()
@@ -462,82 +860,280 @@ RPMDirHandler::~RPMDirHandler()
       headerFree(HeaderP);
    if (TS != NULL)
       rpmtsFree(TS);
-   if (Dir != NULL)
-      closedir(Dir);
+#if RPM_VERSION >= 0x040c00
+   if (HdrCache != NULL) {
+      HdrCache->Commit(Files);
+      delete HdrCache;
+   }
+#endif
 }
 
-bool RPMDirHandler::Skip()
+string RPMDirHandler::FileHash(const string &Path, const string &HashType)
 {
-   if (Dir == NULL)
+   int Fd = open(Path.c_str(), O_RDONLY);
+   if (Fd < 0)
+      return "";
+   struct stat St;
+   raptHash MD5(HashType);
+   bool Res = (fstat(Fd, &St) == 0 && MD5.AddFD(Fd, St.st_size) == true);
+   close(Fd);
+   return (Res == true) ? MD5.Result() : "";
+}
+
+#if defined(HAVE_PTHREAD) && RPM_VERSION >= 0x040c00
+// Big endian 32 bit number, as used in the package layout
+static uint32_t PackageInt(const unsigned char *P)
+{
+   return ((uint32_t)P[0] << 24) | ((uint32_t)P[1] << 16) |
+	  ((uint32_t)P[2] << 8) | (uint32_t)P[3];
+}
+
+// ScanPackage - Hash a package and pick up its main header		/*{{{*/
+// ---------------------------------------------------------------------
+/* The package is read once. On the way the lead, the signature header
+   and the intro of the main header are followed to find the bytes of the
+   main header, which are kept in the form headerImport() takes. This
+   doesn't call into librpm. A file that doesn't look like a package just
+   gets no header, the caller reads it with librpm then. */
+static bool ScanPackage(const string &Path, const string &HashType,
+			string &MD5, string &RawHeader)
+{
+   static const unsigned char LeadMagic[] = {0xed, 0xab, 0xee, 0xdb};
+   static const unsigned char HeaderMagic[] = {0x8e, 0xad, 0xe8};
+   int Fd = open(Path.c_str(), O_RDONLY);
+   if (Fd < 0)
       return false;
-   if (HeaderP != NULL) {
-      headerFree(HeaderP);
-      HeaderP = NULL;
+
+   // 96 bytes of lead, then the signature and the main header, each with
+   // 16 bytes of magic, index count and data size in front
+   enum {Signature, Intro, Body, Done, Broken} Stage = Signature;
+   string Head;
+   size_t Need = 96 + 16;
+   size_t Start = 0;
+   raptHash Hash(HashType);
+   unsigned char Buf[64*1024];
+   bool Res = true;
+   while (true) {
+      ssize_t Len = read(Fd, Buf, sizeof(Buf));
+      if (Len < 0 && errno == EINTR)
+	 continue;
+      if (Len <= 0) {
+	 Res = (Len == 0);
+	 break;
+      }
+      Hash.Add(Buf, Len);
+      if (Stage >= Done)
+	 continue;
+
+      Head.append((const char *)Buf, Len);
+      while (Stage < Done && Head.size() >= Need) {
+	 const unsigned char *P = (const unsigned char *)Head.data();
+	 if (Stage == Body) {
+	    RawHeader = Head.substr(Start + 8, Need - Start - 8);
+	    Stage = Done;
+	    break;
+	 }
+	 uint32_t Il = PackageInt(P + Need - 8);
+	 uint32_t Dl = PackageInt(P + Need - 4);
+	 if ((Stage == Signature && memcmp(P, LeadMagic, 4) != 0) ||
+	     memcmp(P + Need - 16, HeaderMagic, 3) != 0 ||
+	     Il > 0xffff || Dl > 0x10000000) {
+	    Stage = Broken;
+	    break;
+	 }
+	 if (Stage == Signature) {
+	    // The signature is padded to 8 bytes
+	    Start = 96 + ((16 + Il*16 + Dl + 7) & ~7);
+	    Need = Start + 16;
+	    Stage = Intro;
+	 } else {
+	    Need = Start + 16 + Il*16 + Dl;
+	    Stage = Body;
+	 }
+      }
+      if (Stage >= Done)
+	 string().swap(Head);
    }
-   const char *fname = nextFileName();
-   bool Res = false;
-   for (; fname != NULL; fname = nextFileName()) {
-      iOffset++;
-      if (fname == NULL)
+   close(Fd);
+   if (Res == true)
+      MD5 = Hash.Result();
+   return Res;
+}
+									/*}}}*/
+// RPMDirHandler::ScanFiles - Read new packages in a few threads	/*{{{*/
+// ---------------------------------------------------------------------
+/* Each package the cache doesn't know has to be read in full for its
+   hash, and its header has to be read on top of that. When a walk gets
+   to such a file, it and the next ones missing from the cache are read
+   by a few threads, each taking the next file off the shared list and
+   doing both in one pass with ScanPackage(). librpm isn't safe to use
+   from several threads at once, so only turning the header bytes into a
+   Header is left to the caller. The batch is limited to bound the raw
+   headers held at a time. Files that fail here are read again the usual
+   way. */
+struct RPMDirScanJob
+{
+   pthread_mutex_t Lock;
+   vector<RPMDirHandler::DirFile*> Todo;
+   vector<RPMDirHandler::DirFile*>::size_type Next;
+   string DirName;
+   string HashType;
+};
+
+static void *RPMDirScanThread(void *Arg)
+{
+   RPMDirScanJob *Job = (RPMDirScanJob *)Arg;
+   while (true) {
+      pthread_mutex_lock(&Job->Lock);
+      RPMDirHandler::DirFile *F = NULL;
+      if (Job->Next < Job->Todo.size())
+	 F = Job->Todo[Job->Next++];
+      pthread_mutex_unlock(&Job->Lock);
+      if (F == NULL)
+	 break;
+      if (ScanPackage(flCombine(Job->DirName, F->Name), Job->HashType,
+		      F->MD5, F->RawHeader) == false)
+	 F->RawHeader.clear();
+   }
+   return NULL;
+}
+
+void RPMDirHandler::ScanFiles(vector<DirFile>::size_type From)
+{
+   int Threads = _config->FindI("RPM::Dir-Header-Cache::Threads", 4);
+   if (Threads < 2)
+      return;
+
+   RPMDirScanJob Job;
+   for (vector<DirFile>::size_type I = From;
+	I < Files.size() && Job.Todo.size() < (unsigned)Threads*16; I++) {
+      DirFile &F = Files[I];
+      if (F.Scanned == true || HdrCache->Valid(F) == true)
+	 continue;
+      F.Scanned = true;
+      Job.Todo.push_back(&F);
+   }
+   if (Job.Todo.size() < 2)
+      return;
+   if ((unsigned)Threads > Job.Todo.size())
+      Threads = Job.Todo.size();
+
+   Job.Next = 0;
+   Job.DirName = sDirName;
+   Job.HashType = HashType();
+   pthread_mutex_init(&Job.Lock, NULL);
+   vector<pthread_t> Tids;
+   for (int I = 0; I < Threads; I++) {
+      pthread_t Tid;
+      if (pthread_create(&Tid, NULL, RPMDirScanThread, &Job) != 0)
 	 break;
+      Tids.push_back(Tid);
+   }
+   // If no thread could be started the files get read one by one in Skip()
+   for (vector<pthread_t>::iterator I = Tids.begin(); I != Tids.end(); I++)
+      pthread_join(*I, NULL);
+   pthread_mutex_destroy(&Job.Lock);
+}
+									/*}}}*/
+#endif
+
+bool RPMDirHandler::ReadHeader(DirFile &F)
+{
+   Header Full = NULL;
+#if RPM_VERSION >= 0x040c00
+   if (F.RawHeader.empty() == false) {
+      Full = headerImport((void *)F.RawHeader.data(), F.RawHeader.size(),
+			  HEADERIMPORT_COPY);
+      string().swap(F.RawHeader);
+      // Old packages need the conversions rpmReadPackageFile() does
+      if (Full != NULL &&
+	  (headerIsEntry(Full, RPMTAG_HEADERIMMUTABLE) == 0 ||
+	   headerIsEntry(Full, RPMTAG_OLDFILENAMES) != 0)) {
+	 headerFree(Full);
+	 Full = NULL;
+      }
+   }
+#endif
+   if (Full == NULL) {
       FD_t FD = Fopen(sFilePath.c_str(), "r");
       if (FD == NULL)
-	 continue;
-      int rc = rpmReadPackageFile(TS, FD, fname, &HeaderP);
+	 return false;
+      int rc = rpmReadPackageFile(TS, FD, sFileName.c_str(), &Full);
       Fclose(FD);
       if (rc != RPMRC_OK
 	  && rc != RPMRC_NOTTRUSTED
 	  && rc != RPMRC_NOKEY)
-	 continue;
-      Res = true;
-      break;
+	 return false;
    }
-   return Res;
+#if RPM_VERSION >= 0x040c00
+   if (HdrCache != NULL) {
+      if (F.MD5.empty() == true)
+	 F.MD5 = FileHash(sFilePath, HashType());
+      HeaderP = HdrCache->Add(F, Full);
+      headerFree(Full);
+      return true;
+   }
+#endif
+   HeaderP = Full;
+   return true;
 }
 
-bool RPMDirHandler::Jump(off_t Offset)
+bool RPMDirHandler::Skip()
 {
-   if (Dir == NULL)
+   if (DirOK == false)
       return false;
-   rewinddir(Dir);
-   iOffset = 0;
-   while (1) {
-      if (iOffset+1 == Offset)
-	 return Skip();
-      if (nextFileName() == NULL)
-	 break;
-      iOffset++;
+   if (HeaderP != NULL) {
+      headerFree(HeaderP);
+      HeaderP = NULL;
+   }
+   while ((vector<DirFile>::size_type)iOffset < Files.size()) {
+      DirFile &F = Files[iOffset++];
+      sFileName = F.Name;
+      sFilePath = flCombine(sDirName, F.Name);
+#if RPM_VERSION >= 0x040c00
+      if (HdrCache != NULL && (HeaderP = HdrCache->Find(F)) != NULL)
+	 return true;
+#endif
+#if defined(HAVE_PTHREAD) && RPM_VERSION >= 0x040c00
+      if (Walking == true && HdrCache != NULL && F.Scanned == false)
+	 ScanFiles(iOffset - 1);
+#endif
+      if (ReadHeader(F) == true)
+	 return true;
    }
    return false;
 }
 
+bool RPMDirHandler::Jump(off_t Offset)
+{
+   if (DirOK == false || Offset < 1 ||
+       (vector<DirFile>::size_type)Offset > Files.size())
+      return false;
+   Walking = false;
+   iOffset = Offset - 1;
+   return Skip();
+}
+
 void RPMDirHandler::Rewind()
 {
-   rewinddir(Dir);
    iOffset = 0;
+   Walking = true;
 }
 
 off_t RPMDirHandler::FileSize() const
 {
-   if (Dir == NULL)
-      return 0;
-   struct stat St;
-   if (stat(sFilePath.c_str(),&St) != 0) {
-      _error->Errno("stat",_("Unable to determine the file size"));
+   if (DirOK == false || iOffset == 0)
       return 0;
-   }
-   return St.st_size;
+   return Files[iOffset-1].Size;
 }
 
 string RPMDirHandler::Hash() const
 {
-   if (Dir == NULL)
+   if (DirOK == false || iOffset == 0)
       return "";
-   raptHash MD5(HashType());
-   FileFd File(sFilePath, FileFd::ReadOnly);
-   MD5.AddFD(File.Fd(), File.Size());
-   File.Close();
-   return MD5.Result();
+   if (Files[iOffset-1].MD5.empty() == false)
+      return Files[iOffset-1].MD5;
+   return FileHash(sFilePath, HashType());
 }
 
 string RPMDirHandler::HashType() const
@@ -545,8 +1141,244 @@ string RPMDirHandler::HashType() const
    return "MD5-Hash";
 }
 
+#if RPM_VERSION >= 0x040c00
+// RPMDBHeaderCache - Stripped copies of the installed headers		/*{{{*/
+// ---------------------------------------------------------------------
+/* Any rpm transaction changes the database mtime and with it throws away
+   pkgcache.bin, after which every installed header has to be read from
+   the database again. This keeps a copy of each installed header, reduced
+   to what the cache generator looks at, keyed by its database instance and
+   SHA1HEADER. When the cache is rebuilt only the headers that were added
+   since the last run are read from the database; removed ones simply
+   aren't listed by the index anymore.
+
+   File layout, in host byte order:
+      "APTDBHC1", uint32 count, uint32 length + database path
+      count * (uint32 instance, uint32 length + sha1, uint32 length + blob)
+*/
+static const char DBHeaderCacheMagic[] = "APTDBHC1";
+
+static raptTag DBHeaderCacheTags[] = {
+   RPMTAG_NAME,
+   RPMTAG_EPOCH,
+   RPMTAG_VERSION,
+   RPMTAG_RELEASE,
+   RPMTAG_GROUP,
+   RPMTAG_ARCH,
+   RPMTAG_PACKAGER,
+   RPMTAG_SOURCERPM,
+   RPMTAG_SIZE,
+   RPMTAG_VENDOR,
+   RPMTAG_HEADERI18NTABLE,
+
+   RPMTAG_REQUIREFLAGS,
+   RPMTAG_REQUIRENAME,
+   RPMTAG_REQUIREVERSION,
+
+   RPMTAG_CONFLICTFLAGS,
+   RPMTAG_CONFLICTNAME,
+   RPMTAG_CONFLICTVERSION,
+
+   RPMTAG_PROVIDENAME,
+   RPMTAG_PROVIDEFLAGS,
+   RPMTAG_PROVIDEVERSION,
+
+   RPMTAG_OBSOLETENAME,
+   RPMTAG_OBSOLETEFLAGS,
+   RPMTAG_OBSOLETEVERSION,
+
+   RPMTAG_SUGGESTNAME,
+   RPMTAG_SUGGESTFLAGS,
+   RPMTAG_SUGGESTVERSION,
+
+   RPMTAG_DIRNAMES,
+   RPMTAG_BASENAMES,
+   RPMTAG_DIRINDEXES
+};
+
+class RPMDBHeaderCache
+{
+   struct Entry
+   {
+      string SHA1;
+      const char *Blob;
+      unsigned long Len;
+   };
+
+   string FileName;
+   string DBPath;
+
+   void *OldMap;
+   size_t OldSize;
+   map<raptDbOffset,Entry> Entries;
+
+   // Headers read from the database since the last Commit()
+   map<raptDbOffset,string> Added;
+
+   bool Load();
+
+   public:
+
+   Header Find(raptDbOffset Offset, const string &SHA1);
+   Header Add(raptDbOffset Offset, Header Full);
+   bool Commit(const vector<RPMDBHandler::Instance> &Instances);
+
+   RPMDBHeaderCache(const string &FileName, const string &DBPath);
+   ~RPMDBHeaderCache();
+};
+
+RPMDBHeaderCache::RPMDBHeaderCache(const string &FileName,
+				   const string &DBPath) :
+   FileName(FileName), DBPath(DBPath), OldMap(NULL), OldSize(0)
+{
+   if (Load() == false)
+      Entries.clear();
+}
+
+RPMDBHeaderCache::~RPMDBHeaderCache()
+{
+   if (OldMap != NULL)
+      munmap(OldMap, OldSize);
+}
+
+// A missing, broken or foreign file is silently ignored, it'll get
+// rewritten on Commit().
+bool RPMDBHeaderCache::Load()
+{
+   OldMap = MapCacheFile(FileName, OldSize);
+   if (OldMap == NULL)
+      return false;
+
+   const char *Pos = (const char *)OldMap;
+   const char *End = Pos + OldSize;
+   uint32_t Count, Len;
+
+   if ((size_t)(End - Pos) < sizeof(DBHeaderCacheMagic) - 1 + 2*sizeof(Len) ||
+       memcmp(Pos, DBHeaderCacheMagic, sizeof(DBHeaderCacheMagic) - 1) != 0)
+      return false;
+   Pos += sizeof(DBHeaderCacheMagic) - 1;
+   memcpy(&Count, Pos, sizeof(Count));
+   Pos += sizeof(Count);
+   memcpy(&Len, Pos, sizeof(Len));
+   Pos += sizeof(Len);
+   if ((size_t)(End - Pos) < Len || DBPath != string(Pos, Len))
+      return false;
+   Pos += Len;
+
+   for (; Count > 0; Count--) {
+      uint32_t Offset;
+      Entry E;
+      if ((size_t)(End - Pos) < 2*sizeof(uint32_t))
+	 return false;
+      memcpy(&Offset, Pos, sizeof(Offset));
+      Pos += sizeof(Offset);
+      memcpy(&Len, Pos, sizeof(Len));
+      Pos += sizeof(Len);
+      if ((size_t)(End - Pos) < Len + sizeof(Len))
+	 return false;
+      E.SHA1 = string(Pos, Len);
+      Pos += Len;
+      memcpy(&Len, Pos, sizeof(Len));
+      Pos += sizeof(Len);
+      if ((size_t)(End - Pos) < Len)
+	 return false;
+      E.Blob = Pos;
+      E.Len = Len;
+      Pos += Len;
+      Entries[Offset] = E;
+   }
+   return true;
+}
+
+Header RPMDBHeaderCache::Find(raptDbOffset Offset, const string &SHA1)
+{
+   map<raptDbOffset,Entry>::const_iterator I = Entries.find(Offset);
+   if (I == Entries.end() || I->second.SHA1 != SHA1)
+      return NULL;
+   return headerImport((void *)I->second.Blob, I->second.Len,
+		       HEADERIMPORT_COPY);
+}
+
+// Strip the database header down and remember it for Commit()
+Header RPMDBHeaderCache::Add(raptDbOffset Offset, Header Full)
+{
+   Header H = StripCacheHeader(Full, DBHeaderCacheTags,
+			       sizeof(DBHeaderCacheTags)/sizeof(raptTag));
+   unsigned int Len = 0;
+   void *Blob = headerExport(H, &Len);
+   if (Blob != NULL) {
+      Added[Offset] = string((const char *)Blob, Len);
+      free(Blob);
+   }
+   return H;
+}
+
+// Rewrite the file if the set of installed headers changed. That is
+// decided on the listed instances rather than on what the walk looked
+// up, walks may be restricted to some of them or be done more than once.
+// This is a cache, failing to write it (eg. as non-root) is not an error.
+bool RPMDBHeaderCache::Commit(const vector<RPMDBHandler::Instance> &Instances)
+{
+   uint32_t Count = 0;
+   unsigned long Kept = 0;
+   vector<RPMDBHandler::Instance>::const_iterator I;
+   for (I = Instances.begin(); I != Instances.end(); I++) {
+      map<raptDbOffset,Entry>::const_iterator E = Entries.find(I->Offset);
+      if (E != Entries.end() && E->second.SHA1 == I->SHA1)
+	 Kept++;
+      if (Added.find(I->Offset) != Added.end() || E != Entries.end())
+	 Count++;
+   }
+   if (Added.empty() == true && Kept == Entries.size())
+      return true;
+
+   string NewName = FileName + ".new";
+   FILE *F = fopen(NewName.c_str(), "w");
+   if (F == NULL)
+      return false;
+
+   bool Res = (fwrite(DBHeaderCacheMagic, sizeof(DBHeaderCacheMagic) - 1,
+		      1, F) == 1 &&
+	       fwrite(&Count, sizeof(Count), 1, F) == 1 &&
+	       WriteCacheString(F, DBPath.c_str(), DBPath.size()));
+   for (I = Instances.begin(); Res == true && I != Instances.end(); I++) {
+      uint32_t Offset = I->Offset;
+      map<raptDbOffset,string>::const_iterator A = Added.find(I->Offset);
+      map<raptDbOffset,Entry>::const_iterator E = Entries.find(I->Offset);
+      if (A != Added.end()) {
+	 Res = (fwrite(&Offset, sizeof(Offset), 1, F) == 1 &&
+		WriteCacheString(F, I->SHA1.c_str(), I->SHA1.size()) &&
+		WriteCacheString(F, A->second.c_str(), A->second.size()));
+      } else if (E != Entries.end()) {
+	 Res = (fwrite(&Offset, sizeof(Offset), 1, F) == 1 &&
+		WriteCacheString(F, E->second.SHA1.c_str(), E->second.SHA1.size()) &&
+		WriteCacheString(F, E->second.Blob, E->second.Len));
+      }
+   }
+   if (fclose(F) != 0)
+      Res = false;
+
+   if (Res == false || rename(NewName.c_str(), FileName.c_str()) != 0) {
+      unlink(NewName.c_str());
+      return false;
+   }
+
+   // Go on from what was written, for the next walk
+   if (OldMap != NULL)
+      munmap(OldMap, OldSize);
+   OldMap = NULL;
+   Entries.clear();
+   Added.clear();
+   if (Load() == false)
+      Entries.clear();
+   return true;
+}
+									/*}}}*/
+#endif
+
 RPMDBHandler::RPMDBHandler(bool WriteLock)
-   : Handler(0), WriteLock(WriteLock)
+   : Handler(0), WriteLock(WriteLock), HaveSize(false), InstPos(0),
+     HdrCache(NULL), OwnHeader(false), Selecting(false)
 {
    RpmIter = NULL;
    string Dir = _config->Find("RPM::RootDir", "/");
@@ -573,17 +1405,8 @@ RPMDBHandler::RPMDBHandler(bool WriteLock)
       _error->Error(_("could not create RPM database iterator"));
       return;
    }
-   // iSize = rpmdbGetIteratorCount(RpmIter);
-   // This doesn't seem to work right now. Code in rpm (4.0.4, at least)
-   // returns a 0 from rpmdbGetIteratorCount() if raptInitIterator() is
-   // called with RPMDBI_PACKAGES or with keyp == NULL. The algorithm
-   // below will be used until there's support for it.
-   iSize = 0;
-   rpmdbMatchIterator countIt;
-   countIt = raptInitIterator(Handler, RPMDBI_PACKAGES, NULL, 0);
-   while (rpmdbNextIterator(countIt) != NULL)
-      iSize++;
-   rpmdbFreeIterator(countIt);
+   // The package count is only needed for progress reporting while
+   // building the cache, it's computed on demand by Size().
 
    // Restore just after opening the database, and just after closing.
    if (WriteLock) {
@@ -596,6 +1419,10 @@ RPMDBHandler::RPMDBHandler(bool WriteLock)
 
 RPMDBHandler::~RPMDBHandler()
 {
+   FreeHeader();
+#if RPM_VERSION >= 0x040c00
+   delete HdrCache;
+#endif
    if (RpmIter != NULL)
       rpmdbFreeIterator(RpmIter);
 
@@ -638,10 +1465,168 @@ string RPMDBHandler::DataPath(bool DirectoryOnly)
        return DBPath+"/"+File;
 }
 
+// RPMDBHandler::Size - Number of installed packages			/*{{{*/
+// ---------------------------------------------------------------------
+/* rpmdbGetIteratorCount() returns 0 for RPMDBI_PACKAGES iterators, so
+   there's no direct way to ask for the count. Walking the whole database
+   for it reads every header once more just for the progress meter, so
+   with a new enough rpm the entries of the name index are summed up
+   instead, which doesn't touch the headers at all. */
+unsigned RPMDBHandler::Size()
+{
+   if (HaveSize == true || RpmIter == NULL)
+      return iSize;
+
+   iSize = 0;
+#if RPM_VERSION >= 0x040900
+   rpmdbIndexIterator NameIt;
+   NameIt = rpmdbIndexIteratorInit(rpmtsGetRdb(Handler), RPMDBI_NAME);
+   if (NameIt != NULL) {
+      const void *Key;
+      size_t KeyLen;
+      while (rpmdbIndexIteratorNext(NameIt, &Key, &KeyLen) == 0)
+	 iSize += rpmdbIndexIteratorNumPkgs(NameIt);
+      rpmdbIndexIteratorFree(NameIt);
+      HaveSize = true;
+      return iSize;
+   }
+#endif
+   rpmdbMatchIterator countIt;
+   countIt = raptInitIterator(Handler, RPMDBI_PACKAGES, NULL, 0);
+   while (rpmdbNextIterator(countIt) != NULL)
+      iSize++;
+   rpmdbFreeIterator(countIt);
+   HaveSize = true;
+   return iSize;
+}
+									/*}}}*/
+// RPMDBHandler::LoadInstances - List the installed headers		/*{{{*/
+// ---------------------------------------------------------------------
+/* Instances and their SHA1HEADER are taken from the index, without
+   loading any header. If the index doesn't account for every package the
+   header cache isn't used for this pass. */
+bool RPMDBHandler::LoadInstances()
+{
+   Instances.clear();
+   InstPos = 0;
+#if RPM_VERSION >= 0x040c00
+   if (_config->FindB("RPM::DB-Header-Cache", true) == false)
+      return false;
+
+   rpmdbIndexIterator SHA1It;
+   SHA1It = rpmdbIndexIteratorInit(rpmtsGetRdb(Handler), RPMDBI_SHA1HEADER);
+   if (SHA1It == NULL)
+      return false;
+   const void *Key;
+   size_t KeyLen;
+   while (rpmdbIndexIteratorNext(SHA1It, &Key, &KeyLen) == 0) {
+      Instance I;
+      I.SHA1 = string((const char *)Key, KeyLen);
+      unsigned int Count = rpmdbIndexIteratorNumPkgs(SHA1It);
+      for (unsigned int i = 0; i < Count; i++) {
+	 I.Offset = rpmdbIndexIteratorPkgOffset(SHA1It, i);
+	 Instances.push_back(I);
+      }
+   }
+   rpmdbIndexIteratorFree(SHA1It);
+
+   if (Instances.size() != Size()) {
+      Instances.clear();
+      return false;
+   }
+   sort(Instances.begin(), Instances.end());
+
+   if (HdrCache == NULL)
+      HdrCache = new RPMDBHeaderCache(_config->FindFile("Dir::Cache::dbheaders"),
+				      DataPath(false));
+   return true;
+#else
+   return false;
+#endif
+}
+									/*}}}*/
+// RPMDBHandler::InstanceKeys - Describe the installed headers		/*{{{*/
+// ---------------------------------------------------------------------
+/* One line per instance listed by the last Rewind(), in instance order.
+   Fails when they couldn't be listed. */
+bool RPMDBHandler::InstanceKeys(string &Keys) const
+{
+   Keys.clear();
+   if (Instances.empty() == true)
+      return false;
+   vector<Instance>::const_iterator I;
+   for (I = Instances.begin(); I != Instances.end(); I++) {
+      char Buf[32];
+      snprintf(Buf, sizeof(Buf), "%lu ", (unsigned long)I->Offset);
+      Keys += Buf;
+      Keys += I->SHA1;
+      Keys += '\n';
+   }
+   return true;
+}
+									/*}}}*/
+// RPMDBHandler::SelectInstances - Walk only some of the instances	/*{{{*/
+// ---------------------------------------------------------------------
+/* Applies to the walks from Rewind() until SelectAll(). Those only go
+   over instances that are listed by the SHA1HEADER index as well, and
+   don't find anything when it can't be used. */
+void RPMDBHandler::SelectInstances(const vector<raptDbOffset> &Offsets)
+{
+   Selected = Offsets;
+   sort(Selected.begin(), Selected.end());
+   Selecting = true;
+}
+
+void RPMDBHandler::SelectAll()
+{
+   Selected.clear();
+   Selecting = false;
+}
+									/*}}}*/
+void RPMDBHandler::FreeHeader()
+{
+   if (OwnHeader == true && HeaderP != NULL)
+      headerFree(HeaderP);
+   OwnHeader = false;
+   HeaderP = NULL;
+}
+
 bool RPMDBHandler::Skip()
 {
    if (RpmIter == NULL)
        return false;
+#if RPM_VERSION >= 0x040c00
+   if (HdrCache != NULL && Instances.empty() == false) {
+      FreeHeader();
+      while (InstPos < Instances.size()) {
+	 const Instance &I = Instances[InstPos++];
+	 if (Selecting == true &&
+	     binary_search(Selected.begin(), Selected.end(), I.Offset) == false)
+	    continue;
+	 iOffset = I.Offset;
+	 HeaderP = HdrCache->Find(I.Offset, I.SHA1);
+	 if (HeaderP == NULL) {
+	    raptDbOffset rpmOffset = I.Offset;
+	    rpmdbFreeIterator(RpmIter);
+	    RpmIter = raptInitIterator(Handler, RPMDBI_PACKAGES,
+				       &rpmOffset, sizeof(rpmOffset));
+	    Header Full = rpmdbNextIterator(RpmIter);
+	    if (Full == NULL)
+	       continue;
+	    HeaderP = HdrCache->Add(I.Offset, Full);
+	 }
+	 OwnHeader = true;
+	 return true;
+      }
+      // Once at the end of the walk
+      if (InstPos++ == Instances.size())
+	 HdrCache->Commit(Instances);
+      return false;
+   }
+#endif
+   // Nothing to select from without the instances
+   if (Selecting == true)
+      return false;
    HeaderP = rpmdbNextIterator(RpmIter);
    iOffset = rpmdbGetIteratorOffset(RpmIter);
    if (HeaderP == NULL)
@@ -651,6 +1636,8 @@ bool RPMDBHandler::Skip()
 
 bool RPMDBHandler::Jump(off_t Offset)
 {
+   FreeHeader();
+   Instances.clear();
    iOffset = Offset;
    // rpmdb indexes are hardcoded uint32_t, the size must match here
    raptDbOffset rpmOffset = iOffset;
@@ -672,6 +1659,8 @@ bool RPMDBHandler::JumpByName(string PkgName, bool Provides)
 {
    raptTag tag = Provides ? RPMDBI_PROVIDENAME : RPMDBI_LABEL;
    if (RpmIter == NULL) return false;
+   FreeHeader();
+   Instances.clear();
    rpmdbFreeIterator(RpmIter);
    RpmIter = raptInitIterator(Handler, tag, PkgName.c_str(), 0);
    HeaderP = rpmdbNextIterator(RpmIter);
@@ -682,13 +1671,60 @@ void RPMDBHandler::Rewind()
 {
    if (RpmIter == NULL)
       return;
+   FreeHeader();
    rpmdbFreeIterator(RpmIter);
    RpmIter = raptInitIterator(Handler, RPMDBI_PACKAGES, NULL, 0);
    iOffset = 0;
+   LoadInstances();
 }
 #endif
 
 #ifdef APT_WITH_REPOMD
+// Lists kept in the indexed gzip form are a series of gzip members, and
+// libxml2 stops at the end of the first one, so they are fed to it
+// through GzIndexReader instead of letting it open the file itself.
+static int XmlGzRead(void *Context,char *To,int Len)
+{
+   unsigned long Actual;
+   if (((GzIndexReader *)Context)->Read(To,Len,&Actual) == false)
+      return -1;
+   return Actual;
+}
+
+static int XmlGzClose(void *Context)
+{
+   delete (GzIndexReader *)Context;
+   return 0;
+}
+
+static GzIndexReader *XmlGzOpen(const string &File)
+{
+   GzIndexReader *Reader = new GzIndexReader;
+   if (Reader->Open(File) == true)
+      return Reader;
+   delete Reader;
+   return NULL;
+}
+
+static xmlTextReaderPtr XmlReaderForList(const string &File)
+{
+   int Options = XML_PARSE_NONET|XML_PARSE_NOBLANKS;
+   GzIndexReader *Reader = XmlGzOpen(File);
+   if (Reader == NULL)
+      return xmlReaderForFile(File.c_str(),NULL,Options);
+   return xmlReaderForIO(XmlGzRead,XmlGzClose,Reader,File.c_str(),NULL,
+			 Options);
+}
+
+static xmlDocPtr XmlReadList(const string &File)
+{
+   int Options = XML_PARSE_NONET|XML_PARSE_NOBLANKS;
+   GzIndexReader *Reader = XmlGzOpen(File);
+   if (Reader == NULL)
+      return xmlReadFile(File.c_str(),NULL,Options);
+   return xmlReadIO(XmlGzRead,XmlGzClose,Reader,File.c_str(),NULL,Options);
+}
+
 RPMRepomdHandler::RPMRepomdHandler(repomdXML const *repomd): RPMHandler(),
       Primary(NULL), Root(NULL), HavePrimary(false)
 {
@@ -700,8 +1736,7 @@ RPMRepomdHandler::RPMRepomdHandler(repomdXML const *repomd): RPMHandler(),
    OtherPath = base + flNotDir(repomd->FindURI("other"));
 
    xmlTextReaderPtr Index;
-   Index = xmlReaderForFile(PrimaryPath.c_str(), NULL,
-                          XML_PARSE_NONET|XML_PARSE_NOBLANKS);
+   Index = XmlReaderForList(PrimaryPath);
    if (Index == NULL) {
       _error->Error(_("Failed to open package index %s"), PrimaryPath.c_str());
       return;
@@ -723,7 +1758,7 @@ bool RPMRepomdHandler::LoadPrimary()
    xmlChar *packages = NULL;
    off_t pkgcount = 0;
 
-   Primary = xmlReadFile(PrimaryPath.c_str(), NULL, XML_PARSE_NONET|XML_PARSE_NOBLANKS);
+   Primary = XmlReadList(PrimaryPath);
    if ((Root = xmlDocGetRootElement(Primary)) == NULL) {
       _error->Error(_("Failed to open package index %s"), PrimaryPath.c_str());
       goto error;
@@ -1075,14 +2110,24 @@ RPMRepomdHandler::~RPMRepomdHandler()
 }
 
 RPMRepomdReaderHandler::RPMRepomdReaderHandler(string File) : RPMHandler(),
-   XmlFile(NULL), XmlPath(File), NodeP(NULL)
+   XmlFile(NULL), XmlPath(File), NodeP(NULL), XmlFd(-1), Indexed(NULL),
+   Doc(NULL)
 {
    ID = File;
+   iSize = 0;
    iOffset = -1;
 
    if (FileExists(XmlPath)) {
-      XmlFile = xmlReaderForFile(XmlPath.c_str(), NULL,
-                                  XML_PARSE_NONET|XML_PARSE_NOBLANKS);
+      if (_config->FindB("RPM::Repomd::Offset-Index", true) == true &&
+	  OpenXml() == true) {
+	 if (LoadOffsets() == true) {
+	    iSize = Offsets.size() - 1;
+	    return;
+	 }
+	 Offsets.clear();
+      }
+
+      XmlFile = XmlReaderForList(XmlPath);
       if (XmlFile == NULL) {
         xmlFreeTextReader(XmlFile);
         _error->Error(_("Failed to open filelist index %s"), XmlPath.c_str());
@@ -1112,8 +2157,240 @@ error:
    }
 }
 
+// RPMRepomdReaderHandler::OpenXml - Open the metadata for the index	/*{{{*/
+// ---------------------------------------------------------------------
+/* Lists kept compressed (Acquire::Compressed-Lists) are read through
+   their block index, so only the block holding a package is inflated. */
+bool RPMRepomdReaderHandler::OpenXml()
+{
+   Indexed = XmlGzOpen(XmlPath);
+   if (Indexed != NULL)
+      return true;
+
+   XmlFd = open(XmlPath.c_str(), O_RDONLY);
+   return (XmlFd >= 0);
+}
+									/*}}}*/
+// RPMRepomdReaderHandler::ReadXml - Read uncompressed metadata		/*{{{*/
+// ---------------------------------------------------------------------
+/* Actual is less than Len only at the end of the data. */
+bool RPMRepomdReaderHandler::ReadXml(off_t Start, char *To, size_t Len,
+				     size_t &Actual)
+{
+   Actual = 0;
+   if (Indexed != NULL) {
+      unsigned long Got = 0;
+      if ((unsigned long long)Start >= Indexed->Size())
+	 return true;
+      if (Indexed->Seek(Start) == false ||
+	  Indexed->Read(To, Len, &Got) == false)
+	 return false;
+      Actual = Got;
+      return true;
+   }
+
+   while (Actual < Len) {
+      ssize_t Res = pread(XmlFd, To + Actual, Len - Actual, Start + Actual);
+      if (Res < 0 && errno == EINTR)
+	 continue;
+      if (Res < 0)
+	 return _error->Errno("pread", _("Unable to read %s"), XmlPath.c_str());
+      if (Res == 0)
+	 break;
+      Actual += Res;
+   }
+   return true;
+}
+									/*}}}*/
+// RPMRepomdReaderHandler::LoadOffsets - Where each package starts	/*{{{*/
+// ---------------------------------------------------------------------
+/* The streaming reader can only go forward, so looking up the changelog
+   or file list of one package meant parsing the file up to it, every
+   time. Instead the offset of each <package> element in the uncompressed
+   data is kept in Dir::Cache::xmloffsets, and a lookup reads and parses
+   just that element. Text content is escaped in the metadata so a plain
+   scan for the start tags is enough; the result is only used if it
+   agrees with the package count given on the root element. Entry N+1
+   holds the end of the last package. The size and mtime in the key are
+   those of the file as it is on disk, compressed or not.
+
+   File layout, in host byte order:
+      "APTXOFF1", uint64 size, uint64 mtime, uint32 count,
+      (count + 1) * uint64 offset
+*/
+static const char XmlOffsetsMagic[] = "APTXOFF1";
+
+// The packages="N" attribute of the root element, which is all that
+// comes before the first package
+static long XmlPackageCount(const char *Head, size_t Len)
+{
+   const char *Attr = (const char *)memmem(Head, Len, "packages=\"", 10);
+   if (Attr == NULL)
+      return -1;
+   return atol(string(Attr + 10, Head + Len).c_str());
+}
+
+// Offsets are only used if they go up, stay inside the metadata and
+// leave a sane amount of room for the root element before them
+static bool XmlOffsetsValid(uint64_t Size, const vector<uint64_t> &Raw)
+{
+   for (vector<uint64_t>::size_type I = 1; I < Raw.size(); I++)
+      if (Raw[I] <= Raw[I-1])
+	 return false;
+   return (Raw.size() >= 2 && Raw.back() <= Size && Raw[0] <= 1024*1024);
+}
+
+// The package count of the root element, which ends before Len
+long RPMRepomdReaderHandler::XmlHeadCount(off_t Len)
+{
+   string Head(Len, '\0');
+   size_t Actual;
+   if (ReadXml(0, &Head[0], Len, Actual) == false || Actual != (size_t)Len)
+      return -1;
+   return XmlPackageCount(Head.c_str(), Len);
+}
+
+bool RPMRepomdReaderHandler::LoadOffsets()
+{
+   struct stat St;
+   if (stat(XmlPath.c_str(), &St) != 0 || St.st_size == 0)
+      return false;
+   uint64_t Key[2] = {(uint64_t)St.st_size, (uint64_t)St.st_mtime};
+   uint64_t Size = (Indexed != NULL) ? Indexed->Size() : St.st_size;
+   string IndexPath = _config->FindDir("Dir::Cache::xmloffsets") +
+		      flNotDir(XmlPath) + ".idx";
+
+   FILE *F = fopen(IndexPath.c_str(), "r");
+   if (F != NULL) {
+      char Magic[sizeof(XmlOffsetsMagic) - 1];
+      uint64_t OldKey[2];
+      uint32_t Count;
+      struct stat ISt;
+      if (fread(Magic, sizeof(Magic), 1, F) == 1 &&
+	  memcmp(Magic, XmlOffsetsMagic, sizeof(Magic)) == 0 &&
+	  fread(OldKey, sizeof(OldKey), 1, F) == 1 &&
+	  memcmp(OldKey, Key, sizeof(Key)) == 0 &&
+	  fread(&Count, sizeof(Count), 1, F) == 1 &&
+	  fstat(fileno(F), &ISt) == 0 &&
+	  (uint64_t)ISt.st_size == sizeof(Magic) + sizeof(OldKey) +
+	  sizeof(Count) + ((uint64_t)Count + 1) * sizeof(uint64_t)) {
+	 vector<uint64_t> Raw((size_t)Count + 1);
+	 if (fread(&Raw[0], sizeof(uint64_t), Raw.size(), F) == Raw.size() &&
+	     XmlOffsetsValid(Size, Raw) == true &&
+	     XmlHeadCount(Raw[0]) == (long)Count)
+	    Offsets.assign(Raw.begin(), Raw.end());
+      }
+      fclose(F);
+      if (Offsets.empty() == false)
+	 return true;
+   }
+
+   /* Scan the uncompressed data in chunks. The last bytes of a chunk are
+      carried over, a tag is only taken once the character after it was
+      seen. */
+   static const size_t Chunk = 64*1024;
+   static const size_t Carry = 8;
+   vector<char> Buf(Chunk + Carry);
+   size_t Kept = 0;
+   off_t BufStart = 0;
+   off_t LastOpen = -1;
+   while (true) {
+      size_t Actual;
+      if (ReadXml(BufStart + Kept, &Buf[Kept], Chunk, Actual) == false) {
+	 Offsets.clear();
+	 return false;
+      }
+      const char *Start = &Buf[0];
+      const char *End = Start + Kept + Actual;
+      const char *Last = (const char *)memrchr(Start + Kept, '<', Actual);
+      if (Last != NULL)
+	 LastOpen = BufStart + (Last - Start);
+
+      const char *Pos = Start;
+      while ((Pos = (const char *)memmem(Pos, End - Pos, "<package", 8)) != NULL) {
+	 const char *Next = Pos + 8;
+	 if (Next >= End)
+	    break;
+	 if (*Next == '>' || isspace(*Next) != 0)
+	    Offsets.push_back(BufStart + (Pos - Start));
+	 Pos = Next;
+      }
+      if (Actual < Chunk)
+	 break;
+
+      Kept = std::min(Carry, (size_t)(End - Start));
+      memmove(&Buf[0], End - Kept, Kept);
+      BufStart += (End - Start) - Kept;
+   }
+
+   // The last package ends where the closing root tag starts
+   if (Offsets.empty() == false && LastOpen > Offsets.back())
+      Offsets.push_back(LastOpen);
+   vector<uint64_t> Raw(Offsets.begin(), Offsets.end());
+   long Packages = -1;
+   if (XmlOffsetsValid(Size, Raw) == true)
+      Packages = XmlHeadCount(Raw[0]);
+   if (Packages < 0 || Raw.size() != (unsigned long)Packages + 1) {
+      Offsets.clear();
+      return false;
+   }
+
+   // Failing to save the offsets (eg. as non-root) only costs a rescan
+   string NewName = IndexPath + ".new";
+   F = fopen(NewName.c_str(), "w");
+   if (F == NULL && errno == ENOENT &&
+       mkdir(flNotFile(IndexPath).c_str(), 0755) == 0)
+      F = fopen(NewName.c_str(), "w");
+   if (F == NULL)
+      return true;
+   uint32_t Count = Packages;
+   bool Res = (fwrite(XmlOffsetsMagic, sizeof(XmlOffsetsMagic) - 1, 1, F) == 1 &&
+	       fwrite(Key, sizeof(Key), 1, F) == 1 &&
+	       fwrite(&Count, sizeof(Count), 1, F) == 1 &&
+	       fwrite(&Raw[0], sizeof(uint64_t), Raw.size(), F) == Raw.size());
+   if (fclose(F) != 0 || Res == false ||
+       rename(NewName.c_str(), IndexPath.c_str()) != 0)
+      unlink(NewName.c_str());
+   return true;
+}
+									/*}}}*/
+// RPMRepomdReaderHandler::ReadPackage - Parse one package by offset	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool RPMRepomdReaderHandler::ReadPackage(off_t Offset)
+{
+   if (Doc != NULL) {
+      xmlFreeDoc(Doc);
+      Doc = NULL;
+   }
+   NodeP = NULL;
+   if (Offset < 0 || Offset >= iSize)
+      return false;
+
+   off_t Start = Offsets[Offset];
+   size_t Len = Offsets[Offset+1] - Start;
+   string Buf(Len, '\0');
+   size_t Actual;
+   if (ReadXml(Start, &Buf[0], Len, Actual) == false)
+      return false;
+   if (Actual != Len)
+      return _error->Error(_("Unable to read %s"), XmlPath.c_str());
+
+   Doc = xmlReadMemory(Buf.c_str(), Len, NULL, NULL,
+		       XML_PARSE_NONET|XML_PARSE_NOBLANKS);
+   if (Doc == NULL)
+      return _error->Error(_("Failed to parse %s"), XmlPath.c_str());
+   NodeP = xmlDocGetRootElement(Doc);
+   iOffset = Offset;
+   return (NodeP != NULL);
+}
+									/*}}}*/
+
 bool RPMRepomdReaderHandler::Jump(off_t Offset)
 {
+   if (Offsets.empty() == false)
+      return ReadPackage(Offset);
+
    bool res = false;
    while (iOffset != Offset) {
       res = Skip();
@@ -1126,6 +2403,11 @@ bool RPMRepomdReaderHandler::Jump(off_t Offset)
 
 void RPMRepomdReaderHandler::Rewind()
 {
+   if (Offsets.empty() == false) {
+      iOffset = -1;
+      return;
+   }
+
    // XXX Ignore rewinds when already at start, any other cases we can't
    // handle at the moment. Other cases shouldn't be needed due to usage
    // patterns but just in case...
@@ -1139,6 +2421,8 @@ bool RPMRepomdReaderHandler::Skip()
    if (iOffset +1 >= iSize) {
       return false;
    }
+   if (Offsets.empty() == false)
+      return ReadPackage(iOffset + 1);
    if (iOffset >= 0) {
       xmlTextReaderNext(XmlFile);
    }
@@ -1177,7 +2461,13 @@ string RPMRepomdReaderHandler::FindVerTag(const char *Tag) const
 
 RPMRepomdReaderHandler::~RPMRepomdReaderHandler()
 {
-   xmlFreeTextReader(XmlFile);
+   if (XmlFile != NULL)
+      xmlFreeTextReader(XmlFile);
+   if (Doc != NULL)
+      xmlFreeDoc(Doc);
+   if (XmlFd >= 0)
+      close(XmlFd);
+   delete Indexed;
 }
 
 bool RPMRepomdFLHandler::FileList(vector<string> &FileList) const
@@ -1194,7 +2484,7 @@ bool RPMRepomdFLHandler::FileList(vector<string> &FileList) const
 bool RPMRepomdOtherHandler::ChangeLog(vector<ChangeLogEntry* > &ChangeLogs) const
 {
    // Changelogs aren't necessarily available at all
-   if (! XmlFile) {
+   if (NodeP == NULL) {
       return false;
    }
 
@@ -1216,17 +2506,206 @@ bool RPMRepomdOtherHandler::ChangeLog(vector<ChangeLogEntry* > &ChangeLogs) cons
 }
 
 #ifdef WITH_SQLITE3
-static SqliteQuery * prcoQuery(SqliteDB *db, const string & what)
+// RPMSqlitePRCO - Access to one of the provides/requires/... tables	/*{{{*/
+// ---------------------------------------------------------------------
+/* Cache generation walks the packages in pkgKey order and wants the
+   dependencies of every one of them. Instead of running a query per
+   package, the whole table is streamed once ordered by pkgKey and merged
+   with the package cursor. Random access (record lookups) uses the keyed
+   query instead. The rows of the last package are kept since the list
+   parser asks for the same dependency type more than once. */
+class RPMSqlitePRCO
+{
+   public:
+
+   struct Entry
+   {
+      string Name;
+      string Version;
+      unsigned int Flags;
+   };
+   vector<Entry> Entries;
+
+   private:
+
+   SqliteDB *DB;
+   string Table;
+
+   SqliteQuery *Stream;
+   SqliteQuery *Keyed;
+
+   int ColKey;
+   int ColName;
+   int ColFlags;
+   int ColEpoch;
+   int ColVersion;
+   int ColRelease;
+
+   // The stream has been positioned and all rows up to and including
+   // StreamAsked have been consumed. StreamRow tells whether the query
+   // holds a pending row, whose key is StreamKey.
+   bool StreamStarted;
+   bool StreamRow;
+   unsigned long StreamKey;
+   unsigned long StreamAsked;
+
+   bool Loaded;
+   unsigned long LoadedKey;
+
+   SqliteQuery *Prepare(const char *Tail);
+   bool ReadRow(SqliteQuery *Q, Entry &E);
+   void StepStream();
+
+   public:
+
+   bool Load(unsigned long Key, bool Sequential);
+   void Reset();
+
+   RPMSqlitePRCO(SqliteDB *DB, const string &Table);
+   ~RPMSqlitePRCO();
+};
+
+RPMSqlitePRCO::RPMSqlitePRCO(SqliteDB *DB, const string &Table) :
+   DB(DB), Table(Table), Stream(NULL), Keyed(NULL),
+   ColKey(-1), ColName(-1), ColFlags(-1), ColEpoch(-1), ColVersion(-1),
+   ColRelease(-1), StreamStarted(false), StreamRow(false), StreamKey(0),
+   StreamAsked(0), Loaded(false), LoadedKey(0)
+{
+}
+
+RPMSqlitePRCO::~RPMSqlitePRCO()
+{
+   if (Stream) delete Stream;
+   if (Keyed) delete Keyed;
+}
+
+// Both queries return the same columns, so the indexes only need to be
+// resolved for whichever one gets prepared first.
+SqliteQuery *RPMSqlitePRCO::Prepare(const char *Tail)
 {
    ostringstream sql;
-   sql << "select name, flags, epoch, version, release from " << what << " where pkgKey = ?" << endl;
-   return db->Query(sql.str());
+   sql << "select pkgKey, name, flags, epoch, version, release from "
+       << Table << " " << Tail;
+   SqliteQuery *Q = DB->Query(sql.str());
+   if (ColKey < 0) {
+      ColKey = Q->ColIndex("pkgKey");
+      ColName = Q->ColIndex("name");
+      ColFlags = Q->ColIndex("flags");
+      ColEpoch = Q->ColIndex("epoch");
+      ColVersion = Q->ColIndex("version");
+      ColRelease = Q->ColIndex("release");
+   }
+   return Q;
+}
+
+void RPMSqlitePRCO::Reset()
+{
+   if (Stream != NULL)
+      Stream->Rewind();
+   StreamStarted = false;
+   StreamRow = false;
+   Loaded = false;
+}
+
+void RPMSqlitePRCO::StepStream()
+{
+   StreamRow = Stream->Step();
+   if (StreamRow)
+      StreamKey = Stream->GetColI(ColKey);
+}
+
+bool RPMSqlitePRCO::ReadRow(SqliteQuery *Q, Entry &E)
+{
+   string deptype;
+   E.Name.clear();
+   E.Version.clear();
+   E.Flags = RPMSENSE_ANY;
+
+   Q->Get(ColFlags, deptype);
+   if (deptype.empty() == false) {
+      if (deptype == "EQ") {
+	 E.Flags = RPMSENSE_EQUAL;
+      } else if (deptype == "GE") {
+	 E.Flags = RPMSENSE_GREATER | RPMSENSE_EQUAL;
+      } else if (deptype == "GT") {
+	 E.Flags = RPMSENSE_GREATER;
+      } else if (deptype == "LE") {
+	 E.Flags = RPMSENSE_LESS | RPMSENSE_EQUAL;
+      } else if (deptype == "LT") {
+	 E.Flags = RPMSENSE_LESS;
+      } else {
+	 // wtf, unknown dependency type?
+	 _error->Warning(_("Ignoring unknown dependency type %s"),
+			   deptype.c_str());
+	 return false;
+      }
+
+      string e, v, r;
+      Q->Get(ColEpoch, e);
+      Q->Get(ColVersion, v);
+      Q->Get(ColRelease, r);
+      if (! e.empty()) {
+	 E.Version += e;
+	 E.Version += ":";
+      }
+      if (! v.empty()) {
+	 E.Version += v;
+      }
+      if (! r.empty()) {
+	 E.Version += "-";
+	 E.Version += r;
+      }
+   }
+   Q->Get(ColName, E.Name);
+   return true;
 }
 
+bool RPMSqlitePRCO::Load(unsigned long Key, bool Sequential)
+{
+   if (Loaded == true && LoadedKey == Key)
+      return true;
+
+   Entries.clear();
+   Loaded = false;
+   Entry E;
+
+   // Rows of keys we already went past can't be served by the stream
+   if (Sequential == true && (StreamStarted == false || Key > StreamAsked)) {
+      if (Stream == NULL)
+	 Stream = Prepare("order by pkgKey");
+      if (StreamStarted == false) {
+	 StreamStarted = true;
+	 StepStream();
+      }
+      while (StreamRow == true && StreamKey < Key)
+	 StepStream();
+      while (StreamRow == true && StreamKey == Key) {
+	 if (ReadRow(Stream, E) == true)
+	    Entries.push_back(E);
+	 StepStream();
+      }
+      StreamAsked = Key;
+   } else {
+      if (Keyed == NULL)
+	 Keyed = Prepare("where pkgKey = ?");
+      if (!(Keyed->Rewind() && Keyed->Bind(1, Key)))
+	 return false;
+      while (Keyed->Step()) {
+	 if (ReadRow(Keyed, E) == true)
+	    Entries.push_back(E);
+      }
+   }
+
+   Loaded = true;
+   LoadedKey = Key;
+   return true;
+}
+									/*}}}*/
+
 RPMSqliteHandler::RPMSqliteHandler(repomdXML const *repomd) :
    Primary(NULL), Filelists(NULL), Other(NULL),
    Packages(NULL), Provides(NULL), Requires(NULL), Conflicts(NULL), Obsoletes(NULL),
-   Files(NULL), Changes(NULL)
+   Files(NULL), Changes(NULL), Sequential(false)
 
 {
    ID = repomd->ID();
@@ -1235,6 +2714,7 @@ RPMSqliteHandler::RPMSqliteHandler(repomdXML const *repomd) :
    DBPath = base + flNotDir(repomd->FindURI("primary_db"));
    FilesDBPath = base + flNotDir(repomd->FindURI("filelists_db"));
    OtherDBPath = base + flNotDir(repomd->FindURI("other_db"));
+   BulkLoad = _config->FindB("RPM::SQLite::Bulk-Load", true);
 
    Primary = new SqliteDB(DBPath);
    Primary->Exclusive(true);
@@ -1250,12 +2730,23 @@ RPMSqliteHandler::RPMSqliteHandler(repomdXML const *repomd) :
    }
 
    // XXX TODO: We dont need all of these on cache generation
-   Packages = Primary->Query("select pkgKey, pkgId, name, arch, version, epoch, release, summary, description, rpm_vendor, rpm_group, rpm_sourcerpm, rpm_packager, size_package, size_installed, location_href from packages");
-
-   Provides = prcoQuery(Primary, "provides");
-   Requires = prcoQuery(Primary, "requires");
-   Conflicts = prcoQuery(Primary, "conflicts");;
-   Obsoletes = prcoQuery(Primary, "obsoletes");
+   // pkgKey is the rowid, so ordering by it is free and makes the
+   // offsets match the order the PRCO tables are streamed in.
+   Packages = Primary->Query("select pkgKey, pkgId, name, arch, version, epoch, release, summary, description, rpm_vendor, rpm_group, rpm_sourcerpm, rpm_packager, size_package, size_installed, location_href, checksum_type from packages order by pkgKey");
+
+   static const char *ColNames[ColCount] = {
+      "pkgKey", "pkgId", "name", "arch", "version", "epoch", "release",
+      "summary", "description", "rpm_vendor", "rpm_group", "rpm_sourcerpm",
+      "rpm_packager", "size_package", "size_installed", "location_href",
+      "checksum_type"
+   };
+   for (int i = 0; i < ColCount; i++)
+      PkgCol[i] = Packages->ColIndex(ColNames[i]);
+
+   Provides = new RPMSqlitePRCO(Primary, "provides");
+   Requires = new RPMSqlitePRCO(Primary, "requires");
+   Conflicts = new RPMSqlitePRCO(Primary, "conflicts");
+   Obsoletes = new RPMSqlitePRCO(Primary, "obsoletes");
 
    Filelists = new SqliteDB(FilesDBPath);
    Filelists->Exclusive(true);
@@ -1299,7 +2790,11 @@ bool RPMSqliteHandler::Skip()
 
 bool RPMSqliteHandler::Jump(off_t Offset)
 {
-   Rewind();
+   // Record lookups jump around, the dependency tables are better
+   // queried per package then.
+   if (Offset <= iOffset)
+      Rewind();
+   Sequential = false;
    while (1) {
       if (iOffset + 1 == Offset)
 	 return Skip();
@@ -1313,95 +2808,100 @@ void RPMSqliteHandler::Rewind()
 {
    Packages->Rewind();
    iOffset = 0;
+   Sequential = BulkLoad;
+   Provides->Reset();
+   Requires->Reset();
+   Conflicts->Reset();
+   Obsoletes->Reset();
 }
 
 string RPMSqliteHandler::Name() const
 {
-   return Packages->GetCol("name");
+   return Packages->GetCol(PkgCol[ColName]);
 }
 
 string RPMSqliteHandler::Version() const
 {
-   return Packages->GetCol("version");
+   return Packages->GetCol(PkgCol[ColVersion]);
 }
 
 string RPMSqliteHandler::Release() const
 {
-   return Packages->GetCol("release");
+   return Packages->GetCol(PkgCol[ColRelease]);
 }
 
 string RPMSqliteHandler::Epoch() const
 {
-   return Packages->GetCol("epoch");
+   return Packages->GetCol(PkgCol[ColEpoch]);
 }
 
 string RPMSqliteHandler::Arch() const
 {
-   return Packages->GetCol("arch");
+   return Packages->GetCol(PkgCol[ColArch]);
 }
 
 string RPMSqliteHandler::Group() const
 {
-   return Packages->GetCol("rpm_group");
+   return Packages->GetCol(PkgCol[ColGroup]);
 }
 
 string RPMSqliteHandler::Packager() const
 {
-   return Packages->GetCol("rpm_packager");
+   return Packages->GetCol(PkgCol[ColPackager]);
 }
 string RPMSqliteHandler::Vendor() const
 {
-   return Packages->GetCol("rpm_vendor");
+   return Packages->GetCol(PkgCol[ColVendor]);
 }
 
 string RPMSqliteHandler::Summary() const
 {
-   return Packages->GetCol("summary");
+   return Packages->GetCol(PkgCol[ColSummary]);
 }
 
 string RPMSqliteHandler::Description() const
 {
-   return Packages->GetCol("description");
+   return Packages->GetCol(PkgCol[ColDescription]);
 }
 
 string RPMSqliteHandler::SourceRpm() const
 {
-   return Packages->GetCol("rpm_sourcerpm");
+   return Packages->GetCol(PkgCol[ColSourceRpm]);
 }
 
 string RPMSqliteHandler::FileName() const
 {
-   return flNotDir(Packages->GetCol("location_href"));
+   return flNotDir(Packages->GetCol(PkgCol[ColLocation]));
 }
 
 string RPMSqliteHandler::Directory() const
 {
-   return flNotFile(Packages->GetCol("location_href"));
+   return flNotFile(Packages->GetCol(PkgCol[ColLocation]));
 }
 
 off_t RPMSqliteHandler::FileSize() const
 {
-   return Packages->GetColI("size_package");
+   return Packages->GetColI(PkgCol[ColSizePackage]);
 }
 
 off_t RPMSqliteHandler::InstalledSize() const
 {
-   return Packages->GetColI("size_installed");
+   return Packages->GetColI(PkgCol[ColSizeInstalled]);
 }
 
 string RPMSqliteHandler::Hash() const
 {
-   return Packages->GetCol("pkgId");
+   return Packages->GetCol(PkgCol[ColPkgId]);
 }
 
 string RPMSqliteHandler::HashType() const
 {
-   return chk2hash(Packages->GetCol("checksum_type"));
+   return chk2hash(Packages->GetCol(PkgCol[ColChecksumType]));
 }
 
 bool RPMSqliteHandler::PRCO(unsigned int Type, vector<Dependency*> &Deps) const
 {
-   SqliteQuery *prco = NULL;
+   RPMSqlitePRCO *prco = NULL;
    switch (Type) {
       case pkgCache::Dep::Depends:
 	 prco = Requires;
@@ -1417,58 +2917,17 @@ bool RPMSqliteHandler::PRCO(unsigned int Type, vector<Dependency*> &Deps) const
          break;
    }
 
-   unsigned long pkgKey;
-   Packages->Get("pkgKey", pkgKey);
-   if (!(prco->Rewind() && prco->Bind(1, pkgKey)))
-      return false;
-
-   string deptype, depver, depname;
-   string e, v, r;
-
-   while (prco->Step()) {
-      unsigned int RpmOp = 0;
+   if (prco == NULL)
+      return true;
 
-      depname.clear(); deptype.clear(); depver.clear();
+   unsigned long pkgKey = Packages->GetColI(PkgCol[ColPkgKey]);
+   if (prco->Load(pkgKey, Sequential) == false)
+      return false;
 
-      prco->Get("flags", deptype);
-      if (deptype.empty()) {
-	 RpmOp = RPMSENSE_ANY;
-      } else {
-	 if (deptype == "EQ") {
-	    RpmOp = RPMSENSE_EQUAL;
-	 } else if (deptype == "GE") {
-	    RpmOp = RPMSENSE_GREATER | RPMSENSE_EQUAL;
-	 } else if (deptype == "GT") {
-	    RpmOp = RPMSENSE_GREATER;
-	 } else if (deptype == "LE") {
-	    RpmOp = RPMSENSE_LESS | RPMSENSE_EQUAL;
-	 } else if (deptype == "LT") {
-	    RpmOp = RPMSENSE_LESS;
-	 } else {
-	    // wtf, unknown dependency type?
-	    _error->Warning(_("Ignoring unknown dependency type %s"),
-			      deptype.c_str());
-	    continue;
-	 }
-	 e.clear(); v.clear(); r.clear();
-
-	 prco->Get("epoch", e);
-	 prco->Get("version", v);
-	 prco->Get("release", r);
-	 if (! e.empty()) {
-	    depver += e;
-	    depver += ":";
-	 }
-	 if (! v.empty()) {
-	    depver += v;
-	 }
-	 if (! r.empty()) {
-	    depver += "-";
-	    depver += r;
-	 }
-      }
-      prco->Get("name", depname);
-      PutDep(depname.c_str(), depver.c_str(), (raptDepFlags) RpmOp, Type, Deps);
+   vector<RPMSqlitePRCO::Entry>::const_iterator I = prco->Entries.begin();
+   for (; I != prco->Entries.end(); I++) {
+      PutDep(I->Name.c_str(), I->Version.c_str(), (raptDepFlags) I->Flags,
+	     Type, Deps);
    }
    return true;
 }
@@ -1478,7 +2937,7 @@ bool RPMSqliteHandler::FileList(vector<string> &FileList) const
    unsigned long pkgKey;
    string dir, filenames, fn;
 
-   Packages->Get("pkgKey", pkgKey);
+   Packages->Get(PkgCol[ColPkgKey], pkgKey);
    Files->Rewind();
    if (!(Files->Rewind() && Files->Bind(1, pkgKey)))
       return false;
@@ -1504,7 +2963,7 @@ bool RPMSqliteHandler::FileList(vector<string> &FileList) const
 bool RPMSqliteHandler::ChangeLog(vector<ChangeLogEntry* > &ChangeLogs) const
 {
    unsigned long pkgKey;
-   Packages->Get("pkgKey", pkgKey);
+   Packages->Get(PkgCol[ColPkgKey], pkgKey);
 
    if (!(Changes && Changes->Rewind() && Changes->Bind(1, pkgKey)))
       return false;
@@ -75,7 +75,7 @@ class RPMHandler
    virtual void Rewind() = 0;
    inline unsigned Offset() const {return iOffset;}
    virtual bool OrderedOffset() const {return true;}
-   inline unsigned Size() {return iSize;}
+   virtual unsigned Size() {return iSize;}
    virtual bool IsDatabase() const {return false;};
 
    virtual string FileName() const = 0;
@@ -151,12 +151,17 @@ class RPMHdrHandler : public RPMHandler
 };
 
 
+class GzIndexReader;
 class RPMFileHandler : public RPMHdrHandler
 {
    protected:
 
    FD_t FD;
 
+   // Set instead of FD for lists kept compressed (Acquire::Compressed-Lists)
+   GzIndexReader *Indexed;
+   bool ReadIndexed();
+
    public:
 
    virtual bool Skip();
@@ -201,8 +206,11 @@ class RPMSingleFileHandler : public RPMFileHandler
    virtual ~RPMSingleFileHandler() {}
 };
 
+class RPMDBHeaderCache;
 class RPMDBHandler : public RPMHdrHandler
 {
+   friend class RPMDBHeaderCache;
+
    private:
 
    rpmts Handler;
@@ -211,9 +219,34 @@ class RPMDBHandler : public RPMHdrHandler
 
    time_t DbFileMtime;
 
+   bool HaveSize;
+
+   // Sequential walks from Rewind() go over the installed instances as
+   // listed by the SHA1HEADER index, taking unchanged headers from the
+   // header cache instead of the database.
+   struct Instance
+   {
+      raptDbOffset Offset;
+      string SHA1;
+      bool operator <(const Instance &Other) const
+         {return Offset < Other.Offset;}
+   };
+   vector<Instance> Instances;
+   vector<Instance>::size_type InstPos;
+   RPMDBHeaderCache *HdrCache;
+   bool OwnHeader;
+
+   // While set, those walks skip the instances not listed here
+   vector<raptDbOffset> Selected;
+   bool Selecting;
+
+   bool LoadInstances();
+   void FreeHeader();
+
    public:
 
    static string DataPath(bool DirectoryOnly=true);
+   virtual unsigned Size();
    virtual bool Skip();
    virtual bool Jump(off_t Offset);
    virtual void Rewind();
@@ -225,30 +258,58 @@ class RPMDBHandler : public RPMHdrHandler
    // used by rpmSystem::DistroVer()
    bool JumpByName(string PkgName, bool Provides=false);
 
+   // used by rpmDatabaseIndex::MergeChanges(), the keys are lines of
+   // "instance sha1header" for the last Rewind()
+   bool InstanceKeys(string &Keys) const;
+   void SelectInstances(const vector<raptDbOffset> &Offsets);
+   void SelectAll();
+
    RPMDBHandler(bool WriteLock=false);
    virtual ~RPMDBHandler();
 };
 
+class RPMDirHeaderCache;
 class RPMDirHandler : public RPMHdrHandler
 {
+   public:
+
+   // The directory is read once on construction, offsets index this list
+   struct DirFile
+   {
+      string Name;
+      ino_t Inode;
+      off_t Size;
+      time_t Mtime;
+      string MD5;
+      // Main header read by ScanFiles(), until Skip() gets to the file
+      string RawHeader;
+      bool Scanned;
+   };
+
    private:
 
-   DIR *Dir;
+   vector<DirFile> Files;
+   bool DirOK;
    string sDirName;
    string sFileName;
    string sFilePath;
 
    rpmts TS;
+   RPMDirHeaderCache *HdrCache;
+   bool Walking;
 
-   const char *nextFileName();
+   bool ReadHeader(DirFile &F);
+   void ScanFiles(vector<DirFile>::size_type From);
 
    public:
 
+   static string FileHash(const string &Path, const string &HashType);
+
    virtual bool Skip();
    virtual bool Jump(off_t Offset);
    virtual void Rewind();
 
-   virtual string FileName()  const{return (Dir == NULL)?"":sFileName;}
+   virtual string FileName()  const{return (DirOK == false)?"":sFileName;}
    virtual off_t FileSize() const;
    virtual string Hash() const;
    virtual string HashType() const;
@@ -320,6 +381,20 @@ class RPMRepomdReaderHandler : public RPMHandler
    string XmlPath;
    xmlNode *NodeP;
 
+   // Byte offsets of the packages, when known Jump() doesn't need the
+   // reader but parses the single package into Doc. The offsets are into
+   // the uncompressed data, read through Indexed for compressed lists.
+   vector<off_t> Offsets;
+   int XmlFd;
+   GzIndexReader *Indexed;
+   xmlDocPtr Doc;
+
+   bool OpenXml();
+   bool ReadXml(off_t Start,char *To,size_t Len,size_t &Actual);
+   long XmlHeadCount(off_t Len);
+   bool LoadOffsets();
+   bool ReadPackage(off_t Offset);
+
    string FindTag(const char *Tag) const;
    string FindVerTag(const char *Tag) const;
 
@@ -374,6 +449,7 @@ class RPMRepomdOtherHandler : public RPMRepomdReaderHandler
 };
 
 #ifdef WITH_SQLITE3
+class RPMSqlitePRCO;
 class RPMSqliteHandler : public RPMHandler
 {
    private:
@@ -384,10 +460,10 @@ class RPMSqliteHandler : public RPMHandler
 
    SqliteQuery *Packages;
 
-   SqliteQuery *Provides;
-   SqliteQuery *Requires;
-   SqliteQuery *Conflicts;
-   SqliteQuery *Obsoletes;
+   RPMSqlitePRCO *Provides;
+   RPMSqlitePRCO *Requires;
+   RPMSqlitePRCO *Conflicts;
+   RPMSqlitePRCO *Obsoletes;
 
    SqliteQuery *Files;
    SqliteQuery *Changes;
@@ -398,6 +474,21 @@ class RPMSqliteHandler : public RPMHandler
 
    int DBVersion;
 
+   // Column indexes of the Packages query, resolved once after prepare
+   enum {
+      ColPkgKey, ColPkgId, ColName, ColArch, ColVersion, ColEpoch,
+      ColRelease, ColSummary, ColDescription, ColVendor, ColGroup,
+      ColSourceRpm, ColPackager, ColSizePackage, ColSizeInstalled,
+      ColLocation, ColChecksumType, ColCount
+   };
+   int PkgCol[ColCount];
+
+   // True while the packages are walked in order from Rewind(), which
+   // lets PRCO() stream the dependency tables instead of querying them
+   // per package.
+   bool Sequential;
+   bool BulkLoad;
+
    public:
 
    virtual bool Skip();
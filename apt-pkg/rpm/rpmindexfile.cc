@@ -33,6 +33,8 @@
 #include <apti18n.h>
 
 #include <sys/stat.h>
+#include <map>
+#include <set>
 
 vector<pkgRepository *> RepList;
 
@@ -281,7 +283,7 @@ bool rpmSrcListIndex::GetIndexes(pkgAcquire *Owner) const
        Repository->HasRelease() == false)
       return true;
    new pkgAcqIndex(Owner,Repository,IndexURI("srclist"),Info("srclist"),
-		   "srclist");
+		   "srclist",true);
    return true;
 }
 									/*}}}*/
@@ -355,7 +357,7 @@ bool rpmPkgListIndex::GetIndexes(pkgAcquire *Owner) const
        Repository->HasRelease() == false)
       return true;
    new pkgAcqIndex(Owner,Repository,IndexURI("pkglist"),Info("pkglist"),
-		   "pkglist");
+		   "pkglist",true);
    new pkgAcqIndexRel(Owner,Repository,IndexURI("release"),Info("release"),
 		      "release");
    return true;
@@ -670,13 +672,18 @@ bool rpmRepomdIndex::GetIndexes(pkgAcquire *Owner) const
 			Repository->URI.c_str(), Repository->Dist.c_str());
    }
 
-   new pkgAcqIndex(Owner,Repository,IndexURI(AutoType("primary")),
-		   Info(AutoType("primary")), "primary");
-   new pkgAcqIndex(Owner,Repository,IndexURI(AutoType("filelists")),
-		   Info(AutoType("filelists")), "filelists");
+   // The XML lists may be kept compressed, the handlers read them through
+   // their block index. The sqlite databases have to stay plain.
+   string Primary = AutoType("primary");
+   string FileLists = AutoType("filelists");
+   new pkgAcqIndex(Owner,Repository,IndexURI(Primary),
+		   Info(Primary), "primary", Primary == "primary");
+   new pkgAcqIndex(Owner,Repository,IndexURI(FileLists),
+		   Info(FileLists), "filelists", FileLists == "filelists");
    if (AcqOther) {
-      new pkgAcqIndex(Owner,Repository,IndexURI(AutoType("other")),
-		     Info(AutoType("other")), "other");
+      string Other = AutoType("other");
+      new pkgAcqIndex(Owner,Repository,IndexURI(Other),
+		     Info(Other), "other", Other == "other");
    }
 
    if (AcqGroup) {
@@ -894,6 +901,11 @@ bool rpmDatabaseIndex::Merge(pkgCacheGenerator &Gen,OpProgress &Prog) const
    CFile->Size = St.st_size;
    CFile->mtime = Handler->Mtime();
 
+   // What MergeChanges() starts from next time
+   string Keys;
+   if (Handler->InstanceKeys(Keys) == true)
+      CFile->Entries = Gen.WriteString(Keys);
+
    if (Gen.MergeList(Parser) == false)
       return _error->Error(_("Problem with MergeList %s"),
 			   Handler->DataPath(false).c_str());
@@ -918,6 +930,168 @@ bool rpmDatabaseIndex::MergeFileProvides(pkgCacheGenerator &Gen,
    return true;
 }
 									/*}}}*/
+// ParseInstanceKeys - Split up RPMDBHandler::InstanceKeys()		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+static void ParseInstanceKeys(const char *Keys,map<unsigned long,string> &Out)
+{
+   while (*Keys != 0)
+   {
+      char *End;
+      unsigned long Offset = strtoul(Keys,&End,10);
+      if (*End == ' ')
+	 End++;
+      const char *Stop = strchr(End,'\n');
+      if (Stop == 0)
+	 Stop = End + strlen(End);
+      Out[Offset] = string(End,Stop - End);
+      Keys = *Stop == 0 ? Stop : Stop + 1;
+   }
+}
+									/*}}}*/
+// MergeInstances - Merge the selected instances of the database	/*{{{*/
+// ---------------------------------------------------------------------
+/* Fails when a package ends up with a second installed version, the full
+   walk would have made a duplicated package of it. */
+static bool MergeInstances(pkgCacheGenerator &Gen,rpmListParser &Parser,
+			   pkgCache::PkgFileIterator CFile)
+{
+   pkgCache &Cache = Gen.GetCache();
+   while (true)
+   {
+      pkgCache::VerIterator Ver(Cache);
+      if (Gen.MergeList(Parser,&Ver) == false)
+	 return false;
+      if (Ver.end() == true)
+	 return true;
+
+      pkgCache::VerIterator V = Ver.ParentPkg().VersionList();
+      for (; V.end() == false; V++)
+      {
+	 if (V == Ver)
+	    continue;
+	 for (pkgCache::VerFileIterator VF = V.FileList(); VF.end() == false; VF++)
+	    if (VF.File() == CFile)
+	       return false;
+      }
+   }
+}
+									/*}}}*/
+// DatabaseIndex::MergeChanges - Merge what changed in the database	/*{{{*/
+// ---------------------------------------------------------------------
+/* Merge() keeps the instances it walked over in the cache, together with
+   their SHA1HEADER. These are compared with what the database lists now:
+   the versions of instances that are gone are taken out of the cache and
+   only the new instances are merged, file provides included, instead of
+   walking over all of them again. Fails when too much changed for that
+   to pay off, or when duplicated packages are involved, which need the
+   full walk. */
+bool rpmDatabaseIndex::MergeChanges(pkgCacheGenerator &Gen,
+				    OpProgress &Prog) const
+{
+   RPMDBHandler *Handler = rpmSys.GetDBHandler();
+   RPMPackageData *RpmData = RPMPackageData::Singleton();
+   pkgCache &Cache = Gen.GetCache();
+   string DataPath = Handler->DataPath(false);
+
+   pkgCache::PkgFileIterator CFile = Cache.FileBegin();
+   for (; CFile.end() == false; CFile++)
+      if (DataPath == CFile.FileName())
+	 break;
+   if (CFile.end() == true || CFile.Entries() == 0)
+      return false;
+
+   rpmListParser Parser(Handler);
+   string Keys;
+   if (_error->PendingError() == true ||
+       Handler->InstanceKeys(Keys) == false)
+      return false;
+
+   map<unsigned long,string> Old;
+   map<unsigned long,string> New;
+   ParseInstanceKeys(CFile.Entries(),Old);
+   ParseInstanceKeys(Keys.c_str(),New);
+
+   vector<raptDbOffset> Added;
+   map<unsigned long,string>::const_iterator I;
+   for (I = New.begin(); I != New.end(); I++)
+   {
+      map<unsigned long,string>::const_iterator O = Old.find(I->first);
+      if (O == Old.end() || O->second != I->second)
+	 Added.push_back(I->first);
+   }
+   set<unsigned long> Removed;
+   for (I = Old.begin(); I != Old.end(); I++)
+   {
+      map<unsigned long,string>::const_iterator N = New.find(I->first);
+      if (N == New.end() || N->second != I->second)
+	 Removed.insert(I->first);
+   }
+   if ((Added.size() + Removed.size())*2 > New.size())
+      return false;
+
+   // Find the versions of the instances that are gone
+   vector<pkgCache::VerIterator> Gone;
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; Pkg++)
+   {
+      // Duplicates that weren't configured are only found by the full walk
+      const char *Name = Pkg.Name();
+      const char *Hash = strchr(Name,'#');
+      bool Dup = (Hash != 0 &&
+		  RpmData->IsDupPackage(string(Name,Hash - Name)) == false);
+      for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() == false; Ver++)
+      {
+	 for (pkgCache::VerFileIterator VF = Ver.FileList(); VF.end() == false; VF++)
+	 {
+	    if (VF.File() != CFile)
+	       continue;
+	    if (Dup == true)
+	       return false;
+	    if (Removed.find(VF->Offset) != Removed.end())
+	       Gone.push_back(Ver);
+	 }
+      }
+   }
+
+   Prog.SubProgress(0,"RPM Database");
+   vector<pkgCache::VerIterator>::iterator G;
+   for (G = Gone.begin(); G != Gone.end(); G++)
+   {
+      pkgCache::PkgIterator Pkg = G->ParentPkg();
+      if (Pkg->CurrentVer == G->Index())
+      {
+	 Pkg->SelectedState = pkgCache::State::Unknown;
+	 Pkg->InstState = pkgCache::State::Ok;
+	 Pkg->CurrentState = pkgCache::State::NotInstalled;
+	 Pkg->CurrentVer = 0;
+      }
+      if (Gen.RemoveFileVer(*G,CFile) == false)
+	 return false;
+   }
+
+   // The new instances, the same way Merge() and MergeFileProvides() do
+   Gen.SelectFile(CFile);
+   Handler->SelectInstances(Added);
+   bool Res = MergeInstances(Gen,Parser,CFile);
+   if (Res == true && Added.empty() == false &&
+       Cache.HeaderP->HasFileDeps == true)
+   {
+      rpmListParser FileParser(Handler);
+      Res = Gen.MergeFileProvides(FileParser);
+   }
+   Handler->SelectAll();
+   if (Res == false)
+      return false;
+
+   struct stat St;
+   if (stat(DataPath.c_str(),&St) != 0)
+      return _error->Errno("fstat",_("Failed to stat %s"),DataPath.c_str());
+   CFile->Size = St.st_size;
+   CFile->mtime = Handler->Mtime();
+   CFile->Entries = Gen.WriteString(Keys);
+   return CFile->Entries != 0;
+}
+									/*}}}*/
 // DatabaseIndex::FindInCache - Find this index				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
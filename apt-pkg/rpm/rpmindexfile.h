@@ -66,6 +66,7 @@ class rpmDatabaseIndex : public rpmIndexFile
    virtual bool MergeFileProvides(pkgCacheGenerator &/*Gen*/,
 				  OpProgress &/*Prog*/) const;
    virtual pkgCache::PkgFileIterator FindInCache(pkgCache &Cache) const;
+   virtual bool MergeChanges(pkgCacheGenerator &Gen,OpProgress &Prog) const;
 
    rpmDatabaseIndex();
 };
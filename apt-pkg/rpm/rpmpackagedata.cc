@@ -327,9 +327,8 @@ bool RPMPackageData::IsDupPackage(const string &Name)
 
 RPMPackageData *RPMPackageData::Singleton()
 {
-   static RPMPackageData *data = NULL;
-   if (!data)
-      data = new RPMPackageData();
+   // Initialized once even when first asked for by several threads
+   static RPMPackageData *data = new RPMPackageData();
    return data;
 }
 
@@ -4,6 +4,15 @@
 
    RPM Package Manager - Provide an interface to rpm
 
+   With RPM::Transaction-Size set, the operations are committed as a
+   series of rpm transactions instead of a single one. rpm keeps every
+   header of a transaction in memory, and a failure undoes nothing but
+   still throws away all the work of the run. The ordered operations are
+   cut into transactions of about the given number of operations, where
+   the system in between is consistent. The run stops at the first
+   transaction that fails, RPM::Post-Invoke and Scripts::PM::Post are
+   run once at the end either way.
+
    #####################################################################
  */
 									/*}}}*/
@@ -17,6 +26,7 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/luaiface.h>
 #include <apt-pkg/depcache.h>
+#include <apt-pkg/sptr.h>
 
 #include <apti18n.h>
 
@@ -28,6 +38,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <stdio.h>
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 
@@ -41,7 +52,8 @@ using namespace std;
 // RPMPM::pkgRPMPM - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-pkgRPMPM::pkgRPMPM(pkgDepCache *Cache) : pkgPackageManager(Cache)
+pkgRPMPM::pkgRPMPM(pkgDepCache *Cache) : pkgPackageManager(Cache),
+   Chunked(false)
 {
 }
 									/*}}}*/
@@ -224,6 +236,163 @@ bool pkgRPMPM::RunScriptsWithPkgs(const char *Cnf)
 									/*}}}*/
 
 
+// RPMPM::SplitTransaction - Split the operations into transactions	/*{{{*/
+// ---------------------------------------------------------------------
+/* The list is already in the order the operations have to be done in,
+   so it is cut into consecutive pieces. A cut is only made where the
+   system left by the operations before it is consistent: every
+   dependency of an installed version is met and none of their conflicts
+   is, counting the versions installed so far and the untouched rest of
+   the system. rpm would refuse a transaction leaving it any other way.
+   All the items of a package also stay on one side of a cut. Once a
+   transaction holds RPM::Transaction-Size items it is closed at the next
+   point that allows it, so one can grow past the size when a long run
+   of the list only makes sense as a whole. Chunk gets the transaction
+   number of each item, the number of transactions is returned.
+
+   Only the versions whose dependencies may have changed are checked at
+   a cut point: those just installed, and those depending on or
+   conflicting with a package or provide that was just replaced or
+   removed. Dependencies that are broken on the installed system already
+   don't hold a cut back. */
+static bool SplitDepOk(pkgCache &Cache,pkgCache::DepIterator Start,
+		       pkgCache::DepIterator End,
+		       vector<pkgCache::Version *> const &State)
+{
+   bool Negative = (Start->Type == pkgCache::Dep::Conflicts);
+   while (true)
+   {
+      SPtrArray<pkgCache::Version *> VList = Start.AllTargets();
+      for (pkgCache::Version **V = VList; *V != 0; V++)
+      {
+	 pkgCache::VerIterator Ver(Cache,*V);
+	 if (Negative == true && Ver.ParentPkg() == Start.ParentPkg())
+	    continue;
+	 if (State[Ver.ParentPkg()->ID] == *V)
+	    return !Negative;
+      }
+      if (Start == End)
+	 break;
+      Start++;
+   }
+   return Negative;
+}
+
+static bool SplitVerOk(pkgCache &Cache,pkgCache::Version *Version,
+		       vector<pkgCache::Version *> const &State,
+		       vector<pkgCache::Version *> const &Current)
+{
+   pkgCache::VerIterator Ver(Cache,Version);
+   // Not installed at this point, nothing to check
+   if (State[Ver.ParentPkg()->ID] != Version)
+      return true;
+
+   for (pkgCache::DepIterator D = Ver.DependsList(); D.end() == false;)
+   {
+      pkgCache::DepIterator Start;
+      pkgCache::DepIterator End;
+      D.GlobOr(Start,End);
+      if (Start->Type != pkgCache::Dep::Depends &&
+	  Start->Type != pkgCache::Dep::PreDepends &&
+	  Start->Type != pkgCache::Dep::Conflicts)
+	 continue;
+      if (SplitDepOk(Cache,Start,End,State) == true)
+	 continue;
+      if (Current[Ver.ParentPkg()->ID] == Version &&
+	  SplitDepOk(Cache,Start,End,Current) == false)
+	 continue;
+      return false;
+   }
+   return true;
+}
+
+// Everything depending on or conflicting with the package or what one of
+// its versions provides is to be checked again
+static void SplitRevDepends(pkgCache::PkgIterator Pkg,pkgCache::Version *Ver,
+			    vector<pkgCache::Version *> &Pending)
+{
+   for (pkgCache::DepIterator D = Pkg.RevDependsList(); D.end() == false; D++)
+      Pending.push_back(D.ParentVer());
+   if (Ver == 0)
+      return;
+   pkgCache::VerIterator V(*Pkg.Cache(),Ver);
+   for (pkgCache::PrvIterator P = V.ProvidesList(); P.end() == false; P++)
+      for (pkgCache::DepIterator D = P.ParentPkg().RevDependsList();
+	   D.end() == false; D++)
+	 Pending.push_back(D.ParentVer());
+}
+
+unsigned long pkgRPMPM::SplitTransaction(vector<unsigned long> &Chunk)
+{
+   unsigned long Size = _config->FindI("RPM::Transaction-Size",0);
+   Chunk.assign(List.size(),0);
+   if (Size == 0 || List.size() <= Size)
+      return 1;
+
+   // The installed version of each package before and while walking
+   vector<pkgCache::Version *> Current(Cache.Head().PackageCount,0);
+   for (PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; Pkg++)
+      Current[Pkg->ID] = Pkg.CurrentVer();
+   vector<pkgCache::Version *> State(Current);
+
+   // The last list item of each package, and of them all
+   vector<unsigned long> Last(Cache.Head().PackageCount,0);
+   unsigned long LastOp = 0;
+   for (unsigned long I = 0; I != List.size(); I++)
+      if (List[I].Op != Item::Configure)
+	 LastOp = Last[List[I].Pkg->ID] = I;
+
+   vector<pkgCache::Version *> Pending;
+   unsigned long Chunks = 1;
+   unsigned long InChunk = 0;
+   unsigned long Through = 0;
+   for (unsigned long I = 0; I != List.size(); I++)
+   {
+      Chunk[I] = Chunks - 1;
+      if (List[I].Op == Item::Configure)
+	 continue;
+      InChunk++;
+      Through = max(Through,Last[List[I].Pkg->ID]);
+
+      PkgIterator Pkg = List[I].Pkg;
+      pkgCache::Version *Old = State[Pkg->ID];
+      pkgCache::Version *New = 0;
+      if (List[I].Op == Item::Install)
+	 New = Cache[Pkg].InstVerIter(Cache);
+      if (Old != New)
+      {
+	 State[Pkg->ID] = New;
+	 if (New != 0)
+	    Pending.push_back(New);
+	 SplitRevDepends(Pkg,Old,Pending);
+	 SplitRevDepends(Pkg,New,Pending);
+      }
+
+      if (InChunk < Size || Through > I || I == LastOp)
+	 continue;
+
+      // Keep what is still broken for the next candidate
+      vector<pkgCache::Version *> Broken;
+      for (vector<pkgCache::Version *>::const_iterator V = Pending.begin();
+	   V != Pending.end(); V++)
+	 if (SplitVerOk(Cache,*V,State,Current) == false)
+	    Broken.push_back(*V);
+      sort(Broken.begin(),Broken.end());
+      Broken.erase(unique(Broken.begin(),Broken.end()),Broken.end());
+      Pending.swap(Broken);
+      if (Pending.empty() == false)
+	 continue;
+
+      Chunks++;
+      InChunk = 0;
+   }
+
+   if (_config->FindB("Debug::pkgRPMPM",false) == true)
+      clog << "Splitting " << List.size() << " operations into "
+	   << Chunks << " transactions" << endl;
+   return Chunks;
+}
+									/*}}}*/
 // RPMPM::Go - Run the sequence						/*{{{*/
 // ---------------------------------------------------------------------
 /* This globs the operations and calls rpm */
@@ -247,6 +416,10 @@ bool pkgRPMPM::Go()
 
    vector<char*> unalloc;
 
+   // Where each item went, for splitting the transaction
+   enum {None, ToInstall, ToUpgrade, ToUninstall};
+   vector<int> Kind(List.size(),None);
+
    for (vector<Item>::iterator I = List.begin(); I != List.end(); I++)
    {
       string Name = I->Pkg.Name();
@@ -268,6 +441,7 @@ bool pkgRPMPM::Go()
 	 RealName = RealName + "." + I->Pkg.CurrentVer().Arch();
 	 uninstall.push_back(strdup(RealName.c_str()));
 	 unalloc.push_back(strdup(RealName.c_str()));
+	 Kind[I - List.begin()] = ToUninstall;
 	 pkgs_uninstall.push_back(I->Pkg);
 	 break;
 
@@ -292,12 +466,16 @@ bool pkgRPMPM::Go()
 	    // package with a different name is being installed with
 	    // Allow-Duplicated and requires additional dependencies, but there's
 	    // no other package with the same name in the system."
-	    if (Installed)
+	    if (Installed) {
 	       install.push_back(I->File.c_str());
-	    else
+	       Kind[I - List.begin()] = ToInstall;
+	    } else {
 	       upgrade.push_back(I->File.c_str());
+	       Kind[I - List.begin()] = ToUpgrade;
+	    }
 	 } else {
 	    upgrade.push_back(I->File.c_str());
+	    Kind[I - List.begin()] = ToUpgrade;
 	 }
 	 install_or_upgrade.push_back(I->File.c_str());
 	 pkgs_install.push_back(I->Pkg);
@@ -328,8 +506,53 @@ bool pkgRPMPM::Go()
    }
 #endif
 
-   if (Process(install, upgrade, uninstall) == false)
-      Ret = false;
+   {
+      vector<unsigned long> Chunk;
+      unsigned long Chunks = SplitTransaction(Chunk);
+      Chunked = (Chunks > 1);
+      if (Chunks == 1)
+      {
+	 if (Process(install, upgrade, uninstall) == false)
+	    Ret = false;
+      }
+
+      // Each transaction only sees its own items, in the same order
+      for (unsigned long C = 0; Chunks > 1 && C != Chunks && Ret == true; C++)
+      {
+	 vector<const char*> Install;
+	 vector<const char*> Upgrade;
+	 vector<const char*> Uninstall;
+	 vector<const char*>::const_iterator In = install.begin();
+	 vector<const char*>::const_iterator Up = upgrade.begin();
+	 vector<const char*>::const_iterator Un = uninstall.begin();
+	 for (unsigned long J = 0; J != List.size(); J++)
+	 {
+	    switch (Kind[J])
+	    {
+	       case ToInstall:
+		  if (Chunk[J] == C)
+		     Install.push_back(*In);
+		  In++;
+		  break;
+	       case ToUpgrade:
+		  if (Chunk[J] == C)
+		     Upgrade.push_back(*Up);
+		  Up++;
+		  break;
+	       case ToUninstall:
+		  if (Chunk[J] == C)
+		     Uninstall.push_back(*Un);
+		  Un++;
+		  break;
+	    }
+	 }
+	 if (Install.empty() == true && Upgrade.empty() == true &&
+	     Uninstall.empty() == true)
+	    continue;
+	 if (Process(Install, Upgrade, Uninstall) == false)
+	    Ret = false;
+      }
+   }
 
 #ifdef APT_WITH_LUA
    if (_lua->HasScripts("Scripts::PM::Post") == true) {
@@ -351,8 +574,11 @@ bool pkgRPMPM::Go()
 #endif
 
 
+   // Earlier transactions did change the system when a later one failed
    if (Ret == true)
       Ret = RunScripts("RPM::Post-Invoke");
+   else if (Chunked == true)
+      RunScripts("RPM::Post-Invoke");
 
 exit:
    for (vector<char *>::const_iterator I = unalloc.begin(); I != unalloc.end(); I++)
@@ -597,7 +823,8 @@ bool pkgRPMExtPM::ExecRPM(Item::RPMOps op, vector<const char*> &files)
    {
       if (errno == EINTR)
 	  continue;
-      RunScripts("RPM::Post-Invoke");
+      if (Chunked == false)
+	 RunScripts("RPM::Post-Invoke");
       if (ArgsFileName) {
 	 unlink(ArgsFileName);
 	 free(ArgsFileName);
@@ -616,7 +843,9 @@ bool pkgRPMExtPM::ExecRPM(Item::RPMOps op, vector<const char*> &files)
    // Check for an error code.
    if (WIFEXITED(Status) == 0 || WEXITSTATUS(Status) != 0)
    {
-      RunScripts("RPM::Post-Invoke");
+      // Split runs go on to Go(), which runs it once at the end
+      if (Chunked == false)
+	 RunScripts("RPM::Post-Invoke");
       if (WIFSIGNALED(Status) != 0 && WTERMSIG(Status) == SIGSEGV)
 	  return _error->Error(_("Sub-process %s recieved a segmentation fault."),Args[0]);
 
@@ -637,13 +866,23 @@ bool pkgRPMExtPM::Process(vector<const char*> &install,
 			  vector<const char*> &upgrade,
 			  vector<const char*> &uninstall)
 {
-   if (uninstall.empty() == false)
-       ExecRPM(Item::RPMErase, uninstall);
-   if (install.empty() == false)
-       ExecRPM(Item::RPMInstall, install);
-   if (upgrade.empty() == false)
-       ExecRPM(Item::RPMUpgrade, upgrade);
-   return true;
+   // A single run carries on past a failed rpm call as it always did, a
+   // split one stops so the later transactions aren't tried
+   bool Ret = true;
+   if (uninstall.empty() == false &&
+       ExecRPM(Item::RPMErase, uninstall) == false)
+      Ret = false;
+   if (Chunked == true && Ret == false)
+      return false;
+   if (install.empty() == false &&
+       ExecRPM(Item::RPMInstall, install) == false)
+      Ret = false;
+   if (Chunked == true && Ret == false)
+      return false;
+   if (upgrade.empty() == false &&
+       ExecRPM(Item::RPMUpgrade, upgrade) == false)
+      Ret = false;
+   return (Chunked == false || Ret == true);
 }
 
 // RPMLibPM::pkgRPMLibPM - Constructor					/*{{{*/
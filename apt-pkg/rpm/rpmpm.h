@@ -39,9 +39,13 @@ class pkgRPMPM : public pkgPackageManager
    };
    vector<Item> List;
 
+   // Set while the operations go as more than one transaction
+   bool Chunked;
+
    // Helpers
    bool RunScripts(const char *Cnf);
    bool RunScriptsWithPkgs(const char *Cnf);
+   unsigned long SplitTransaction(vector<unsigned long> &Chunk);
 
    // The Actuall installation implementation
    virtual bool Install(PkgIterator Pkg,string File);
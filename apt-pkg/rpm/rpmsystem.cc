@@ -135,6 +135,9 @@ bool rpmSystem::Initialize(Configuration &Cnf)
    Cnf.CndSet("Dir::Etc::translatelist", "translate.list");
    Cnf.CndSet("Dir::Etc::translateparts", "translate.list.d");
    Cnf.CndSet("Dir::State::prefetch", "prefetch");
+   Cnf.CndSet("Dir::Cache::dbheaders", "dbheaders.bin");
+   Cnf.CndSet("Dir::Cache::dirheaders", "dirheaders/");
+   Cnf.CndSet("Dir::Cache::xmloffsets", "xmloffsets/");
    Cnf.CndSet("Acquire::CDROM::Mount", "/media/cdrom");
    Cnf.CndSet("Acquire::CDROM::Copy-All", "true");
 
@@ -18,10 +18,12 @@
 #include "rapttypes.h"
 #include "rpmversion.h"
 #include <apt-pkg/pkgcache.h>
+#include <apt-pkg/configuration.h>
 
 #include <rpm/rpmlib.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <rpm/rpmds.h>
@@ -31,7 +33,7 @@ rpmVersioningSystem rpmVS;
 // rpmVS::rpmVersioningSystem - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-rpmVersioningSystem::rpmVersioningSystem()
+rpmVersioningSystem::rpmVersioningSystem() : UseNative(-1)
 {
    Label = "Standard .rpm";
 }
@@ -144,50 +146,75 @@ int rpmVersioningSystem::DoCmpVersionArch(const char *A,const char *Aend,
    return rc;
 }
 									/*}}}*/
-// rpmVS::CheckDep - Check a single dependency				/*{{{*/
+// DepSense - Map an apt compare operator to rpm sense flags		/*{{{*/
 // ---------------------------------------------------------------------
-/* This simply preforms the version comparison and switch based on
-   operator. If DepVer is 0 then we are comparing against a provides
-   with no version. */
-bool rpmVersioningSystem::CheckDep(const char *PkgVer,
-				   int Op,const char *DepVer)
+/* NotEquals has no rpm equivalent, it's checked as Equals and inverted. */
+static int DepSense(int Op,bool &Invert)
 {
-   int PkgFlags = RPMSENSE_EQUAL;
-   int DepFlags = 0;
-   bool invert = false;
-   int rc;
-
+   Invert = false;
    switch (Op & 0x0F)
    {
     case pkgCache::Dep::LessEq:
-      DepFlags = RPMSENSE_LESS|RPMSENSE_EQUAL;
-      break;
+      return RPMSENSE_LESS|RPMSENSE_EQUAL;
 
     case pkgCache::Dep::GreaterEq:
-      DepFlags = RPMSENSE_GREATER|RPMSENSE_EQUAL;
-      break;
+      return RPMSENSE_GREATER|RPMSENSE_EQUAL;
 
     case pkgCache::Dep::Less:
-      DepFlags = RPMSENSE_LESS;
-      break;
+      return RPMSENSE_LESS;
 
     case pkgCache::Dep::Greater:
-      DepFlags = RPMSENSE_GREATER;
-      break;
+      return RPMSENSE_GREATER;
 
     case pkgCache::Dep::Equals:
-      DepFlags = RPMSENSE_EQUAL;
-      break;
+      return RPMSENSE_EQUAL;
 
     case pkgCache::Dep::NotEquals:
-      DepFlags = RPMSENSE_EQUAL;
-      invert = true;
-      break;
+      Invert = true;
+      return RPMSENSE_EQUAL;
 
     default:
-      DepFlags = RPMSENSE_ANY;
-      break;
+      return RPMSENSE_ANY;
    }
+}
+									/*}}}*/
+// rpmVS::CheckDep - Check a single dependency				/*{{{*/
+// ---------------------------------------------------------------------
+/* This simply preforms the version comparison and switch based on
+   operator. If DepVer is 0 then we are comparing against a provides
+   with no version. The check is done in place by CheckDepNative()
+   unless RPM::Native-CheckDep is false, then librpm does it. */
+bool rpmVersioningSystem::CheckDep(const char *PkgVer,
+				   int Op,const char *DepVer)
+{
+   if (UseNative == -1)
+      UseNative = _config->FindB("RPM::Native-CheckDep", true) ? 1 : 0;
+   if (UseNative == 1)
+      return CheckDepNative(PkgVer,Op,DepVer);
+   return CheckDepRpm(PkgVer,Op,DepVer);
+}
+									/*}}}*/
+// rpmVS::ThreadSafeCheckDep - Check if CheckDep() can be threaded	/*{{{*/
+// ---------------------------------------------------------------------
+/* The native check only looks at the strings, librpm makes no promises.
+   This runs before the threads are started and always sets UseNative,
+   so the threads calling CheckDep() only ever read it. */
+bool rpmVersioningSystem::ThreadSafeCheckDep()
+{
+   UseNative = _config->FindB("RPM::Native-CheckDep", true) ? 1 : 0;
+   return UseNative == 1;
+}
+									/*}}}*/
+// rpmVS::CheckDepRpm - Check a single dependency using librpm		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool rpmVersioningSystem::CheckDepRpm(const char *PkgVer,
+				      int Op,const char *DepVer)
+{
+   int PkgFlags = RPMSENSE_EQUAL;
+   bool invert;
+   int DepFlags = DepSense(Op,invert);
+   int rc;
 
    rpmds pds = rpmdsSingle(RPMTAG_PROVIDENAME, "", PkgVer, (raptDepFlags) PkgFlags);
    rpmds dds = rpmdsSingle(RPMTAG_REQUIRENAME, "", DepVer, (raptDepFlags) DepFlags);
@@ -200,6 +227,249 @@ bool rpmVersioningSystem::CheckDep(const char *PkgVer,
    return (!invert && rc) || (invert && !rc);
 }
 									/*}}}*/
+// SplitEVR - Locate the components of an [E:]V[-R] string		/*{{{*/
+// ---------------------------------------------------------------------
+/* The same split as rpmds does, but by pointing into the string instead
+   of copying it. A missing epoch or release is a NULL Begin, an empty
+   epoch counts as "0". */
+struct EVRPart
+{
+   const char *Begin;
+   const char *End;
+};
+static const char ZeroEpoch[] = "0";
+
+static void SplitEVR(const char *EVR,EVRPart &E,EVRPart &V,EVRPart &R)
+{
+   const char *End = EVR + strlen(EVR);
+   const char *S = EVR;
+   while (*S >= '0' && *S <= '9')
+      S++;
+   const char *Dash = strrchr(S,'-');
+
+   if (*S == ':')
+   {
+      E.Begin = EVR;
+      E.End = S;
+      if (E.Begin == E.End)
+      {
+	 E.Begin = ZeroEpoch;
+	 E.End = ZeroEpoch + 1;
+      }
+      V.Begin = S + 1;
+   }
+   else
+   {
+      E.Begin = E.End = NULL;
+      V.Begin = EVR;
+   }
+
+   if (Dash != NULL)
+   {
+      V.End = Dash;
+      R.Begin = Dash + 1;
+      R.End = End;
+   }
+   else
+   {
+      V.End = End;
+      R.Begin = R.End = NULL;
+   }
+}
+									/*}}}*/
+// VerCmp - rpmvercmp() on string ranges				/*{{{*/
+// ---------------------------------------------------------------------
+/* Segment by segment comparison as in rpmio/rpmvercmp.c, without the
+   copy it makes to terminate the segments. The separators that sort
+   before anything else follow the librpm we're built against. */
+static inline bool IsDigit(char C) {return C >= '0' && C <= '9';}
+static inline bool IsAlpha(char C)
+{
+   return (C >= 'a' && C <= 'z') || (C >= 'A' && C <= 'Z');
+}
+
+#if RPM_VERSION >= 0x040f00
+static inline bool IsSep(char C) {return C == '~' || C == '^';}
+#elif RPM_VERSION >= 0x040a00
+static inline bool IsSep(char C) {return C == '~';}
+#else
+static inline bool IsSep(char C) {return false;}
+#endif
+
+static int VerCmp(const char *A,const char *AEnd,
+		  const char *B,const char *BEnd)
+{
+   if (AEnd - A == BEnd - B && memcmp(A,B,AEnd - A) == 0)
+      return 0;
+
+   while (A != AEnd || B != BEnd)
+   {
+      while (A != AEnd && IsDigit(*A) == false && IsAlpha(*A) == false &&
+	     IsSep(*A) == false)
+	 A++;
+      while (B != BEnd && IsDigit(*B) == false && IsAlpha(*B) == false &&
+	     IsSep(*B) == false)
+	 B++;
+
+#if RPM_VERSION >= 0x040a00
+      // Tilde sorts before everything else
+      bool ATilde = (A != AEnd && *A == '~');
+      bool BTilde = (B != BEnd && *B == '~');
+      if (ATilde == true || BTilde == true)
+      {
+	 if (ATilde == false)
+	    return 1;
+	 if (BTilde == false)
+	    return -1;
+	 A++;
+	 B++;
+	 continue;
+      }
+#endif
+#if RPM_VERSION >= 0x040f00
+      // Caret too, except that it sorts after the end of the version
+      bool ACaret = (A != AEnd && *A == '^');
+      bool BCaret = (B != BEnd && *B == '^');
+      if (ACaret == true || BCaret == true)
+      {
+	 if (A == AEnd)
+	    return -1;
+	 if (B == BEnd)
+	    return 1;
+	 if (ACaret == false)
+	    return 1;
+	 if (BCaret == false)
+	    return -1;
+	 A++;
+	 B++;
+	 continue;
+      }
+#endif
+
+      if (A == AEnd || B == BEnd)
+	 break;
+
+      const char *ASeg = A;
+      const char *BSeg = B;
+      bool IsNum = IsDigit(*A);
+      if (IsNum == true)
+      {
+	 while (A != AEnd && IsDigit(*A) == true)
+	    A++;
+	 while (B != BEnd && IsDigit(*B) == true)
+	    B++;
+      }
+      else
+      {
+	 while (A != AEnd && IsAlpha(*A) == true)
+	    A++;
+	 while (B != BEnd && IsAlpha(*B) == true)
+	    B++;
+      }
+
+      // Numeric segments are always newer than alpha ones
+      if (BSeg == B)
+	 return IsNum ? 1 : -1;
+
+      if (IsNum == true)
+      {
+	 while (ASeg != A && *ASeg == '0')
+	    ASeg++;
+	 while (BSeg != B && *BSeg == '0')
+	    BSeg++;
+	 if (A - ASeg > B - BSeg)
+	    return 1;
+	 if (A - ASeg < B - BSeg)
+	    return -1;
+      }
+
+      size_t ALen = A - ASeg;
+      size_t BLen = B - BSeg;
+      int Res = memcmp(ASeg,BSeg,ALen < BLen ? ALen : BLen);
+      if (Res != 0)
+	 return Res < 0 ? -1 : 1;
+      if (ALen != BLen)
+	 return ALen < BLen ? -1 : 1;
+   }
+
+   if (A == AEnd && B == BEnd)
+      return 0;
+   return (A == AEnd) ? -1 : 1;
+}
+									/*}}}*/
+// rpmVS::CheckDepNative - Check a single dependency in place		/*{{{*/
+// ---------------------------------------------------------------------
+/* The range overlap test of rpmdsCompare() for a package version (always
+   an EQUAL sense) against the dependency, working directly on the two
+   strings. test/checkdeptest compares it against CheckDepRpm(). */
+bool rpmVersioningSystem::CheckDepNative(const char *PkgVer,
+					 int Op,const char *DepVer)
+{
+   const int PkgFlags = RPMSENSE_EQUAL;
+   bool Invert;
+   int DepFlags = DepSense(Op,Invert);
+
+   // Existence tests and missing versions always overlap
+   if ((DepFlags & RPMSENSE_SENSEMASK) == 0 ||
+       PkgVer == NULL || *PkgVer == '\0' ||
+       DepVer == NULL || *DepVer == '\0')
+      return !Invert;
+
+   EVRPart AE, AV, AR, BE, BV, BR;
+   SplitEVR(PkgVer,AE,AV,AR);
+   SplitEVR(DepVer,BE,BV,BR);
+
+   bool AHasE = (AE.Begin != NULL && AE.Begin != AE.End);
+   bool BHasE = (BE.Begin != NULL && BE.Begin != BE.End);
+   bool AHasR = (AR.Begin != NULL && AR.Begin != AR.End);
+   bool BHasR = (BR.Begin != NULL && BR.Begin != BR.End);
+
+   int Sense = 0;
+   if (AHasE == true && BHasE == true)
+      Sense = VerCmp(AE.Begin,AE.End,BE.Begin,BE.End);
+   else if (AHasE == true && atol(AE.Begin) > 0)
+   {
+#if RPM_VERSION < 0x041000
+      Sense = _rpmds_nopromote ? 1 : 0;
+#else
+      Sense = 1;
+#endif
+   }
+   else if (BHasE == true && atol(BE.Begin) > 0)
+      Sense = -1;
+
+   if (Sense == 0)
+   {
+      Sense = VerCmp(AV.Begin,AV.End,BV.Begin,BV.End);
+      if (Sense == 0)
+      {
+	 if (AHasR == true && BHasR == true)
+	    Sense = VerCmp(AR.Begin,AR.End,BR.Begin,BR.End);
+#if RPM_VERSION >= 0x040b00
+	 // The side without a release matches any release with EQUAL
+	 else if ((AHasR == true && (DepFlags & RPMSENSE_EQUAL)) ||
+		  (BHasR == true && (PkgFlags & RPMSENSE_EQUAL)))
+	    return !Invert;
+#endif
+      }
+   }
+
+   bool Res = false;
+   if (Sense < 0 &&
+       ((PkgFlags & RPMSENSE_GREATER) || (DepFlags & RPMSENSE_LESS)))
+      Res = true;
+   else if (Sense > 0 &&
+	    ((PkgFlags & RPMSENSE_LESS) || (DepFlags & RPMSENSE_GREATER)))
+      Res = true;
+   else if (Sense == 0 &&
+	    (((PkgFlags & RPMSENSE_EQUAL) && (DepFlags & RPMSENSE_EQUAL)) ||
+	     ((PkgFlags & RPMSENSE_LESS) && (DepFlags & RPMSENSE_LESS)) ||
+	     ((PkgFlags & RPMSENSE_GREATER) && (DepFlags & RPMSENSE_GREATER))))
+      Res = true;
+
+   return Res != Invert;
+}
+									/*}}}*/
 // rpmVS::CheckDep - Check a single dependency				/*{{{*/
 // ---------------------------------------------------------------------
 /* This prototype is a wrapper over CheckDep above. It's useful in the
@@ -17,6 +17,9 @@
 
 class rpmVersioningSystem : public pkgVersioningSystem
 {
+   // RPM::Native-CheckDep, looked up on first use or by ThreadSafeCheckDep()
+   int UseNative;
+
    public:
 
    // Compare versions..
@@ -28,6 +31,8 @@ class rpmVersioningSystem : public pkgVersioningSystem
 				const char *BA,const char *BAend);
    virtual bool CheckDep(const char *PkgVer,int Op,const char *DepVer);
    virtual bool CheckDep(const char *PkgVer,pkgCache::DepIterator Dep);
+   bool CheckDepNative(const char *PkgVer,int Op,const char *DepVer);
+   bool CheckDepRpm(const char *PkgVer,int Op,const char *DepVer);
    virtual int DoCmpReleaseVer(const char *A,const char *Aend,
 			     const char *B,const char *Bend)
    {
@@ -36,6 +41,8 @@ class rpmVersioningSystem : public pkgVersioningSystem
    virtual string UpstreamVersion(const char *A);
 
    rpmVersioningSystem();
+
+   virtual bool ThreadSafeCheckDep();
 };
 
 extern rpmVersioningSystem rpmVS;
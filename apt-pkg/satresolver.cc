@@ -0,0 +1,658 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   SAT Resolver - Dependency problem resolution as a satisfiability problem
+
+   The solver keeps no activity scores and does no restarts. The order
+   the variables are decided in is the order of the resolver scores, and
+   the value tried first is what the depcache has now, so the answer
+   stays close to what was asked for and only moves where clauses force
+   it to. Learned clauses are never dropped, the conflict limit bounds
+   how many there can be.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <apt-pkg/satresolver.h>
+#include <apt-pkg/resolvetrace.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/version.h>
+
+#include <algorithm>
+#include <iostream>
+									/*}}}*/
+using namespace std;
+
+const unsigned int pkgSatSolver::NoReason;
+
+// SatSolver::pkgSatSolver - Constructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+pkgSatSolver::pkgSatSolver() : QHead(0), NextDecision(0), Broken(false),
+                               iConflicts(0), iDecisions(0), iLearned(0)
+{
+}
+									/*}}}*/
+// SatSolver::NewVar - Add a variable					/*{{{*/
+// ---------------------------------------------------------------------
+/* Preferred is the value it gets when it is decided on. */
+int pkgSatSolver::NewVar(bool Preferred)
+{
+   int Var = Value.size();
+   Value.push_back(0);
+   Level.push_back(0);
+   Reason.push_back(NoReason);
+   Phase.push_back(Preferred);
+   Seen.push_back(0);
+   Watches.resize(Watches.size() + 2);
+   OrderPos.push_back(Order.size());
+   Order.push_back(Var);
+   return Var;
+}
+									/*}}}*/
+// SatSolver::SetOrder - Set the decision order				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgSatSolver::SetOrder(vector<int> const &Vars)
+{
+   vector<char> Done(Value.size(),0);
+   Order.clear();
+   for (vector<int>::const_iterator I = Vars.begin(); I != Vars.end(); I++)
+   {
+      if (Done[*I] != 0)
+	 continue;
+      Done[*I] = 1;
+      Order.push_back(*I);
+   }
+   for (unsigned int I = 0; I != Value.size(); I++)
+      if (Done[I] == 0)
+	 Order.push_back(I);
+   for (unsigned int I = 0; I != Order.size(); I++)
+      OrderPos[Order[I]] = I;
+   NextDecision = 0;
+}
+									/*}}}*/
+// SatSolver::Assign - Make a literal true				/*{{{*/
+// ---------------------------------------------------------------------
+/* From is the clause that implied it, or NoReason for decisions. */
+void pkgSatSolver::Assign(int Lit,unsigned int From)
+{
+   int Var = Lit >> 1;
+   Value[Var] = (Lit & 1) ? -1 : 1;
+   Level[Var] = DecisionLevel();
+   Reason[Var] = From;
+   Trail.push_back(Lit);
+}
+									/*}}}*/
+// SatSolver::Attach - Store a clause and watch its first two literals	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+unsigned int pkgSatSolver::Attach(vector<int> const &Lits)
+{
+   unsigned int Ref = Pool.size();
+   Pool.push_back(Lits.size());
+   Pool.insert(Pool.end(),Lits.begin(),Lits.end());
+   Watches[Lits[0]].push_back(Ref);
+   Watches[Lits[1]].push_back(Ref);
+   return Ref;
+}
+									/*}}}*/
+// SatSolver::AddClause - Add a clause					/*{{{*/
+// ---------------------------------------------------------------------
+/* Anything decided so far is undone first. False if the clauses can no
+   longer be satisfied at all. */
+bool pkgSatSolver::AddClause(vector<int> Lits)
+{
+   if (Broken == true)
+      return false;
+   Backtrack(0);
+
+   sort(Lits.begin(),Lits.end());
+   Lits.erase(unique(Lits.begin(),Lits.end()),Lits.end());
+   vector<int>::iterator Out = Lits.begin();
+   for (vector<int>::iterator I = Lits.begin(); I != Lits.end(); I++)
+   {
+      // Both a literal and its negation, or already true
+      if ((I + 1 != Lits.end() && *(I + 1) == (*I ^ 1)) || LitValue(*I) > 0)
+	 return true;
+      if (LitValue(*I) == 0)
+	 *Out++ = *I;
+   }
+   Lits.erase(Out,Lits.end());
+
+   if (Lits.empty() == true)
+   {
+      Broken = true;
+      return false;
+   }
+   if (Lits.size() == 1)
+   {
+      Assign(Lits[0],NoReason);
+      if (Propagate() != NoReason)
+	 Broken = true;
+      return !Broken;
+   }
+   Attach(Lits);
+   return true;
+}
+									/*}}}*/
+// SatSolver::Propagate - Unit propagation				/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns the clause that became false, or NoReason. The two watched
+   literals of a clause are its first two; the implied one is moved to
+   the front so it can serve as the reason. */
+unsigned int pkgSatSolver::Propagate()
+{
+   while (QHead < Trail.size())
+   {
+      int False = Trail[QHead++] ^ 1;
+      vector<unsigned int> &W = Watches[False];
+      unsigned int I = 0;
+      unsigned int J = 0;
+      while (I != W.size())
+      {
+	 unsigned int Ref = W[I++];
+	 int Size = Pool[Ref];
+	 int *C = &Pool[Ref + 1];
+	 if (C[0] == False)
+	    swap(C[0],C[1]);
+	 if (LitValue(C[0]) > 0)
+	 {
+	    W[J++] = Ref;
+	    continue;
+	 }
+
+	 // Look for another literal to watch
+	 bool Moved = false;
+	 for (int K = 2; K < Size; K++)
+	 {
+	    if (LitValue(C[K]) < 0)
+	       continue;
+	    swap(C[1],C[K]);
+	    Watches[C[1]].push_back(Ref);
+	    Moved = true;
+	    break;
+	 }
+	 if (Moved == true)
+	    continue;
+
+	 W[J++] = Ref;
+	 if (LitValue(C[0]) < 0)
+	 {
+	    while (I != W.size())
+	       W[J++] = W[I++];
+	    W.resize(J);
+	    QHead = Trail.size();
+	    return Ref;
+	 }
+	 Assign(C[0],Ref);
+      }
+      W.resize(J);
+   }
+   return NoReason;
+}
+									/*}}}*/
+// SatSolver::Analyze - Learn a clause from a conflict			/*{{{*/
+// ---------------------------------------------------------------------
+/* Resolves back along the trail up to the first unique implication
+   point. The asserting literal ends up first and one of the highest
+   level among the rest second; that level is returned. */
+unsigned int pkgSatSolver::Analyze(unsigned int Conflict,vector<int> &Learnt)
+{
+   Learnt.assign(1,0);
+   unsigned int Paths = 0;
+   unsigned int Index = Trail.size();
+   unsigned int Ref = Conflict;
+   int Lit = -1;
+   do
+   {
+      int Size = Pool[Ref];
+      int *C = &Pool[Ref + 1];
+      for (int K = (Lit == -1) ? 0 : 1; K < Size; K++)
+      {
+	 int Var = C[K] >> 1;
+	 if (Seen[Var] != 0 || Level[Var] == 0)
+	    continue;
+	 Seen[Var] = 1;
+	 if (Level[Var] >= DecisionLevel())
+	    Paths++;
+	 else
+	    Learnt.push_back(C[K]);
+      }
+
+      while (Seen[Trail[--Index] >> 1] == 0);
+      Lit = Trail[Index];
+      Ref = Reason[Lit >> 1];
+      Seen[Lit >> 1] = 0;
+      Paths--;
+   }
+   while (Paths > 0);
+   Learnt[0] = Lit ^ 1;
+
+   unsigned int Back = 0;
+   for (unsigned int I = 1; I < Learnt.size(); I++)
+   {
+      Seen[Learnt[I] >> 1] = 0;
+      if (Level[Learnt[I] >> 1] > Back)
+      {
+	 Back = Level[Learnt[I] >> 1];
+	 swap(Learnt[1],Learnt[I]);
+      }
+   }
+   return Back;
+}
+									/*}}}*/
+// SatSolver::Backtrack - Undo everything above a decision level	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgSatSolver::Backtrack(unsigned int ToLevel)
+{
+   if (DecisionLevel() <= ToLevel)
+      return;
+   for (unsigned int I = Trail.size(); I-- > TrailLim[ToLevel];)
+   {
+      int Var = Trail[I] >> 1;
+      Value[Var] = 0;
+      Reason[Var] = NoReason;
+      if (OrderPos[Var] < NextDecision)
+	 NextDecision = OrderPos[Var];
+   }
+   Trail.resize(TrailLim[ToLevel]);
+   TrailLim.resize(ToLevel);
+   QHead = Trail.size();
+}
+									/*}}}*/
+// SatSolver::Solve - Search for a satisfying assignment		/*{{{*/
+// ---------------------------------------------------------------------
+/* The assumptions are taken as the first decisions. Unsatisfiable means
+   there is no solution under them, it does not stick to the solver
+   unless the clauses alone are unsatisfiable. MaxConflicts of 0 means no
+   limit. The assignment found is kept until the solver is changed. */
+pkgSatSolver::Result pkgSatSolver::Solve(vector<int> const &Assume,
+					 unsigned long MaxConflicts)
+{
+   if (Broken == true)
+      return Unsatisfiable;
+   Backtrack(0);
+
+   unsigned long Start = iConflicts;
+   vector<int> Learnt;
+   while (true)
+   {
+      unsigned int Conflict = Propagate();
+      if (Conflict != NoReason)
+      {
+	 iConflicts++;
+	 if (DecisionLevel() == 0)
+	 {
+	    Broken = true;
+	    return Unsatisfiable;
+	 }
+
+	 unsigned int Back = Analyze(Conflict,Learnt);
+	 Backtrack(Back);
+	 if (Learnt.size() == 1)
+	    Assign(Learnt[0],NoReason);
+	 else
+	    Assign(Learnt[0],Attach(Learnt));
+	 iLearned++;
+
+	 if (MaxConflicts != 0 && iConflicts - Start >= MaxConflicts)
+	 {
+	    Backtrack(0);
+	    return GaveUp;
+	 }
+	 continue;
+      }
+
+      // Each assumption gets a level of its own, even if already true
+      if (DecisionLevel() < Assume.size())
+      {
+	 int Lit = Assume[DecisionLevel()];
+	 if (LitValue(Lit) < 0)
+	 {
+	    Backtrack(0);
+	    return Unsatisfiable;
+	 }
+	 TrailLim.push_back(Trail.size());
+	 if (LitValue(Lit) == 0)
+	    Assign(Lit,NoReason);
+	 continue;
+      }
+
+      for (; NextDecision < Order.size() &&
+	     Value[Order[NextDecision]] != 0; NextDecision++);
+      if (NextDecision == Order.size())
+	 return Satisfied;
+
+      int Var = Order[NextDecision];
+      iDecisions++;
+      TrailLim.push_back(Trail.size());
+      Assign(Phase[Var] != 0 ? Pos(Var) : Neg(Var),NoReason);
+   }
+}
+									/*}}}*/
+
+// SatResolver::pkgSatResolver - Constructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+pkgSatResolver::pkgSatResolver(pkgDepCache &Cache) : Cache(Cache)
+{
+   unsigned long Size = Cache.Head().PackageCount;
+   Flags.resize(Size,0);
+   Scores.resize(Size,0);
+   CurVar.resize(Size,-1);
+   CandVar.resize(Size,-1);
+   Debug = _config->FindB("Debug::pkgProblemResolver",false);
+}
+									/*}}}*/
+// SatResolver::VarOf - Variable of a version				/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the current and candidate versions can be installed, and only
+   packages that were looked at have variables. -1 for anything else. */
+int pkgSatResolver::VarOf(pkgCache::Version *Ver)
+{
+   pkgCache &C = Cache.GetCache();
+   PkgIterator Pkg = VerIterator(C,Ver).ParentPkg();
+   map_ptrloc Off = Ver - C.VerP;
+   if (Off == Cache[Pkg].CandidateVer)
+      return CandVar[Pkg->ID];
+   if (Off == Pkg->CurrentVer)
+      return CurVar[Pkg->ID];
+   return -1;
+}
+									/*}}}*/
+// SatResolver::AddPackage - Queue a package for Encode()		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgSatResolver::AddPackage(PkgIterator const &Pkg)
+{
+   if ((Flags[Pkg->ID] & Queued) != 0)
+      return;
+   Flags[Pkg->ID] |= Queued;
+   Pkgs.push_back(Pkg->ID);
+}
+									/*}}}*/
+// SatResolver::AddVersion - Add the clauses of a version		/*{{{*/
+// ---------------------------------------------------------------------
+/* A Depends group needs one of the versions any member of it may be
+   satisfied with, Conflicts and Obsoletes exclude every version they
+   hit. Like in pkgDepCache, Obsoletes don't follow Provides and
+   dependencies the system ignores are always satisfied. */
+void pkgSatResolver::AddVersion(VerIterator const &Ver,int Var)
+{
+   for (DepIterator D = Ver.DependsList(); D.end() == false;)
+   {
+      DepIterator Start = D;
+      DepIterator End = D;
+      for (bool LastOR = true; D.end() == false && LastOR == true; D++)
+      {
+	 LastOR = (D->CompareOp & pkgCache::Dep::Or) == pkgCache::Dep::Or;
+	 End = D;
+      }
+
+      if (Start->Type == pkgCache::Dep::Depends ||
+	  Start->Type == pkgCache::Dep::PreDepends)
+      {
+	 vector<int> Lits(1,pkgSatSolver::Neg(Var));
+	 bool Ignored = false;
+	 for (DepIterator G = Start; Ignored == false; G++)
+	 {
+	    if (_system->IgnoreDep(Cache.VS(),G) == true)
+	       Ignored = true;
+	    pkgCache::Version **Targets = G.AllTargets();
+	    for (pkgCache::Version **T = Targets; *T != 0; T++)
+	    {
+	       int TVar = VarOf(*T);
+	       if (TVar >= 0)
+		  Lits.push_back(pkgSatSolver::Pos(TVar));
+	    }
+	    delete [] Targets;
+	    if (G == End)
+	       break;
+	 }
+	 if (Ignored == false)
+	    Solver.AddClause(Lits);
+	 continue;
+      }
+
+      if (Start->Type != pkgCache::Dep::Conflicts &&
+	  Start->Type != pkgCache::Dep::Obsoletes)
+	 continue;
+      for (DepIterator G = Start;; G++)
+      {
+	 PkgIterator Target = G.TargetPkg();
+	 pkgCache::Version **Targets = G.AllTargets();
+	 for (pkgCache::Version **T = Targets; *T != 0; T++)
+	 {
+	    if (G->Type == pkgCache::Dep::Obsoletes &&
+		VerIterator(Cache.GetCache(),*T).ParentPkg() != Target)
+	       continue;
+	    int TVar = VarOf(*T);
+	    if (TVar < 0)
+	       continue;
+	    vector<int> Lits;
+	    Lits.push_back(pkgSatSolver::Neg(Var));
+	    Lits.push_back(pkgSatSolver::Neg(TVar));
+	    Solver.AddClause(Lits);
+	 }
+	 delete [] Targets;
+	 if (G == End)
+	    break;
+      }
+   }
+}
+									/*}}}*/
+// Higher scores first
+struct SatScoreOrder
+{
+   const vector<signed short> &Scores;
+   bool operator ()(unsigned long A,unsigned long B) const
+      {return Scores[A] > Scores[B];}
+   SatScoreOrder(const vector<signed short> &Scores) : Scores(Scores) {}
+};
+
+// SatResolver::Encode - Build the problem				/*{{{*/
+// ---------------------------------------------------------------------
+/* Starts from what is installed or marked and follows the Depends of
+   every version that gets a variable. Packages never reached can stay
+   as they are, not installed, whatever happens. */
+bool pkgSatResolver::Encode()
+{
+   pkgCache &C = Cache.GetCache();
+   for (PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+      if (I->CurrentVer != 0 || Cache[I].InstallVer != 0)
+	 AddPackage(I);
+
+   for (unsigned long I = 0; I < Pkgs.size(); I++)
+   {
+      PkgIterator Pkg(C,C.PkgP + Pkgs[I]);
+      pkgDepCache::StateCache &State = Cache[Pkg];
+
+      // What is there now is what we try first
+      bool Keep = State.InstallVer != 0 && (Flags[Pkg->ID] & ToRemove) == 0;
+      if (State.CandidateVer != 0)
+      {
+	 CandVar[Pkg->ID] = Solver.NewVar(Keep);
+	 VarPkg.push_back(Pkg->ID);
+      }
+      if (Pkg->CurrentVer != 0 && Pkg->CurrentVer != State.CandidateVer)
+      {
+	 CurVar[Pkg->ID] = Solver.NewVar(Keep);
+	 VarPkg.push_back(Pkg->ID);
+      }
+
+      map_ptrloc Vers[2] = {State.CandidateVer, Pkg->CurrentVer};
+      for (int V = 0; V != 2; V++)
+      {
+	 if (Vers[V] == 0 || (V == 1 && Vers[1] == Vers[0]))
+	    continue;
+	 for (DepIterator D = VerIterator(C,C.VerP + Vers[V]).DependsList();
+	      D.end() == false; D++)
+	 {
+	    if (D->Type != pkgCache::Dep::Depends &&
+		D->Type != pkgCache::Dep::PreDepends)
+	       continue;
+	    pkgCache::Version **Targets = D.AllTargets();
+	    for (pkgCache::Version **T = Targets; *T != 0; T++)
+	    {
+	       PkgIterator TPkg = VerIterator(C,*T).ParentPkg();
+	       map_ptrloc Off = *T - C.VerP;
+	       if (Off == Cache[TPkg].CandidateVer || Off == TPkg->CurrentVer)
+		  AddPackage(TPkg);
+	    }
+	    delete [] Targets;
+	 }
+      }
+   }
+
+   // At most one version of a package, then the dependencies
+   for (vector<unsigned long>::const_iterator I = Pkgs.begin(); I != Pkgs.end(); I++)
+   {
+      PkgIterator Pkg(C,C.PkgP + *I);
+      if (CandVar[*I] >= 0 && CurVar[*I] >= 0)
+      {
+	 vector<int> Lits;
+	 Lits.push_back(pkgSatSolver::Neg(CandVar[*I]));
+	 Lits.push_back(pkgSatSolver::Neg(CurVar[*I]));
+	 Solver.AddClause(Lits);
+      }
+      if (CandVar[*I] >= 0)
+	 AddVersion(VerIterator(C,C.VerP + Cache[Pkg].CandidateVer),CandVar[*I]);
+      if (CurVar[*I] >= 0)
+	 AddVersion(Pkg.CurrentVer(),CurVar[*I]);
+   }
+
+   /* Higher scores are decided first, and within a package the version
+      it is marked for, then the candidate the policy prefers */
+   vector<unsigned long> Sorted(Pkgs);
+   stable_sort(Sorted.begin(),Sorted.end(),SatScoreOrder(Scores));
+   vector<int> Order;
+   for (vector<unsigned long>::const_iterator I = Sorted.begin(); I != Sorted.end(); I++)
+   {
+      PkgIterator Pkg(C,C.PkgP + *I);
+      bool CurFirst = Cache[Pkg].InstallVer != 0 &&
+		      Cache[Pkg].InstallVer == Pkg->CurrentVer;
+      int First = CurFirst ? CurVar[*I] : CandVar[*I];
+      int Second = CurFirst ? CandVar[*I] : CurVar[*I];
+      if (First >= 0)
+	 Order.push_back(First);
+      if (Second >= 0)
+	 Order.push_back(Second);
+   }
+   Solver.SetOrder(Order);
+   return true;
+}
+									/*}}}*/
+// SatResolver::Resolve - Solve and mark the result			/*{{{*/
+// ---------------------------------------------------------------------
+/* Protected packages keep what they are marked for, as assumptions so
+   that a failure there doesn't spoil the solver. The marks are done in
+   the order removals, keeps, installs, and none with AutoInst so the
+   depcache ends up exactly at the solution. */
+bool pkgSatResolver::Resolve()
+{
+   if (Encode() == false)
+      return false;
+
+   pkgCache &C = Cache.GetCache();
+   vector<int> Assume;
+   for (vector<unsigned long>::const_iterator I = Pkgs.begin(); I != Pkgs.end(); I++)
+   {
+      if ((Flags[*I] & Protected) == 0)
+	 continue;
+      map_ptrloc InstallVer = Cache[PkgIterator(C,C.PkgP + *I)].InstallVer;
+      if (InstallVer != 0)
+      {
+	 int Var = VarOf(C.VerP + InstallVer);
+	 if (Var >= 0)
+	    Assume.push_back(pkgSatSolver::Pos(Var));
+      }
+      else
+      {
+	 if (CandVar[*I] >= 0)
+	    Assume.push_back(pkgSatSolver::Neg(CandVar[*I]));
+	 if (CurVar[*I] >= 0)
+	    Assume.push_back(pkgSatSolver::Neg(CurVar[*I]));
+      }
+   }
+
+   unsigned long Max = _config->FindI("APT::Solver::SAT::Max-Conflicts",50000);
+   pkgSatSolver::Result Res = Solver.Solve(Assume,Max);
+   if (Debug == true)
+      clog << "SAT: " << Pkgs.size() << " packages, " << Solver.Vars()
+	   << " variables, " << Solver.Decisions() << " decisions, "
+	   << Solver.Conflicts() << " conflicts, " << Solver.Learned()
+	   << " learned" << endl;
+   if (Res != pkgSatSolver::Satisfied)
+   {
+      if (Debug == true)
+	 clog << (Res == pkgSatSolver::GaveUp ? "SAT: conflict limit reached" :
+		  "SAT: no solution") << endl;
+      return false;
+   }
+
+   vector<map_ptrloc> Chosen(Pkgs.size(),0);
+   for (unsigned long I = 0; I != Pkgs.size(); I++)
+   {
+      PkgIterator Pkg(C,C.PkgP + Pkgs[I]);
+      if (CandVar[Pkgs[I]] >= 0 && Solver.Get(CandVar[Pkgs[I]]) == true)
+	 Chosen[I] = Cache[Pkg].CandidateVer;
+      else if (CurVar[Pkgs[I]] >= 0 && Solver.Get(CurVar[Pkgs[I]]) == true)
+	 Chosen[I] = Pkg->CurrentVer;
+   }
+
+   pkgDepCache::State Saved(&Cache);
+   for (int Pass = 0; Pass != 3; Pass++)
+   {
+      for (unsigned long I = 0; I != Pkgs.size(); I++)
+      {
+	 PkgIterator Pkg(C,C.PkgP + Pkgs[I]);
+	 if (Cache[Pkg].InstallVer == Chosen[I])
+	    continue;
+	 if (Chosen[I] == 0)
+	 {
+	    if (Pass != 0)
+	       continue;
+	    if (Debug == true)
+	       clog << "SAT: removing " << Pkg.Name() << endl;
+	    if (Cache.GetTrace() != 0)
+	       Cache.GetTrace()->Action("remove",Pkg,Scores[Pkg->ID],"sat");
+	    Cache.MarkDelete(Pkg);
+	 }
+	 else if (Chosen[I] == Pkg->CurrentVer)
+	 {
+	    if (Pass != 1)
+	       continue;
+	    if (Debug == true)
+	       clog << "SAT: keeping " << Pkg.Name() << endl;
+	    if (Cache.GetTrace() != 0)
+	       Cache.GetTrace()->Action("keep",Pkg,Scores[Pkg->ID],"sat");
+	    Cache.MarkKeep(Pkg);
+	 }
+	 else
+	 {
+	    if (Pass != 2)
+	       continue;
+	    if (Debug == true)
+	       clog << "SAT: installing " << Pkg.Name() << endl;
+	    if (Cache.GetTrace() != 0)
+	       Cache.GetTrace()->Action("install",Pkg,Scores[Pkg->ID],"sat");
+	    Cache.MarkInstall(Pkg,false);
+	 }
+      }
+   }
+
+   // Anything the clauses got different from the depcache
+   if (Cache.BrokenCount() != 0)
+   {
+      if (Debug == true)
+	 clog << "SAT: " << Cache.BrokenCount() << " broken after marking" << endl;
+      Saved.Restore();
+      return false;
+   }
+   return true;
+}
+									/*}}}*/
@@ -0,0 +1,144 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   SAT Resolver - Dependency problem resolution as a satisfiability problem
+
+   pkgSatSolver is a small CDCL solver: two watched literals, first UIP
+   clause learning and backjumping. Decisions follow a fixed order with a
+   preferred value per variable instead of activity heuristics, so the
+   same problem is always solved the same way, and a conflict limit
+   bounds the work. Clauses may be added between calls to Solve(), and
+   each call can take assumptions; learned clauses are kept.
+
+   pkgSatResolver turns the state of a pkgDepCache into clauses. Every
+   package that is installed or marked, and everything their versions
+   may depend on, gets a variable for its current and for its candidate
+   version; at most one of them may be true, and none true means the
+   package is not installed. Depends and PreDepends, with their Or
+   groups and Provides, and Conflicts and Obsoletes become clauses over
+   those, the same way pkgDepCache evaluates them. The solution is
+   written back with MarkDelete, MarkKeep and MarkInstall.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_SATRESOLVER_H
+#define PKGLIB_SATRESOLVER_H
+
+#include <apt-pkg/depcache.h>
+
+#include <vector>
+
+using std::vector;
+
+class pkgSatSolver
+{
+   public:
+
+   // Literals are 2*Var for Var true and 2*Var + 1 for Var false
+   static inline int Pos(int Var) {return Var << 1;}
+   static inline int Neg(int Var) {return (Var << 1) | 1;}
+
+   enum Result {Satisfied, Unsatisfiable, GaveUp};
+
+   protected:
+
+   static const unsigned int NoReason = ~0U;
+
+   // Clauses are stored as their size followed by their literals
+   vector<int> Pool;
+   vector<vector<unsigned int> > Watches;
+
+   vector<signed char> Value;        // 1 true, -1 false, 0 unassigned
+   vector<unsigned int> Level;
+   vector<unsigned int> Reason;
+   vector<char> Phase;
+   vector<char> Seen;
+
+   vector<int> Trail;
+   vector<unsigned int> TrailLim;
+   unsigned int QHead;
+
+   vector<int> Order;
+   vector<unsigned int> OrderPos;
+   unsigned int NextDecision;
+
+   bool Broken;
+   unsigned long iConflicts;
+   unsigned long iDecisions;
+   unsigned long iLearned;
+
+   inline signed char LitValue(int Lit) const
+      {return (Lit & 1) ? -Value[Lit >> 1] : Value[Lit >> 1];}
+   inline unsigned int DecisionLevel() const {return TrailLim.size();}
+
+   void Assign(int Lit,unsigned int From);
+   unsigned int Attach(vector<int> const &Lits);
+   unsigned int Propagate();
+   unsigned int Analyze(unsigned int Conflict,vector<int> &Learnt);
+   void Backtrack(unsigned int ToLevel);
+
+   public:
+
+   int NewVar(bool Preferred);
+   void SetPhase(int Var,bool Preferred) {Phase[Var] = Preferred;}
+   bool AddClause(vector<int> Lits);
+
+   /* Variables are decided in the order given here, any left out come
+      after them in creation order */
+   void SetOrder(vector<int> const &Vars);
+
+   Result Solve(vector<int> const &Assume,unsigned long MaxConflicts);
+   inline bool Get(int Var) const {return Value[Var] > 0;}
+
+   inline unsigned int Vars() const {return Value.size();}
+   inline unsigned long Conflicts() const {return iConflicts;}
+   inline unsigned long Decisions() const {return iDecisions;}
+   inline unsigned long Learned() const {return iLearned;}
+
+   pkgSatSolver();
+};
+
+class pkgSatResolver
+{
+   typedef pkgCache::PkgIterator PkgIterator;
+   typedef pkgCache::VerIterator VerIterator;
+   typedef pkgCache::DepIterator DepIterator;
+
+   pkgDepCache &Cache;
+   pkgSatSolver Solver;
+   bool Debug;
+
+   enum Flags {Protected = (1 << 0), ToRemove = (1 << 1), Queued = (1 << 2)};
+   vector<unsigned char> Flags;
+   vector<signed short> Scores;
+
+   // Variables of the current and candidate versions of each package
+   vector<int> CurVar;
+   vector<int> CandVar;
+   vector<unsigned long> VarPkg;
+   vector<unsigned long> Pkgs;
+
+   int VarOf(pkgCache::Version *Ver);
+   void AddPackage(PkgIterator const &Pkg);
+   void AddVersion(VerIterator const &Ver,int Var);
+   bool Encode();
+
+   public:
+
+   inline void Protect(PkgIterator const &Pkg) {Flags[Pkg->ID] |= Protected;}
+   inline void Remove(PkgIterator const &Pkg) {Flags[Pkg->ID] |= ToRemove;}
+   inline void Score(PkgIterator const &Pkg,signed short S) {Scores[Pkg->ID] = S;}
+
+   /* Finds a state without broken packages and marks it. False, without
+      an error and with the cache untouched, if there is none or the
+      conflict limit was reached first. */
+   bool Resolve();
+
+   // Conflicts the solver ran into, over all Resolve() calls
+   inline unsigned long Conflicts() const {return Solver.Conflicts();}
+
+   pkgSatResolver(pkgDepCache &Cache);
+};
+
+#endif
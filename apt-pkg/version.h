@@ -64,6 +64,7 @@ class pkgVersioningSystem
 
 
    virtual bool CheckDep(const char *PkgVer,int Op,const char *DepVer) = 0;
+
    virtual int DoCmpReleaseVer(const char *A,const char *Aend,
 			       const char *B,const char *Bend) = 0;
    virtual string UpstreamVersion(const char *A) = 0;
@@ -78,6 +79,11 @@ class pkgVersioningSystem
 
    pkgVersioningSystem();
    virtual ~pkgVersioningSystem() {}
+
+   // True if CheckDep() may be called from several threads at once. This
+   // is asked by the main thread before any are started, so it may settle
+   // state that CheckDep() would otherwise look up on first use.
+   virtual bool ThreadSafeCheckDep() {return false;}
 };
 
 
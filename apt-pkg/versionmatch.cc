@@ -8,6 +8,10 @@
    This module takes a matching string and a type and locates the version
    record that satisfies the constraint described by the matching string.
 
+   A release or origin match only depends on the package file, so when
+   the same match is tried on many packages Compile() works it out for
+   every package file once and FileMatch() becomes a table lookup.
+
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
@@ -120,39 +124,28 @@ pkgVersionMatch::pkgVersionMatch(string Data,MatchType Type,int Op) : VerOp(Op),
 									/*}}}*/
 // VersionMatch::MatchVer - Match a version string with prefixing	/*{{{*/
 // ---------------------------------------------------------------------
-/* */
-bool pkgVersionMatch::MatchVer(const char *A,string B,bool Prefix)
+/* B is compared with A both without and with the release, A never
+   needs to be copied for that. */
+bool pkgVersionMatch::MatchVer(const char *A,string const &B,bool Prefix)
 {
    // CNC:2003-11-05 - Patch by ALT-Linux, which ignores the release
    //                  if it was not provided, and the epoch.
-   string s(A), sc(A);
-   const char *Ab = s.c_str(), *Ac = sc.c_str();
-
-   for (string::iterator i = s.begin(), k = sc.begin(); i != s.end(); ++i,++k)
-   {
-      if (*i == ':')
-      {
-         Ab = &(*i) + 1;
-	 Ac = &(*k) + 1;
-      }
-      else if (*i == '-')
-      {
-         *i = 0;
-	 break;
-      }
-   }
-
-   const char *Ae = Ab + strlen(Ab);
-   const char *Af = Ac + strlen(Ac);
+   const char *Ab = A;
+   const char *Ae = A;
+   for (; *Ae != 0 && *Ae != '-'; Ae++)
+      if (*Ae == ':')
+	 Ab = Ae + 1;
+   const char *Af = Ae + strlen(Ae);
 
    // Strings are not a compatible size.
-   if (((unsigned)(Ae - Ab) == B.length() || Prefix == true) &&
-       (unsigned)(Ae - Ab) >= B.length() &&
-       stringcasecmp(B,Ab,Ab + B.length()) == 0)
+   unsigned long Len = B.length();
+   if (((unsigned long)(Ae - Ab) == Len || Prefix == true) &&
+       (unsigned long)(Ae - Ab) >= Len &&
+       stringcasecmp(B,Ab,Ab + Len) == 0)
        return true;
-   else if (((unsigned)(Af - Ac) == B.length() || Prefix == true) &&
-       (unsigned)(Af - Ac) >= B.length() &&
-       stringcasecmp(B,Ac,Ac + B.length()) == 0)
+   else if (((unsigned long)(Af - Ab) == Len || Prefix == true) &&
+       (unsigned long)(Af - Ab) >= Len &&
+       stringcasecmp(B,Ab,Ab + Len) == 0)
        return true;
 
    return false;
@@ -214,11 +207,33 @@ pkgCache::VerIterator pkgVersionMatch::Find(pkgCache::PkgIterator Pkg)
    return Ver;
 }
 									/*}}}*/
+// VersionMatch::Compile - Match every package file now		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgVersionMatch::Compile(pkgCache &Cache)
+{
+   if (Type != Release && Type != Origin)
+      return;
+   FileMatches.assign(Cache.Head().PackageFileCount,0);
+   for (pkgCache::PkgFileIterator F = Cache.FileBegin(); F.end() == false; F++)
+      FileMatches[F->ID] = MatchFile(F);
+}
+									/*}}}*/
 // VersionMatch::FileMatch - Match against an index file		/*{{{*/
 // ---------------------------------------------------------------------
+/* */
+bool pkgVersionMatch::FileMatch(pkgCache::PkgFileIterator File)
+{
+   if (File->ID < FileMatches.size())
+      return FileMatches[File->ID] != 0;
+   return MatchFile(File);
+}
+									/*}}}*/
+// VersionMatch::MatchFile - Match against an index file		/*{{{*/
+// ---------------------------------------------------------------------
 /* This matcher checks against the release file and the origin location
    to see if the constraints are met. */
-bool pkgVersionMatch::FileMatch(pkgCache::PkgFileIterator File)
+bool pkgVersionMatch::MatchFile(pkgCache::PkgFileIterator const &File)
 {
    if (Type == Release)
    {
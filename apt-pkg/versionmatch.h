@@ -33,8 +33,10 @@
 
 #include <string>
 #include <apt-pkg/pkgcache.h>
+#include <vector>
 
 using std::string;
+using std::vector;
 
 class pkgVersionMatch
 {
@@ -56,12 +58,18 @@ class pkgVersionMatch
    // Origin Matching
    string OrSite;
 
+   // Results of MatchFile() for each package file, after Compile()
+   vector<unsigned char> FileMatches;
+
+   bool MatchFile(pkgCache::PkgFileIterator const &File);
+
    public:
 
    enum MatchType {None = 0,Version,Release,Origin} Type;
 
-   bool MatchVer(const char *A,string B,bool Prefix);
+   bool MatchVer(const char *A,string const &B,bool Prefix);
    bool FileMatch(pkgCache::PkgFileIterator File);
+   void Compile(pkgCache &Cache);
    pkgCache::VerIterator Find(pkgCache::PkgIterator Pkg);
 
    // CNC:2003-11-05
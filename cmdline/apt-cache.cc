@@ -246,6 +246,7 @@ bool DumpAvail(CommandLine &Cmd)
    pkgPolicy Plcy(&Cache);
    if (ReadPinFile(Plcy) == false)
       return false;
+   Plcy.Prepare();
 
    unsigned long Count = Cache.HeaderP->PackageCount+1;
    pkgCache::VerFile **VFList = new pkgCache::VerFile *[Count];
@@ -91,10 +91,10 @@ class CacheFile : public cmdCacheFile
 	 return false;
       return true;
    }
-   bool Open(bool WithLock = true)
+   bool Open(bool WithLock = true,bool Lazy = false)
    {
       OpTextProgress Prog(*_config);
-      if (pkgCacheFile::Open(Prog,WithLock) == false)
+      if (pkgCacheFile::Open(Prog,WithLock,Lazy) == false)
 	 return false;
       Sort();
 
@@ -699,11 +699,11 @@ bool TryToInstall(pkgCache::PkgIterator Pkg,pkgDepCache &Cache,
 	    pkgCache::PkgIterator GoodPkg(Cache, GoodSolutions[i]);
 	    if (GoodPkg.CurrentVer().end() == false)
 	       c1out << "  " << GoodSolutionNames[i]
-		     << " "  << Cache[GoodPkg].CandVersion
+		     << " "  << Cache[GoodPkg].CandVersion(Cache)
 		     << _(" [Installed]") << endl;
 	    else
 	       c1out << "  " << GoodSolutionNames[i]
-		     << " "  << Cache[GoodPkg].CandVersion << endl;
+		     << " "  << Cache[GoodPkg].CandVersion(Cache) << endl;
 	 }
 	 c1out << _("You should explicitly select one to install.") << endl;
 	 _error->Error(_("Package %s is a virtual package with multiple "
@@ -1020,7 +1020,7 @@ bool DoUpdate(CommandLine &CmdL)
 #else
    // Prepare the cache.
    CacheFile Cache;
-   if (Cache.Open() == false)
+   if (Cache.Open(true,true) == false)
       return false;
 
 #ifdef APT_WITH_LUA
@@ -1401,7 +1401,7 @@ bool DoInstall(CommandLine &CmdL)
 
 	 if (*K == 0) {
 	    List += string(I.Name()) + " ";
-        VersionsList += string(Cache[I].CandVersion) + "\n";
+        VersionsList += string(Cache[I].CandVersion(Cache)) + "\n";
      }
       }
 
@@ -1458,7 +1458,7 @@ bool DoInstall(CommandLine &CmdL)
 		       if (int(SuggestsList.find(target)) > -1)
 			 break;
 		       SuggestsList += target;
-		       SuggestsVersions += string(Cache[Start.TargetPkg()].CandVersion) + "\n";
+		       SuggestsVersions += string(Cache[Start.TargetPkg()].CandVersion(Cache)) + "\n";
 		     }
 
 		     if (Start->Type == pkgCache::Dep::Recommends) {
@@ -1476,7 +1476,7 @@ bool DoInstall(CommandLine &CmdL)
 		       if (int(RecommendsList.find(target)) > -1)
 			 break;
 		       RecommendsList += target;
-		       SuggestsVersions += string(Cache[Start.TargetPkg()].CandVersion) + "\n";
+		       SuggestsVersions += string(Cache[Start.TargetPkg()].CandVersion(Cache)) + "\n";
 		     }
 	      if (Start == End)
 		break;
@@ -1554,7 +1554,7 @@ bool DoAutoClean(CommandLine &CmdL)
    }
 
    CacheFile Cache;
-   if (Cache.Open() == false)
+   if (Cache.Open(true,true) == false)
       return false;
 
    LogCleaner Cleaner;
@@ -1589,7 +1589,7 @@ struct DscFile
 bool DoSource(CommandLine &CmdL)
 {
    CacheFile Cache;
-   if (Cache.Open(false) == false)
+   if (Cache.Open(false,true) == false)
       return false;
 
    if (CmdL.FileSize() <= 1)
@@ -725,11 +725,11 @@ bool TryToInstall(pkgCache::PkgIterator Pkg,pkgDepCache &Cache,
 	    pkgCache::PkgIterator GoodPkg(Cache, GoodSolutions[i]);
 	    if (GoodPkg.CurrentVer().end() == false)
 	       c1out << "  " << GoodSolutionNames[i]
-		     << " "  << Cache[GoodPkg].CandVersion
+		     << " "  << Cache[GoodPkg].CandVersion(Cache)
 		     << _(" [Installed]") << endl;
 	    else
 	       c1out << "  " << GoodSolutionNames[i]
-		     << " "  << Cache[GoodPkg].CandVersion << endl;
+		     << " "  << Cache[GoodPkg].CandVersion(Cache) << endl;
 	 }
 	 c1out << _("You should explicitly select one to install.") << endl;
 	 _error->Error(_("Package %s is a virtual package with multiple "
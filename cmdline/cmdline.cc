@@ -364,7 +364,7 @@ void ShowNew(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
       if (Cache[I].NewInstall() == true &&
 	  (State == NULL || (*State)[I].NewInstall() == false)) {
 	 List += string(I.Name()) + " ";
-         VersionsList += string(Cache[I].CandVersion) + "\n";
+         VersionsList += string(Cache[I].CandVersion(Cache)) + "\n";
       }
    }
 
@@ -393,7 +393,7 @@ void ShowDel(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
 	 {
 	    if (D->Type == pkgCache::Dep::Obsoletes &&
 	        Cache[D.ParentPkg()].Install() &&
-	        (pkgCache::Version*)D.ParentVer() == Cache[D.ParentPkg()].InstallVer &&
+	        D->ParentVer == Cache[D.ParentPkg()].InstallVer &&
 	        Cache->VS().CheckDep(I.CurrentVer().VerStr(), D) == true)
 	    {
 	       if (Obsoleted)
@@ -449,7 +449,7 @@ void ShowKept(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
       }
 
       List += string(I.Name()) + " ";
-      VersionsList += string(Cache[I].CurVersion) + " => " + Cache[I].CandVersion + "\n";
+      VersionsList += string(Cache[I].CurVersion(I)) + " => " + Cache[I].CandVersion(Cache) + "\n";
    }
    ShowList(out,_("The following packages have been kept back"),List,VersionsList);
 }
@@ -477,7 +477,7 @@ void ShowUpgraded(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
       }
 
       List += string(I.Name()) + " ";
-      VersionsList += string(Cache[I].CurVersion) + " => " + Cache[I].CandVersion + "\n";
+      VersionsList += string(Cache[I].CurVersion(I)) + " => " + Cache[I].CandVersion(Cache) + "\n";
    }
    ShowList(out,_("The following packages will be upgraded"),List,VersionsList);
 }
@@ -505,7 +505,7 @@ bool ShowDowngraded(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
       }
 
       List += string(I.Name()) + " ";
-      VersionsList += string(Cache[I].CurVersion) + " => " + Cache[I].CandVersion + "\n";
+      VersionsList += string(Cache[I].CurVersion(I)) + " => " + Cache[I].CandVersion(Cache) + "\n";
    }
    return ShowList(out,_("The following packages will be DOWNGRADED"),List,VersionsList);
 }
@@ -520,12 +520,12 @@ bool ShowHold(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
    for (unsigned J = 0; J < Cache->Head().PackageCount; J++)
    {
       pkgCache::PkgIterator I(Cache,Cache.List[J]);
-      if (Cache[I].InstallVer != (pkgCache::Version *)I.CurrentVer() &&
+      if (Cache[I].InstallVer != I->CurrentVer &&
 	  I->SelectedState == pkgCache::State::Hold &&
 	  (State == NULL ||
 	   Cache[I].InstallVer != (*State)[I].InstallVer)) {
 	 List += string(I.Name()) + " ";
-	 VersionsList += string(Cache[I].CurVersion) + " => " + Cache[I].CandVersion + "\n";
+	 VersionsList += string(Cache[I].CurVersion(I)) + " => " + Cache[I].CandVersion(Cache) + "\n";
       }
    }
 
@@ -565,7 +565,7 @@ bool ShowEssential(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
 	    {
 	       if (D->Type == pkgCache::Dep::Obsoletes &&
 		   Cache[D.ParentPkg()].Install() &&
-		   ((pkgCache::Version*)D.ParentVer() == Cache[D.ParentPkg()].InstallVer ||
+		   (D->ParentVer == Cache[D.ParentPkg()].InstallVer ||
 		    (pkgCache::Version*)D.ParentVer() == ((pkgCache::Version*)D.ParentPkg().CurrentVer())) &&
 		   Cache->VS().CheckDep(I.CurrentVer().VerStr(), D) == true)
 	       {
@@ -577,7 +577,7 @@ bool ShowEssential(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
 	       Added[I->ID] = true;
 	       List += string(I.Name()) + " ";
 	    }
-        //VersionsList += string(Cache[I].CurVersion) + "\n"; ???
+        //VersionsList += string(Cache[I].CurVersion(I)) + "\n"; ???
 	 }
       }
 
@@ -606,7 +606,7 @@ bool ShowEssential(ostream &out,cmdCacheFile &Cache,pkgDepCache::State *State)
 	    {
 	       if (D->Type == pkgCache::Dep::Obsoletes &&
 		   Cache[D.ParentPkg()].Install() &&
-		   ((pkgCache::Version*)D.ParentVer() == Cache[D.ParentPkg()].InstallVer ||
+		   (D->ParentVer == Cache[D.ParentPkg()].InstallVer ||
 		    (pkgCache::Version*)D.ParentVer() == ((pkgCache::Version*)D.ParentPkg().CurrentVer())) &&
 		   Cache->VS().CheckDep(P.CurrentVer().VerStr(), D) == true)
 	       {
@@ -677,7 +677,7 @@ void Stats(ostream &out,pkgDepCache &Dep,pkgDepCache::State *State)
 	 {
 	    if (D->Type == pkgCache::Dep::Obsoletes &&
 	        Dep[D.ParentPkg()].Install() &&
-	        (pkgCache::Version*)D.ParentVer() == Dep[D.ParentPkg()].InstallVer &&
+	        D->ParentVer == Dep[D.ParentPkg()].InstallVer &&
 	        Dep.VS().CheckDep(I.CurrentVer().VerStr(), D) == true)
 	    {
 	       Obsoleted = true;
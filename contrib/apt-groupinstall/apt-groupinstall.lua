@@ -68,12 +68,15 @@ elseif script_slot == "Scripts::AptGet::Command" then
 
     print(_("Finding packages belonging to group(s) "..group.."..."))
     pkgs = io.popen(helper.." "..helperopts.." "..cmd)
+	list = {}
     for name in pkgs:lines() do
 		pkg = pkgfind(name)
 		if pkg then
-			oper(pkg)
+			table.insert(list, pkg)
 		end
 	end
+	-- The whole group is marked and resolved at once
+	oper(list)
 end
 
 -- vim:ts=4:sw=4
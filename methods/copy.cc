@@ -6,89 +6,16 @@
    Copy URI - This method takes a uri like a file: uri and copies it
    to the destination file.
 
+   The method itself is in the library, APT normally runs it in process.
+
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
-#include <apt-pkg/fileutl.h>
-#include <apt-pkg/acquire-method.h>
-#include <apt-pkg/error.h>
-
-#include <sys/stat.h>
-#include <utime.h>
-#include <unistd.h>
-
-// CNC:2003-02-20 - Moved header to fix compilation error when
-// 		    --disable-nls is used.
-#include <apti18n.h>
-									/*}}}*/
-
-class CopyMethod : public pkgAcqMethod
-{
-   virtual bool Fetch(FetchItem *Itm);
-
-   public:
-
-   CopyMethod() : pkgAcqMethod("1.0",SingleInstance) {}
-};
-
-// CopyMethod::Fetch - Fetch a file					/*{{{*/
-// ---------------------------------------------------------------------
-/* */
-bool CopyMethod::Fetch(FetchItem *Itm)
-{
-   URI Get = Itm->Uri;
-   string File = Get.Path;
-
-   // Stat the file and send a start message
-   struct stat Buf;
-   if (stat(File.c_str(),&Buf) != 0)
-      return _error->Errno("stat",_("Failed to stat"));
-
-   // Forumulate a result and send a start message
-   FetchResult Res;
-   Res.Size = Buf.st_size;
-   Res.Filename = Itm->DestFile;
-   Res.LastModified = Buf.st_mtime;
-   Res.IMSHit = false;
-   URIStart(Res);
-
-   // See if the file exists
-   FileFd From(File,FileFd::ReadOnly);
-   FileFd To(Itm->DestFile,FileFd::WriteEmpty);
-   To.EraseOnFailure();
-   if (_error->PendingError() == true)
-   {
-      To.OpFail();
-      return false;
-   }
-
-   // Copy the file
-   if (CopyFile(From,To) == false)
-   {
-      To.OpFail();
-      return false;
-   }
-
-   From.Close();
-   To.Close();
-
-   // Transfer the modification times
-   struct utimbuf TimeBuf;
-   TimeBuf.actime = Buf.st_atime;
-   TimeBuf.modtime = Buf.st_mtime;
-   if (utime(Itm->DestFile.c_str(),&TimeBuf) != 0)
-   {
-      To.OpFail();
-      return _error->Errno("utime",_("Failed to set modification time"));
-   }
-
-   URIDone(Res);
-   return true;
-}
+#include <apt-pkg/acquire-local.h>
 									/*}}}*/
 
 int main()
 {
-   CopyMethod Mth;
+   pkgAcqCopyMethod Mth;
    return Mth.Run();
 }
@@ -10,84 +10,16 @@
    name with .gz removed will also be checked and information about it
    will be returned in Alt-*
 
+   The method itself is in the library, APT normally runs it in process.
+
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
-#include <apt-pkg/acquire-method.h>
-#include <apt-pkg/error.h>
-
-#include <sys/stat.h>
-#include <unistd.h>
-
-// CNC:2003-02-20 - Moved header to fix compilation error when
-// 		    --disable-nls is used.
-#include <apti18n.h>
-									/*}}}*/
-
-class FileMethod : public pkgAcqMethod
-{
-   virtual bool Fetch(FetchItem *Itm);
-
-   public:
-
-   FileMethod() : pkgAcqMethod("1.0",SingleInstance | LocalOnly) {}
-};
-
-// FileMethod::Fetch - Fetch a file					/*{{{*/
-// ---------------------------------------------------------------------
-/* */
-bool FileMethod::Fetch(FetchItem *Itm)
-{
-   URI Get = Itm->Uri;
-   string File = Get.Path;
-   FetchResult Res;
-   if (Get.Host.empty() == false)
-      return _error->Error(_("Invalid URI, local URIS must not start with //"));
-
-   // See if the file exists
-   struct stat Buf;
-   if (stat(File.c_str(),&Buf) == 0)
-   {
-      Res.Size = Buf.st_size;
-      Res.Filename = File;
-      Res.LastModified = Buf.st_mtime;
-      Res.IMSHit = false;
-      if (Itm->LastModified == Buf.st_mtime && Itm->LastModified != 0)
-	 Res.IMSHit = true;
-   }
-
-   // CNC:2003-11-04
-   // See if we can compute a file without a .gz/.bz2/etc extension
-   string ComprExtension = _config->Find("Acquire::ComprExtension", ".bz2");
-   string::size_type Pos = File.rfind(ComprExtension);
-   if (Pos + ComprExtension.length() == File.length())
-   {
-      File = string(File,0,Pos);
-      if (stat(File.c_str(),&Buf) == 0)
-      {
-	 FetchResult AltRes;
-	 AltRes.Size = Buf.st_size;
-	 AltRes.Filename = File;
-	 AltRes.LastModified = Buf.st_mtime;
-	 AltRes.IMSHit = false;
-	 if (Itm->LastModified == Buf.st_mtime && Itm->LastModified != 0)
-	    AltRes.IMSHit = true;
-
-	 URIDone(Res,&AltRes);
-	 return true;
-      }
-   }
-
-   if (Res.Filename.empty() == true)
-      return _error->Error(_("File not found"));
-
-   URIDone(Res);
-   return true;
-}
+#include <apt-pkg/acquire-local.h>
 									/*}}}*/
 
 int main()
 {
-   FileMethod Mth;
+   pkgAcqFileMethod Mth;
    return Mth.Run();
 }
@@ -22,6 +22,9 @@
    hand topped out at 170k/s. That combined with the time to setup the
    FTP connection makes HTTP a vastly superior protocol.
 
+   Large files from servers that take byte ranges are split into segments
+   that are fetched over several connections at once and written in place.
+
    ##################################################################### */
 									/*}}}*/
 // Include Files							/*{{{*/
@@ -59,7 +62,10 @@ using namespace std;
 string HttpMethod::FailFile;
 int HttpMethod::FailFd = -1;
 time_t HttpMethod::FailTime = 0;
+long HttpMethod::FailSize = -1;
 unsigned long PipelineDepth = 10;
+unsigned long SegmentCount = 4;
+unsigned long SegmentThreshold = 32*1024*1024;
 unsigned long TimeOut = 120;
 bool ChokePipe = true;
 bool Debug = false;
@@ -199,6 +205,40 @@ bool CircleBuf::Write(int Fd)
    }
 }
 									/*}}}*/
+// CircleBuf::WriteAt - Write from the buffer into a FD at an offset	/*{{{*/
+// ---------------------------------------------------------------------
+/* This empties the buffer into the file with pwrite, Pos is moved along
+   with the data. */
+bool CircleBuf::WriteAt(int Fd,unsigned long &Pos)
+{
+   while (1)
+   {
+      // Woops, buffer is empty
+      if (OutP == InP)
+	 return true;
+
+      if (OutP == MaxGet)
+	 return true;
+
+      // Write the buffer segment
+      int Res;
+      Res = pwrite(Fd,Buf + (OutP%Size),LeftWrite(),Pos);
+
+      if (Res <= 0)
+      {
+	 if (Res < 0 && errno == EINTR)
+	    continue;
+	 return false;
+      }
+
+      if (Hash != 0)
+	 Hash->Add(Buf + (OutP%Size),Res);
+
+      OutP += Res;
+      Pos += Res;
+   }
+}
+									/*}}}*/
 // CircleBuf::WriteTillEl - Write from the buffer to a string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This copies till the first empty line */
@@ -335,16 +375,13 @@ bool ServerState::Close()
    return true;
 }
 									/*}}}*/
-// ServerState::RunHeaders - Get the headers before the data		/*{{{*/
+// ServerState::StartHeaders - Get ready for a new reply header		/*{{{*/
 // ---------------------------------------------------------------------
-/* Returns 0 if things are OK, 1 if an IO error occursed and 2 if a header
-   parse error occured */
-int ServerState::RunHeaders()
+/* */
+void ServerState::StartHeaders()
 {
    State = Header;
 
-   Owner->Status(_("Waiting for headers"));
-
    Major = 0;
    Minor = 0;
    Result = 0;
@@ -352,35 +389,56 @@ int ServerState::RunHeaders()
    StartPos = 0;
    Encoding = Closes;
    HaveContent = false;
+   AcceptRanges = false;
    time(&Date);
+}
+									/*}}}*/
+// ServerState::TryHeaders - Parse the header if all of it is here	/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns -1 if more data is needed, otherwise like RunHeaders */
+int ServerState::TryHeaders()
+{
+   string Data;
+   if (In.WriteTillEl(Data) == false)
+      return -1;
 
-   do
+   if (Debug == true)
+      clog << Data;
+
+   for (string::const_iterator I = Data.begin(); I < Data.end(); I++)
    {
-      string Data;
-      if (In.WriteTillEl(Data) == false)
-	 continue;
+      string::const_iterator J = I;
+      for (; J != Data.end() && *J != '\n' && *J != '\r';J++);
+      if (HeaderLine(string(I,J)) == false)
+	 return 2;
+      I = J;
+   }
 
-      if (Debug == true)
-	 clog << Data;
+   // 100 Continue is a Nop...
+   if (Result == 100)
+      return -1;
 
-      for (string::const_iterator I = Data.begin(); I < Data.end(); I++)
-      {
-	 string::const_iterator J = I;
-	 for (; J != Data.end() && *J != '\n' && *J != '\r';J++);
-	 if (HeaderLine(string(I,J)) == false)
-	    return 2;
-	 I = J;
-      }
+   // Tidy up the connection persistance state.
+   if (Encoding == Closes && HaveContent == true)
+      Persistent = false;
 
-      // 100 Continue is a Nop...
-      if (Result == 100)
-	 continue;
-
-      // Tidy up the connection persistance state.
-      if (Encoding == Closes && HaveContent == true)
-	 Persistent = false;
+   return 0;
+}
+									/*}}}*/
+// ServerState::RunHeaders - Get the headers before the data		/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns 0 if things are OK, 1 if an IO error occursed and 2 if a header
+   parse error occured */
+int ServerState::RunHeaders()
+{
+   Owner->Status(_("Waiting for headers"));
+   StartHeaders();
 
-      return 0;
+   do
+   {
+      int Res = TryHeaders();
+      if (Res != -1)
+	 return Res;
    }
    while (Owner->Go(false,this) == true);
 
@@ -573,6 +631,12 @@ bool ServerState::HeaderLine(string Line)
       return true;
    }
 
+   if (stringcasecmp(Tag,"Accept-Ranges:") == 0)
+   {
+      AcceptRanges = (stringcasecmp(Val,"bytes") == 0);
+      return true;
+   }
+
    if (stringcasecmp(Tag,"Transfer-Encoding:") == 0)
    {
       HaveContent = true;
@@ -628,8 +692,10 @@ bool ServerState::HeaderLine(string Line)
 
 // HttpMethod::SendReq - Send the HTTP request				/*{{{*/
 // ---------------------------------------------------------------------
-/* This places the http request in the outbound buffer */
-void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out)
+/* This places the http request in the outbound buffer. A non zero To asks
+   for the bytes From up to To only. */
+void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out,unsigned long From,
+			 unsigned long To)
 {
    URI Uri = Itm->Uri;
 
@@ -681,7 +747,12 @@ void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out)
 
    // Check for a partial file
    struct stat SBuf;
-   if (stat(Itm->DestFile.c_str(),&SBuf) >= 0 && SBuf.st_size > 0)
+   if (To != 0)
+   {
+      sprintf(Buf,"Range: bytes=%lu-%lu\r\n",From,To - 1);
+      Req += Buf;
+   }
+   else if (stat(Itm->DestFile.c_str(),&SBuf) >= 0 && SBuf.st_size > 0)
    {
       // In this case we send an if-range query with a range header
       sprintf(Buf,"Range: bytes=%li-\r\nIf-Range: %s\r\n",(long)SBuf.st_size - 1,
@@ -1067,6 +1138,315 @@ int HttpMethod::DealWithHeaders(FetchResult &Res,ServerState *Srv)
    return 0;
 }
 									/*}}}*/
+// HttpMethod::Segmentable - Check if a reply can be split up		/*{{{*/
+// ---------------------------------------------------------------------
+/* Only complete replies of a known and large enough size qualify, from
+   servers that said they take byte ranges and did not let us down with
+   them before. */
+bool HttpMethod::Segmentable(ServerState *Srv)
+{
+   if (SegmentCount <= 1 || SegmentThreshold == 0 ||
+       Srv->Size < SegmentThreshold)
+      return false;
+   if (Srv->Result != 200 || Srv->Encoding != ServerState::Stream ||
+       Srv->StartPos != 0 || Srv->AcceptRanges == false)
+      return false;
+   return NoSegments.find(Srv->ServerName.Host) == NoSegments.end();
+}
+									/*}}}*/
+// HttpMethod::RunSegments - Transfer the data over several connections	/*{{{*/
+// ---------------------------------------------------------------------
+/* The reply on Srv carries the first segment of the file, the rest is
+   split evenly among new connections that each ask for their own byte
+   range. Everything is written in place with pwrite, so the file has
+   holes until it is complete.
+
+   The hash is fed in file order. The segment holding the hashed frontier
+   hashes its data as it writes it, data that arrived ahead of the
+   frontier is read back once the frontier gets there. A connection that
+   is lost after it got some data, Srv included, is replaced by a new one
+   asking for the rest of its range. If a connection fails before that or
+   the server does not answer with the range asked for, the others are
+   dropped and Srv carries on with the whole file. When that is no longer
+   possible the file is cut back to the part that is complete from the
+   start, so a retry can resume it. */
+bool HttpMethod::RunSegments(ServerState *Srv)
+{
+   unsigned long Total = Srv->Size;
+   unsigned long Len = (Total + SegmentCount - 1)/SegmentCount;
+   unsigned long Hashed = 0;
+
+   Srv->State = ServerState::Data;
+   Srv->In.Limit(Len);
+   vector<HttpSegment> Segs;
+   HttpSegment First = {Srv,0,0,0,Len,false};
+   Segs.push_back(First);
+
+   bool Drop = false;
+   for (unsigned long Start = Len; Start < Total && Drop == false;
+	Start += Len)
+   {
+      HttpSegment Seg = {new ServerState(Queue->Uri,this),Start,Start,Start,
+			 min(Start + Len,Total),true};
+      Segs.push_back(Seg);
+      if (Seg.Srv->Open() == false)
+      {
+	 Drop = true;
+	 break;
+      }
+      Seg.Srv->StartHeaders();
+      SendReq(Queue,Seg.Srv->Out,Seg.Start,Seg.End);
+
+      if (Debug == true)
+	 clog << "Segment " << Seg.Start << '-' << Seg.End << endl;
+   }
+
+   FailSize = 0;
+   bool Ok = true;
+   while (Ok == true)
+   {
+      if (Drop == true)
+      {
+	 Drop = false;
+	 if (DropSegments(Segs) == false)
+	 {
+	    Ok = false;
+	    break;
+	 }
+      }
+
+      bool Done = true;
+      for (vector<HttpSegment>::iterator I = Segs.begin(); I != Segs.end(); I++)
+	 if (I->Pos != I->End)
+	    Done = false;
+      if (Done == true)
+	 break;
+
+      fd_set rfds,wfds;
+      FD_ZERO(&rfds);
+      FD_ZERO(&wfds);
+      FD_SET(STDIN_FILENO,&rfds);
+      int MaxFd = STDIN_FILENO;
+      for (vector<HttpSegment>::iterator I = Segs.begin(); I != Segs.end(); I++)
+      {
+	 ServerState *Cur = I->Srv;
+	 if (Cur->ServerFd == -1)
+	    continue;
+	 if (Cur->Out.WriteSpace() == true && (Cur != Srv ||
+	     (Cur->Persistent == true && I->End == Total)))
+	    FD_SET(Cur->ServerFd,&wfds);
+	 if (Cur->In.ReadSpace() == true)
+	    FD_SET(Cur->ServerFd,&rfds);
+	 if (MaxFd < Cur->ServerFd)
+	    MaxFd = Cur->ServerFd;
+      }
+
+      struct timeval tv;
+      tv.tv_sec = TimeOut;
+      tv.tv_usec = 0;
+      int Res = 0;
+      if ((Res = select(MaxFd+1,&rfds,&wfds,0,&tv)) < 0)
+      {
+	 if (errno == EINTR)
+	    continue;
+	 Ok = _error->Errno("select",_("Select failed"));
+	 break;
+      }
+
+      if (Res == 0)
+      {
+	 Ok = _error->Error(_("Connection timed out"));
+	 break;
+      }
+
+      for (vector<HttpSegment>::iterator I = Segs.begin(); I != Segs.end(); I++)
+      {
+	 ServerState *Cur = I->Srv;
+	 if (I->Pos == I->End)
+	    continue;
+
+	 // Whatever was read before the server closed is still used
+	 if (Cur->ServerFd != -1 && FD_ISSET(Cur->ServerFd,&rfds))
+	    if (Cur->In.Read(Cur->ServerFd) == false)
+	       Cur->Close();
+	 if (Cur->ServerFd != -1 && FD_ISSET(Cur->ServerFd,&wfds))
+	    if (Cur->Out.Write(Cur->ServerFd) == false)
+	       Cur->Close();
+
+	 // Check that the reply holds the range that was asked for
+	 if (I->Headers == true)
+	 {
+	    int Res = Cur->TryHeaders();
+	    if (Res == -1 && Cur->ServerFd != -1)
+	       continue;
+	    if (Res != 0 || Cur->Result != 206 || Cur->Size != Total ||
+		(unsigned long)Cur->StartPos != I->Asked ||
+		Cur->Encoding == ServerState::Chunked)
+	    {
+	       if (Res == 0)
+		  NoSegments.insert(Cur->ServerName.Host);
+	       if (Debug == true)
+		  clog << "Segment " << I->Start << " refused" << endl;
+	       Drop = true;
+	       break;
+	    }
+
+	    I->Headers = false;
+	    Cur->State = ServerState::Data;
+	    Cur->In.Limit(I->End - I->Asked);
+	 }
+
+	 // Put the data in its place, hashing it if it is next in line
+	 bool InOrder = (I->Pos == Hashed);
+	 if (InOrder == true && Cur != Srv)
+	    Cur->In.Hash = Srv->In.Hash;
+	 bool Wrote = Cur->In.WriteAt(File->Fd(),I->Pos);
+	 if (Cur != Srv)
+	    Cur->In.Hash = 0;
+	 if (Wrote == false)
+	 {
+	    Ok = _error->Errno("write",_("Error writing to output file"));
+	    break;
+	 }
+	 if (InOrder == true)
+	    Hashed = I->Pos;
+
+	 if (I->Pos == I->End)
+	 {
+	    /* The first connection is in the middle of its reply unless it
+	       got the whole file */
+	    if (Cur == Srv && I->End == Total)
+	       Cur->In.Limit(-1);
+	    else
+	    {
+	       Cur->Persistent = false;
+	       Cur->Close();
+	    }
+	    continue;
+	 }
+
+	 if (Cur->ServerFd == -1)
+	 {
+	    if (Debug == true)
+	       clog << "Segment " << I->Start << " lost at " << I->Pos << endl;
+	    if (I->Pos == I->Asked || ResumeSegment(Srv,*I) == false)
+	    {
+	       Drop = true;
+	       break;
+	    }
+	 }
+      }
+
+      if (Ok == true)
+	 Ok = HashSegments(Segs,Srv->In.Hash,Hashed);
+      FailSize = Hashed;
+
+      // Handle commands from APT
+      if (FD_ISSET(STDIN_FILENO,&rfds))
+      {
+	 if (Run(true) != -1)
+	    exit(100);
+      }
+   }
+
+   for (vector<HttpSegment>::iterator I = Segs.begin(); I != Segs.end(); I++)
+      if (I->Srv != Srv)
+	 delete I->Srv;
+   FailSize = -1;
+
+   if (Ok == false || Hashed != Total)
+   {
+      Srv->Persistent = false;
+      Srv->Close();
+      if (ftruncate(File->Fd(),Hashed) != 0)
+	 _error->Errno("ftruncate",_("Error writing to output file"));
+      if (_error->PendingError() == false)
+	 _error->Error(_("Error reading from server"));
+      return false;
+   }
+
+   return !_error->PendingError();
+}
+									/*}}}*/
+// HttpMethod::ResumeSegment - Ask for the rest of a segment again	/*{{{*/
+// ---------------------------------------------------------------------
+/* A new connection takes over [Pos,End) of a segment whose connection
+   was lost. Srv is only closed, it still holds the hash. */
+bool HttpMethod::ResumeSegment(ServerState *Srv,HttpSegment &Seg)
+{
+   ServerState *Cur = new ServerState(Queue->Uri,this);
+   if (Cur->Open() == false)
+   {
+      delete Cur;
+      return false;
+   }
+
+   if (Seg.Srv == Srv)
+      Srv->Persistent = false;
+   else
+      delete Seg.Srv;
+   Seg.Srv = Cur;
+   Seg.Asked = Seg.Pos;
+   Seg.Headers = true;
+   Cur->StartHeaders();
+   SendReq(Queue,Cur->Out,Seg.Pos,Seg.End);
+
+   if (Debug == true)
+      clog << "Segment " << Seg.Start << " resumed at " << Seg.Pos << endl;
+   return true;
+}
+									/*}}}*/
+// HttpMethod::DropSegments - Give the whole file to the first connection	/*{{{*/
+// ---------------------------------------------------------------------
+/* The other connections are closed, what they wrote is overwritten. This
+   is not possible once the first connection is done with its part or was
+   replaced by one that only asked for the rest of it. */
+bool HttpMethod::DropSegments(vector<HttpSegment> &Segs)
+{
+   for (vector<HttpSegment>::iterator I = Segs.begin() + 1; I != Segs.end(); I++)
+      delete I->Srv;
+   Segs.erase(Segs.begin() + 1,Segs.end());
+
+   HttpSegment &First = Segs.front();
+   if (First.Pos == First.End || First.Asked != 0 ||
+       First.Srv->ServerFd == -1)
+      return _error->Error(_("Error reading from server"));
+
+   // Errors of the dropped connections are of no interest now
+   _error->Discard();
+   First.End = First.Srv->Size;
+   First.Srv->In.Limit(First.End - First.Pos);
+   return true;
+}
+									/*}}}*/
+// HttpMethod::HashSegments - Move the hashed frontier along		/*{{{*/
+// ---------------------------------------------------------------------
+/* Data that the next segments wrote before the frontier got to them is
+   read back from the file. */
+bool HttpMethod::HashSegments(vector<HttpSegment> &Segs,Hashes *Hash,
+			      unsigned long &Hashed)
+{
+   for (vector<HttpSegment>::iterator I = Segs.begin(); I != Segs.end(); I++)
+   {
+      if (Hashed >= I->End)
+	 continue;
+      if (Hashed < I->Start)
+	 break;
+
+      if (I->Pos > Hashed)
+      {
+	 if (lseek(File->Fd(),Hashed,SEEK_SET) < 0 ||
+	     Hash->AddFD(File->Fd(),I->Pos - Hashed) == false)
+	    return _error->Errno("read",_("Problem hashing file"));
+	 Hashed = I->Pos;
+      }
+
+      if (Hashed < I->End)
+	 break;
+   }
+   return true;
+}
+									/*}}}*/
 // HttpMethod::SigTerm - Handle a fatal signal				/*{{{*/
 // ---------------------------------------------------------------------
 /* This closes and timestamps the open file. This is neccessary to get
@@ -1075,6 +1455,16 @@ void HttpMethod::SigTerm(int)
 {
    if (FailFd == -1)
       _exit(100);
+
+   /* Segments may have left holes, keep only what is there from the start.
+      If that fails the holes would be taken for data on resume, so the
+      file is removed instead */
+   if (FailSize >= 0 && ftruncate(FailFd,FailSize) != 0)
+   {
+      close(FailFd);
+      unlink(FailFile.c_str());
+      _exit(100);
+   }
    close(FailFd);
 
    // Timestamp
@@ -1134,7 +1524,7 @@ bool HttpMethod::Fetch(FetchItem *)
 									/*}}}*/
 // HttpMethod::Configuration - Handle a configuration message		/*{{{*/
 // ---------------------------------------------------------------------
-/* We stash the desired pipeline depth */
+/* We stash the desired pipeline depth and how to split large files */
 bool HttpMethod::Configuration(string Message)
 {
    if (pkgAcqMethod::Configuration(Message) == false)
@@ -1143,8 +1533,16 @@ bool HttpMethod::Configuration(string Message)
    TimeOut = _config->FindI("Acquire::http::Timeout",TimeOut);
    PipelineDepth = _config->FindI("Acquire::http::Pipeline-Depth",
 				  PipelineDepth);
+   SegmentCount = _config->FindI("Acquire::http::Segments",SegmentCount);
    Debug = _config->FindB("Debug::Acquire::http",false);
 
+   // Sizes past what an int holds are meaningful here
+   string Threshold = _config->Find("Acquire::http::Segment-Threshold");
+   if (Threshold.empty() == false &&
+       StrToNum(Threshold.c_str(),SegmentThreshold,Threshold.length(),10) == false)
+      return _error->Error(_("Invalid value %s for %s"),Threshold.c_str(),
+			   "Acquire::http::Segment-Threshold");
+
    return true;
 }
 									/*}}}*/
@@ -1259,7 +1657,11 @@ int HttpMethod::Loop()
 	    URIStart(Res);
 
 	    // Run the data
-	    bool Result =  Server->RunData();
+	    bool Result;
+	    if (Segmentable(Server) == true)
+	       Result = RunSegments(Server);
+	    else
+	       Result = Server->RunData();
 
 	    /* If the server is sending back sizeless responses then fill in
 	       the size now */
@@ -14,6 +14,7 @@
 #define MAXLEN 360
 
 #include <vector>
+#include <set>
 #include <iostream>
 
 using std::cout;
@@ -60,6 +61,7 @@ class CircleBuf
 
    // Write data out
    bool Write(int Fd);
+   bool WriteAt(int Fd,unsigned long &Pos);
    bool WriteTillEl(string &Data,bool Single = false);
 
    // Control the write limit
@@ -95,6 +97,7 @@ struct ServerState
    enum {Chunked,Stream,Closes} Encoding;
    enum {Header, Data} State;
    bool Persistent;
+   bool AcceptRanges;
    string Location;
    string Realm, ProxyRealm;
 
@@ -113,7 +116,9 @@ struct ServerState
    bool Comp(URI Other) {return Other.Host == ServerName.Host && Other.Port == ServerName.Port;}
    void Reset() {Major = 0; Minor = 0; Result = 0; Size = 0; StartPos = 0;
                  Encoding = Closes; time(&Date); ServerFd = -1;
-                 Pipeline = true;}
+                 Pipeline = true; AcceptRanges = false;}
+   void StartHeaders();
+   int TryHeaders();
    int RunHeaders();
    bool RunData();
 
@@ -124,6 +129,17 @@ struct ServerState
    ~ServerState() {Close();}
 };
 
+// A byte range of a file that is fetched over its own connection
+struct HttpSegment
+{
+   ServerState *Srv;
+   unsigned long Start;
+   unsigned long Asked;       // Where the range Srv asked for starts
+   unsigned long Pos;
+   unsigned long End;
+   bool Headers;
+};
+
 class HttpMethod : public pkgAcqMethod
 {
    struct AuthRec
@@ -135,12 +151,21 @@ class HttpMethod : public pkgAcqMethod
       vector <string *> AuthURIs;
    };
 
-   void SendReq(FetchItem *Itm,CircleBuf &Out);
+   void SendReq(FetchItem *Itm,CircleBuf &Out,unsigned long From = 0,
+		unsigned long To = 0);
    bool Go(bool ToFile,ServerState *Srv);
    bool Flush(ServerState *Srv);
    bool ServerDie(ServerState *Srv);
    int DealWithHeaders(FetchResult &Res,ServerState *Srv);
 
+   // Large files are fetched in segments over several connections
+   bool Segmentable(ServerState *Srv);
+   bool RunSegments(ServerState *Srv);
+   bool ResumeSegment(ServerState *Srv,HttpSegment &Seg);
+   bool DropSegments(vector<HttpSegment> &Segs);
+   bool HashSegments(vector<HttpSegment> &Segs,Hashes *Hash,
+		     unsigned long &Hashed);
+
    virtual bool Fetch(FetchItem *);
    virtual bool Configuration(string Message);
 
@@ -148,10 +173,12 @@ class HttpMethod : public pkgAcqMethod
    static string FailFile;
    static int FailFd;
    static time_t FailTime;
+   static long FailSize;
    static void SigTerm(int);
 
    string NextURI;
    vector<AuthRec> AuthList;
+   std::set<string> NoSegments;
 
    public:
    friend class ServerState;
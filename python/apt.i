@@ -77,8 +77,6 @@ typedef pkgRecords::Parser Parser;
 %immutable pkgCPU;
 %immutable pkgSystem::Label;
 %immutable pkgVersioningSystem::Label;
-%immutable pkgDepCache::StateCache::CandVersion;
-%immutable pkgDepCache::StateCache::CurVersion;
 
 /* One-shot initialization function. */
 %inline %{
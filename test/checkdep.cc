@@ -0,0 +1,229 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   CheckDep Test - Compare the native dependency check against librpm
+
+   rpmVersioningSystem::CheckDepNative() is meant to give exactly the
+   answers of CheckDepRpm(), which goes through rpmdsCompare(). This runs
+   both over:
+     - every pair of versions taken from version lists in the format of
+       versions.lst, plus variants of them with and without epoch and
+       release, under every operator;
+     - with -p, every versioned dependency of the given pkglists against
+       every versioned provide of the same name in them, which is what
+       the cache does all day. The time taken by both is shown.
+   Any difference is reported as an error.
+
+   ##################################################################### */
+									/*}}}*/
+#include <system.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/pkgcache.h>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sys/time.h>
+#include "rpmversion.h"
+#include "rpmhandler.h"
+
+using namespace std;
+
+static const int Ops[] = {pkgCache::Dep::NoOp, pkgCache::Dep::LessEq,
+			  pkgCache::Dep::GreaterEq, pkgCache::Dep::Less,
+			  pkgCache::Dep::Greater, pkgCache::Dep::Equals,
+			  pkgCache::Dep::NotEquals};
+static const char *OpNames[] = {"", "<=", ">=", "<", ">", "=", "!="};
+
+static unsigned long Checks = 0;
+
+static void Compare(const string &PkgVer,int Op,const char *OpName,
+		    const string &DepVer)
+{
+   bool Native = rpmVS.CheckDepNative(PkgVer.c_str(),Op,DepVer.c_str());
+   bool Rpm = rpmVS.CheckDepRpm(PkgVer.c_str(),Op,DepVer.c_str());
+   Checks++;
+   if (Native != Rpm)
+      _error->Error("'%s' against '%s %s': native %i, librpm %i",
+		    PkgVer.c_str(),OpName,DepVer.c_str(),Native,Rpm);
+}
+
+// Add a version and the variants of it that exercise the epoch and
+// release rules
+static void AddVersion(set<string> &Versions,const string &Ver)
+{
+   Versions.insert(Ver);
+   string::size_type Colon = Ver.find(':');
+   string NoEpoch = (Colon == string::npos) ? Ver : string(Ver,Colon+1);
+   Versions.insert(NoEpoch);
+   Versions.insert("0:" + NoEpoch);
+   Versions.insert("1:" + NoEpoch);
+   string::size_type Dash = NoEpoch.rfind('-');
+   if (Dash != string::npos)
+   {
+      Versions.insert(string(NoEpoch,0,Dash));
+      Versions.insert("1:" + string(NoEpoch,0,Dash));
+   }
+}
+
+bool ReadVersions(const char *File,set<string> &Versions)
+{
+   ifstream F(File,ios::in);
+   if (!F != 0)
+      return _error->Error("Unable to open %s",File);
+
+   string Line;
+   while (getline(F,Line))
+   {
+      if (Line.empty() == true || Line[0] == '#')
+	 continue;
+      // "a b Res" lines, the result is for the version test
+      string::size_type A = Line.find(' ');
+      AddVersion(Versions,string(Line,0,A));
+      if (A == string::npos)
+	 continue;
+      string::size_type B = Line.find(' ',A+1);
+      AddVersion(Versions,string(Line,A+1,B == string::npos ? B : B-A-1));
+   }
+   return true;
+}
+
+void RunPairs(const set<string> &Versions)
+{
+   for (set<string>::const_iterator A = Versions.begin();
+	A != Versions.end(); A++)
+      for (set<string>::const_iterator B = Versions.begin();
+	   B != Versions.end(); B++)
+	 for (unsigned I = 0; I < sizeof(Ops)/sizeof(Ops[0]); I++)
+	    Compare(*A,Ops[I],OpNames[I],*B);
+}
+
+struct RealDep
+{
+   string Name;
+   string Version;
+   unsigned int Op;
+};
+
+static double Now()
+{
+   struct timeval Tv;
+   gettimeofday(&Tv,0);
+   return Tv.tv_sec + Tv.tv_usec/1000000.0;
+}
+
+bool RunPkgList(const char *File)
+{
+   RPMFileHandler Handler(File);
+   if (_error->PendingError() == true)
+      return false;
+
+   map<string,vector<string> > Provides;
+   vector<RealDep> Deps;
+   static const unsigned int Types[] = {pkgCache::Dep::Depends,
+					pkgCache::Dep::Conflicts,
+					pkgCache::Dep::Obsoletes};
+   while (Handler.Skip() == true)
+   {
+      vector<Dependency*> Prv;
+      Handler.PRCO(pkgCache::Dep::Provides,Prv);
+      Provides[Handler.Name()].push_back(Handler.EVR());
+      for (vector<Dependency*>::iterator I = Prv.begin(); I != Prv.end(); I++)
+      {
+	 if ((*I)->Version.empty() == false)
+	    Provides[(*I)->Name].push_back((*I)->Version);
+	 delete *I;
+      }
+
+      for (unsigned T = 0; T < sizeof(Types)/sizeof(Types[0]); T++)
+      {
+	 vector<Dependency*> Dep;
+	 Handler.PRCO(Types[T],Dep);
+	 for (vector<Dependency*>::iterator I = Dep.begin(); I != Dep.end(); I++)
+	 {
+	    if ((*I)->Version.empty() == false)
+	    {
+	       RealDep D;
+	       D.Name = (*I)->Name;
+	       D.Version = (*I)->Version;
+	       D.Op = (*I)->Op;
+	       Deps.push_back(D);
+	    }
+	    delete *I;
+	 }
+      }
+   }
+
+   unsigned long Before = Checks;
+   for (vector<RealDep>::const_iterator D = Deps.begin(); D != Deps.end(); D++)
+   {
+      const vector<string> &Vers = Provides[D->Name];
+      for (vector<string>::const_iterator V = Vers.begin(); V != Vers.end(); V++)
+	 Compare(*V,D->Op,pkgCache::CompType(D->Op),D->Version);
+   }
+
+   // And the time it takes, the same checks again without comparing
+   unsigned long NativeMatches = 0;
+   unsigned long RpmMatches = 0;
+   double Start = Now();
+   for (vector<RealDep>::const_iterator D = Deps.begin(); D != Deps.end(); D++)
+   {
+      const vector<string> &Vers = Provides[D->Name];
+      for (vector<string>::const_iterator V = Vers.begin(); V != Vers.end(); V++)
+	 NativeMatches += rpmVS.CheckDepNative(V->c_str(),D->Op,D->Version.c_str());
+   }
+   double Native = Now() - Start;
+   Start = Now();
+   for (vector<RealDep>::const_iterator D = Deps.begin(); D != Deps.end(); D++)
+   {
+      const vector<string> &Vers = Provides[D->Name];
+      for (vector<string>::const_iterator V = Vers.begin(); V != Vers.end(); V++)
+	 RpmMatches += rpmVS.CheckDepRpm(V->c_str(),D->Op,D->Version.c_str());
+   }
+   double Rpm = Now() - Start;
+
+   cout << File << ": " << Checks - Before << " checks, native "
+	<< Native << "s (" << NativeMatches << " matches), librpm "
+	<< Rpm << "s (" << RpmMatches << " matches)" << endl;
+   return true;
+}
+
+int main(int argc, char *argv[])
+{
+   if (argc <= 1)
+   {
+      cerr << "Usage: checkdeptest versions.lst... [-p pkglist...]" << endl;
+      return 0;
+   }
+
+   set<string> Versions;
+   bool PkgLists = false;
+   for (int I = 1; I < argc; I++)
+   {
+      if (strcmp(argv[I],"-p") == 0)
+	 PkgLists = true;
+      else if (PkgLists == true)
+	 RunPkgList(argv[I]);
+      else
+	 ReadVersions(argv[I],Versions);
+   }
+   RunPairs(Versions);
+   cout << Checks << " checks done" << endl;
+
+   // Print any errors or warnings found
+   if (_error->empty() == false)
+   {
+      string Err;
+      while (_error->empty() == false)
+      {
+	 bool Type = _error->PopMessage(Err);
+	 if (Type == true)
+	    cout << "E: " << Err << endl;
+	 else
+	    cout << "W: " << Err << endl;
+      }
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,167 @@
+#!/bin/sh
+# Fetch a repomd repository with Acquire::Compressed-Lists on and check
+# which lists were kept in the seekable gzip form. The XML lists may be,
+# the sqlite databases must stay plain, and both have to be readable by
+# apt-cache afterwards. Run from the build tree:
+#
+#    sh compressed-lists.sh [top build dir]
+#
+# Needs rpm, sqlite3, gzip, bzip2 and sha256sum, exits with 77 (skipped)
+# without them.
+
+BUILD=`cd ${1:-..} && pwd`
+for P in rpm sqlite3 gzip bzip2 sha256sum; do
+   if ! command -v $P >/dev/null 2>&1; then
+      echo "$P not found, skipped"
+      exit 77
+   fi
+done
+
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf "$TMP"' 0
+REPO=$TMP/repo/repodata
+mkdir -p $REPO $TMP/root $TMP/etc/sources.list.d \
+	 $TMP/state/lists/partial $TMP/cache/archives/partial
+rpm --root $TMP/root --initdb || exit 1
+
+# One package, both as XML and as sqlite databases of scheme 10. The
+# description is long enough for the kept primary.xml to need several
+# gzip members.
+DESC=`head -c 600000 /dev/zero | tr '\0' x`
+cat > $REPO/primary.xml <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<metadata xmlns="http://linux.duke.edu/metadata/common" xmlns:rpm="http://linux.duke.edu/metadata/rpm" packages="1">
+<package type="rpm">
+  <name>hello</name>
+  <arch>noarch</arch>
+  <version epoch="0" ver="1.0" rel="1"/>
+  <checksum type="sha256" pkgid="YES">0000</checksum>
+  <summary>Hello</summary>
+  <description>$DESC</description>
+  <packager></packager>
+  <url></url>
+  <time file="0" build="0"/>
+  <size package="100" installed="100" archive="100"/>
+  <location href="hello-1.0-1.noarch.rpm"/>
+  <format>
+    <rpm:license>GPL</rpm:license>
+    <rpm:vendor></rpm:vendor>
+    <rpm:group>Test</rpm:group>
+    <rpm:buildhost>localhost</rpm:buildhost>
+    <rpm:sourcerpm>hello-1.0-1.src.rpm</rpm:sourcerpm>
+    <rpm:header-range start="0" end="100"/>
+  </format>
+</package>
+</metadata>
+EOF
+cat > $REPO/filelists.xml <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<filelists xmlns="http://linux.duke.edu/metadata/filelists" packages="1">
+<package pkgid="0000" name="hello" arch="noarch">
+  <version epoch="0" ver="1.0" rel="1"/>
+  <file>/usr/bin/hello</file>
+</package>
+</filelists>
+EOF
+PRCO="name TEXT, flags TEXT, epoch TEXT, version TEXT, release TEXT, pkgKey INTEGER"
+sqlite3 $REPO/primary.sqlite <<EOF || exit 1
+CREATE TABLE db_info (dbversion INTEGER, checksum TEXT);
+INSERT INTO db_info VALUES (10, '');
+CREATE TABLE packages (pkgKey INTEGER PRIMARY KEY, pkgId TEXT, name TEXT,
+   arch TEXT, version TEXT, epoch TEXT, release TEXT, summary TEXT,
+   description TEXT, url TEXT, time_file INTEGER, time_build INTEGER,
+   rpm_license TEXT, rpm_vendor TEXT, rpm_group TEXT, rpm_buildhost TEXT,
+   rpm_sourcerpm TEXT, rpm_header_start INTEGER, rpm_header_end INTEGER,
+   rpm_packager TEXT, size_package INTEGER, size_installed INTEGER,
+   size_archive INTEGER, location_href TEXT, location_base TEXT,
+   checksum_type TEXT);
+INSERT INTO packages VALUES (1, '0000', 'hello', 'noarch', '1.0', '0', '1',
+   'Hello', 'Hello', '', 0, 0, 'GPL', '', 'Test', 'localhost',
+   'hello-1.0-1.src.rpm', 0, 100, '', 100, 100, 100,
+   'hello-1.0-1.noarch.rpm', NULL, 'sha256');
+CREATE TABLE provides ($PRCO);
+CREATE TABLE requires ($PRCO, pre BOOLEAN DEFAULT FALSE);
+CREATE TABLE conflicts ($PRCO);
+CREATE TABLE obsoletes ($PRCO);
+EOF
+sqlite3 $REPO/filelists.sqlite <<EOF || exit 1
+CREATE TABLE db_info (dbversion INTEGER, checksum TEXT);
+INSERT INTO db_info VALUES (10, '');
+CREATE TABLE packages (pkgKey INTEGER PRIMARY KEY, pkgId TEXT);
+INSERT INTO packages VALUES (1, '0000');
+CREATE TABLE filelist (pkgKey INTEGER, dirname TEXT, filenames TEXT,
+   filetypes TEXT);
+INSERT INTO filelist VALUES (1, '/usr/bin', 'hello', 'f');
+EOF
+
+# Only the compressed files are published, so the lists have to go
+# through the gzip and bzip2 methods
+Data()
+{
+   cat <<EOF
+  <data type="$1">
+    <location href="repodata/$2.$3"/>
+    <checksum type="sha256">`sha256sum < $REPO/$2.$3 | cut -d' ' -f1`</checksum>
+    <open-checksum type="sha256">`sha256sum < $REPO/$2 | cut -d' ' -f1`</open-checksum>
+    $4
+  </data>
+EOF
+}
+gzip -c $REPO/primary.xml > $REPO/primary.xml.gz
+gzip -c $REPO/filelists.xml > $REPO/filelists.xml.gz
+bzip2 -c $REPO/primary.sqlite > $REPO/primary.sqlite.bz2
+bzip2 -c $REPO/filelists.sqlite > $REPO/filelists.sqlite.bz2
+DBVER="<database_version>10</database_version>"
+{
+   echo '<?xml version="1.0" encoding="UTF-8"?>'
+   echo '<repomd xmlns="http://linux.duke.edu/metadata/repo">'
+   Data primary primary.xml gz
+   Data filelists filelists.xml gz
+   Data primary_db primary.sqlite bz2 "$DBVER"
+   Data filelists_db filelists.sqlite bz2 "$DBVER"
+   echo '</repomd>'
+} > $REPO/repomd.xml
+rm -f $REPO/primary.xml $REPO/filelists.xml $REPO/primary.sqlite \
+      $REPO/filelists.sqlite
+
+echo "repomd file://$TMP/repo/ ./" > $TMP/etc/sources.list
+touch $TMP/etc/apt.conf
+APT_CONFIG=$TMP/etc/apt.conf
+export APT_CONFIG
+OPTS="-o Dir::Etc=$TMP/etc/ -o Dir::State=$TMP/state/
+      -o Dir::Cache=$TMP/cache/ -o Dir::Bin::Methods=$BUILD/methods/
+      -o RPM::RootDir=$TMP/root -o Acquire::Compressed-Lists=true"
+
+FAILED=0
+Check()
+{
+   if [ "$2" = "$3" ]; then
+      echo "ok: $1"
+   else
+      echo "FAILED: $1, got '$2' instead of '$3'"
+      FAILED=1
+   fi
+}
+Magic()
+{
+   od -An -tx1 -N$2 $TMP/state/lists/*_$1* | tr -d ' \n'
+}
+Update()
+{
+   rm -f $TMP/state/lists/*_* $TMP/cache/*.bin
+   $BUILD/cmdline/apt-get $OPTS "$@" update >$TMP/log 2>&1 ||
+      cat $TMP/log >&2
+   $BUILD/cmdline/apt-cache $OPTS "$@" pkgnames 2>&1 | grep -x hello
+}
+
+# The databases are used when there are any, they must be left plain
+Check "sqlite lists readable" "`Update`" hello
+Check "primary.sqlite kept plain" "`Magic primary.sqlite 6`" 53514c697465
+Check "filelists.sqlite kept plain" "`Magic filelists.sqlite 6`" 53514c697465
+
+# The XML lists are kept in the seekable gzip form
+Check "XML lists readable" "`Update -o Acquire::RepoMD::NoDB=true`" hello
+Check "primary.xml compressed" "`Magic primary.xml 2`" 1f8b
+Check "filelists.xml compressed" "`Magic filelists.xml 2`" 1f8b
+
+exit $FAILED
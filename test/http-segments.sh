@@ -0,0 +1,97 @@
+#!/bin/sh
+# Fetch a file over several connections (Acquire::http::Segments) from
+# httpserver.py, once for each way it can mishandle ranges, and check the
+# result. Run from the build tree:
+#
+#    sh http-segments.sh [top build dir] [port]
+#
+# Needs python3, exits with 77 (skipped) without it.
+
+BUILD=`cd ${1:-..} && pwd`
+PORT=${2:-18080}
+SRC=`cd \`dirname $0\` && pwd`
+if ! command -v python3 >/dev/null 2>&1; then
+   echo "python3 not found, skipped"
+   exit 77
+fi
+
+TMP=`mktemp -d` || exit 1
+SERVER=
+trap '[ -n "$SERVER" ] && kill $SERVER; rm -rf "$TMP"' 0
+mkdir $TMP/www
+head -c 5000000 /dev/urandom > $TMP/www/big
+
+FAILED=0
+# Fetch mode - run the method against the server in the given mode
+Fetch()
+{
+   rm -f $TMP/out
+   python3 $SRC/httpserver.py $PORT $TMP/www $1 2>$TMP/server.log &
+   SERVER=$!
+   sleep 1
+   (printf "601 Configuration\n"
+    printf "Config-Item: Acquire::http::Segments=4\n"
+    printf "Config-Item: Acquire::http::Segment-Threshold=1000000\n\n"
+    printf "600 URI Acquire\nURI: http://127.0.0.1:$PORT/big\n"
+    printf "Filename: $TMP/out\n\n"
+    sleep 5) | $BUILD/methods/http > $TMP/method.log 2>&1
+   kill $SERVER
+   wait $SERVER 2>/dev/null
+   SERVER=
+}
+Check()
+{
+   if [ "$2" = "$3" ]; then
+      echo "ok: $1"
+   else
+      echo "FAILED: $1, got '$2' instead of '$3'"
+      FAILED=1
+   fi
+}
+Result()
+{
+   sed -n 's/^\(20[01]\|400\) .*/\1/p' $TMP/method.log | tail -1
+}
+Ranges()
+{
+   grep -c "bytes=" $TMP/server.log
+}
+Same()
+{
+   cmp -s $TMP/out $TMP/www/big && echo same
+}
+# A prefix of the file is all that may be left for a resume
+Prefix()
+{
+   Size=`wc -c < $TMP/out`
+   head -c $Size $TMP/www/big | cmp -s - $TMP/out && echo prefix
+}
+
+Fetch ok
+Check "split: done" "`Result`" 201
+Check "split: three more connections" "`Ranges`" 3
+Check "split: contents" "`Same`" same
+
+Fetch norange
+Check "Range ignored: done" "`Result`" 201
+Check "Range ignored: contents" "`Same`" same
+
+Fetch badrange
+Check "wrong Content-Range: done" "`Result`" 201
+Check "wrong Content-Range: contents" "`Same`" same
+
+Fetch drop
+Check "early drop: done" "`Result`" 201
+Check "early drop: contents" "`Same`" same
+
+Fetch late
+Check "late drop: done" "`Result`" 201
+Check "late drop: rest asked for again" "`Ranges`" 4
+Check "late drop: contents" "`Same`" same
+
+Fetch lost
+Check "late drop, rest lost: failed" "`Result`" 400
+Check "late drop, rest lost: transient" "`grep -c '^Transient-Failure: true' $TMP/method.log`" 1
+Check "late drop, rest lost: partial file" "`Prefix`" prefix
+
+exit $FAILED
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# HTTP server for http-segments.sh, serving the files of a directory with
+# the Range handling broken in several ways:
+#
+#    httpserver.py port root mode
+#
+# ok        ranges answered correctly
+# norange   ranges ignored, always the whole file with 200
+# badrange  a later segment gets bytes one past what it asked for
+# drop      segments past the middle end their connection early
+# late      the last segment ends its connection after the others are done,
+#           the rest of it is sent in full when asked for again
+# lost      like late, but nothing is sent when the rest is asked for again
+#
+# Every request is logged to stderr with its Range header.
+
+import os
+import re
+import sys
+import time
+from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
+
+Port = int(sys.argv[1])
+Root = sys.argv[2]
+Mode = sys.argv[3]
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, *args):
+        sys.stderr.write("%s %s\n" % (self.requestline,
+                                      self.headers.get('Range')))
+
+    def do_GET(self):
+        Path = os.path.join(Root, self.path.lstrip('/'))
+        if not os.path.isfile(Path):
+            self.send_response(404)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        Data = open(Path, 'rb').read()
+        Range = self.headers.get('Range')
+        Match = Range and re.match(r'bytes=(\d+)-(\d*)$', Range)
+        Start = 0
+        if Match and Mode != 'norange':
+            Start = int(Match.group(1))
+            End = int(Match.group(2)) if Match.group(2) else len(Data) - 1
+            if Mode == 'badrange' and Start > 0 and Match.group(2):
+                Start += 1
+            Body = Data[Start:End + 1]
+            self.send_response(206)
+            self.send_header('Content-Range', 'bytes %d-%d/%d' %
+                             (Start, Start + len(Body) - 1, len(Data)))
+        else:
+            Body = Data
+            self.send_response(200)
+        self.send_header('Accept-Ranges', 'bytes')
+        self.send_header('Content-Length', str(len(Body)))
+        self.send_header('Last-Modified', 'Mon, 01 Jan 2024 00:00:00 GMT')
+        self.end_headers()
+
+        Send = len(Body)
+        Segment = Match and Mode != 'norange'
+        if Segment and Mode == 'drop':
+            if Start >= len(Data) // 2:
+                Send = 100000
+            else:
+                time.sleep(0.3)
+        if Segment and Mode in ('late', 'lost'):
+            if Start == len(Data) * 3 // 4:
+                time.sleep(1)
+                Send = 100000
+            elif Mode == 'lost' and Start > len(Data) * 3 // 4:
+                Send = 0
+        try:
+            for I in range(0, Send, 65536):
+                self.wfile.write(Body[I:min(Send, I + 65536)])
+            if Send < len(Body):
+                self.wfile.flush()
+                self.close_connection = True
+        except OSError:
+            pass
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    def handle_error(self, *args):
+        pass
+
+Server(('127.0.0.1', Port), Handler).serve_forever()
@@ -0,0 +1,140 @@
+#!/bin/sh
+# Look up a changelog in a repomd repository whose other.xml is kept in
+# the seekable gzip form (Acquire::Compressed-Lists) and check that it
+# went through the offset index, with the package several blocks into
+# the list. The streaming reader has to find the same entry. Run from
+# the build tree:
+#
+#    sh repomd-offsets.sh [top build dir]
+#
+# Needs rpm, gzip and sha256sum, exits with 77 (skipped) without them.
+
+BUILD=`cd ${1:-..} && pwd`
+for P in rpm gzip sha256sum; do
+   if ! command -v $P >/dev/null 2>&1; then
+      echo "$P not found, skipped"
+      exit 77
+   fi
+done
+
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf "$TMP"' 0
+REPO=$TMP/repo/repodata
+mkdir -p $REPO $TMP/root $TMP/etc/sources.list.d \
+	 $TMP/state/lists/partial $TMP/cache/archives/partial
+rpm --root $TMP/root --initdb || exit 1
+
+# Enough packages for other.xml to span a few 256k blocks, with the one
+# looked up last
+COUNT=3000
+Names()
+{
+   awk "BEGIN { for (I = 1; I < $COUNT; I++) printf(\"pkg%04d\\n\", I);
+		print \"hello\" }"
+}
+{
+   echo '<?xml version="1.0" encoding="UTF-8"?>'
+   echo "<metadata xmlns=\"http://linux.duke.edu/metadata/common\" xmlns:rpm=\"http://linux.duke.edu/metadata/rpm\" packages=\"$COUNT\">"
+   Names | awk '{ print "<package type=\"rpm\">"
+      print "  <name>" $1 "</name>"
+      print "  <arch>noarch</arch>"
+      print "  <version epoch=\"0\" ver=\"1.0\" rel=\"1\"/>"
+      print "  <checksum type=\"sha256\" pkgid=\"YES\">" NR "</checksum>"
+      print "  <summary>" $1 "</summary>"
+      print "  <description>" $1 "</description>"
+      print "  <packager></packager>"
+      print "  <url></url>"
+      print "  <time file=\"0\" build=\"0\"/>"
+      print "  <size package=\"100\" installed=\"100\" archive=\"100\"/>"
+      print "  <location href=\"" $1 "-1.0-1.noarch.rpm\"/>"
+      print "  <format>"
+      print "    <rpm:license>GPL</rpm:license>"
+      print "    <rpm:vendor></rpm:vendor>"
+      print "    <rpm:group>Test</rpm:group>"
+      print "    <rpm:buildhost>localhost</rpm:buildhost>"
+      print "    <rpm:sourcerpm>" $1 "-1.0-1.src.rpm</rpm:sourcerpm>"
+      print "    <rpm:header-range start=\"0\" end=\"100\"/>"
+      print "  </format>"
+      print "</package>" }'
+   echo '</metadata>'
+} > $REPO/primary.xml
+cat > $REPO/filelists.xml <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<filelists xmlns="http://linux.duke.edu/metadata/filelists" packages="0">
+</filelists>
+EOF
+{
+   echo '<?xml version="1.0" encoding="UTF-8"?>'
+   echo "<otherdata xmlns=\"http://linux.duke.edu/metadata/other\" packages=\"$COUNT\">"
+   Names | awk '{ print "<package pkgid=\"" NR "\" name=\"" $1 "\" arch=\"noarch\">"
+      print "  <version epoch=\"0\" ver=\"1.0\" rel=\"1\"/>"
+      for (I = 0; I < 3; I++)
+	 print "  <changelog author=\"Packager &lt;packager@example.com&gt; 1.0-" I "\" date=\"" 1700000000 + I "\">- " $1 " build " I " with a line of text to give the list some bulk</changelog>"
+      print "</package>" }'
+   echo '</otherdata>'
+} > $REPO/other.xml
+
+Data()
+{
+   cat <<EOF
+  <data type="$1">
+    <location href="repodata/$1.xml.gz"/>
+    <checksum type="sha256">`sha256sum < $REPO/$1.xml.gz | cut -d' ' -f1`</checksum>
+    <open-checksum type="sha256">`sha256sum < $REPO/$1.xml | cut -d' ' -f1`</open-checksum>
+  </data>
+EOF
+}
+for T in primary filelists other; do
+   gzip -c $REPO/$T.xml > $REPO/$T.xml.gz
+done
+{
+   echo '<?xml version="1.0" encoding="UTF-8"?>'
+   echo '<repomd xmlns="http://linux.duke.edu/metadata/repo">'
+   Data primary
+   Data filelists
+   Data other
+   echo '</repomd>'
+} > $REPO/repomd.xml
+rm -f $REPO/primary.xml $REPO/filelists.xml $REPO/other.xml
+
+echo "repomd file://$TMP/repo/ ./" > $TMP/etc/sources.list
+touch $TMP/etc/apt.conf
+APT_CONFIG=$TMP/etc/apt.conf
+export APT_CONFIG
+OPTS="-o Dir::Etc=$TMP/etc/ -o Dir::State=$TMP/state/
+      -o Dir::Cache=$TMP/cache/ -o Dir::Bin::Methods=$BUILD/methods/
+      -o RPM::RootDir=$TMP/root -o Acquire::Compressed-Lists=true
+      -o Acquire::RepoMD::OtherData=true"
+
+FAILED=0
+Check()
+{
+   if [ "$2" = "$3" ]; then
+      echo "ok: $1"
+   else
+      echo "FAILED: $1, got '$2' instead of '$3'"
+      FAILED=1
+   fi
+}
+ChangeLog()
+{
+   $BUILD/cmdline/apt-cache $OPTS "$@" changelog hello 2>&1 |
+      grep -c '^- hello build [012] '
+}
+
+$BUILD/cmdline/apt-get $OPTS update >$TMP/log 2>&1 || cat $TMP/log >&2
+Check "other.xml compressed" \
+   "`od -An -tx1 -N2 $TMP/state/lists/*_other.xml* | tr -d ' \n'`" 1f8b
+Check "other.xml spans blocks" \
+   "`[ \`gzip -dc $TMP/state/lists/*_other.xml* | wc -c\` -gt 1000000 ] && echo yes`" yes
+
+# The first lookup scans the list and saves the offsets, the second
+# one loads them
+Check "indexed changelog" "`ChangeLog`" 3
+Check "offsets saved" "`ls $TMP/cache/xmloffsets/ | grep -c 'other.xml.*\.idx$'`" 1
+Check "indexed changelog, saved offsets" "`ChangeLog`" 3
+
+# The streaming reader has to get past the first gzip member as well
+Check "streamed changelog" "`ChangeLog -o RPM::Repomd::Offset-Index=false`" 3
+
+exit $FAILED
@@ -0,0 +1,199 @@
+// -*- mode: c++; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Resolve Bench - Compare the problem resolver engines
+
+   Each scenario file holds one request per line, applied to the system
+   cache in order:
+     dist-upgrade
+     upgrade
+     install <package>
+     remove <package>
+     set <option> <value>
+   Installs and removes are marked like apt-get does and resolved at
+   the end, or by a dist-upgrade that comes after them. Options set are put back after each run, so they only apply
+   to the scenario that sets them. Every scenario runs with the pass based resolver, with it
+   exploring 4 or group alternatives (APT::Solver::Explore) and with the
+   SAT one (APT::Solver "sat"), from the same starting state. The time
+   taken, the result and the conflicts the SAT engine ran into in the
+   last resolve are shown (upgrade only keeps back and never uses it), along with how many packages the other two ended up marking
+   differently from the plain passes.
+
+   The scenarios used to compare the engines are the .scn files in
+   resolvebench/, they run against the system cache like apt-get does:
+     ./resolvebench resolvebench/dist-upgrade.scn resolvebench/swap-mta.scn
+
+   ##################################################################### */
+									/*}}}*/
+#include <apt-pkg/init.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/progress.h>
+#include <apt-pkg/pkgsystem.h>
+#include <iostream>
+#include <fstream>
+#include <utility>
+#include <sys/time.h>
+#include <string.h>
+
+using namespace std;
+
+static double Now()
+{
+   struct timeval Tv;
+   gettimeofday(&Tv,0);
+   return Tv.tv_sec + Tv.tv_usec/1000000.0;
+}
+
+// Run the scenario, the chosen install version of each package goes to Result
+static bool RunScenario(pkgDepCache &Cache,const char *File,
+			const char *Engine,vector<map_ptrloc> &Result)
+{
+   ifstream F(File,ios::in);
+   if (!F)
+      return _error->Error("Unable to open %s",File);
+   if (strcmp(Engine,"explore") == 0)
+   {
+      _config->Set("APT::Solver","internal");
+      _config->Set("APT::Solver::Explore",4);
+   }
+   else
+   {
+      _config->Set("APT::Solver",Engine);
+      _config->Set("APT::Solver::Explore",0);
+   }
+
+   pkgDepCache::State Start(&Cache);
+   vector<pair<string,string> > Saved;
+   pkgProblemResolver Fix(&Cache);
+   bool Marked = false;
+   bool Res = true;
+   double Begin = Now();
+   string Line;
+   while (getline(F,Line) && Res == true)
+   {
+      if (Line.empty() == true || Line[0] == '#')
+	 continue;
+      string::size_type Space = Line.find(' ');
+      string Op(Line,0,Space);
+      string Name = (Space == string::npos) ? "" : string(Line,Space + 1);
+      if (Op == "dist-upgrade")
+      {
+	 Res = pkgDistUpgrade(Cache,Fix);
+	 Marked = false;
+      }
+      else if (Op == "upgrade")
+	 Res = pkgAllUpgrade(Cache);
+      else if (Op == "set")
+      {
+	 string::size_type Sep = Name.find(' ');
+	 if (Sep == string::npos)
+	    Res = _error->Error("No value in %s",Line.c_str());
+	 else
+	 {
+	    string Option(Name,0,Sep);
+	    Saved.push_back(make_pair(Option,_config->Find(Option)));
+	    _config->Set(Option,string(Name,Sep + 1));
+	 }
+      }
+      else if (Op == "install" || Op == "remove")
+      {
+	 pkgCache::PkgIterator Pkg = Cache.FindPkg(Name);
+	 if (Pkg.end() == true)
+	    Res = _error->Error("Unknown package %s",Name.c_str());
+	 else if (Op == "install")
+	 {
+	    Cache.MarkInstall(Pkg,true);
+	    Fix.Clear(Pkg);
+	    Fix.Protect(Pkg);
+	 }
+	 else
+	 {
+	    Fix.Clear(Pkg);
+	    Fix.Protect(Pkg);
+	    Fix.Remove(Pkg);
+	    Cache.MarkDelete(Pkg);
+	 }
+	 Marked = true;
+      }
+      else
+	 Res = _error->Error("Unknown request %s",Line.c_str());
+   }
+   if (Res == true && Marked == true)
+   {
+      _system->ProcessCache(Cache,Fix);
+      Res = Fix.Resolve(true);
+   }
+   double Took = Now() - Begin;
+
+   cout << File << " " << Engine << ": " << Took << "s, "
+	<< (Res == true ? "ok" : "failed") << ", " << Cache.InstCount()
+	<< " install, " << Cache.DelCount() << " remove, "
+	<< Cache.KeepCount() << " keep, " << Cache.BrokenCount()
+	<< " broken, " << Fix.Conflicts() << " conflicts" << endl;
+   _error->DumpErrors();
+
+   for (vector<pair<string,string> >::reverse_iterator I = Saved.rbegin();
+	I != Saved.rend(); I++)
+   {
+      if (I->second.empty() == true)
+	 _config->Clear(I->first);
+      else
+	 _config->Set(I->first,I->second);
+   }
+
+   Result.resize(Cache.Head().PackageCount);
+   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; I++)
+      Result[I->ID] = Cache[I].InstallVer;
+   Start.Restore();
+   return Res;
+}
+
+int main(int argc,char *argv[])
+{
+   if (argc <= 1)
+   {
+      cerr << "Usage: resolvebench scenario..." << endl;
+      return 0;
+   }
+
+   if (pkgInitConfig(*_config) == false || pkgInitSystem(*_config,_system) == false)
+   {
+      _error->DumpErrors();
+      return 100;
+   }
+
+   OpProgress Prog;
+   pkgCacheFile Cache;
+   if (Cache.Open(Prog,false) == false)
+   {
+      _error->DumpErrors();
+      return 100;
+   }
+
+   for (int I = 1; I < argc; I++)
+   {
+      vector<map_ptrloc> Passes;
+      vector<map_ptrloc> Explore;
+      vector<map_ptrloc> Sat;
+      RunScenario(Cache,argv[I],"internal",Passes);
+      RunScenario(Cache,argv[I],"explore",Explore);
+      RunScenario(Cache,argv[I],"sat",Sat);
+
+      unsigned long ExploreDiffer = 0;
+      unsigned long SatDiffer = 0;
+      for (unsigned long J = 0; J < Passes.size(); J++)
+      {
+	 if (J < Explore.size() && Passes[J] != Explore[J])
+	    ExploreDiffer++;
+	 if (J < Sat.size() && Passes[J] != Sat[J])
+	    SatDiffer++;
+      }
+      cout << argv[I] << ": explore marked " << ExploreDiffer
+	   << " packages differently, sat " << SatDiffer << endl;
+   }
+   return 0;
+}
@@ -0,0 +1,96 @@
+#!/bin/sh
+# Change a few packages of an rpm database behind apt's back and check
+# that the status cache updated in place from the old one agrees with a
+# cache built from scratch. Run from the build tree:
+#
+#    sh status-update.sh [top build dir]
+#
+# Needs rpm and rpmbuild, exits with 77 (skipped) without them.
+
+BUILD=`cd ${1:-..} && pwd`
+for P in rpm rpmbuild; do
+   if ! command -v $P >/dev/null 2>&1; then
+      echo "$P not found, skipped"
+      exit 77
+   fi
+done
+
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf "$TMP"' 0
+mkdir -p $TMP/root $TMP/build $TMP/rpms $TMP/etc/sources.list.d \
+	 $TMP/state/lists/partial $TMP/cache/archives/partial
+rpm --root $TMP/root --initdb || exit 1
+
+# Package name version [requires]
+Package()
+{
+   cat > $TMP/build/$1.spec <<EOF
+Name: $1
+Version: $2
+Release: 1
+Summary: $1
+License: GPL
+BuildArch: noarch
+${3:+Requires: $3}
+%description
+$1
+%files
+EOF
+   rpmbuild -bb --quiet --define "_topdir $TMP/build" \
+      --define "_rpmdir $TMP/rpms" $TMP/build/$1.spec >/dev/null 2>&1
+   ls $TMP/rpms/noarch/$1-$2-1.noarch.rpm
+}
+Install()
+{
+   rpm --root $TMP/root --nodeps -U "$@" || exit 1
+}
+
+for P in a b c d e f g h i j; do
+   Install `Package pkg$P 1 "pkga"`
+done
+
+touch $TMP/etc/sources.list $TMP/etc/apt.conf
+APT_CONFIG=$TMP/etc/apt.conf
+export APT_CONFIG
+OPTS="-o Dir::Etc=$TMP/etc/ -o Dir::State=$TMP/state/
+      -o Dir::Cache=$TMP/cache/ -o RPM::RootDir=$TMP/root"
+
+FAILED=0
+Check()
+{
+   if [ "$2" = "$3" ]; then
+      echo "ok: $1"
+   else
+      echo "FAILED: $1, got '$2' instead of '$3'"
+      FAILED=1
+   fi
+}
+# What the cache says about the installed packages
+Describe()
+{
+   Names=`$BUILD/cmdline/apt-cache $OPTS "$@" pkgnames | sort`
+   echo $Names
+   $BUILD/cmdline/apt-cache $OPTS "$@" policy $Names
+   $BUILD/cmdline/apt-cache $OPTS "$@" depends $Names
+}
+
+Check "first cache" "`Describe | head -1`" \
+   "pkga pkgb pkgc pkgd pkge pkgf pkgg pkgh pkgi pkgj"
+
+# An upgrade, a removal and a new package
+Install `Package pkgb 2 "pkgc"` `Package pkgk 1 "pkgb >= 2"`
+rpm --root $TMP/root --nodeps -e pkgf || exit 1
+
+Describe > $TMP/updated
+Check "updated cache" "`head -1 $TMP/updated`" \
+   "pkga pkgb pkgc pkgd pkge pkgg pkgh pkgi pkgj pkgk"
+Updated=`wc -c < $TMP/cache/pkgcache.bin`
+
+rm -f $TMP/cache/*.bin
+Describe -o APT::Cache-Update=false > $TMP/rebuilt
+Check "same as rebuilt" "`cmp -s $TMP/updated $TMP/rebuilt && echo same`" same
+# Only the update keeps the unused structures of the old cache
+Check "updated in place" \
+   "`[ $Updated -gt \`wc -c < $TMP/cache/pkgcache.bin\` ] && echo yes`" yes
+
+exit $FAILED